@@ -135,13 +135,14 @@ void VJSBufferObject::ToString (CharSet inEncoding, sLONG inStart, sLONG inEnd,
 		case eENCODING_HEX: {
 
 			sLONG	n;
-			uBYTE	*p;
+			UniChar	*p;
 
-			for (n = inEnd - inStart, p = &fBuffer[inStart]; n != 0; n--, p++) {
+			n = inEnd - inStart;
+			if ((p = outString->GetCPointerForWrite(2 * n)) != NULL) {
+
+				HexCoder::Encode(&fBuffer[inStart], n, p);
+				outString->Validate(2 * n);
 
-				outString->AppendUniChar(_ToHex((*p >> 4) & 0xf));
-				outString->AppendUniChar(_ToHex(*p & 0xf));
-				
 			}
 
 			break;
@@ -306,34 +307,8 @@ sLONG VJSBufferObject::FromString (const XBOX::VString &inString, CharSet inEnco
 				break;
 
 			}
-	
-			uLONG			i;
-			const UniChar	*p;
-			uBYTE			*q;
-			
-			p = inString.GetCPointer();
-			q = encodedData;
-			for (i = 0; i < size; i++) {
-
-				sLONG	c;
-
-				if ((c = _FromHex(*p++)) < 0)
-
-					break;
-
-				*q = c << 4;
 
-				if ((c = _FromHex(*p++)) < 0)
-
-					break;
-
-				*q |= c;
-
-				q++;
-
-			}
-
-			if (i == size) {
+			if (HexCoder::Decode(inString.GetCPointer(), 2 * size, encodedData)) {
 
 				*outBuffer = encodedData;
 				r = size;
@@ -342,7 +317,7 @@ sLONG VJSBufferObject::FromString (const XBOX::VString &inString, CharSet inEnco
 
 				// An error occured.
 
-				if (outBuffer == NULL)
+				if (*outBuffer == NULL)
 
 					::free(encodedData);
 
@@ -420,38 +395,6 @@ VJSBufferObject::~VJSBufferObject ()
 	fBuffer	= NULL;
 }
 
-UniChar VJSBufferObject::_ToHex (uBYTE inValue)
-{
-	xbox_assert(inValue >= 0 && inValue <= 0xf);
-
-	if (inValue < 10)
-
-		return '0' + inValue;
-
-	else
-
-		return 'a' + (inValue - 10);
-}
-
-sLONG VJSBufferObject::_FromHex (UniChar inUniChar)
-{
-	if (inUniChar >= '0' && inUniChar <= '9') 
-
-		return inUniChar - '0';
-
-	else if (inUniChar >= 'a' && inUniChar <= 'f') 
-
-		return 10 + inUniChar - 'a';
-
-	else if (inUniChar >= 'A' && inUniChar <= 'F') 
-
-		return 10 + inUniChar - 'A';
-
-	else
-
-		return -1;
-}
-
 void VJSBufferClass::GetDefinition (ClassDefinition &outDefinition)
 {
 	static inherited::StaticFunction functions[] =
@@ -81,9 +81,6 @@ friend class VJSBufferClass;
 					VJSBufferObject (VJSBufferObject *inParent, sLONG inStart, sLONG inEnd);
 
 	virtual			~VJSBufferObject ();
-
-	static UniChar	_ToHex (uBYTE inValue);
-	static sLONG	_FromHex (UniChar inUniChar);	// Return negative value if invalid.
 };
 
 class XTOOLBOX_API VJSBufferClass : public XBOX::VJSClass<VJSBufferClass , VJSBufferObject>
@@ -921,26 +921,32 @@ void VJSFolderIterator::_eachFile(VJSParms_callStaticFunction& ioParms, JS4DFold
 				VJSObject thisParam(thisParamVal.GetObject());
 
 				sLONG counter = 0;
-				VFileIterator iter(folder, FI_NORMAL_FILES | FI_WANT_INVISIBLES | FI_ITERATE_DELETE);
+				VFolderEnumerator enumerator(folder, FI_NORMAL_FILES | FI_WANT_INVISIBLES | FI_ITERATE_DELETE);
+				VectorOfFolderEntry entries;
 				bool cont = true;
-				while (iter.IsValid() && cont)
+				while (cont && enumerator.NextBatch(entries))
 				{
-					params[1].SetNumber(counter);
-					VFile* file = iter.Current();
-					JS4DFileIterator* ifile = new JS4DFileIterator(file);
-					VJSObject thisobj(VJSFileIterator::CreateInstance(ioParms.GetContextRef(), ifile));
-					ReleaseRefCountable( &ifile);
-					params[0] = thisobj;
-					VJSValue result(ioParms.GetContextRef());
-					JS4D::ExceptionRef except = nil;
-					thisParam.CallFunction(objfunc, &params, &result, &except);
-					if (except != nil)
+					for (VectorOfFolderEntry::const_iterator i = entries.begin() ; i != entries.end() && cont ; ++i)
 					{
-						cont = false;
-						ioParms.SetException(except);
+						params[1].SetNumber(counter);
+						VFilePath filePath(path);
+						filePath.ToSubFile(i->fName);
+						VFile* file = new VFile(i->fTarget.IsEmpty() ? filePath : i->fTarget);
+						JS4DFileIterator* ifile = new JS4DFileIterator(file);
+						ReleaseRefCountable( &file);
+						VJSObject thisobj(VJSFileIterator::CreateInstance(ioParms.GetContextRef(), ifile));
+						ReleaseRefCountable( &ifile);
+						params[0] = thisobj;
+						VJSValue result(ioParms.GetContextRef());
+						JS4D::ExceptionRef except = nil;
+						thisParam.CallFunction(objfunc, &params, &result, &except);
+						if (except != nil)
+						{
+							cont = false;
+							ioParms.SetException(except);
+						}
+						++counter;
 					}
-					++iter;
-					++counter;
 				}
 			}
 		}
@@ -972,28 +978,32 @@ void VJSFolderIterator::_eachFolder(VJSParms_callStaticFunction& ioParms, JS4DFo
 				VJSObject thisParam(thisParamVal.GetObject());
 
 				sLONG counter = 0;
-				VFolderIterator iter(folder, FI_NORMAL_FOLDERS | FI_WANT_INVISIBLES | FI_ITERATE_DELETE);
+				VFolderEnumerator enumerator(folder, FI_NORMAL_FOLDERS | FI_WANT_INVISIBLES | FI_ITERATE_DELETE);
+				VectorOfFolderEntry entries;
 				bool cont = true;
-				while (iter.IsValid() && cont)
+				while (cont && enumerator.NextBatch(entries))
 				{
-					params[1].SetNumber(counter);
-
-					VFolder* subfolder = iter.Current();
-					JS4DFolderIterator* ifolder = new JS4DFolderIterator(subfolder);
-					VJSObject thisobj(VJSFolderIterator::CreateInstance(ioParms.GetContextRef(), ifolder));
-					ReleaseRefCountable( &ifolder);
-
-					params[0] = thisobj;
-					VJSValue result(ioParms.GetContextRef());
-					JS4D::ExceptionRef except = nil;
-					thisParam.CallFunction(objfunc, &params, &result, &except);
-					if (except != nil)
+					for (VectorOfFolderEntry::const_iterator i = entries.begin() ; i != entries.end() && cont ; ++i)
 					{
-						cont = false;
-						ioParms.SetException(except);
+						params[1].SetNumber(counter);
+
+						VFolder* subfolder = i->fTarget.IsEmpty() ? new VFolder(*folder, i->fName) : new VFolder(i->fTarget);
+						JS4DFolderIterator* ifolder = new JS4DFolderIterator(subfolder);
+						ReleaseRefCountable( &subfolder);
+						VJSObject thisobj(VJSFolderIterator::CreateInstance(ioParms.GetContextRef(), ifolder));
+						ReleaseRefCountable( &ifolder);
+
+						params[0] = thisobj;
+						VJSValue result(ioParms.GetContextRef());
+						JS4D::ExceptionRef except = nil;
+						thisParam.CallFunction(objfunc, &params, &result, &except);
+						if (except != nil)
+						{
+							cont = false;
+							ioParms.SetException(except);
+						}
+						++counter;
 					}
-					++iter;
-					++counter;
 				}
 			}
 		}
@@ -1195,11 +1205,18 @@ void VJSFolderIterator::_files(VJSParms_getProperty& ioParms, JS4DFolderIterator
 		folder->GetPath(path);
 		if (path.IsFolder())
 		{
-			VFileIterator iter(folder, FI_NORMAL_FILES | FI_WANT_INVISIBLES | FI_ITERATE_DELETE);
-			while (iter.IsValid())
+			VFolderEnumerator enumerator(folder, FI_NORMAL_FILES | FI_WANT_INVISIBLES | FI_ITERATE_DELETE);
+			VectorOfFolderEntry entries;
+			while (enumerator.NextBatch(entries))
 			{
-				result.PushFile( iter);
-				++iter;
+				for (VectorOfFolderEntry::const_iterator i = entries.begin() ; i != entries.end() ; ++i)
+				{
+					VFilePath filePath(path);
+					filePath.ToSubFile(i->fName);
+					VFile* file = new VFile(i->fTarget.IsEmpty() ? filePath : i->fTarget);
+					result.PushFile( file);
+					ReleaseRefCountable( &file);
+				}
 			}
 		}
 	}
@@ -1217,11 +1234,16 @@ void VJSFolderIterator::_folders(VJSParms_getProperty& ioParms, JS4DFolderIterat
 		folder->GetPath(path);
 		if (path.IsFolder())
 		{
-			VFolderIterator iter(folder, FI_NORMAL_FOLDERS | FI_WANT_INVISIBLES | FI_ITERATE_DELETE);
-			while (iter.IsValid())
+			VFolderEnumerator enumerator(folder, FI_NORMAL_FOLDERS | FI_WANT_INVISIBLES | FI_ITERATE_DELETE);
+			VectorOfFolderEntry entries;
+			while (enumerator.NextBatch(entries))
 			{
-				result.PushFolder( iter);
-				++iter;
+				for (VectorOfFolderEntry::const_iterator i = entries.begin() ; i != entries.end() ; ++i)
+				{
+					VFolder* subfolder = i->fTarget.IsEmpty() ? new VFolder(*folder, i->fName) : new VFolder(i->fTarget);
+					result.PushFolder( subfolder);
+					ReleaseRefCountable( &subfolder);
+				}
 			}
 		}
 	}
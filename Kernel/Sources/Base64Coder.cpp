@@ -35,8 +35,15 @@
 
 #include "VKernelPrecompiled.h"
 #include "VError.h"
+#include "VErrorContext.h"
+#include "VStream.h"
 #include "Base64Coder.h"
 
+#if WITH_X86_EXTENSIONS
+#include <cpuid.h>
+#include <tmmintrin.h>
+#endif
+
 static const size_t	B64CODER_BASELENGTH	= 255;
 static const size_t	B64CODER_FOURBYTE	= 4;
 static const uBYTE	BASE64_PADDING		= 0x3D;
@@ -57,7 +64,24 @@ const uBYTE Base64Coder::sBase64Alphabet[] = {
 	0x2B, 0x2F, 0x00
 };
 
-uBYTE Base64Coder::sBase64Inverse[B64CODER_BASELENGTH];
+const uBYTE Base64Coder::sBase64URLAlphabet[] = {
+    0x41, 0x42, 0x43, 0x44, 0x45, /* 'A', 'B', 'C', ... */
+    0x46, 0x47, 0x48, 0x49, 0x4A,
+    0x4B, 0x4C, 0x4D, 0x4E, 0x4F,
+    0x50, 0x51, 0x52, 0x53, 0x54,
+    0x55, 0x56, 0x57, 0x58, 0x59, 0x5A,
+    0x61, 0x62, 0x63, 0x64, 0x65,
+    0x66, 0x67, 0x68, 0x69, 0x6A,
+    0x6B, 0x6C, 0x6D, 0x6E, 0x6F,
+    0x70, 0x71, 0x72, 0x73, 0x74,
+    0x75, 0x76, 0x77, 0x78, 0x79, 0x7A,
+	0x30, 0x31, 0x32, 0x33, 0x34, /* '1', '2', '3', ... */
+	0x35, 0x36, 0x37, 0x38, 0x39,
+	0x2D, 0x5F, 0x00
+};
+
+uBYTE Base64Coder::sBase64Inverse[B64CODER_BASELENGTH + 1];
+uBYTE Base64Coder::sBase64URLInverse[B64CODER_BASELENGTH + 1];
 
 
 
@@ -102,113 +126,285 @@ inline void split3rdOctet(const uBYTE& ch, uBYTE& b3, uBYTE& b4)
     b4 = ( ch & 0x3f );
 }
 
-bool Base64Coder::Encode( const void *inInputData, size_t inInputSize, VMemoryBuffer<>&	outResult, sLONG inQuadsPerLine)
+
+
+// -----------------------------------------------------------------------
+//  Triplets and quadruplets
+//
+//	The ssse3 versions handle 4 quads at a time and leave the rest to the
+//	regular code. Decoding stops before the first quad holding a char that is
+//	not in the alphabet (pad, white space, error) which is left to Base64Decoder.
+// -----------------------------------------------------------------------
+
+typedef void (*EncodeProc)( const uBYTE *inData, size_t inTripletCount, uBYTE *outText, const uBYTE *inAlphabet);
+typedef size_t (*DecodeProc)( const uBYTE *inText, size_t inQuadCount, uBYTE *outData, const uBYTE *inAlphabet, const uBYTE *inInverse);
+
+
+/* static */
+static void _EncodeTriplets( const uBYTE *inData, size_t inTripletCount, uBYTE *outText, const uBYTE *inAlphabet)
 {
-	xbox_assert(inQuadsPerLine > 0);
+	uBYTE b1, b2, b3, b4;
+	for( ; inTripletCount > 0 ; --inTripletCount, inData += 3, outText += 4)
+	{
+		split1stOctet( inData[0], b1, b2 );
+		split2ndOctet( inData[1], b2, b3 );
+		split3rdOctet( inData[2], b3, b4 );
+
+		outText[0] = inAlphabet[ b1 ];
+		outText[1] = inAlphabet[ b2 ];
+		outText[2] = inAlphabet[ b3 ];
+		outText[3] = inAlphabet[ b4 ];
+	}
+}
 
-	Init();
 
-	outResult.Clear();
+/* static */
+static size_t _DecodeQuads( const uBYTE *inText, size_t inQuadCount, uBYTE *outData, const uBYTE* /*inAlphabet*/, const uBYTE *inInverse)
+{
+	size_t count = 0;
+	for( ; count < inQuadCount ; ++count, inText += 4, outData += 3)
+	{
+		uBYTE b1 = inInverse[ inText[0] ];
+		uBYTE b2 = inInverse[ inText[1] ];
+		uBYTE b3 = inInverse[ inText[2] ];
+		uBYTE b4 = inInverse[ inText[3] ];
+		if ((b1 | b2 | b3 | b4) == 0xff)
+			break;
 
-    if (inInputData == NULL)
-        return false;
+		outData[0] = set1stOctet( b1, b2);
+		outData[1] = set2ndOctet( b2, b3);
+		outData[2] = set3rdOctet( b3, b4);
+	}
+	return count;
+}
 
-    size_t quadrupletCount = ( inInputSize + 2 ) / 3;
-    if (quadrupletCount == 0)
-        return false;
 
-    // Number of rows in encoded stream (*not* including the last one, because we don't add a "final" line break)
-	size_t lineCount = quadrupletCount / inQuadsPerLine;
+#if WITH_X86_EXTENSIONS
 
-	// Compute size of encoded string, note that we add 2 bytes per line breaks, and that it is not null ended.
+// cpuid 1: ecx bit 9 ssse3
+static bool _HasSSSE3()
+{
+	unsigned int eax, ebx, ecx, edx;
+	return (__get_cpuid( 1, &eax, &ebx, &ecx, &edx) != 0) && ((ecx & (1 << 9)) != 0);
+}
 
-	if (!outResult.SetSize( quadrupletCount*B64CODER_FOURBYTE + lineCount * 2))
-		return false;
 
-    //
-    // convert the triplet(s) to quadruplet(s)
-    //
-    uBYTE  b1, b2, b3, b4;  // base64 binary codes ( 0..63 )
+/*
+	12 bytes are loaded in 4 dwords of 6-bit codes, see http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+	The codes are then turned into chars adding the offset of their range.
+*/
+__attribute__((target("ssse3")))
+static void _EncodeTripletsSSSE3( const uBYTE *inData, size_t inTripletCount, uBYTE *outText, const uBYTE *inAlphabet)
+{
+	const __m128i shuffle = _mm_setr_epi8( 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
 
-	size_t inputIndex = 0;
-	size_t outputIndex = 0;
+	// offsets for 'a'..'z', '0'..'9' (x10), 62, 63, 'A'..'Z'
+	const __m128i offsets = _mm_setr_epi8( 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+										(char) (inAlphabet[62] - 62), (char) (inAlphabet[63] - 63), 'A', 0, 0);
 
-	uBYTE *encodedData = (uBYTE*) outResult.GetDataPtr();
-	const uBYTE *inputData = (const uBYTE *) inInputData;
+	// 16 bytes are read to use 12 of them
+	for( ; inTripletCount >= 6 ; inTripletCount -= 4, inData += 12, outText += 16)
+	{
+		__m128i in = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) inData), shuffle);
 
-	//
-	// Process all quadruplet(s) except the last
-	//
-	size_t quad = 1;
-	for (; quad <= quadrupletCount-1; quad++ )
+		__m128i codes1 = _mm_mulhi_epu16( _mm_and_si128( in, _mm_set1_epi32( 0x0fc0fc00)), _mm_set1_epi32( 0x04000040));
+		__m128i codes2 = _mm_mullo_epi16( _mm_and_si128( in, _mm_set1_epi32( 0x003f03f0)), _mm_set1_epi32( 0x01000010));
+		__m128i codes = _mm_or_si128( codes1, codes2);
+
+		// 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12
+		__m128i ranges = _mm_subs_epu8( codes, _mm_set1_epi8( 51));
+		ranges = _mm_or_si128( ranges, _mm_and_si128( _mm_cmpgt_epi8( _mm_set1_epi8( 26), codes), _mm_set1_epi8( 13)));
+
+		_mm_storeu_si128( (__m128i*) outText, _mm_add_epi8( codes, _mm_shuffle_epi8( offsets, ranges)));
+	}
+
+	_EncodeTriplets( inData, inTripletCount, outText, inAlphabet);
+}
+
+
+__attribute__((target("ssse3")))
+static size_t _DecodeQuadsSSSE3( const uBYTE *inText, size_t inQuadCount, uBYTE *outData, const uBYTE *inAlphabet, const uBYTE *inInverse)
+{
+	const __m128i char62 = _mm_set1_epi8( (char) inAlphabet[62]);
+	const __m128i char63 = _mm_set1_epi8( (char) inAlphabet[63]);
+	const __m128i pack = _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+	size_t count = 0;
+	for( ; inQuadCount - count >= 4 ; count += 4, inText += 16, outData += 12)
 	{
-		// read triplet from the input stream
-		split1stOctet( inputData[ inputIndex++ ], b1, b2 );
-		split2ndOctet( inputData[ inputIndex++ ], b2, b3 );
-		split3rdOctet( inputData[ inputIndex++ ], b3, b4 );
+		__m128i in = _mm_loadu_si128( (const __m128i*) inText);
+
+		// chars >= 0x80 are negative and belong to no range
+		__m128i upper = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8( 'A' - 1)), _mm_cmpgt_epi8( _mm_set1_epi8( 'Z' + 1), in));
+		__m128i lower = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8( 'a' - 1)), _mm_cmpgt_epi8( _mm_set1_epi8( 'z' + 1), in));
+		__m128i digit = _mm_and_si128( _mm_cmpgt_epi8( in, _mm_set1_epi8( '0' - 1)), _mm_cmpgt_epi8( _mm_set1_epi8( '9' + 1), in));
+		__m128i is62 = _mm_cmpeq_epi8( in, char62);
+		__m128i is63 = _mm_cmpeq_epi8( in, char63);
+
+		__m128i valid = _mm_or_si128( _mm_or_si128( upper, lower), _mm_or_si128( digit, _mm_or_si128( is62, is63)));
+		if (_mm_movemask_epi8( valid) != 0xFFFF)
+			break;
 
-		// write quadruplet to the output stream
-		encodedData[ outputIndex++ ] = sBase64Alphabet[ b1 ];
-		encodedData[ outputIndex++ ] = sBase64Alphabet[ b2 ];
-		encodedData[ outputIndex++ ] = sBase64Alphabet[ b3 ];
-		encodedData[ outputIndex++ ] = sBase64Alphabet[ b4 ];
+		__m128i offsets = _mm_or_si128( _mm_and_si128( upper, _mm_set1_epi8( -'A')), _mm_and_si128( lower, _mm_set1_epi8( 26 - 'a')));
+		offsets = _mm_or_si128( offsets, _mm_and_si128( digit, _mm_set1_epi8( 52 - '0')));
+		offsets = _mm_or_si128( offsets, _mm_and_si128( is62, _mm_set1_epi8( (char) (62 - inAlphabet[62]))));
+		offsets = _mm_or_si128( offsets, _mm_and_si128( is63, _mm_set1_epi8( (char) (63 - inAlphabet[63]))));
+		__m128i codes = _mm_add_epi8( in, offsets);
 
-		// Use CRLF for line breaks.
+		// 4 codes of 6 bits make 24 bits in each dword
+		__m128i merged = _mm_maddubs_epi16( codes, _mm_set1_epi32( 0x01400140));
+		merged = _mm_madd_epi16( merged, _mm_set1_epi32( 0x00011000));
+		merged = _mm_shuffle_epi8( merged, pack);
+
+		_mm_storel_epi64( (__m128i*) outData, merged);
+		*(uLONG*) (outData + 8) = (uLONG) _mm_cvtsi128_si32( _mm_srli_si128( merged, 8));
+	}
+
+	return count + _DecodeQuads( inText, inQuadCount - count, outData, inAlphabet, inInverse);
+}
 
-		if (( quad % inQuadsPerLine) == 0 ) {
+#endif
 
-			encodedData[ outputIndex++ ] = 0x0D;
-			encodedData[ outputIndex++ ] = 0x0A;
 
+/* static */
+static EncodeProc _GetEncodeProc()
+{
+#if WITH_X86_EXTENSIONS
+	static EncodeProc sProc = _HasSSSE3() ? _EncodeTripletsSSSE3 : _EncodeTriplets;
+	return sProc;
+#else
+	return _EncodeTriplets;
+#endif
+}
+
+
+/* static */
+static DecodeProc _GetDecodeProc()
+{
+#if WITH_X86_EXTENSIONS
+	static DecodeProc sProc = _HasSSSE3() ? _DecodeQuadsSSSE3 : _DecodeQuads;
+	return sProc;
+#else
+	return _DecodeQuads;
+#endif
+}
+
+
+// -----------------------------------------------------------------------
+//  Base64Coder
+// -----------------------------------------------------------------------
+
+bool Base64Coder::IsAccelerated()
+{
+	return _GetEncodeProc() != _EncodeTriplets;
+}
+
+
+void Base64Coder::EncodeQuads( const uBYTE*& ioData, size_t inTripletCount, uBYTE*& ioText, sLONG inQuadsPerLine, sLONG& ioQuadsInLine, Alphabet inAlphabet)
+{
+	EncodeProc proc = _GetEncodeProc();
+	const uBYTE *alphabet = GetAlphabet( inAlphabet);
+
+	while( inTripletCount > 0)
+	{
+		// Use CRLF for line breaks, only if followed by a quad.
+		if (ioQuadsInLine >= inQuadsPerLine)
+		{
+			*ioText++ = 0x0D;
+			*ioText++ = 0x0A;
+			ioQuadsInLine = 0;
 		}
+
+		size_t count = std::min<size_t>( inTripletCount, inQuadsPerLine - ioQuadsInLine);
+		(*proc)( ioData, count, ioText, alphabet);
+
+		ioData += 3 * count;
+		ioText += 4 * count;
+		ioQuadsInLine += (sLONG) count;
+		inTripletCount -= count;
+	}
+}
+
+
+void Base64Coder::EncodeLastQuad( const uBYTE *inData, size_t inDataSize, uBYTE*& ioText, sLONG inQuadsPerLine, sLONG& ioQuadsInLine, Alphabet inAlphabet, bool inPadding)
+{
+	xbox_assert( (inDataSize == 1) || (inDataSize == 2));
+
+	const uBYTE *alphabet = GetAlphabet( inAlphabet);
+	uBYTE  b1, b2, b3;
+
+	if (ioQuadsInLine >= inQuadsPerLine)
+	{
+		*ioText++ = 0x0D;
+		*ioText++ = 0x0A;
+		ioQuadsInLine = 0;
 	}
 
-	//
-	// process the last Quadruplet
-	//
 	// first octet is present always, process it
-	split1stOctet( inputData[ inputIndex++ ], b1, b2 );
-	encodedData[ outputIndex++ ] = sBase64Alphabet[ b1 ];
+	split1stOctet( inData[0], b1, b2 );
+	*ioText++ = alphabet[ b1 ];
 
-	if( inputIndex < inInputSize)
+	if (inDataSize > 1)
 	{
 		// second octet is present, process it
-		split2ndOctet( inputData[ inputIndex++ ], b2, b3 );
-		encodedData[ outputIndex++ ] = sBase64Alphabet[ b2 ];
-
-		if( inputIndex < inInputSize )
-		{
-			// third octet present, process it
-			// no PAD e.g. 3cQl
-			split3rdOctet( inputData[ inputIndex++ ], b3, b4 );
-			encodedData[ outputIndex++ ] = sBase64Alphabet[ b3 ];
-			encodedData[ outputIndex++ ] = sBase64Alphabet[ b4 ];
-		}
-		else
-		{
-			// third octet not present
-			// one PAD e.g. 3cQ=
-			encodedData[ outputIndex++ ] = sBase64Alphabet[ b3 ];
-			encodedData[ outputIndex++ ] = BASE64_PADDING;
-		}
+		// one PAD e.g. 3cQ=
+		split2ndOctet( inData[1], b2, b3 );
+		*ioText++ = alphabet[ b2 ];
+		*ioText++ = alphabet[ b3 ];
+		if (inPadding)
+			*ioText++ = BASE64_PADDING;
 	}
 	else
 	{
 		// second octet not present
 		// two PADs e.g. 3c==
-		encodedData[ outputIndex++ ] = sBase64Alphabet[ b2 ];
-		encodedData[ outputIndex++ ] = BASE64_PADDING;
-		encodedData[ outputIndex++ ] = BASE64_PADDING;
+		*ioText++ = alphabet[ b2 ];
+		if (inPadding)
+		{
+			*ioText++ = BASE64_PADDING;
+			*ioText++ = BASE64_PADDING;
+		}
 	}
+	++ioQuadsInLine;
+}
+
+
+bool Base64Coder::Encode( const void *inInputData, size_t inInputSize, VMemoryBuffer<>&	outResult, sLONG inQuadsPerLine, Alphabet inAlphabet, bool inPadding)
+{
+	xbox_assert(inQuadsPerLine > 0);
+
+	Init();
+
+	outResult.Clear();
+
+    if (inInputData == NULL)
+        return false;
+
+    size_t quadrupletCount = ( inInputSize + 2 ) / 3;
+    if (quadrupletCount == 0)
+        return false;
+
+    // Number of line breaks (we don't add a "final" line break)
+	size_t lineCount = (quadrupletCount - 1) / inQuadsPerLine;
+
+	// Compute size of encoded string, note that we add 2 bytes per line breaks, and that it is not null ended.
 
-	xbox_assert(outResult.GetDataSize() == outputIndex);
+	if (!outResult.SetSize( quadrupletCount*B64CODER_FOURBYTE + lineCount * 2))
+		return false;
+
+	const uBYTE *inputData = (const uBYTE *) inInputData;
+	uBYTE *encodedData = (uBYTE*) outResult.GetDataPtr();
+	uBYTE *outputData = encodedData;
+	sLONG quadsInLine = 0;
+
+	EncodeQuads( inputData, inInputSize / 3, outputData, inQuadsPerLine, quadsInLine, inAlphabet);
 
-	// write out end of the last line
-	//encodedData[ outputIndex++ ] = 0x0A;
-	// write out end of string
-	// encodedData[ outputIndex ] = 0;
+	if ((inInputSize % 3) != 0)
+		EncodeLastQuad( inputData, inInputSize % 3, outputData, inQuadsPerLine, quadsInLine, inAlphabet, inPadding);
 
-	outResult.ShrinkSizeNoReallocate( outputIndex);
+	xbox_assert( (size_t) (outputData - encodedData) <= outResult.GetDataSize());
+
+	outResult.ShrinkSizeNoReallocate( outputData - encodedData);
 
 	return true;
 }
@@ -225,20 +421,22 @@ void Base64Coder::Init()
 	// if sBase64Alphabet[ 17 ] = 'R', then sBase64Inverse[ 'R' ] = 17
 	// for characters not in sBase64Alphabet the sBase64Inverse[] = -1
 
-	size_t i;
 	// set all fields to -1
-	for ( i = 0; i < B64CODER_BASELENGTH; i++ )
-		sBase64Inverse[i] = 0xff;
+	std::fill( sBase64Inverse, sBase64Inverse + sizeof( sBase64Inverse), 0xff);
+	std::fill( sBase64URLInverse, sBase64URLInverse + sizeof( sBase64URLInverse), 0xff);
 
 	// compute inverse table
-	for ( i = 0; i < 64; i++ )
+	for ( size_t i = 0; i < 64; i++ )
+	{
 		sBase64Inverse[ sBase64Alphabet[i] ] = (uBYTE)i;
+		sBase64URLInverse[ sBase64URLAlphabet[i] ] = (uBYTE)i;
+	}
 
 	sInitialized = true;
 }
 
 
-bool Base64Coder::Decode ( const void *inInputData, size_t inInputSize, VMemoryBuffer<>& outResult, Conformance inConform)
+bool Base64Coder::Decode ( const void *inInputData, size_t inInputSize, VMemoryBuffer<>& outResult, Conformance inConform, Alphabet inAlphabet)
 {
 	Init();
 	
@@ -246,208 +444,286 @@ bool Base64Coder::Decode ( const void *inInputData, size_t inInputSize, VMemoryB
 
 	if ((inInputData == NULL) || (inInputSize == 0))
 		return false;
-	
-	//
-	// remove all XML whitespaces from the base64Data
-	//
-	VMemoryBuffer<> rawInputBuffer;
+
+	if (!outResult.SetSize( (inInputSize / B64CODER_FOURBYTE + 1) * 3))
+		return false;
 
 	const uBYTE *inputData = (const uBYTE*) inInputData;
-	size_t inputIndex = 0;
-	const uBYTE *rawInputData = inputData;
-	size_t rawInputLength = inInputSize;
+	uBYTE *decodedData = (uBYTE *) outResult.GetDataPtr();
+	uBYTE *outputData = decodedData;
 
-	switch( inConform)
+	Base64Decoder decoder( NULL, inConform, inAlphabet);
+	if (!decoder._Decode( inputData, inputData + inInputSize, outputData) || !decoder._Finish( outputData))
 	{
-		case Conf_RFC2045:
-			{
-				static const uBYTE whites[] = {0x20, 0x09, 0x0d, 0x0a};
-				if (std::find_first_of( inputData, inputData + inInputSize, whites, whites+sizeof(whites)) != inputData + inInputSize)
-				{
-					if (rawInputBuffer.SetSize( inInputSize))
-					{
-						rawInputData = (const uBYTE*) rawInputBuffer.GetDataPtr();
-						rawInputLength = 0;
-						while ( inputIndex < inInputSize )
-						{
-							//if (!XMLChar1_0::isWhitespace(inputData[inputIndex]))
-							if (std::find( whites, whites+sizeof(whites), inputData[inputIndex]) == whites+sizeof(whites))
-							{
-								const_cast<uBYTE*>(rawInputData)[ rawInputLength++ ] = inputData[ inputIndex ];
-							}
-							// RFC2045 does not explicitly forbid more than ONE whitespace 
-							// before, in between, or after base64 octects.
-							// Besides, S? allows more than ONE whitespace as specified in the production 
-							// [3]   S   ::=   (#x20 | #x9 | #xD | #xA)+
-							// therefore we do not detect multiple ws
-
-							inputIndex++;
-						}
-					}
-					else
-					{
-						vThrowError( VE_MEMORY_FULL);
-						rawInputData = NULL;
-						rawInputLength = 0;
-					}
-				}
-				break;
-			}
+		outResult.Clear();
+		return false;
+	}
 
-		case Conf_Schema:
-			/*
-			// no leading #x20
-			if (chSpace == inputData[inputIndex])
-				return 0;
+	outResult.ShrinkSizeNoReallocate( outputData - decodedData);
 
-			while ( inputIndex < inputLength )
-			{
-				if (chSpace != inputData[inputIndex])
-				{
-					rawInputData[ rawInputLength++ ] = inputData[ inputIndex ];
-					inWhiteSpace = false;
-				}
-				else
-				{
-					if (inWhiteSpace)
-						return 0; // more than 1 #x20 encountered
-					else
-						inWhiteSpace = true;
-				}
-
-				inputIndex++;
-			}
+	return true;
+}
 
-			// no trailing #x20
-			if (inWhiteSpace)
-				return 0;
-			*/
-			break;
 
-		default:
-			break;
-    }
+// -----------------------------------------------------------------------
+//  Base64Encoder
+// -----------------------------------------------------------------------
 
-	if (rawInputData == NULL)
-		return false;
+Base64Encoder::Base64Encoder( VStream *inStream, sLONG inQuadsPerLine, Base64Coder::Alphabet inAlphabet, bool inPadding)
+: fStream( inStream)
+, fQuadsPerLine( inQuadsPerLine)
+, fQuadsInLine( 0)
+, fAlphabet( inAlphabet)
+, fPadding( inPadding)
+, fPendingCount( 0)
+{
+	xbox_assert( (inStream != NULL) && (inQuadsPerLine > 0));
 
-    //now rawInputData contains canonical representation 
-    //if the data is valid Base64
+	Base64Coder::Init();
+}
 
-    // the length of raw data should be divisible by four
-    if (!testAssert(( rawInputLength % B64CODER_FOURBYTE ) == 0) )
-        return false;
 
-    size_t quadrupletCount = rawInputLength / B64CODER_FOURBYTE;
-    if ( quadrupletCount == 0 )
-        return true;
+Base64Encoder::~Base64Encoder()
+{
+	xbox_assert( fPendingCount == 0);	// Close() not called?
+}
+
 
-	if (!outResult.SetSize( quadrupletCount*3 + 1))
-		return false;
+VError Base64Encoder::Put( const void *inData, size_t inDataSize)
+{
+	const uBYTE *data = (const uBYTE*) inData;
+	const uBYTE *dataEnd = data + inDataSize;
+	uBYTE *text = fText;
+	VError err = VE_OK;
+
+	if (fPendingCount > 0)
+	{
+		for( ; (fPendingCount < 3) && (data != dataEnd) ; ++fPendingCount)
+			fPending[fPendingCount] = *data++;
 
-    //
-    // convert the quadruplet(s) to triplet(s)
-    //
-    uBYTE d1, d2, d3, d4;  // base64 characters
-    uBYTE b1, b2, b3, b4;  // base64 binary codes ( 0..64 )
+		if (fPendingCount < 3)
+			return VE_OK;
+
+		const uBYTE *pending = fPending;
+		Base64Coder::EncodeQuads( pending, 1, text, fQuadsPerLine, fQuadsInLine, fAlphabet);
+		fPendingCount = 0;
+	}
+
+	while( (dataEnd - data >= 3) && (err == VE_OK) )
+	{
+		// worst case, each line of n quads takes 4 * n + 2 chars
+		size_t room = fText + sizeof( fText) - text;
+		size_t count = (room > 2) ? (room - 2) * fQuadsPerLine / (4 * fQuadsPerLine + 2) : 0;
+		if (count == 0)
+		{
+			err = _Flush( text);
+			text = fText;
+		}
+		else
+		{
+			Base64Coder::EncodeQuads( data, std::min<size_t>( count, (dataEnd - data) / 3), text, fQuadsPerLine, fQuadsInLine, fAlphabet);
+		}
+	}
+
+	if (err == VE_OK)
+	{
+		err = _Flush( text);
+
+		for( ; data != dataEnd ; ++fPendingCount)
+			fPending[fPendingCount] = *data++;
+	}
+
+	return err;
+}
+
+
+VError Base64Encoder::Close()
+{
+	uBYTE *text = fText;
+	if (fPendingCount > 0)
+	{
+		Base64Coder::EncodeLastQuad( fPending, fPendingCount, text, fQuadsPerLine, fQuadsInLine, fAlphabet, fPadding);
+		fPendingCount = 0;
+	}
+	return _Flush( text);
+}
+
+
+VError Base64Encoder::_Flush( uBYTE *inTextEnd)
+{
+	return (inTextEnd > fText) ? fStream->PutData( fText, inTextEnd - fText) : VE_OK;
+}
+
+
+// -----------------------------------------------------------------------
+//  Base64Decoder
+// -----------------------------------------------------------------------
+
+Base64Decoder::Base64Decoder( VStream *inStream, Base64Coder::Conformance inConform, Base64Coder::Alphabet inAlphabet)
+: fStream( inStream)
+, fConform( inConform)
+, fAlphabet( inAlphabet)
+, fQuadCount( 0)
+, fPadCount( 0)
+, fEnded( false)
+, fFailed( false)
+, fEmpty( true)
+{
+	Base64Coder::Init();
+	fInverse = Base64Coder::GetInverse( inAlphabet);
+}
 
-    size_t rawInputIndex  = 0;
-    size_t outputIndex    = 0;
-	
-    uBYTE *decodedData = (uBYTE *) outResult.GetDataPtr();
-
-    //
-    // Process all quadruplet(s) except the last
-    //
-    size_t quad = 1;
-    for (; quad <= quadrupletCount-1; quad++ )
-    {
-        // read quadruplet from the input stream
-        if (!isData( (d1 = rawInputData[ rawInputIndex++ ]) ) ||
-            !isData( (d2 = rawInputData[ rawInputIndex++ ]) ) ||
-            !isData( (d3 = rawInputData[ rawInputIndex++ ]) ) ||
-            !isData( (d4 = rawInputData[ rawInputIndex++ ]) ))
-        {
-            // if found "no data" just return NULL
-            return false;
-        }
-
-        b1 = sBase64Inverse[ d1 ];
-        b2 = sBase64Inverse[ d2 ];
-        b3 = sBase64Inverse[ d3 ];
-        b4 = sBase64Inverse[ d4 ];
-
-        // write triplet to the output stream
-        decodedData[ outputIndex++ ] = set1stOctet(b1, b2);
-        decodedData[ outputIndex++ ] = set2ndOctet(b2, b3);
-        decodedData[ outputIndex++ ] = set3rdOctet(b3, b4);
-    }
-
-    //
-    // process the last Quadruplet
-    //
-    // first two octets are present always, process them
-    if (!isData( (d1 = rawInputData[ rawInputIndex++ ]) ) ||
-        !isData( (d2 = rawInputData[ rawInputIndex++ ]) ))
-    {
-        // if found "no data" just return NULL
-        return false;
-    }
-
-    b1 = sBase64Inverse[ d1 ];
-    b2 = sBase64Inverse[ d2 ];
-
-    // try to process last two octets
-    d3 = rawInputData[ rawInputIndex++ ];
-    d4 = rawInputData[ rawInputIndex++ ];
-
-    if (!isData( d3 ) || !isData( d4 ))
-    {
-        // check if last two are PAD characters
-        if (isPad( d3 ) && isPad( d4 ))
-        {
-            // two PAD e.g. 3c==
-            if ((b2 & 0xf) != 0) // last 4 bits should be zero
-            {
-                return false;
-            }
-
-            decodedData[ outputIndex++ ] = set1stOctet(b1, b2);
-        }
-        else if (!isPad( d3 ) && isPad( d4 ))
-        {
-            // one PAD e.g. 3cQ=
-            b3 = sBase64Inverse[ d3 ];
-            if (( b3 & 0x3 ) != 0 ) // last 2 bits should be zero
-            {
-                return false;
-            }
-
-            decodedData[ outputIndex++ ] = set1stOctet( b1, b2 );
-            decodedData[ outputIndex++ ] = set2ndOctet( b2, b3 );
-        }
-        else
-        {
-            // an error like "3c[Pad]r", "3cdX", "3cXd", "3cXX" where X is non data
-            return false;
-        }
-    }
-    else
-    {
-        // no PAD e.g 3cQl
-        b3 = sBase64Inverse[ d3 ];
-        b4 = sBase64Inverse[ d4 ];
-        decodedData[ outputIndex++ ] = set1stOctet( b1, b2 );
-        decodedData[ outputIndex++ ] = set2ndOctet( b2, b3 );
-        decodedData[ outputIndex++ ] = set3rdOctet( b3, b4 );
-    }
-
-    // write out the end of string
-    outResult.ShrinkSizeNoReallocate( outputIndex);
 
+Base64Decoder::~Base64Decoder()
+{
+}
+
+
+VError Base64Decoder::Put( const void *inText, size_t inTextSize)
+{
+	if (fFailed)
+		return VE_STREAM_TEXT_CONVERSION_FAILURE;
+
+	if (inTextSize > 0)
+		fEmpty = false;
+
+	// each chunk decodes in fData
+	const size_t chunkSize = (sizeof( fData) / 3 - 1) * B64CODER_FOURBYTE;
+
+	const uBYTE *text = (const uBYTE*) inText;
+	const uBYTE *textEnd = text + inTextSize;
+	VError err = VE_OK;
+	while( (text != textEnd) && (err == VE_OK) )
+	{
+		uBYTE *data = fData;
+		bool ok = _Decode( text, text + std::min<size_t>( textEnd - text, chunkSize), data);
+
+		if ( (data != fData) && (fStream != NULL) )
+			err = fStream->PutData( fData, data - fData);
+
+		if (!ok)
+			err = _Fail();
+	}
+	return err;
+}
+
+
+VError Base64Decoder::Close()
+{
+	if (fFailed)
+		return VE_STREAM_TEXT_CONVERSION_FAILURE;
+
+	// no text at all is refused like Base64Coder::Decode does
+	uBYTE *data = fData;
+	if (fEmpty || !_Finish( data))
+		return _Fail();
+
+	return ( (data != fData) && (fStream != NULL) ) ? fStream->PutData( fData, data - fData) : VE_OK;
+}
+
+
+VError Base64Decoder::_Fail()
+{
+	fFailed = true;
+	return vThrowError( VE_STREAM_TEXT_CONVERSION_FAILURE);
+}
+
+
+bool Base64Decoder::_Decode( const uBYTE*& ioText, const uBYTE *inTextEnd, uBYTE*& ioData)
+{
+	DecodeProc proc = _GetDecodeProc();
+	const uBYTE *alphabet = Base64Coder::GetAlphabet( fAlphabet);
+
+	while( ioText != inTextEnd)
+	{
+		if ( (fQuadCount == 0) && (fPadCount == 0) && !fEnded)
+		{
+			size_t count = (*proc)( ioText, (inTextEnd - ioText) / B64CODER_FOURBYTE, ioData, alphabet, fInverse);
+			ioText += count * B64CODER_FOURBYTE;
+			ioData += count * 3;
+			if (ioText == inTextEnd)
+				break;
+		}
+
+		uBYTE c = *ioText++;
+
+		if ( (c == 0x20) || (c == 0x09) || (c == 0x0d) || (c == 0x0a) )
+		{
+			// RFC2045 does not explicitly forbid more than ONE whitespace 
+			// before, in between, or after base64 octects.
+			if (fConform == Base64Coder::Conf_RFC2045)
+				continue;
+			fFailed = true;
+		}
+		else if (isPad( c))
+		{
+			// only the last quad may be padded e.g. 3c== or 3cQ=
+			if ( fEnded || (fQuadCount < 2) )
+			{
+				fFailed = true;
+			}
+			else if (fQuadCount + ++fPadCount == 4)
+			{
+				fEnded = true;
+				fFailed = !_Finish( ioData);
+			}
+		}
+		else if ( fEnded || (fPadCount > 0) || (fInverse[c] == 0xff) )
+		{
+			// an error like "3c[Pad]r", "3cdX", "3cXd", "3cXX" where X is non data
+			fFailed = true;
+		}
+		else
+		{
+			fQuad[fQuadCount++] = fInverse[c];
+			if (fQuadCount == 4)
+			{
+				*ioData++ = set1stOctet( fQuad[0], fQuad[1]);
+				*ioData++ = set2ndOctet( fQuad[1], fQuad[2]);
+				*ioData++ = set3rdOctet( fQuad[2], fQuad[3]);
+				fQuadCount = 0;
+			}
+		}
+
+		if (fFailed)
+			return false;
+	}
 	return true;
 }
 
 
+bool Base64Decoder::_Finish( uBYTE*& ioData)
+{
+	if (fFailed)
+		return false;
+
+	if (fQuadCount == 0)
+		return true;
+
+	// the last quad must be padded but with the url alphabet
+	if ( (fQuadCount + fPadCount != 4) && ( (fPadCount > 0) || (fAlphabet != Base64Coder::Alphabet_URL) ) )
+		return false;
+
+	switch( fQuadCount)
+	{
+		case 2:
+			if ((fQuad[1] & 0xf) != 0) // last 4 bits should be zero
+				return false;
+			*ioData++ = set1stOctet( fQuad[0], fQuad[1]);
+			break;
+
+		case 3:
+			if ((fQuad[2] & 0x3) != 0) // last 2 bits should be zero
+				return false;
+			*ioData++ = set1stOctet( fQuad[0], fQuad[1]);
+			*ioData++ = set2ndOctet( fQuad[1], fQuad[2]);
+			break;
 
+		default:
+			return false;
+	}
 
+	fQuadCount = 0;
+	fPadCount = 0;
+	return true;
+}
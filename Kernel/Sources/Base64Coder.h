@@ -20,6 +20,10 @@
 
 BEGIN_TOOLBOX_NAMESPACE
 
+// Needed declarations
+class VStream;
+
+
 /* The code was borrowed from xerces project. */
 class XTOOLBOX_API Base64Coder
 {
@@ -30,23 +34,123 @@ public:
 		Conf_Schema
 	};
 
+	enum Alphabet
+	{
+		Alphabet_Standard,	// '+' and '/' (RFC 4648 section 4)
+		Alphabet_URL		// '-' and '_' (RFC 4648 section 5), padding is optional when decoding
+	};
+
 	static const size_t	BASE64_QUADSPERLINE	= 10000;	
 
 	// For SMTP (max 998 bytes per line), set inQuadsPerLine to 249 because 4 * 249 + 2 = 998 (CRLF = 2 bytes).	
 
-	static	bool	Encode( const void *inData, size_t inDataSize, VMemoryBuffer<>& outResult, sLONG inQuadsPerLine = BASE64_QUADSPERLINE);
+	static	bool	Encode( const void *inData, size_t inDataSize, VMemoryBuffer<>& outResult, sLONG inQuadsPerLine = BASE64_QUADSPERLINE, Alphabet inAlphabet = Alphabet_Standard, bool inPadding = true);
 
-	static	bool	Decode( const void *inData, size_t inDataSize, VMemoryBuffer<>& outResult, Conformance inConform = Conf_RFC2045 );
+	static	bool	Decode( const void *inData, size_t inDataSize, VMemoryBuffer<>& outResult, Conformance inConform = Conf_RFC2045, Alphabet inAlphabet = Alphabet_Standard);
+
+	// true if the ssse3 code paths are taken
+	static	bool	IsAccelerated();
 	
 private:
+	friend class Base64Encoder;
+	friend class Base64Decoder;
+
     Base64Coder();
     Base64Coder(const Base64Coder&);
 
     static	void			Init();
 	static	bool			isData(const uBYTE& octet)	{ return sBase64Inverse[octet] != 0xff; }
 
+	static	const uBYTE*	GetAlphabet( Alphabet inAlphabet)	{ return (inAlphabet == Alphabet_URL) ? sBase64URLAlphabet : sBase64Alphabet; }
+	static	const uBYTE*	GetInverse( Alphabet inAlphabet)	{ return (inAlphabet == Alphabet_URL) ? sBase64URLInverse : sBase64Inverse; }
+
+	static	void			EncodeQuads( const uBYTE*& ioData, size_t inTripletCount, uBYTE*& ioText, sLONG inQuadsPerLine, sLONG& ioQuadsInLine, Alphabet inAlphabet);
+	static	void			EncodeLastQuad( const uBYTE *inData, size_t inDataSize, uBYTE*& ioText, sLONG inQuadsPerLine, sLONG& ioQuadsInLine, Alphabet inAlphabet, bool inPadding);
+
     static	const uBYTE		sBase64Alphabet[];
+    static	const uBYTE		sBase64URLAlphabet[];
     static	uBYTE			sBase64Inverse[];
+    static	uBYTE			sBase64URLInverse[];
+};
+
+
+/*!
+	@class	Base64Encoder
+	@abstract	Encodes data in base64 as it comes and writes the text in a stream.
+	@discussion
+		Gives the same text as Base64Coder::Encode over the whole data, without having it all in memory.
+		The stream must be opened for writing. Close() writes the last quad, it does not close the stream.
+
+		Base64Encoder encoder( &stream, 76 / 4);
+		while( ...)
+			encoder.Put( data, size);
+		encoder.Close();
+*/
+class XTOOLBOX_API Base64Encoder
+{
+public:
+									Base64Encoder( VStream *inStream, sLONG inQuadsPerLine = Base64Coder::BASE64_QUADSPERLINE, Base64Coder::Alphabet inAlphabet = Base64Coder::Alphabet_Standard, bool inPadding = true);
+									~Base64Encoder();
+
+			VError					Put( const void *inData, size_t inDataSize);
+			VError					Close();
+
+private:
+									Base64Encoder( const Base64Encoder&);
+			Base64Encoder&			operator=( const Base64Encoder&);
+
+			VError					_Flush( uBYTE *inTextEnd);
+
+			VStream*				fStream;
+			sLONG					fQuadsPerLine;
+			sLONG					fQuadsInLine;
+			Base64Coder::Alphabet	fAlphabet;
+			bool					fPadding;
+			uBYTE					fPending[3];	// data not making a triplet yet
+			size_t					fPendingCount;
+			uBYTE					fText[4096];
+};
+
+
+/*!
+	@class	Base64Decoder
+	@abstract	Decodes base64 text as it comes and writes the data in a stream.
+	@discussion
+		Accepts the same text as Base64Coder::Decode, the text can be cut anywhere.
+		Invalid text gives VE_STREAM_TEXT_CONVERSION_FAILURE, from Put() or from Close() if the text is truncated or empty.
+		With a NULL stream, Put() only checks the text.
+*/
+class XTOOLBOX_API Base64Decoder
+{
+public:
+									Base64Decoder( VStream *inStream, Base64Coder::Conformance inConform = Base64Coder::Conf_RFC2045, Base64Coder::Alphabet inAlphabet = Base64Coder::Alphabet_Standard);
+									~Base64Decoder();
+
+			VError					Put( const void *inText, size_t inTextSize);
+			VError					Close();
+
+private:
+	friend class Base64Coder;
+
+									Base64Decoder( const Base64Decoder&);
+			Base64Decoder&			operator=( const Base64Decoder&);
+
+			// decodes up to inTextEnd, outData must have room for 3 * ((inTextEnd - ioText) / 4 + 1) bytes
+			bool					_Decode( const uBYTE*& ioText, const uBYTE *inTextEnd, uBYTE*& ioData);
+			bool					_Finish( uBYTE*& ioData);
+			VError					_Fail();
+
+			VStream*				fStream;
+			Base64Coder::Conformance fConform;
+			Base64Coder::Alphabet	fAlphabet;
+			const uBYTE*			fInverse;
+			uBYTE					fQuad[4];		// codes of the incomplete quad
+			sLONG					fQuadCount;
+			sLONG					fPadCount;
+			bool					fEnded;			// a padded quad has been read
+			bool					fFailed;
+			bool					fEmpty;			// no text has been put
+			uBYTE					fData[3072];
 };
 
 
@@ -0,0 +1,221 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "HexCoder.h"
+
+#if WITH_SSE2
+#include <emmintrin.h>
+#endif
+
+
+static const char sLowerDigits[] = "0123456789abcdef";
+static const char sUpperDigits[] = "0123456789ABCDEF";
+
+
+/* static */
+template<class CHAR>
+static void _EncodeBytes( const uBYTE *inData, size_t inDataSize, CHAR *outText, const char *inDigits)
+{
+	for( ; inDataSize > 0 ; --inDataSize, ++inData)
+	{
+		*outText++ = (CHAR) inDigits[*inData >> 4];
+		*outText++ = (CHAR) inDigits[*inData & 0xf];
+	}
+}
+
+
+/* static */
+template<class CHAR>
+static inline sLONG _FromHex( CHAR inChar)
+{
+	if (inChar >= '0' && inChar <= '9')
+		return inChar - '0';
+	else if (inChar >= 'a' && inChar <= 'f')
+		return 10 + inChar - 'a';
+	else if (inChar >= 'A' && inChar <= 'F')
+		return 10 + inChar - 'A';
+	else
+		return -1;
+}
+
+
+/* static */
+template<class CHAR>
+static bool _DecodeBytes( const CHAR *inText, size_t inByteCount, uBYTE *outData)
+{
+	for( ; inByteCount > 0 ; --inByteCount, inText += 2)
+	{
+		sLONG hi = _FromHex( inText[0]);
+		sLONG lo = _FromHex( inText[1]);
+		if ( (hi < 0) || (lo < 0) )
+			return false;
+		*outData++ = (uBYTE) ((hi << 4) | lo);
+	}
+	return true;
+}
+
+
+#if WITH_SSE2
+
+// ---------------------------------------------------------------------------
+//	16 bytes make 32 digits. Decoding takes 16 digits at a time and stops before
+//	a block with a char that is not a digit, which is left to the regular code.
+// ---------------------------------------------------------------------------
+
+static inline void _EncodeDigits( __m128i inBytes, __m128i inLetterOffset, __m128i& outFirst, __m128i& outSecond)
+{
+	const __m128i nibble = _mm_set1_epi8( 0x0f);
+	const __m128i nine = _mm_set1_epi8( 9);
+	const __m128i zero = _mm_set1_epi8( '0');
+
+	__m128i hi = _mm_and_si128( _mm_srli_epi16( inBytes, 4), nibble);
+	__m128i lo = _mm_and_si128( inBytes, nibble);
+	hi = _mm_add_epi8( hi, _mm_add_epi8( zero, _mm_and_si128( _mm_cmpgt_epi8( hi, nine), inLetterOffset)));
+	lo = _mm_add_epi8( lo, _mm_add_epi8( zero, _mm_and_si128( _mm_cmpgt_epi8( lo, nine), inLetterOffset)));
+
+	outFirst = _mm_unpacklo_epi8( hi, lo);
+	outSecond = _mm_unpackhi_epi8( hi, lo);
+}
+
+
+// returns the 8 bytes in the low quad word
+static inline bool _DecodeDigits( __m128i inChars, __m128i& outBytes)
+{
+	// unsigned compares through min
+	__m128i digits = _mm_sub_epi8( inChars, _mm_set1_epi8( '0'));
+	__m128i isDigit = _mm_cmpeq_epi8( _mm_min_epu8( digits, _mm_set1_epi8( 9)), digits);
+	__m128i letters = _mm_sub_epi8( _mm_or_si128( inChars, _mm_set1_epi8( 0x20)), _mm_set1_epi8( 'a'));
+	__m128i isLetter = _mm_cmpeq_epi8( _mm_min_epu8( letters, _mm_set1_epi8( 5)), letters);
+
+	if (_mm_movemask_epi8( _mm_or_si128( isDigit, isLetter)) != 0xFFFF)
+		return false;
+
+	__m128i values = _mm_or_si128( _mm_and_si128( isDigit, digits), _mm_and_si128( isLetter, _mm_add_epi8( letters, _mm_set1_epi8( 10))));
+
+	// even chars are high nibbles
+	__m128i bytes = _mm_or_si128( _mm_slli_epi16( _mm_and_si128( values, _mm_set1_epi16( 0x00ff)), 4), _mm_srli_epi16( values, 8));
+	outBytes = _mm_packus_epi16( bytes, bytes);
+	return true;
+}
+
+#endif
+
+
+void HexCoder::Encode( const void *inData, size_t inDataSize, char *outText, bool inUpperCase)
+{
+	const uBYTE *data = (const uBYTE*) inData;
+
+#if WITH_SSE2
+	const __m128i letterOffset = _mm_set1_epi8( inUpperCase ? ('A' - '0' - 10) : ('a' - '0' - 10));
+	for( ; inDataSize >= 16 ; inDataSize -= 16, data += 16, outText += 32)
+	{
+		__m128i first, second;
+		_EncodeDigits( _mm_loadu_si128( (const __m128i*) data), letterOffset, first, second);
+		_mm_storeu_si128( (__m128i*) outText, first);
+		_mm_storeu_si128( (__m128i*) (outText + 16), second);
+	}
+#endif
+
+	_EncodeBytes( data, inDataSize, outText, inUpperCase ? sUpperDigits : sLowerDigits);
+}
+
+
+void HexCoder::Encode( const void *inData, size_t inDataSize, UniChar *outText, bool inUpperCase)
+{
+	const uBYTE *data = (const uBYTE*) inData;
+
+#if WITH_SSE2
+	const __m128i letterOffset = _mm_set1_epi8( inUpperCase ? ('A' - '0' - 10) : ('a' - '0' - 10));
+	const __m128i zero = _mm_setzero_si128();
+	for( ; inDataSize >= 16 ; inDataSize -= 16, data += 16, outText += 32)
+	{
+		__m128i first, second;
+		_EncodeDigits( _mm_loadu_si128( (const __m128i*) data), letterOffset, first, second);
+		_mm_storeu_si128( (__m128i*) outText, _mm_unpacklo_epi8( first, zero));
+		_mm_storeu_si128( (__m128i*) (outText + 8), _mm_unpackhi_epi8( first, zero));
+		_mm_storeu_si128( (__m128i*) (outText + 16), _mm_unpacklo_epi8( second, zero));
+		_mm_storeu_si128( (__m128i*) (outText + 24), _mm_unpackhi_epi8( second, zero));
+	}
+#endif
+
+	_EncodeBytes( data, inDataSize, outText, inUpperCase ? sUpperDigits : sLowerDigits);
+}
+
+
+bool HexCoder::Encode( const void *inData, size_t inDataSize, VMemoryBuffer<>& outResult, bool inUpperCase)
+{
+	outResult.Clear();
+	if (!outResult.SetSize( 2 * inDataSize))
+		return false;
+
+	Encode( inData, inDataSize, (char*) outResult.GetDataPtr(), inUpperCase);
+	return true;
+}
+
+
+bool HexCoder::Decode( const char *inText, size_t inTextSize, void *outData)
+{
+	uBYTE *data = (uBYTE*) outData;
+	size_t count = inTextSize / 2;
+
+#if WITH_SSE2
+	for( ; count >= 8 ; count -= 8, inText += 16, data += 8)
+	{
+		__m128i bytes;
+		if (!_DecodeDigits( _mm_loadu_si128( (const __m128i*) inText), bytes))
+			break;
+		_mm_storel_epi64( (__m128i*) data, bytes);
+	}
+#endif
+
+	return _DecodeBytes( inText, count, data);
+}
+
+
+bool HexCoder::Decode( const UniChar *inText, size_t inTextSize, void *outData)
+{
+	uBYTE *data = (uBYTE*) outData;
+	size_t count = inTextSize / 2;
+
+#if WITH_SSE2
+	for( ; count >= 8 ; count -= 8, inText += 16, data += 8)
+	{
+		// chars above 0xff become 0xff, which is not a digit
+		__m128i chars = _mm_packus_epi16( _mm_loadu_si128( (const __m128i*) inText), _mm_loadu_si128( (const __m128i*) (inText + 8)));
+		__m128i bytes;
+		if (!_DecodeDigits( chars, bytes))
+			break;
+		_mm_storel_epi64( (__m128i*) data, bytes);
+	}
+#endif
+
+	return _DecodeBytes( inText, count, data);
+}
+
+
+bool HexCoder::Decode( const void *inText, size_t inTextSize, VMemoryBuffer<>& outResult)
+{
+	outResult.Clear();
+	if (!outResult.SetSize( inTextSize / 2))
+		return false;
+
+	if (!Decode( (const char*) inText, inTextSize, outResult.GetDataPtr()))
+	{
+		outResult.Clear();
+		return false;
+	}
+	return true;
+}
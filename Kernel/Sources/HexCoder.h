@@ -0,0 +1,52 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __HEX_CODER__
+#define __HEX_CODER__
+
+#include "VMemoryBuffer.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+/*!
+	@class	HexCoder
+	@abstract	Hexadecimal encoding of binary data, two digits per byte.
+	@discussion
+		Encoding writes 2 * inDataSize chars, lower case unless inUpperCase. Decoding accepts both cases
+		and reads inTextSize / 2 bytes (an odd last char is ignored). Decoding fails on a char that is not an hexadecimal digit,
+		outData content is then undefined.
+
+		There's no state between bytes: to encode or decode a stream, cut it in chunks of even text size.
+*/
+class XTOOLBOX_API HexCoder
+{
+public:
+	static	void	Encode( const void *inData, size_t inDataSize, char *outText, bool inUpperCase = false);
+	static	void	Encode( const void *inData, size_t inDataSize, UniChar *outText, bool inUpperCase = false);
+	static	bool	Encode( const void *inData, size_t inDataSize, VMemoryBuffer<>& outResult, bool inUpperCase = false);
+
+	static	bool	Decode( const char *inText, size_t inTextSize, void *outData);
+	static	bool	Decode( const UniChar *inText, size_t inTextSize, void *outData);
+	static	bool	Decode( const void *inText, size_t inTextSize, VMemoryBuffer<>& outResult);
+
+private:
+	HexCoder();
+	HexCoder( const HexCoder&);
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif /* __HEX_CODER__ */
@@ -16,6 +16,7 @@
 #include "VKernelPrecompiled.h"
 #include "ISortable.h"
 #include "VMemoryCpp.h"
+#include "VParallel.h"
 
 
 ISortable::ISortable()
@@ -205,3 +206,90 @@ done:
 }
 
 
+
+
+class ISortable::IndexComparator
+{
+public:
+	IndexComparator (ISortable** inArrays, uBYTE** inDatas, Boolean* inInvert, sLONG inMultiCriteriaLevel)
+		: fArrays(inArrays), fDatas(inDatas), fInvert(inInvert), fMultiCriteriaLevel(inMultiCriteriaLevel)	{}
+
+	bool operator () (sLONG inIndexA, sLONG inIndexB) const
+	{
+		return ISortable::MultiCriteriaCompare(fArrays, fDatas, fInvert, fMultiCriteriaLevel, inIndexA, inIndexB) == CR_SMALLER;
+	}
+
+	ISortable**	fArrays;
+	uBYTE**		fDatas;
+	Boolean*	fInvert;
+	sLONG		fMultiCriteriaLevel;
+};
+
+
+void ISortable::MultiCriteriaParallelSort(ISortable** inArrays, Boolean* inInvert, sLONG inMultiCriteriaLevel, sLONG inFrom, sLONG inTo)
+{
+	if (inTo - inFrom < 2)
+		return;
+
+	// compute number of arrays;
+	sLONG nb = 0;
+	bool concurrent = true;
+	while (inArrays[nb])
+	{
+		concurrent = concurrent && inArrays[nb]->CanCompareConcurrently();
+		nb++;
+	}
+
+	if (!concurrent || (inTo - inFrom + 1 < 2 * VParallel::kMIN_SORT_RUN_SIZE))
+	{
+		MultiCriteriaQSort(inArrays, inInvert, inMultiCriteriaLevel, inFrom, inTo);
+		return;
+	}
+
+	// allocate buffers for arrays and for the permutation
+	uBYTE** datas = (uBYTE**) vMalloc(nb * sizeof(uBYTE*), 'sort');
+	sLONG* indexes = (sLONG*) vMalloc((inTo - inFrom + 1) * sizeof(sLONG), 'sort');
+	if (datas == NULL || indexes == NULL)
+	{
+		if (datas != NULL)
+			vFree(datas);
+		if (indexes != NULL)
+			vFree(indexes);
+		MultiCriteriaQSort(inArrays, inInvert, inMultiCriteriaLevel, inFrom, inTo);
+		return;
+	}
+
+	sLONG i;
+	for (i = 0; i < nb; i++)
+		datas[i] = inArrays[i]->LockAndGetData();
+
+	for (i = inFrom; i <= inTo; i++)
+		indexes[i - inFrom] = i;
+
+	VParallel::Sort(indexes, inTo - inFrom + 1, IndexComparator(inArrays, datas, inInvert, inMultiCriteriaLevel));
+
+	// element at position p must come from position indexes[p - inFrom].
+	// follow each cycle of the permutation: every swap puts one element at its final place.
+	for (i = inFrom; i <= inTo; i++)
+	{
+		if (indexes[i - inFrom] < 0)
+			continue;
+
+		sLONG pos = i;
+		for (;;)
+		{
+			sLONG from = indexes[pos - inFrom];
+			indexes[pos - inFrom] = -1;
+			if (from == i)
+				break;
+			MultiCriteriaSwap(inArrays, datas, pos, from);
+			pos = from;
+		}
+	}
+
+	for (i = 0; i < nb; i++)
+		inArrays[i]->UnlockData();
+
+	vFree(indexes);
+	vFree(datas);
+}
@@ -28,7 +28,17 @@ public:
 
 	static void	MultiCriteriaQSort (ISortable** inArrays, Boolean* inInvert, sLONG inMultiCriteriaLevel, sLONG inFrom, sLONG inTo);
 
+	// Stable sort on the shared VExecutor (see VParallel::Sort).
+	// The element indexes are sorted concurrently then the elements are swapped in place along the permutation cycles.
+	// All the arrays must return true from CanCompareConcurrently(), else MultiCriteriaQSort is used.
+	static void	MultiCriteriaParallelSort (ISortable** inArrays, Boolean* inInvert, sLONG inMultiCriteriaLevel, sLONG inFrom, sLONG inTo);
+
 protected:
+	class IndexComparator;
+
+	// tells if CompareElements may be called from several threads at once on the same data
+	virtual Boolean	CanCompareConcurrently () const { return false; };
+
 	virtual uBYTE*	LockAndGetData () const { return NULL; };
 	virtual void	UnlockData () const {};
 	
@@ -17,11 +17,366 @@
 #include "VArchiveStream.h"
 #include "VStream.h"
 #include "VErrorContext.h"
+#include "VExecutor.h"
+#include "VChecksumMD5.h"
 
 #if VERSIONMAC
 #include <mach-o/loader.h>
 #endif
 
+#if WITH_ZLIB
+#include <zlib.h>
+#endif
+
+#if WITH_ZSTD
+#include <zstd.h>
+#endif
+
+
+// Class constants
+const uBYTE	kARCHIVE_LAST_VERSION	= 5;
+const VSize	kARCHIVE_CHUNK_SIZE		= 1024*1024;	// uncompressed size of version 5 chunks, also the size of read buffers
+const sLONG	kARCHIVE_JOBS_PER_WORKER = 2;			// chunks being compressed while the writer waits for the oldest
+
+
+/*
+	Version 5 archives
+
+	Same header and catalog as version 4, then for each file:
+		'Fdat' data size (8 bytes) chunks
+		'Frez' resource size (8 bytes) chunks
+	each chunk being:
+		stored size (4 bytes) uncompressed size (4 bytes) compression (1 byte) crc32c of uncompressed data (4 bytes) stored data
+	and at the end:
+		'INDX' file count (8 bytes) offset of each 'Fdat' from the signature (8 bytes each)
+		offset of 'INDX' (8 bytes) 'FPIX'
+*/
+
+/* static */
+static bool _IsCompressionAvailable( EArchiveCompression inCompression )
+{
+	switch( inCompression )
+	{
+		case eArchiveStore:		return true;
+#if WITH_ZLIB
+		case eArchiveDeflate:	return true;
+#endif
+#if WITH_ZSTD
+		case eArchiveZstd:		return true;
+#endif
+		default:				return false;
+	}
+}
+
+
+/* static */
+static VSize _GetCompressBound( EArchiveCompression inCompression, VSize inSize )
+{
+	switch( inCompression )
+	{
+#if WITH_ZLIB
+		case eArchiveDeflate:	return (VSize) compressBound( (uLong) inSize );
+#endif
+#if WITH_ZSTD
+		case eArchiveZstd:		return (VSize) ZSTD_compressBound( inSize );
+#endif
+		default:				return inSize;
+	}
+}
+
+
+/* static */
+static bool _Compress( EArchiveCompression inCompression, sLONG inLevel, const char *inData, VSize inSize, char *outData, VSize inCapacity, VSize &outSize )
+{
+	switch( inCompression )
+	{
+#if WITH_ZLIB
+		case eArchiveDeflate:
+			{
+				uLongf size = (uLongf) inCapacity;
+				if (compress2( (Bytef*) outData, &size, (const Bytef*) inData, (uLong) inSize, (inLevel > 0) ? inLevel : Z_DEFAULT_COMPRESSION ) != Z_OK)
+					return false;
+				outSize = (VSize) size;
+				return true;
+			}
+#endif
+#if WITH_ZSTD
+		case eArchiveZstd:
+			{
+				size_t size = ZSTD_compress( outData, inCapacity, inData, inSize, (inLevel > 0) ? inLevel : ZSTD_CLEVEL_DEFAULT );
+				if (ZSTD_isError( size ))
+					return false;
+				outSize = (VSize) size;
+				return true;
+			}
+#endif
+		default:
+			return false;
+	}
+}
+
+
+/* static */
+static bool _Decompress( EArchiveCompression inCompression, const char *inData, VSize inSize, char *outData, VSize inExpectedSize )
+{
+	switch( inCompression )
+	{
+		case eArchiveStore:
+			if (inSize != inExpectedSize)
+				return false;
+			::memcpy( outData, inData, inSize );
+			return true;
+#if WITH_ZLIB
+		case eArchiveDeflate:
+			{
+				uLongf size = (uLongf) inExpectedSize;
+				return (uncompress( (Bytef*) outData, &size, (const Bytef*) inData, (uLong) inSize ) == Z_OK) && (size == inExpectedSize);
+			}
+#endif
+#if WITH_ZSTD
+		case eArchiveZstd:
+			return ZSTD_decompress( outData, inExpectedSize, inData, inSize ) == inExpectedSize;
+#endif
+		default:
+			return false;
+	}
+}
+
+
+BEGIN_TOOLBOX_NAMESPACE
+
+/*
+	Compresses one chunk of a file. The chunk is read by the writer task before the job is submitted.
+	If compressing does not make it smaller, the chunk is stored.
+*/
+class VArchiveChunkJob : public VJob
+{
+public:
+								VArchiveChunkJob( EArchiveCompression inCompression, sLONG inLevel, VSize inRawSize )
+									: fCompression( inCompression), fLevel( inLevel), fRaw( new char[inRawSize]), fRawSize( inRawSize), fPacked( NULL), fPackedSize( 0), fCRC( 0), fSubmitted( false)	{;}
+
+			void				Compute()
+								{
+									fCRC = VChecksumCRC32C::GetChecksumFromBytes( fRaw, fRawSize );
+									if (fCompression != eArchiveStore)
+									{
+										VSize capacity = _GetCompressBound( fCompression, fRawSize );
+										fPacked = new char[capacity];
+										if (!_Compress( fCompression, fLevel, fRaw, fRawSize, fPacked, capacity, fPackedSize ) || (fPackedSize >= fRawSize))
+										{
+											delete[] fPacked;
+											fPacked = NULL;
+											fCompression = eArchiveStore;
+										}
+									}
+									if (fPacked == NULL)
+										fPackedSize = fRawSize;
+								}
+
+			const char*			GetStoredData() const		{ return (fPacked != NULL) ? fPacked : fRaw;}
+
+			EArchiveCompression	fCompression;
+			sLONG				fLevel;
+			char*				fRaw;
+			VSize				fRawSize;
+			char*				fPacked;
+			VSize				fPackedSize;
+			uLONG				fCRC;
+			bool				fSubmitted;		// false if computed by the writer
+
+protected:
+	virtual						~VArchiveChunkJob()			{ delete[] fRaw; delete[] fPacked;}
+	virtual	void				DoExecute()					{ Compute();}
+};
+
+
+/*
+	Keeps the chunks in file order: forks are queued as their chunks are read and written
+	once the oldest chunk is compressed, so that at most a few chunks per worker are in memory.
+*/
+class VArchiveChunkWriter
+{
+public:
+								VArchiveChunkWriter( VStream *inStream, sLONG8 inStart, EArchiveCompression inCompression, sLONG inLevel, CB_VArchiveStream inCallBack, uLONG8 &ioPartialByteCount, uLONG8 inTotalByteCount );
+								~VArchiveChunkWriter();
+
+			VError				AddFork( OsType inTag, const VFileDesc *inFileDesc );
+			VError				Finish();
+
+private:
+			typedef struct Item
+			{
+				OsType				fTag;		// 'Fdat' or 'Frez' for the first chunk of a fork, 0 for the next ones
+				sLONG8				fForkSize;
+				VArchiveChunkJob	*fJob;		// NULL for an empty fork
+			} Item;
+
+			VError				_WriteItems( size_t inMaxPendingCount );
+
+			VStream				*fStream;
+			EArchiveCompression	fCompression;
+			sLONG				fLevel;
+			CB_VArchiveStream	fCallBack;
+			uLONG8				&fPartialByteCount;
+			uLONG8				fTotalByteCount;
+			VExecutor			*fExecutor;
+			size_t				fMaxPendingCount;
+			std::deque<Item>	fPending;
+			sLONG8				fStart;			// position of the archive signature
+			std::vector<sLONG8>	fEntryOffsets;
+};
+
+END_TOOLBOX_NAMESPACE
+
+
+VArchiveChunkWriter::VArchiveChunkWriter( VStream *inStream, sLONG8 inStart, EArchiveCompression inCompression, sLONG inLevel, CB_VArchiveStream inCallBack, uLONG8 &ioPartialByteCount, uLONG8 inTotalByteCount )
+: fStream( inStream)
+, fCompression( inCompression)
+, fLevel( inLevel)
+, fCallBack( inCallBack)
+, fPartialByteCount( ioPartialByteCount)
+, fTotalByteCount( inTotalByteCount)
+, fExecutor( VExecutor::GetShared())
+, fMaxPendingCount( 1)
+, fStart( inStart)
+{
+	if ( (fExecutor != NULL) && !fExecutor->IsShutDown() && (fExecutor->GetWorkerCount() > 0) )
+		fMaxPendingCount = kARCHIVE_JOBS_PER_WORKER * fExecutor->GetWorkerCount();
+}
+
+
+VArchiveChunkWriter::~VArchiveChunkWriter()
+{
+	// pending chunks if aborted
+	for( std::deque<Item>::iterator i = fPending.begin() ; i != fPending.end() ; ++i )
+	{
+		if (i->fJob != NULL)
+		{
+			if (i->fJob->fSubmitted)
+			{
+				i->fJob->Cancel();
+				i->fJob->Wait();
+			}
+			i->fJob->Release();
+		}
+	}
+}
+
+
+VError VArchiveChunkWriter::AddFork( OsType inTag, const VFileDesc *inFileDesc )
+{
+	VError result = VE_OK;
+	sLONG8 forkSize = (inFileDesc != NULL) ? inFileDesc->GetSize() : 0;
+	Item item = { inTag, forkSize, NULL };
+
+	if (forkSize == 0)
+	{
+		fPending.push_back( item );
+		result = _WriteItems( fMaxPendingCount );
+	}
+
+	for( sLONG8 offset = 0 ; (offset < forkSize) && (result == VE_OK) ; )
+	{
+		VSize byteCount = (VSize) Min( forkSize - offset, (sLONG8) kARCHIVE_CHUNK_SIZE );
+		VArchiveChunkJob *job = new VArchiveChunkJob( fCompression, fLevel, byteCount );
+		result = inFileDesc->GetData( job->fRaw, byteCount, offset );
+		if (result == VE_OK)
+		{
+			// if the executor is shut down the job gets cancelled and is computed by the writer
+			if (fMaxPendingCount > 1)
+				job->fSubmitted = fExecutor->Submit( job );
+
+			item.fJob = job;
+			fPending.push_back( item );
+			item.fTag = 0;
+			offset += byteCount;
+
+			result = _WriteItems( fMaxPendingCount );
+		}
+		else
+		{
+			job->Release();
+		}
+	}
+
+	return result;
+}
+
+
+VError VArchiveChunkWriter::_WriteItems( size_t inMaxPendingCount )
+{
+	VError result = VE_OK;
+	bool userAbort = false;
+
+	while( (fPending.size() > inMaxPendingCount) && (result == VE_OK) )
+	{
+		Item item = fPending.front();
+		fPending.pop_front();
+
+		if (item.fTag != 0)
+		{
+			if (item.fTag == 'Fdat')
+				fEntryOffsets.push_back( fStream->GetPos() - fStart );
+			result = fStream->PutLong( item.fTag );
+			if (result == VE_OK)
+				result = fStream->PutLong8( item.fForkSize );
+		}
+
+		VArchiveChunkJob *job = item.fJob;
+		if (job != NULL)
+		{
+			if (!job->fSubmitted || !job->Wait() || (job->GetState() != eJobDone))
+				job->Compute();
+
+			if (result == VE_OK)
+				result = fStream->PutLong( (uLONG) job->fPackedSize );
+			if (result == VE_OK)
+				result = fStream->PutLong( (uLONG) job->fRawSize );
+			if (result == VE_OK)
+				result = fStream->PutByte( (uBYTE) job->fCompression );
+			if (result == VE_OK)
+				result = fStream->PutLong( job->fCRC );
+			if (result == VE_OK)
+				result = fStream->PutData( job->GetStoredData(), job->fPackedSize );
+
+			fPartialByteCount += job->fRawSize;
+			job->Release();
+
+			if ( fCallBack )
+			{
+				fCallBack(CB_UpdateProgress,fPartialByteCount,fTotalByteCount,userAbort);
+				if ( userAbort )
+					result = VE_STREAM_USER_ABORTED;
+			}
+		}
+	}
+
+	return result;
+}
+
+
+VError VArchiveChunkWriter::Finish()
+{
+	VError result = _WriteItems( 0 );
+
+	if (result == VE_OK)
+	{
+		sLONG8 indexOffset = fStream->GetPos() - fStart;
+		result = fStream->PutLong( 'INDX' );
+		if (result == VE_OK)
+			result = fStream->PutLong8( (sLONG8) fEntryOffsets.size() );
+		for( std::vector<sLONG8>::const_iterator i = fEntryOffsets.begin() ; (i != fEntryOffsets.end()) && (result == VE_OK) ; ++i )
+			result = fStream->PutLong8( *i );
+		if (result == VE_OK)
+			result = fStream->PutLong8( indexOffset );
+		if (result == VE_OK)
+			result = fStream->PutLong( 'FPIX' );
+	}
+
+	return result;
+}
+
+
 VArchiveCatalog::VArchiveCatalog( VFile *inFile, sLONG8 inDataFileSize, sLONG8 inResFileSize, VString &inStoredPath, VString &inFileExtra, uLONG inKind, uLONG inCreator )
 {
 	inFile->Retain();
@@ -91,6 +446,9 @@ VArchiveStream::VArchiveStream()
 	fStream = NULL;
 	fCallBack = NULL;
 	fUniqueFilesCollection = NULL;
+	fVersion = 4;
+	fCompression = eArchiveStore;
+	fCompressionLevel = 0;
 
 	fUniqueFilesCollection = new SetOfVFilePath();
 }
@@ -255,6 +613,17 @@ void VArchiveStream::SetProgressCallBack( CB_VArchiveStream inProgressCallBack )
 	fCallBack = inProgressCallBack;
 }
 
+VError VArchiveStream::SetCompression( EArchiveCompression inCompression, sLONG inLevel )
+{
+	if (!_IsCompressionAvailable( inCompression ))
+		return vThrowError( VE_UNIMPLEMENTED );
+
+	fVersion = kARCHIVE_LAST_VERSION;
+	fCompression = inCompression;
+	fCompressionLevel = inLevel;
+	return VE_OK;
+}
+
 VError VArchiveStream::_WriteFile( const VFileDesc* inFileDesc, char* buffToUse, VSize buffSize, uLONG8 &ioPartialByteCount, uLONG8 inTotalByteCount )
 {
 	bool userAbort = false;
@@ -290,6 +659,46 @@ VError VArchiveStream::_WriteFile( const VFileDesc* inFileDesc, char* buffToUse,
 	return result;
 }
 
+VError VArchiveStream::_WriteChunkedFiles( sLONG8 inArchiveStart, uLONG8 &ioPartialByteCount, uLONG8 inTotalByteCount )
+{
+	VError result = VE_OK;
+	VArchiveChunkWriter writer( fStream, inArchiveStart, fCompression, fCompressionLevel, fCallBack, ioPartialByteCount, inTotalByteCount );
+
+	/* nota : filedesc passed to the archivestream is considered as data fork */
+	for( VectorOfVFileDesc::iterator i = fFileDescList.begin() ; result == VE_OK && i != fFileDescList.end() ; ++i)
+	{
+		StErrorContextInstaller errors( false);
+		result = writer.AddFork( 'Fdat', *i );
+		if ( result == VE_OK )
+			result = writer.AddFork( 'Frez', NULL );
+	}
+
+	for( VectorOfVFile::iterator i = fFileList.begin() ; result == VE_OK && i != fFileList.end() ; ++i )
+	{
+		StErrorContextInstaller errors( false);
+		VFileDesc *fileDesc = NULL;
+
+		(*i)->Open(FA_READ,&fileDesc);
+		result = writer.AddFork( 'Fdat', fileDesc );
+		delete fileDesc;
+		fileDesc = NULL;
+
+		if ( result == VE_OK )
+		{
+#if VERSIONMAC
+			(*i)->Open(FA_READ,&fileDesc,FO_OpenResourceFork);
+#endif
+			result = writer.AddFork( 'Frez', fileDesc );
+			delete fileDesc;
+		}
+	}
+
+	if ( result == VE_OK )
+		result = writer.Finish();
+
+	return result;
+}
+
 VError VArchiveStream::_AddOneFolder(VFolder& inFolder,const VString& inExtraInfo)
 {
 	VError error = VE_OK;
@@ -433,11 +842,12 @@ VError VArchiveStream::Proceed()
 			sLONG8 byteCount;
 			uLONG8 totalByteCount = 0;
 			uLONG8 partialByteCount = 0;
+			sLONG8 archiveStart = fStream->GetPos();
 
 			/* put the backup file signature */
 			fStream->PutLong('FPBK');
 			/* put the current version of the file */
-			fStream->PutByte(4);
+			fStream->PutByte(fVersion);
 			/* put the number of file stored in this archive */
 			sLONG8 storedObjCount = (sLONG8)fFileList.size();
 			storedObjCount += (sLONG8)fFileDescList.size();
@@ -472,75 +882,81 @@ VError VArchiveStream::Proceed()
 				fCallBack(CB_OpenProgress,partialByteCount,totalByteCount,userAbort);
 			}
 
-			VSize bufferSize = 1024*1024;
-			char *buffer = new char[bufferSize];
-
-			/* writing file descriptor that we have to the archive files */
-			/* nota : filedesc passed to the archivestream is considered as data fork */
-			//ACI0077162, Jul 11th 2012, O.R.: _WriteFile() in charge of calling progress CB to give reactivity to upper layers
-			for( VectorOfVFileDesc::iterator i = fFileDescList.begin() ; result == VE_OK && i != fFileDescList.end() && !userAbort ; ++i)
+			if ( fVersion >= 5 )
 			{
-				StErrorContextInstaller errors( false);
-				result = fStream->PutLong('Fdat');
-				if ( result == VE_OK )
-				{
-					result = (*i)->SetPos(0);
-					if ( result == VE_OK )
-						result = _WriteFile( (*i), buffer, bufferSize, partialByteCount, totalByteCount );
-				}
-
-				if ( result == VE_OK )
-					result = fStream->PutLong('Frez');
-
-				if ( result == VE_OK )
-					result = fStream->PutLong8(0);
-
+				if ( result == VE_OK && !userAbort )
+					result = _WriteChunkedFiles( archiveStart, partialByteCount, totalByteCount );
 			}
-
-			for( VectorOfVFile::iterator i = fFileList.begin() ; result == VE_OK && i != fFileList.end() && !userAbort ; ++i )
+			else
 			{
-				StErrorContextInstaller errors( false);
-				VFileDesc *fileDesc = NULL;
+				VSize bufferSize = kARCHIVE_CHUNK_SIZE;
+				char *buffer = new char[bufferSize];
 
-				result = fStream->PutLong('Fdat');
-				if ( result == VE_OK )
+				/* writing file descriptor that we have to the archive files */
+				/* nota : filedesc passed to the archivestream is considered as data fork */
+				//ACI0077162, Jul 11th 2012, O.R.: _WriteFile() in charge of calling progress CB to give reactivity to upper layers
+				for( VectorOfVFileDesc::iterator i = fFileDescList.begin() ; result == VE_OK && i != fFileDescList.end() && !userAbort ; ++i)
 				{
-					result = (*i)->Open(FA_READ,&fileDesc);
-					if ( fileDesc )
+					StErrorContextInstaller errors( false);
+					result = fStream->PutLong('Fdat');
+					if ( result == VE_OK )
 					{
-						result = _WriteFile( fileDesc, buffer, bufferSize, partialByteCount, totalByteCount );
-						delete fileDesc;
-						fileDesc = NULL;
+						result = (*i)->SetPos(0);
+						if ( result == VE_OK )
+							result = _WriteFile( (*i), buffer, bufferSize, partialByteCount, totalByteCount );
 					}
-					else
-					{
+
+					if ( result == VE_OK )
+						result = fStream->PutLong('Frez');
+
+					if ( result == VE_OK )
 						result = fStream->PutLong8(0);
-					}
-				}
 
-				if ( result == VE_OK )
-					result = fStream->PutLong('Frez');
+				}
 
-				if ( result == VE_OK )
+				for( VectorOfVFile::iterator i = fFileList.begin() ; result == VE_OK && i != fFileList.end() && !userAbort ; ++i )
 				{
-#if VERSIONMAC
-					result = (*i)->Open(FA_READ,&fileDesc,FO_OpenResourceFork);
-					if ( fileDesc )
+					StErrorContextInstaller errors( false);
+					VFileDesc *fileDesc = NULL;
+
+					result = fStream->PutLong('Fdat');
+					if ( result == VE_OK )
 					{
-						result = _WriteFile( fileDesc, buffer, bufferSize, partialByteCount, totalByteCount );
-						delete fileDesc;
-						fileDesc = NULL;
+						result = (*i)->Open(FA_READ,&fileDesc);
+						if ( fileDesc )
+						{
+							result = _WriteFile( fileDesc, buffer, bufferSize, partialByteCount, totalByteCount );
+							delete fileDesc;
+							fileDesc = NULL;
+						}
+						else
+						{
+							result = fStream->PutLong8(0);
+						}
 					}
-					else
-#endif
+
+					if ( result == VE_OK )
+						result = fStream->PutLong('Frez');
+
+					if ( result == VE_OK )
 					{
-						result = fStream->PutLong8(0);
+#if VERSIONMAC
+						result = (*i)->Open(FA_READ,&fileDesc,FO_OpenResourceFork);
+						if ( fileDesc )
+						{
+							result = _WriteFile( fileDesc, buffer, bufferSize, partialByteCount, totalByteCount );
+							delete fileDesc;
+							fileDesc = NULL;
+						}
+						else
+#endif
+						{
+							result = fStream->PutLong8(0);
+						}
 					}
 				}
+				delete[] buffer;
 			}
-			delete[] buffer;
-
-			
 
 			fStream->CloseWriting();
 		}
@@ -560,6 +976,10 @@ VArchiveUnStream::VArchiveUnStream()
 {
 	fCallBack = NULL;
 	fSourceFile = NULL;
+	fVersion = 0;
+	fArchiveStart = 0;
+	fDataStart = 0;
+	fChunkBuffer = NULL;
 }
 
 VArchiveUnStream::~VArchiveUnStream()
@@ -567,6 +987,8 @@ VArchiveUnStream::~VArchiveUnStream()
 	if ( fSourceFile )
 		fSourceFile->Release();
 
+	delete[] fChunkBuffer;
+
 	for ( ArchiveCatalog::iterator i = fFileCatalog.begin() ; i != fFileCatalog.end() ; ++i )
 		delete *i;
 }
@@ -607,6 +1029,9 @@ VError VArchiveUnStream::ProceedCatalog()
 	VStr8 extra("::");
 	VStr8 folderSep(XBOX::FOLDER_SEPARATOR);
 
+	fArchiveStart = fStream->GetPos();
+	fEntryOffsets.clear();
+
 	if ( fStream->GetLong() == 'FPBK' )
 	{
 		VString filePath;
@@ -619,9 +1044,11 @@ VError VArchiveUnStream::ProceedCatalog()
 		uBYTE version = fStream->GetByte();
 		uLONG8 fileCount = fStream->GetLong8();
 		fTotalByteCount = 0;
+		fVersion = version;
 
-
-		if ( fStream->GetLong() == 'LIST' )
+		if ( version > kARCHIVE_LAST_VERSION )
+			result = VE_STREAM_BAD_VERSION;
+		else if ( fStream->GetLong() == 'LIST' )
 		{
 			for ( uLONG i = 0; i < fileCount && result == VE_OK; i++ )
 			{
@@ -659,6 +1086,7 @@ VError VArchiveUnStream::ProceedCatalog()
 				else
 					result = VE_STREAM_BAD_SIGNATURE;
 			}
+			fDataStart = fStream->GetPos();
 		}
 		else
 			result = VE_STREAM_BAD_SIGNATURE;
@@ -715,11 +1143,51 @@ VError VArchiveUnStream::_ExtractFile( VArchiveCatalog *inCatalog, const VFileDe
 
 	while ( offset < fileSize && result == VE_OK )
 	{
-		byteCount = fileSize - offset;
-		//Cast pour eviter le warning C4018
-		if ( byteCount > ((sLONG8)buffSize ))
-			byteCount = buffSize;
-		result = fStream->GetData(buffToUse,(VSize) byteCount);
+		if ( fVersion >= 5 )
+		{
+			/* chunk header: stored size, uncompressed size, compression, crc32c */
+			VSize storedSize = (VSize) fStream->GetLong();
+			byteCount = (sLONG8) fStream->GetLong();
+			EArchiveCompression compression = (EArchiveCompression) fStream->GetByte();
+			uLONG crc = fStream->GetLong();
+
+			result = fStream->GetLastError();
+			if ( result == VE_OK )
+			{
+				if ( (byteCount <= 0) || (byteCount > fileSize - offset) || (byteCount > (sLONG8) kARCHIVE_CHUNK_SIZE) || ((sLONG8) storedSize > byteCount) || (byteCount > (sLONG8) buffSize) )
+					result = VE_STREAM_BAD_SIGNATURE;
+				else if ( !_IsCompressionAvailable( compression ) )
+					result = VE_UNIMPLEMENTED;
+			}
+			if ( result == VE_OK )
+			{
+				if ( compression == eArchiveStore )
+				{
+					if ( (sLONG8) storedSize == byteCount )
+						result = fStream->GetData( buffToUse, storedSize );
+					else
+						result = VE_STREAM_BAD_SIGNATURE;
+				}
+				else
+				{
+					if ( fChunkBuffer == NULL )
+						fChunkBuffer = new char[kARCHIVE_CHUNK_SIZE];
+					result = fStream->GetData( fChunkBuffer, storedSize );
+					if ( (result == VE_OK) && !_Decompress( compression, fChunkBuffer, storedSize, buffToUse, (VSize) byteCount ) )
+						result = VE_STREAM_BAD_SIGNATURE;
+				}
+			}
+			if ( (result == VE_OK) && (VChecksumCRC32C::GetChecksumFromBytes( buffToUse, (VSize) byteCount ) != crc) )
+				result = VE_STREAM_BAD_SIGNATURE;
+		}
+		else
+		{
+			byteCount = fileSize - offset;
+			//Cast pour eviter le warning C4018
+			if ( byteCount > ((sLONG8)buffSize ))
+				byteCount = buffSize;
+			result = fStream->GetData(buffToUse,(VSize) byteCount);
+		}
 		if ( result == VE_OK )
 		{
 			if ( inCatalog->GetExtractFlag() )
@@ -754,78 +1222,168 @@ VError VArchiveUnStream::_ExtractFile( VArchiveCatalog *inCatalog, const VFileDe
 	return result;
 }
 
-VError VArchiveUnStream::ProceedFile()
+VError VArchiveUnStream::_ExtractEntry( VArchiveCatalog *inCatalog, char* buffToUse, VSize buffSize, uLONG8 &ioPartialByteCount )
 {
 	VError result = VE_OK;
-	bool userAbort = false;
-	uLONG8 partialByteCount = 0;
-
-	if ( fCallBack )
-		fCallBack(CB_OpenProgress,partialByteCount,fTotalByteCount,userAbort);
-
 	VFileDesc *fileDesc = NULL;
-	VSize bufferSize = 1024*1024;
-	char *buffer = new char[bufferSize];
-	for ( uLONG i = 0; i < fFileCatalog.size() && result == VE_OK; i++ )
+
+	if ( fStream->GetLong() == 'Fdat' )
 	{
-		fileDesc = NULL;
-		if ( fStream->GetLong() == 'Fdat' )
+		if ( inCatalog->GetExtractFlag() )
 		{
-			if ( fFileCatalog[i]->GetExtractFlag() )
+			VFolder *parentFolder = inCatalog->GetFile()->RetainParentFolder();
+			if ( parentFolder )
 			{
-				VFolder *parentFolder = fFileCatalog[i]->GetFile()->RetainParentFolder();
-				if ( parentFolder )
-				{
-					result = parentFolder->CreateRecursive();
-					parentFolder->Release();
-				}
-				if ( result == VE_OK )
-				{
-					result = fFileCatalog[i]->GetFile()->Open( FA_SHARED, &fileDesc, FO_CreateIfNotFound);
-#if VERSIONMAC
-					fFileCatalog[i]->GetFile()->MAC_SetKind(fFileCatalog[i]->GetKind());
-					fFileCatalog[i]->GetFile()->MAC_SetCreator(fFileCatalog[i]->GetCreator());
-#endif
-				}
+				result = parentFolder->CreateRecursive();
+				parentFolder->Release();
 			}
 			if ( result == VE_OK )
 			{
-				result = _ExtractFile( fFileCatalog[i], fileDesc, buffer, bufferSize, partialByteCount );
-				delete fileDesc;
+				result = inCatalog->GetFile()->Open( FA_SHARED, &fileDesc, FO_CreateIfNotFound);
+#if VERSIONMAC
+				inCatalog->GetFile()->MAC_SetKind(inCatalog->GetKind());
+				inCatalog->GetFile()->MAC_SetCreator(inCatalog->GetCreator());
+#endif
 			}
-			if ( result == VE_OK )
+		}
+		if ( result == VE_OK )
+		{
+			result = _ExtractFile( inCatalog, fileDesc, buffToUse, buffSize, ioPartialByteCount );
+			delete fileDesc;
+		}
+		if ( result == VE_OK )
+		{
+			fileDesc = NULL;
+			if ( fStream->GetLong() == 'Frez' )
 			{
-				fileDesc = NULL;
-				if ( fStream->GetLong() == 'Frez' )
+				if ( inCatalog->GetExtractFlag() )
 				{
-					if ( fFileCatalog[i]->GetExtractFlag() )
-					{
-						#if VERSIONMAC
-						result = fFileCatalog[i]->GetFile()->Open( FA_SHARED, &fileDesc, FO_OpenResourceFork);
-						#endif
-					}
-					if ( result == VE_OK )
-					{
-						result = _ExtractFile( fFileCatalog[i], fileDesc, buffer, bufferSize, partialByteCount );
-						delete fileDesc;
-					}
+					#if VERSIONMAC
+					result = inCatalog->GetFile()->Open( FA_SHARED, &fileDesc, FO_OpenResourceFork);
+					#endif
 				}
-				else
+				if ( result == VE_OK )
 				{
-					result = VE_STREAM_BAD_SIGNATURE;
+					result = _ExtractFile( inCatalog, fileDesc, buffToUse, buffSize, ioPartialByteCount );
+					delete fileDesc;
 				}
 			}
+			else
+			{
+				result = VE_STREAM_BAD_SIGNATURE;
+			}
+		}
+	}
+	else
+	{
+		result = VE_STREAM_BAD_SIGNATURE;
+	}
+	return result;
+}
+
+VError VArchiveUnStream::ProceedFile()
+{
+	VError result = VE_OK;
+	bool userAbort = false;
+	uLONG8 partialByteCount = 0;
+
+	if ( fCallBack )
+		fCallBack(CB_OpenProgress,partialByteCount,fTotalByteCount,userAbort);
+
+	VSize bufferSize = kARCHIVE_CHUNK_SIZE;
+	char *buffer = new char[bufferSize];
+	for ( uLONG i = 0; i < fFileCatalog.size() && result == VE_OK; i++ )
+	{
+		result = _ExtractEntry( fFileCatalog[i], buffer, bufferSize, partialByteCount );
+	}
+	delete[] buffer;
+
+	if ( fCallBack )
+		fCallBack(CB_CloseProgress,partialByteCount,fTotalByteCount,userAbort);
+
+	return result;
+}
+
+VError VArchiveUnStream::_ReadIndex()
+{
+	if ( !fEntryOffsets.empty() || fFileCatalog.empty() )
+		return VE_OK;
+
+	/* trailer: offset of the index (8 bytes) 'FPIX' */
+	VError result = fStream->SetPos( fStream->GetSize() - 12 );
+	if ( result == VE_OK )
+	{
+		sLONG8 indexOffset = fStream->GetLong8();
+		if ( fStream->GetLong() != 'FPIX' || indexOffset < fDataStart - fArchiveStart )
+			result = VE_STREAM_BAD_SIGNATURE;
+		else
+			result = fStream->SetPos( fArchiveStart + indexOffset );
+	}
+
+	if ( result == VE_OK )
+	{
+		if ( fStream->GetLong() == 'INDX' && fStream->GetLong8() == (sLONG8) fFileCatalog.size() )
+		{
+			fEntryOffsets.resize( fFileCatalog.size() );
+			for ( size_t i = 0; i < fEntryOffsets.size(); i++ )
+				fEntryOffsets[i] = fStream->GetLong8();
+			result = fStream->GetLastError();
+			if ( result != VE_OK )
+				fEntryOffsets.clear();
 		}
 		else
 		{
 			result = VE_STREAM_BAD_SIGNATURE;
 		}
 	}
-	delete[] buffer;
+	return result;
+}
 
-	if ( fCallBack )
-		fCallBack(CB_CloseProgress,partialByteCount,fTotalByteCount,userAbort);
+VError VArchiveUnStream::ExtractFile( sLONG inIndex )
+{
+	if ( inIndex < 0 || inIndex >= (sLONG) fFileCatalog.size() )
+		return VE_INVALID_PARAMETER;
+
+	VError result = VE_OK;
+	bool userAbort = false;
+	uLONG8 partialByteCount = 0;
+	VArchiveCatalog *catalog = fFileCatalog[inIndex];
 
+	if ( fVersion >= 5 )
+	{
+		result = _ReadIndex();
+		if ( result == VE_OK )
+			result = fStream->SetPos( fArchiveStart + fEntryOffsets[inIndex] );
+	}
+	else
+	{
+		/* older archives have no index: skip the files before */
+		result = fStream->SetPos( fDataStart );
+		for ( sLONG i = 0; i < inIndex && result == VE_OK; i++ )
+		{
+			for ( sLONG fork = 0; fork < 2 && result == VE_OK; fork++ )
+			{
+				if ( fStream->GetLong() == ((fork == 0) ? 'Fdat' : 'Frez') )
+					result = fStream->SetPosByOffset( fStream->GetLong8() );
+				else
+					result = VE_STREAM_BAD_SIGNATURE;
+			}
+		}
+	}
+
+	if ( result == VE_OK )
+	{
+		if ( fCallBack )
+			fCallBack(CB_OpenProgress,partialByteCount,catalog->GetFileSize( fst_Both ),userAbort);
+
+		VSize bufferSize = kARCHIVE_CHUNK_SIZE;
+		char *buffer = new char[bufferSize];
+		result = _ExtractEntry( catalog, buffer, bufferSize, partialByteCount );
+		delete[] buffer;
+
+		if ( fCallBack )
+			fCallBack(CB_CloseProgress,partialByteCount,catalog->GetFileSize( fst_Both ),userAbort);
+	}
 	return result;
 }
 
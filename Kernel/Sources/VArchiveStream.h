@@ -37,6 +37,13 @@ typedef enum eFileSizeType
 	fst_Both = fst_Data | fst_Resource
 } eFileSizeType;
 
+typedef enum EArchiveCompression
+{
+	eArchiveStore = 0,		/* chunks are stored as is */
+	eArchiveDeflate = 1,	/* zlib, needs WITH_ZLIB */
+	eArchiveZstd = 2		/* zstandard, needs WITH_ZSTD */
+} EArchiveCompression;
+
 class XTOOLBOX_API VArchiveCatalog : public VObject
 {
 public:
@@ -93,6 +100,15 @@ public:
 			void	SetStreamer( VStream* inStream );
 			void	SetProgressCallBack( CB_VArchiveStream inProgressCallBack );
 
+			/*
+				Writes a version 5 archive (not readable by older versions): files are cut in chunks of 1Mb,
+				each chunk is compressed by a VExecutor worker while the calling task reads the next ones and writes
+				the compressed chunks in order. An index at the end lets VArchiveUnStream::ExtractFile() go straight to a file.
+				inLevel 0 means the default level of the method (1 fastest .. 9 for deflate, .. 19 for zstd).
+				Returns VE_UNIMPLEMENTED if the method is not built in.
+			*/
+			VError	SetCompression( EArchiveCompression inCompression, sLONG inLevel = 0 );
+
 	virtual	VError	Proceed();
 
 protected:
@@ -100,6 +116,7 @@ protected:
 	VError			_AddOneFolder(VFolder& inFolder,const VString& inExtraInfo);
 	virtual VError	_WriteCatalog( const VFile* inFile, const VString &inExtraInfo, uLONG8 &ioTotalByteCount );
 	virtual VError	_WriteFile( const VFileDesc* inFileDesc, char* buffToUse, VSize buffSize, uLONG8 &ioPartialByteCount, uLONG8 inTotalByteCount );
+	virtual VError	_WriteChunkedFiles( sLONG8 inArchiveStart, uLONG8 &ioPartialByteCount, uLONG8 inTotalByteCount );
 
 	VFile				*fDestinationFile;	/* file archive */
 	VFilePath			fRelativeFolder;	/* file path stored in the archive is relative to this folder */
@@ -118,6 +135,10 @@ protected:
 
 	VStream				*fStream;			/* streaming used for pushing data */
 	CB_VArchiveStream	fCallBack;			/* compression progress call back */
+
+	uBYTE				fVersion;			/* 4, or 5 with SetCompression() */
+	EArchiveCompression	fCompression;
+	sLONG				fCompressionLevel;
 };
 
 class XTOOLBOX_API VArchiveUnStream : public VObject
@@ -137,11 +158,20 @@ public:
 	virtual	VError			ProceedCatalog();
 	virtual	VError			ProceedFile();
 
+	/*
+		Extracts the catalog entry inIndex (0 based) without reading the other files.
+		Call it after ProceedCatalog(), the stream must be able to set its position (VFileStream).
+		Version 5 archives are read from their index, older ones by skipping the files before.
+	*/
+	virtual	VError			ExtractFile( sLONG inIndex );
+
 	virtual	ArchiveCatalog*	GetCatalog();
 
 protected:
 
 	virtual	VError			_ExtractFile( VArchiveCatalog *inCatalog, const VFileDesc* inFileDesc, char* buffToUse, VSize buffSize, uLONG8 &ioPartialByteCount );
+	virtual	VError			_ExtractEntry( VArchiveCatalog *inCatalog, char* buffToUse, VSize buffSize, uLONG8 &ioPartialByteCount );
+			VError			_ReadIndex();
 	#if VERSIONMAC
 	static bool				_IsExecutable(char* buffToUse, VSize buffSize);
 	#endif
@@ -155,7 +185,11 @@ protected:
 	VStream				*fStream;
 	CB_VArchiveStream	fCallBack;			/* compression progress call back */
 
-
+	uBYTE				fVersion;
+	sLONG8				fArchiveStart;		/* stream position of the signature */
+	sLONG8				fDataStart;			/* stream position of the first file data */
+	std::vector<sLONG8>	fEntryOffsets;		/* version 5 index, relative to fArchiveStart */
+	char				*fChunkBuffer;		/* compressed chunk */
 };
 END_TOOLBOX_NAMESPACE
 
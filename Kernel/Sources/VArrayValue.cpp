@@ -19,10 +19,28 @@
 #include "VStream.h"
 #include "VFloat.h"
 #include "VTime.h"
+#include "VParallel.h"
+#include "VIntlMgr.h"
+#include "VCollator.h"
 
 
 // Class constants
 const uWORD		kArrayAtomSize = 64;
+const sLONG		kParallelSortMinCount = 2 * VParallel::kMIN_SORT_RUN_SIZE;
+
+
+template <class Type> static void _SortValues (Type* inBase, sLONG inNb, Boolean inDescending)
+{
+	if (inNb >= kParallelSortMinCount)
+	{
+		if (inDescending)
+			VParallel::Sort(inBase, inNb, std::greater<Type>());
+		else
+			VParallel::Sort(inBase, inNb, std::less<Type>());
+	}
+	else
+		QSort<Type>(inBase, inNb, inDescending);
+}
 
 
 const VArrayBoolean::InfoType	VArrayBoolean::sInfo;
@@ -207,7 +225,7 @@ void VArrayValue::Sort(sLONG inFrom, sLONG inTo, Boolean inDescending)
 	ar[0] = this;
 	ar[1] = 0;
 
-	ISortable::MultiCriteriaQSort(ar, &inDescending, 1, inFrom, inTo);
+	ISortable::MultiCriteriaParallelSort(ar, &inDescending, 1, inFrom, inTo);
 }
 
 
@@ -233,7 +251,7 @@ void VArrayValue::SynchronizedSort(Boolean inDescending, VArrayValue* inArray, .
 	va_end(marker);				/* Reset variable arguments. */
 
 	if (i > 0)
-		ISortable::MultiCriteriaQSort(ar, invert, 1, 0, inArray->GetCount() - 1);
+		ISortable::MultiCriteriaParallelSort(ar, invert, 1, 0, inArray->GetCount() - 1);
 }
 
 
@@ -387,6 +405,14 @@ void VArrayValue::UnlockData() const
 }
 
 
+Boolean VArrayValue::CanCompareConcurrently() const
+{
+	// strings are compared with the collator of the current task
+	ValueKind kind = GetElemValueKind();
+	return (kind != VK_STRING) && (kind != VK_IMAGE);
+}
+
+
 sLONG VArrayValue::GetDataSize() const
 {
 	return fDataSize;
@@ -1879,7 +1905,7 @@ void VArrayLong::Sort(sLONG inFrom, sLONG inTo, Boolean inDescending)
 	inFrom--;
 
 	sLONG* data = (sLONG*) LockAndGetData();
-	QSort<sLONG>(data + inFrom, inTo - inFrom, inDescending);
+	_SortValues<sLONG>(data + inFrom, inTo - inFrom, inDescending);
 	UnlockData();
 }
 
@@ -2206,7 +2232,7 @@ void VArrayLong8::Sort(sLONG inFrom, sLONG inTo, Boolean inDescending)
 	inFrom--;
 
 	sLONG8* data = (sLONG8*) LockAndGetData();
-	QSort<sLONG8>(data + inFrom, inTo - inFrom, inDescending);
+	_SortValues<sLONG8>(data + inFrom, inTo - inFrom, inDescending);
 	UnlockData();
 }
 
@@ -2592,7 +2618,7 @@ void VArrayReal::Sort(sLONG inFrom, sLONG inTo, Boolean inDescending)
 	inFrom--;
 
 	Real* data = (Real*) LockAndGetData();
-	QSort<Real>(data + inFrom, inTo - inFrom, inDescending);
+	_SortValues<Real>(data + inFrom, inTo - inFrom, inDescending);
 	UnlockData();
 }
 
@@ -3344,6 +3370,23 @@ CompareResult VArrayString::CompareElements(uBYTE* inData, sLONG inA, sLONG inB)
 }
 
 
+void VArrayString::Sort(sLONG inFrom, sLONG inTo, Boolean inDescending)
+{
+	if (inFrom <= 0 || inTo <= inFrom || inTo > fCount)
+	{
+		DebugMsg("Bad parameters for sorting");
+		return;
+	}
+
+	// each string goes once through the collator instead of once per comparison
+	VCollator* collator = VIntlMgr::GetDefaultMgr()->GetCollator();
+
+	VString** data = (VString**) LockAndGetData();
+	collator->SortStrings(data + inFrom - 1, inTo - inFrom + 1, true, inDescending != 0);
+	UnlockData();
+}
+
+
 sLONG VArrayString::QuickFind(const VString& inValue) const
 {
 	sLONG low, high, test, result;
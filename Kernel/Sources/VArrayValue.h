@@ -79,6 +79,7 @@ protected:
 	// Data accessing support
 	uBYTE*	LockAndGetData () const;
 	void	UnlockData () const;
+	virtual Boolean	CanCompareConcurrently () const;
 	
 	// Items management support
 	virtual void	MoveElements (sLONG inFrom, sLONG inTo, sLONG inCount);
@@ -518,6 +519,9 @@ public:
 
 	virtual CompareResult	CompareTo (const VValueSingle& inValue, Boolean inDiacritic, sLONG inElement) const;
 
+	// sorts on the sort keys of the current task collator
+	virtual void	Sort (sLONG inFrom, sLONG inToBoolean, Boolean inDescending = false);
+
 	virtual VError	ReadFromStream (VStream* inStream, sLONG inParam = 0);
 	virtual VError	WriteToStream (VStream* inStream, sLONG inParam = 0) const;
 	
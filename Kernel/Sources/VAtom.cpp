@@ -0,0 +1,224 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VAtom.h"
+#include "VTextConverter.h"
+#include "VSyncObject.h"
+
+
+// Class constants
+const sLONG		kSHARD_COUNT				= 32;		// power of 2
+const size_t	kMAX_UTF8_LENGTH			= 255;		// StPackedDictionaryKey limit
+
+
+// Class statics
+const VString	VAtom::sEmptyString;
+
+
+BEGIN_TOOLBOX_NAMESPACE
+
+/*
+	The table is cut into shards with their own lock so that threads interning different strings rarely wait for each other.
+	Each shard is a chained hash table indexed by the string hash value.
+*/
+class VAtomTable
+{
+public:
+									VAtomTable():fCount( 0)					{;}
+
+			const VAtomEntry*		Get( const VString& inString, bool inCreate);
+
+			sLONG					GetCount() const						{ return fCount;}
+
+	// the table is never deleted since atoms must stay valid until the process exits
+	static	VAtomTable*				GetTable( bool inCreate);
+
+private:
+	class Shard
+	{
+	public:
+									Shard():fCount( 0)						{;}
+
+			VCriticalSection		fLock;
+			std::vector<VAtomEntry*>	fBuckets;
+			size_t					fCount;
+	};
+
+	static	bool					_Equal( const VAtomEntry *inEntry, const VString& inString, uLONG inHashValue)
+									{
+										return (inEntry->fHashValue == inHashValue)
+											&& (inEntry->fString.GetLength() == inString.GetLength())
+											&& (::memcmp( inEntry->fString.GetCPointer(), inString.GetCPointer(), inString.GetLength() * sizeof( UniChar)) == 0);
+									}
+
+	static	void					_Rehash( Shard& ioShard);
+
+			Shard					fShards[kSHARD_COUNT];
+			sLONG					fCount;
+
+	static	VAtomTable*				sTable;
+	static	SpinLockType			sTableLock;
+};
+
+END_TOOLBOX_NAMESPACE
+
+
+VAtomTable*		VAtomTable::sTable = NULL;
+SpinLockType	VAtomTable::sTableLock = 0;
+
+
+//================================================================================================================
+
+
+VAtomEntry::VAtomEntry( const VString& inString, uLONG inHashValue)
+: fString( inString.GetCPointer(), inString.GetLength() * sizeof( UniChar), VTC_UTF_16)	// own buffer, never shared with the caller
+, fHashValue( inHashValue)
+, fUTF8( NULL)
+, fUTF8Length( 0)
+, fNext( NULL)
+{
+	char buffer[kMAX_UTF8_LENGTH];
+	VFromUnicodeConverter_UTF8 converter;
+	VIndex charsConsumed;
+	VSize bytesProduced;
+	if (converter.Convert( fString.GetCPointer(), fString.GetLength(), &charsConsumed, buffer, sizeof( buffer), &bytesProduced) && (charsConsumed == fString.GetLength()))
+	{
+		fUTF8 = new char[bytesProduced + 1];
+		if (fUTF8 != NULL)
+		{
+			::memcpy( fUTF8, buffer, bytesProduced);
+			fUTF8[bytesProduced] = 0;
+			fUTF8Length = bytesProduced;
+		}
+	}
+}
+
+
+//================================================================================================================
+
+
+const VAtomEntry *VAtomTable::Get( const VString& inString, bool inCreate)
+{
+	uLONG hashValue = inString.GetHashValue();
+	Shard& shard = fShards[hashValue & (kSHARD_COUNT - 1)];
+	uLONG bucketHash = hashValue / kSHARD_COUNT;
+
+	VAtomEntry *entry = NULL;
+
+	shard.fLock.Lock();
+
+	if (!shard.fBuckets.empty())
+	{
+		entry = shard.fBuckets[bucketHash % shard.fBuckets.size()];
+		while( (entry != NULL) && !_Equal( entry, inString, hashValue))
+			entry = entry->fNext;
+	}
+
+	if ( (entry == NULL) && inCreate)
+	{
+		entry = new VAtomEntry( inString, hashValue);
+		if (entry != NULL)
+		{
+			if (shard.fCount >= shard.fBuckets.size())
+				_Rehash( shard);
+
+			VAtomEntry*& bucket = shard.fBuckets[bucketHash % shard.fBuckets.size()];
+			entry->fNext = bucket;
+			bucket = entry;
+			++shard.fCount;
+			VInterlocked::Increment( &fCount);
+		}
+	}
+
+	shard.fLock.Unlock();
+
+	return entry;
+}
+
+
+void VAtomTable::_Rehash( Shard& ioShard)
+{
+	std::vector<VAtomEntry*> buckets( Max( ioShard.fBuckets.size() * 2, (size_t) 64), NULL);
+
+	for( std::vector<VAtomEntry*>::iterator i = ioShard.fBuckets.begin() ; i != ioShard.fBuckets.end() ; ++i)
+	{
+		VAtomEntry *entry = *i;
+		while( entry != NULL)
+		{
+			VAtomEntry *next = entry->fNext;
+			VAtomEntry*& bucket = buckets[(entry->fHashValue / kSHARD_COUNT) % buckets.size()];
+			entry->fNext = bucket;
+			bucket = entry;
+			entry = next;
+		}
+	}
+
+	ioShard.fBuckets.swap( buckets);
+}
+
+
+VAtomTable *VAtomTable::GetTable( bool inCreate)
+{
+	VAtomTable *table = (VAtomTable*) VInterlocked::CompareExchangePtr( (void**) &sTable, NULL, NULL);
+	if ( (table == NULL) && inCreate)
+	{
+		SpinLockThread( sTableLock);
+		table = sTable;
+		if (table == NULL)
+		{
+			table = new VAtomTable;
+			VInterlocked::ExchangePtr( &sTable, table);
+		}
+		SpinUnlock( sTableLock);
+	}
+	return table;
+}
+
+
+//================================================================================================================
+
+
+VAtom::VAtom( const VString& inString)
+: fEntry( NULL)
+{
+	VAtomTable *table = VAtomTable::GetTable( true);
+	if (table != NULL)
+		fEntry = table->Get( inString, true);
+}
+
+
+VAtom::VAtom( const char *inASCIIString)
+: fEntry( NULL)
+{
+	VAtomTable *table = VAtomTable::GetTable( true);
+	if (table != NULL)
+		fEntry = table->Get( VString( inASCIIString), true);
+}
+
+
+VAtom VAtom::Find( const VString& inString)
+{
+	VAtomTable *table = VAtomTable::GetTable( false);
+	return VAtom( (table != NULL) ? table->Get( inString, false) : NULL);
+}
+
+
+sLONG VAtom::GetCount()
+{
+	VAtomTable *table = VAtomTable::GetTable( false);
+	return (table != NULL) ? table->GetCount() : 0;
+}
+
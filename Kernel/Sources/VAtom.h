@@ -0,0 +1,103 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VAtom__
+#define __VAtom__
+
+#include "Kernel/Sources/VString.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+// Defined bellow
+class VAtom;
+
+
+/*!
+	@class	VAtomEntry
+	@abstract	Immutable entry of the atom table (private to VAtom), never deleted.
+*/
+class XTOOLBOX_API VAtomEntry
+{
+private:
+	friend class VAtom;
+	friend class VAtomTable;
+
+									VAtomEntry( const VString& inString, uLONG inHashValue);
+
+			VString					fString;
+			uLONG					fHashValue;		// VString::GetHashValue()
+			char*					fUTF8;			// NULL if longer than 255 bytes
+			size_t					fUTF8Length;
+			VAtomEntry*				fNext;			// in hash bucket
+};
+
+
+/*!
+	@class	VAtom
+	@abstract	Handle on an interned string.
+	@discussion
+		The process wide atom table gives the same handle for equal strings (case sensitive)
+		so that atoms are compared with a pointer compare and their hash value is computed once.
+		VAtom is as cheap to copy as a pointer.
+
+		The VString of an atom never changes and copies of it share the atom buffer
+		so that a key repeated in millions of objects is allocated once.
+		A VAtom can be used as a VValueBag key: its utf-8 form is computed once (see StPackedDictionaryKey).
+
+		Atoms are never freed: a VAtom stays valid for the process lifetime (static atoms included).
+		Create atoms for keys coming from a bounded set (bag keys, header names, known property names).
+
+		static const VAtom sNameKey( "name");
+		bag->GetString( sNameKey, name);
+*/
+class XTOOLBOX_API VAtom
+{
+public:
+									VAtom():fEntry( NULL)								{;}
+	explicit						VAtom( const VString& inString);
+	explicit						VAtom( const char *inASCIIString);
+
+			bool					IsNull() const										{ return fEntry == NULL;}
+
+			const VString&			GetString() const									{ return (fEntry != NULL) ? fEntry->fString : sEmptyString;}
+			uLONG					GetHashValue() const								{ return (fEntry != NULL) ? fEntry->fHashValue : 0;}
+
+			// utf-8 form for StPackedDictionaryKey (NULL if longer than 255 bytes)
+			const char*				GetUTF8() const										{ return (fEntry != NULL) ? fEntry->fUTF8 : NULL;}
+			size_t					GetUTF8Length() const								{ return (fEntry != NULL) ? fEntry->fUTF8Length : 0;}
+
+			bool					operator==( const VAtom& inOther) const				{ return fEntry == inOther.fEntry;}
+			bool					operator!=( const VAtom& inOther) const				{ return fEntry != inOther.fEntry;}
+
+			// arbitrary order for use in std::map or std::set (not alphabetical)
+			bool					operator<( const VAtom& inOther) const				{ return fEntry < inOther.fEntry;}
+
+			// returns the atom of inString if it has already been interned or a null atom.
+	static	VAtom					Find( const VString& inString);
+
+	static	sLONG					GetCount();
+
+private:
+	explicit						VAtom( const VAtomEntry *inEntry):fEntry( inEntry)	{;}
+
+			const VAtomEntry*		fEntry;
+
+	static	const VString			sEmptyString;
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
@@ -0,0 +1,1093 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VBinaryLog.h"
+#include "VFile.h"
+#include "VFileStream.h"
+#include "VValueBag.h"
+#include "VValueSingle.h"
+#include "ILogger.h"
+#include "VLogger.h"
+#include "VProcess.h"
+#include "VStringBuilder.h"
+#include "VTask.h"
+
+
+/*
+	File layout
+
+	header		'XBLG', version (4 bytes), reserved (8 bytes)
+	blocks		block header (kBLOCK_HEADER_SIZE bytes) followed by its records
+	index		written by Close(): one entry per block, then the trailer ('XBLT', count, index offset)
+
+	block header	'XBLB', records size, records count, levels bit field, first time, last time, components bloom mask,
+					base time (the records times are relative to the first record one)
+
+	record		varint		time - block base time (zigzag)
+				byte		level
+				varint		task id (zigzag)
+				varint		error code (zigzag)
+				4 bytes		component signature
+				string		source
+				string		message
+				varint		fields count
+				fields		key, type byte, value
+
+	key			varint n: 0 means a new key follows as a string and gets the next number, else it's key number n - 1
+	string		varint length + utf-8 bytes
+*/
+
+// Class constants
+const uLONG	kFILE_MAGIC = 'XBLG';
+const uLONG	kBLOCK_MAGIC = 'XBLB';
+const uLONG	kINDEX_MAGIC = 'XBLI';
+const uLONG	kTRAILER_MAGIC = 'XBLT';
+const uLONG	kFORMAT_VERSION = 1;
+
+const VSize	kFILE_HEADER_SIZE = 16;
+const VSize	kBLOCK_HEADER_SIZE = 48;
+const VSize	kINDEX_ENTRY_SIZE = 40;
+const VSize	kTRAILER_SIZE = 16;
+const VSize	kBLOCK_MAX_RECORDS_SIZE = 65536;	// a block is written once it holds that many bytes of records
+
+// field types
+const uBYTE	kFIELD_LONG = 0;
+const uBYTE	kFIELD_LONG8 = 1;
+const uBYTE	kFIELD_BOOL = 2;
+const uBYTE	kFIELD_REAL = 3;
+const uBYTE	kFIELD_STRING = 4;	// other kinds are recorded as strings
+
+
+static inline void _PutLE32( char *outData, uLONG inValue)
+{
+	uBYTE *p = (uBYTE*) outData;
+	p[0] = (uBYTE) inValue;
+	p[1] = (uBYTE) (inValue >> 8);
+	p[2] = (uBYTE) (inValue >> 16);
+	p[3] = (uBYTE) (inValue >> 24);
+}
+
+
+static inline void _PutLE64( char *outData, uLONG8 inValue)
+{
+	_PutLE32( outData, (uLONG) inValue);
+	_PutLE32( outData + 4, (uLONG) (inValue >> 32));
+}
+
+
+static inline uLONG _GetLE32( const char *inData)
+{
+	const uBYTE *p = (const uBYTE*) inData;
+	return (uLONG) p[0] | ((uLONG) p[1] << 8) | ((uLONG) p[2] << 16) | ((uLONG) p[3] << 24);
+}
+
+
+static inline uLONG8 _GetLE64( const char *inData)
+{
+	return (uLONG8) _GetLE32( inData) | ((uLONG8) _GetLE32( inData + 4) << 32);
+}
+
+
+static inline uLONG8 _ZigZag( sLONG8 inValue)
+{
+	return ((uLONG8) inValue << 1) ^ (uLONG8) (inValue >> 63);
+}
+
+
+static inline sLONG8 _UnZigZag( uLONG8 inValue)
+{
+	return (sLONG8) (inValue >> 1) ^ -(sLONG8) (inValue & 1);
+}
+
+
+// attributes with a fixed place in the record
+static bool _IsRecordKey( const VString& inName)
+{
+	return inName.EqualToUSASCIICString( "message")
+		|| inName.EqualToUSASCIICString( "level")
+		|| inName.EqualToUSASCIICString( "source")
+		|| inName.EqualToUSASCIICString( "component_signature")
+		|| inName.EqualToUSASCIICString( "error_code")
+		|| inName.EqualToUSASCIICString( "task_id");
+}
+
+
+//================================================================================================================
+
+
+VBinaryLogWriter::VBinaryLogWriter()
+: fFileDesc( NULL)
+, fEnd( 0)
+{
+	::memset( &fBlockInfo, 0, sizeof( fBlockInfo));
+}
+
+
+VBinaryLogWriter::~VBinaryLogWriter()
+{
+	Close();
+}
+
+
+VError VBinaryLogWriter::Open( const VFile& inFile, bool inCreateEmptyFile)
+{
+	VTaskLock lock( &fMutex);
+
+	if (fFileDesc != NULL)
+		return VE_OK;
+
+	FileOpenOptions options = FO_CreateIfNotFound;
+	if (inCreateEmptyFile)
+		options |= FO_Overwrite;
+
+	VError err = inFile.Open( FA_READ_WRITE, &fFileDesc, options);
+	if (err == VE_OK)
+	{
+		fBlocks.clear();
+		fBlockKeys.clear();
+		::memset( &fBlockInfo, 0, sizeof( fBlockInfo));
+		fBlock.Fill( 0, 0, kBLOCK_HEADER_SIZE);
+		fBlock.ShrinkSizeNoReallocate( kBLOCK_HEADER_SIZE);
+
+		if (fFileDesc->GetSize() < (sLONG8) kFILE_HEADER_SIZE)
+		{
+			char header[kFILE_HEADER_SIZE];
+			::memset( header, 0, sizeof( header));
+			_PutLE32( header, kFILE_MAGIC);
+			_PutLE32( header + 4, kFORMAT_VERSION);
+			err = fFileDesc->PutData( header, sizeof( header), 0);
+			fEnd = kFILE_HEADER_SIZE;
+			if (err == VE_OK)
+				err = fFileDesc->SetSize( fEnd);
+		}
+		else
+		{
+			err = _Recover();
+		}
+
+		if (err != VE_OK)
+		{
+			delete fFileDesc;
+			fFileDesc = NULL;
+		}
+	}
+	return err;
+}
+
+
+VError VBinaryLogWriter::_Recover()
+{
+	char header[kFILE_HEADER_SIZE];
+	VError err = fFileDesc->GetData( header, sizeof( header), 0);
+	if (err != VE_OK)
+		return err;
+
+	if ( (_GetLE32( header) != kFILE_MAGIC) || (_GetLE32( header + 4) > kFORMAT_VERSION) )
+	{
+		StThrowFileError errThrow( fFileDesc->GetParentVFile(), VE_STREAM_BAD_VERSION);
+		return errThrow.GetError();
+	}
+
+	sLONG8 fileSize = fFileDesc->GetSize();
+
+	// an index means the file has been closed: the new blocks replace it
+	char trailer[kTRAILER_SIZE];
+	if ( (fileSize >= (sLONG8) (kFILE_HEADER_SIZE + kTRAILER_SIZE))
+		&& (fFileDesc->GetData( trailer, sizeof( trailer), fileSize - kTRAILER_SIZE) == VE_OK)
+		&& (_GetLE32( trailer) == kTRAILER_MAGIC) )
+	{
+		uLONG count = _GetLE32( trailer + 4);
+		sLONG8 indexOffset = (sLONG8) _GetLE64( trailer + 8);
+		if ( (indexOffset >= (sLONG8) kFILE_HEADER_SIZE) && (indexOffset < fileSize)
+			&& (indexOffset + 4 + (sLONG8) (count * kINDEX_ENTRY_SIZE) + (sLONG8) kTRAILER_SIZE == fileSize) )
+		{
+			VMemoryBuffer<> index;
+			if (index.SetSize( 4 + count * kINDEX_ENTRY_SIZE) && (fFileDesc->GetData( index.GetDataPtr(), index.GetDataSize(), indexOffset) == VE_OK))
+			{
+				const char *p = (const char*) index.GetDataPtr() + 4;
+				for( uLONG i = 0 ; i < count ; ++i, p += kINDEX_ENTRY_SIZE)
+				{
+					BlockInfo info;
+					info.fOffset = (sLONG8) _GetLE64( p);
+					info.fFirstTime = (sLONG8) _GetLE64( p + 8);
+					info.fLastTime = (sLONG8) _GetLE64( p + 16);
+					info.fLevels = _GetLE32( p + 24);
+					info.fCount = _GetLE32( p + 28);
+					info.fComponents = _GetLE64( p + 32);
+					fBlocks.push_back( info);
+				}
+				fEnd = indexOffset;
+				return fFileDesc->SetSize( fEnd);
+			}
+		}
+	}
+
+	// no index: walk through the block headers, a partly written block is dropped
+	sLONG8 pos = kFILE_HEADER_SIZE;
+	char blockHeader[kBLOCK_HEADER_SIZE];
+	while( (pos + (sLONG8) kBLOCK_HEADER_SIZE <= fileSize) && (fFileDesc->GetData( blockHeader, sizeof( blockHeader), pos) == VE_OK) )
+	{
+		sLONG8 end = pos + kBLOCK_HEADER_SIZE + _GetLE32( blockHeader + 4);
+		if ( (_GetLE32( blockHeader) != kBLOCK_MAGIC) || (end > fileSize) )
+			break;
+
+		BlockInfo info;
+		info.fOffset = pos;
+		info.fCount = _GetLE32( blockHeader + 8);
+		info.fLevels = _GetLE32( blockHeader + 12);
+		info.fFirstTime = (sLONG8) _GetLE64( blockHeader + 16);
+		info.fLastTime = (sLONG8) _GetLE64( blockHeader + 24);
+		info.fComponents = _GetLE64( blockHeader + 32);
+		fBlocks.push_back( info);
+		pos = end;
+	}
+	fEnd = pos;
+
+	return fFileDesc->SetSize( fEnd);
+}
+
+
+VError VBinaryLogWriter::Close()
+{
+	VTaskLock lock( &fMutex);
+
+	if (fFileDesc == NULL)
+		return VE_OK;
+
+	VError err = _WriteBlock();
+
+	if (err == VE_OK)
+	{
+		VMemoryBuffer<> index;
+		VSize size = 4 + fBlocks.size() * kINDEX_ENTRY_SIZE + kTRAILER_SIZE;
+		if (index.SetSize( size))
+		{
+			char *p = (char*) index.GetDataPtr();
+			_PutLE32( p, kINDEX_MAGIC);
+			p += 4;
+			for( std::vector<BlockInfo>::const_iterator i = fBlocks.begin() ; i != fBlocks.end() ; ++i, p += kINDEX_ENTRY_SIZE)
+			{
+				_PutLE64( p, (uLONG8) i->fOffset);
+				_PutLE64( p + 8, (uLONG8) i->fFirstTime);
+				_PutLE64( p + 16, (uLONG8) i->fLastTime);
+				_PutLE32( p + 24, i->fLevels);
+				_PutLE32( p + 28, i->fCount);
+				_PutLE64( p + 32, i->fComponents);
+			}
+			_PutLE32( p, kTRAILER_MAGIC);
+			_PutLE32( p + 4, (uLONG) fBlocks.size());
+			_PutLE64( p + 8, (uLONG8) fEnd);
+
+			// fEnd doesn't move: appending records later overwrites the index
+			err = fFileDesc->PutData( index.GetDataPtr(), size, fEnd);
+			if (err == VE_OK)
+				err = fFileDesc->SetSize( fEnd + size);
+		}
+		else
+		{
+			err = vThrowError( VE_MEMORY_FULL);
+		}
+	}
+
+	if (err == VE_OK)
+		err = fFileDesc->Flush();
+
+	delete fFileDesc;
+	fFileDesc = NULL;
+	fBlocks.clear();
+
+	return err;
+}
+
+
+VError VBinaryLogWriter::Flush()
+{
+	VTaskLock lock( &fMutex);
+
+	VError err = _WriteBlock();
+	if ( (err == VE_OK) && (fFileDesc != NULL) )
+		err = fFileDesc->Flush();
+	return err;
+}
+
+
+sLONG8 VBinaryLogWriter::GetSize() const
+{
+	VTaskLock lock( &fMutex);
+	return (fBlockInfo.fCount > 0) ? fEnd + (sLONG8) fBlock.GetDataSize() : fEnd;
+}
+
+
+VError VBinaryLogWriter::_WriteBlock()
+{
+	if ( (fFileDesc == NULL) || (fBlockInfo.fCount == 0) )
+		return VE_OK;
+
+	char *header = (char*) fBlock.GetDataPtr();
+	_PutLE32( header, kBLOCK_MAGIC);
+	_PutLE32( header + 4, (uLONG) (fBlock.GetDataSize() - kBLOCK_HEADER_SIZE));
+	_PutLE32( header + 8, fBlockInfo.fCount);
+	_PutLE32( header + 12, fBlockInfo.fLevels);
+	_PutLE64( header + 16, (uLONG8) fBlockInfo.fFirstTime);
+	_PutLE64( header + 24, (uLONG8) fBlockInfo.fLastTime);
+	_PutLE64( header + 32, fBlockInfo.fComponents);
+	_PutLE64( header + 40, (uLONG8) fBlockInfo.fBaseTime);
+
+	VError err = fFileDesc->PutData( fBlock.GetDataPtr(), fBlock.GetDataSize(), fEnd);
+	if (err == VE_OK)
+	{
+		fBlockInfo.fOffset = fEnd;
+		fBlocks.push_back( fBlockInfo);
+		fEnd += fBlock.GetDataSize();
+	}
+
+	// on error the block is lost, the next one is written at the same place
+	fBlock.ShrinkSizeNoReallocate( kBLOCK_HEADER_SIZE);
+	fBlockKeys.clear();
+	::memset( &fBlockInfo, 0, sizeof( fBlockInfo));
+
+	return err;
+}
+
+
+void VBinaryLogWriter::_PutVarUInt( uLONG8 inValue)
+{
+	char buffer[10];
+	VSize count = 0;
+	while( inValue >= 0x80)
+	{
+		buffer[count++] = (char) ((inValue & 0x7f) | 0x80);
+		inValue >>= 7;
+	}
+	buffer[count++] = (char) inValue;
+	fBlock.PutDataAmortized( fBlock.GetDataSize(), buffer, count);
+}
+
+
+void VBinaryLogWriter::_PutVarInt( sLONG8 inValue)
+{
+	_PutVarUInt( _ZigZag( inValue));
+}
+
+
+void VBinaryLogWriter::_PutString( const VString& inString)
+{
+	// utf-8 takes 3 bytes at most per utf-16 unit
+	VSize maxSize = inString.GetLength() * 3;
+	VSize size = 0;
+	if ( (maxSize > 0) && fScratch.SetSize( maxSize) )
+		size = inString.ToBlock( fScratch.GetDataPtr(), maxSize, VTC_UTF_8, false, false);
+
+	_PutVarUInt( size);
+	if (size > 0)
+		fBlock.PutDataAmortized( fBlock.GetDataSize(), fScratch.GetDataPtr(), size);
+}
+
+
+void VBinaryLogWriter::_PutKey( const VString& inKey)
+{
+	for( VectorOfVString::const_iterator i = fBlockKeys.begin() ; i != fBlockKeys.end() ; ++i)
+	{
+		if (i->EqualToStringRaw( inKey))
+		{
+			_PutVarUInt( (i - fBlockKeys.begin()) + 1);
+			return;
+		}
+	}
+
+	_PutVarUInt( 0);
+	_PutString( inKey);
+	fBlockKeys.push_back( inKey);
+}
+
+
+void VBinaryLogWriter::_BeginRecord( sLONG8 inTime, EMessageLevel inLevel, sLONG inTaskID, VError inErrorCode, OsType inComponent)
+{
+	if (fBlockInfo.fCount == 0)
+		fBlockInfo.fBaseTime = fBlockInfo.fFirstTime = fBlockInfo.fLastTime = inTime;
+
+	// the clock may go backward
+	fBlockInfo.fFirstTime = Min( fBlockInfo.fFirstTime, inTime);
+	fBlockInfo.fLastTime = Max( fBlockInfo.fLastTime, inTime);
+	fBlockInfo.fLevels |= 1UL << (inLevel & 31);
+	fBlockInfo.fComponents |= VBinaryLogFilter::GetComponentMask( inComponent);
+	++fBlockInfo.fCount;
+
+	_PutVarInt( inTime - fBlockInfo.fBaseTime);
+	uBYTE level = (uBYTE) inLevel;
+	fBlock.PutDataAmortized( fBlock.GetDataSize(), &level, 1);
+	_PutVarInt( inTaskID);
+	_PutVarInt( inErrorCode);
+	char component[4];
+	_PutLE32( component, (uLONG) inComponent);
+	fBlock.PutDataAmortized( fBlock.GetDataSize(), component, 4);
+}
+
+
+VError VBinaryLogWriter::LogBag( const VValueBag& inMessage)
+{
+	VTime time;
+	time.FromSystemTime();
+	sLONG8 now = time.GetMilliseconds();
+
+	VString message;
+	ILoggerBagKeys::message.Get( &inMessage, message);
+
+	VError errorCode = VE_OK;
+	ILoggerBagKeys::error_code.Get( &inMessage, errorCode);
+
+	EMessageLevel level = ILoggerBagKeys::level.Get( &inMessage);
+
+	OsType component = 0;
+	if (!ILoggerBagKeys::component_signature.Get( &inMessage, component))
+		component = COMPONENT_FROM_VERROR( errorCode);
+
+	sLONG taskID = -1;
+	ILoggerBagKeys::task_id.Get( &inMessage, taskID);
+
+	// same logger id as VLog4jMsgFileLogger::LogBag
+	VString source;
+	if (!ILoggerBagKeys::source.Get( &inMessage, source))
+	{
+		VProcess::Get()->GetProductName( source);
+		if (component != 0)
+			source.AppendUniChar( '.').AppendOsType( component);
+	}
+
+	VString taskName;
+	bool addTaskName = !inMessage.AttributeExists( ILoggerBagKeys::task_name);
+	if (addTaskName)
+		VTask::GetCurrent()->GetName( taskName);
+
+	VTaskLock lock( &fMutex);
+
+	if (fFileDesc == NULL)
+		return VE_OK;
+
+	_BeginRecord( now, level, taskID, errorCode, component);
+	_PutString( source);
+	_PutString( message);
+
+	VIndex count = inMessage.GetAttributesCount();
+	VIndex fieldsCount = addTaskName ? 1 : 0;
+	VString name;
+	for( VIndex i = 1 ; i <= count ; ++i)
+	{
+		inMessage.GetNthAttribute( i, &name);
+		if (!_IsRecordKey( name))
+			++fieldsCount;
+	}
+	_PutVarUInt( fieldsCount);
+
+	if (addTaskName)
+	{
+		_PutKey( CVSTR( "task_name"));
+		fBlock.PutDataAmortized( fBlock.GetDataSize(), &kFIELD_STRING, 1);
+		_PutString( taskName);
+	}
+
+	VString stringValue;
+	for( VIndex i = 1 ; i <= count ; ++i)
+	{
+		const VValueSingle *value = inMessage.GetNthAttribute( i, &name);
+		if (_IsRecordKey( name))
+			continue;
+
+		_PutKey( name);
+		ValueKind kind = (value != NULL) ? value->GetValueKind() : (ValueKind) VK_EMPTY;
+		switch( kind)
+		{
+			case VK_BYTE:
+			case VK_WORD:
+			case VK_LONG:
+				fBlock.PutDataAmortized( fBlock.GetDataSize(), &kFIELD_LONG, 1);
+				_PutVarInt( value->GetLong());
+				break;
+
+			case VK_LONG8:
+				fBlock.PutDataAmortized( fBlock.GetDataSize(), &kFIELD_LONG8, 1);
+				_PutVarInt( value->GetLong8());
+				break;
+
+			case VK_BOOLEAN:
+				{
+					uBYTE data[2] = { kFIELD_BOOL, (uBYTE) (value->GetBoolean() ? 1 : 0) };
+					fBlock.PutDataAmortized( fBlock.GetDataSize(), data, 2);
+					break;
+				}
+
+			case VK_REAL:
+				{
+					char data[9];
+					data[0] = (char) kFIELD_REAL;
+					Real real = value->GetReal();
+					uLONG8 bits;
+					::memcpy( &bits, &real, sizeof( bits));
+					_PutLE64( data + 1, bits);
+					fBlock.PutDataAmortized( fBlock.GetDataSize(), data, 9);
+					break;
+				}
+
+			default:
+				if (value != NULL)
+					value->GetString( stringValue);
+				else
+					stringValue.Clear();
+				fBlock.PutDataAmortized( fBlock.GetDataSize(), &kFIELD_STRING, 1);
+				_PutString( stringValue);
+				break;
+		}
+	}
+
+	VError err = VE_OK;
+	if (fBlock.GetDataSize() - kBLOCK_HEADER_SIZE >= kBLOCK_MAX_RECORDS_SIZE)
+		err = _WriteBlock();
+
+	return err;
+}
+
+
+VError VBinaryLogWriter::Log( EMessageLevel inLevel, const VString& inSource, const VString& inMessage)
+{
+	VTime time;
+	time.FromSystemTime();
+	sLONG8 now = time.GetMilliseconds();
+
+	VTaskLock lock( &fMutex);
+
+	if (fFileDesc == NULL)
+		return VE_OK;
+
+	_BeginRecord( now, inLevel, -1, VE_OK, 0);
+	_PutString( inSource);
+	_PutString( inMessage);
+	_PutVarUInt( 0);
+
+	VError err = VE_OK;
+	if (fBlock.GetDataSize() - kBLOCK_HEADER_SIZE >= kBLOCK_MAX_RECORDS_SIZE)
+		err = _WriteBlock();
+
+	return err;
+}
+
+
+//================================================================================================================
+
+
+VBinaryLogRecord::VBinaryLogRecord()
+: fMilliseconds( 0)
+, fLevel( EML_Information)
+, fTaskID( -1)
+, fErrorCode( VE_OK)
+, fComponent( 0)
+, fFields( new VValueBag)
+{
+}
+
+
+VBinaryLogRecord::~VBinaryLogRecord()
+{
+	ReleaseRefCountable( &fFields);
+}
+
+
+VValueBag* VBinaryLogRecord::CreateBag() const
+{
+	VValueBag *bag = fFields->Clone();
+	if (bag != NULL)
+	{
+		ILoggerBagKeys::level.Set( bag, fLevel);
+		ILoggerBagKeys::source.Set( bag, fSource);
+		ILoggerBagKeys::message.Set( bag, fMessage);
+		if (fErrorCode != VE_OK)
+			ILoggerBagKeys::error_code.Set( bag, fErrorCode);
+		if (fComponent != 0)
+			ILoggerBagKeys::component_signature.Set( bag, fComponent);
+		if (fTaskID != -1)
+			ILoggerBagKeys::task_id.Set( bag, fTaskID);
+	}
+	return bag;
+}
+
+
+//================================================================================================================
+
+
+VBinaryLogFilter::VBinaryLogFilter()
+: fFrom( 0)
+, fTo( 0x7fffffffffffffffLL)
+, fLevels( 0xffffffff)
+, fComponent( 0)
+{
+}
+
+
+uLONG8 VBinaryLogFilter::GetComponentMask( OsType inComponent)
+{
+	if (inComponent == 0)
+		return 0;
+
+	// one bit out of 64
+	uLONG hash = (uLONG) inComponent * 2654435761UL;
+	return 1ULL << (hash >> 26);
+}
+
+
+bool VBinaryLogFilter::MatchBlock( sLONG8 inFirstTime, sLONG8 inLastTime, uLONG inLevels, uLONG8 inComponents) const
+{
+	if ( (inLastTime < fFrom) || (inFirstTime > fTo) )
+		return false;
+
+	if ( (inLevels & fLevels) == 0)
+		return false;
+
+	if ( (fComponent != 0) && ((inComponents & GetComponentMask( fComponent)) == 0) )
+		return false;
+
+	return true;
+}
+
+
+bool VBinaryLogFilter::MatchRecord( sLONG8 inTime, EMessageLevel inLevel, OsType inComponent) const
+{
+	return (inTime >= fFrom) && (inTime <= fTo)
+		&& ((fLevels & (1UL << (inLevel & 31))) != 0)
+		&& ((fComponent == 0) || (fComponent == inComponent));
+}
+
+
+//================================================================================================================
+
+
+VBinaryLogReader::VBinaryLogReader()
+: fData( NULL)
+, fSize( 0)
+, fHasIndex( false)
+, fBlock( 0)
+, fBlockTime( 0)
+, fPos( NULL)
+, fEnd( NULL)
+{
+}
+
+
+VBinaryLogReader::~VBinaryLogReader()
+{
+}
+
+
+VError VBinaryLogReader::Open( const VFile& inFile)
+{
+	Close();
+
+	VError err = fMapping.Map( inFile);
+	if (err == VE_OK)
+	{
+		fData = (const char*) fMapping.GetDataPtr();
+		fSize = fMapping.GetDataSize();
+
+		if ( (fSize < kFILE_HEADER_SIZE) || (_GetLE32( fData) != kFILE_MAGIC) || (_GetLE32( fData + 4) > kFORMAT_VERSION) )
+		{
+			Close();
+			StThrowFileError errThrow( &inFile, VE_STREAM_BAD_VERSION);
+			err = errThrow.GetError();
+		}
+		else
+		{
+			fMapping.Advise( eFileMappingSequential);
+			fHasIndex = _ReadIndex();
+			if (!fHasIndex)
+				_ScanBlocks();
+		}
+	}
+	return err;
+}
+
+
+void VBinaryLogReader::Close()
+{
+	fMapping.Unmap();
+	fData = NULL;
+	fSize = 0;
+	fHasIndex = false;
+	fBlocks.clear();
+	fKeys.clear();
+	fBlock = 0;
+	fPos = fEnd = NULL;
+}
+
+
+bool VBinaryLogReader::_ReadIndex()
+{
+	if (fSize < kFILE_HEADER_SIZE + kTRAILER_SIZE)
+		return false;
+
+	const char *trailer = fData + fSize - kTRAILER_SIZE;
+	if (_GetLE32( trailer) != kTRAILER_MAGIC)
+		return false;
+
+	uLONG8 count = _GetLE32( trailer + 4);
+	uLONG8 indexOffset = _GetLE64( trailer + 8);
+	if ( (indexOffset < kFILE_HEADER_SIZE) || (indexOffset >= fSize) )
+		return false;
+
+	// bound count before computing the index end so that the sum can't overflow
+	if ( (count > (fSize - indexOffset) / kINDEX_ENTRY_SIZE) || (indexOffset + 4 + count * kINDEX_ENTRY_SIZE + kTRAILER_SIZE != fSize) || (_GetLE32( fData + indexOffset) != kINDEX_MAGIC) )
+		return false;
+
+	fBlocks.reserve( (size_t) count);
+	const char *p = fData + indexOffset + 4;
+	for( uLONG8 i = 0 ; i < count ; ++i, p += kINDEX_ENTRY_SIZE)
+	{
+		BlockInfo info;
+		info.fOffset = (sLONG8) _GetLE64( p);
+		info.fFirstTime = (sLONG8) _GetLE64( p + 8);
+		info.fLastTime = (sLONG8) _GetLE64( p + 16);
+		info.fLevels = _GetLE32( p + 24);
+		info.fCount = _GetLE32( p + 28);
+		info.fComponents = _GetLE64( p + 32);
+		if ( (info.fOffset < (sLONG8) kFILE_HEADER_SIZE) || (info.fOffset + kBLOCK_HEADER_SIZE > indexOffset) )
+		{
+			fBlocks.clear();
+			return false;
+		}
+		fBlocks.push_back( info);
+	}
+	return true;
+}
+
+
+void VBinaryLogReader::_ScanBlocks()
+{
+	VSize pos = kFILE_HEADER_SIZE;
+	while( pos + kBLOCK_HEADER_SIZE <= fSize)
+	{
+		const char *header = fData + pos;
+		VSize end = pos + kBLOCK_HEADER_SIZE + _GetLE32( header + 4);
+		if ( (_GetLE32( header) != kBLOCK_MAGIC) || (end > fSize) )
+			break;
+
+		BlockInfo info;
+		info.fOffset = pos;
+		info.fCount = _GetLE32( header + 8);
+		info.fLevels = _GetLE32( header + 12);
+		info.fFirstTime = (sLONG8) _GetLE64( header + 16);
+		info.fLastTime = (sLONG8) _GetLE64( header + 24);
+		info.fComponents = _GetLE64( header + 32);
+		fBlocks.push_back( info);
+		pos = end;
+	}
+}
+
+
+void VBinaryLogReader::SetFilter( const VBinaryLogFilter& inFilter)
+{
+	fFilter = inFilter;
+	fBlock = 0;
+	fPos = fEnd = NULL;
+	fKeys.clear();
+}
+
+
+bool VBinaryLogReader::_OpenBlock( sLONG inIndex)
+{
+	const BlockInfo& info = fBlocks[inIndex];
+	const char *header = fData + info.fOffset;
+	if (_GetLE32( header) != kBLOCK_MAGIC)
+		return false;
+
+	VSize size = _GetLE32( header + 4);
+	if (info.fOffset + kBLOCK_HEADER_SIZE + size > fSize)
+		return false;
+
+	fBlockTime = (sLONG8) _GetLE64( header + 40);
+	fPos = header + kBLOCK_HEADER_SIZE;
+	fEnd = fPos + size;
+	fKeys.clear();
+	return true;
+}
+
+
+bool VBinaryLogReader::Next( VBinaryLogRecord& outRecord)
+{
+	while( fData != NULL)
+	{
+		if (fPos < fEnd)
+		{
+			bool match = false;
+			if (!_ReadRecord( outRecord, match))
+			{
+				// damaged block: go on with the next one
+				fPos = fEnd = NULL;
+			}
+			else if (match)
+			{
+				return true;
+			}
+		}
+		else
+		{
+			// next block that may have matching records
+			while( (fBlock < (sLONG) fBlocks.size()) && !fFilter.MatchBlock( fBlocks[fBlock].fFirstTime, fBlocks[fBlock].fLastTime, fBlocks[fBlock].fLevels, fBlocks[fBlock].fComponents))
+				++fBlock;
+
+			if (fBlock >= (sLONG) fBlocks.size())
+				break;
+
+			if (_OpenBlock( fBlock))
+			{
+				// the block pages won't be read again
+				if (fBlock > 0)
+					fMapping.Advise( eFileMappingDontNeed, 0, (VSize) fBlocks[fBlock].fOffset);
+			}
+			++fBlock;
+		}
+	}
+	return false;
+}
+
+
+bool VBinaryLogReader::_ReadRecord( VBinaryLogRecord& outRecord, bool& outMatch)
+{
+	sLONG8 time, taskID, errorCode;
+	if (!_GetVarInt( time) || (fEnd - fPos < 1))
+		return false;
+	time += fBlockTime;
+	EMessageLevel level = (EMessageLevel) (uBYTE) *fPos++;
+	if (!_GetVarInt( taskID) || !_GetVarInt( errorCode) || (fEnd - fPos < 4))
+		return false;
+	OsType component = (OsType) _GetLE32( fPos);
+	fPos += 4;
+
+	outMatch = fFilter.MatchRecord( time, level, component);
+
+	if (outMatch)
+	{
+		outRecord.fMilliseconds = time;
+		outRecord.fLevel = level;
+		outRecord.fTaskID = (sLONG) taskID;
+		outRecord.fErrorCode = (VError) errorCode;
+		outRecord.fComponent = component;
+		outRecord.fFields->Destroy();
+		if (!_GetString( outRecord.fSource) || !_GetString( outRecord.fMessage))
+			return false;
+	}
+	else
+	{
+		if (!_SkipString() || !_SkipString())
+			return false;
+	}
+
+	uLONG8 count;
+	if (!_GetVarUInt( count))
+		return false;
+
+	VString stringValue;
+	for( uLONG8 i = 0 ; i < count ; ++i)
+	{
+		// keys are numbered in the order they appear: new keys must be read even if the record is skipped
+		uLONG8 keyNumber;
+		if (!_GetVarUInt( keyNumber))
+			return false;
+		if (keyNumber == 0)
+		{
+			fKeys.push_back( VString());
+			if (!_GetString( fKeys.back()))
+				return false;
+			keyNumber = fKeys.size();
+		}
+		if ( (keyNumber > fKeys.size()) || (fEnd - fPos < 1) )
+			return false;
+		const VString& key = fKeys[(size_t) keyNumber - 1];
+
+		uBYTE type = (uBYTE) *fPos++;
+		switch( type)
+		{
+			case kFIELD_LONG:
+			case kFIELD_LONG8:
+				{
+					sLONG8 value;
+					if (!_GetVarInt( value))
+						return false;
+					if (outMatch)
+					{
+						if (type == kFIELD_LONG)
+							outRecord.fFields->SetLong( key, (sLONG) value);
+						else
+							outRecord.fFields->SetLong8( key, value);
+					}
+					break;
+				}
+
+			case kFIELD_BOOL:
+				if (fEnd - fPos < 1)
+					return false;
+				if (outMatch)
+					outRecord.fFields->SetBool( key, *fPos != 0);
+				++fPos;
+				break;
+
+			case kFIELD_REAL:
+				if (fEnd - fPos < 8)
+					return false;
+				if (outMatch)
+				{
+					uLONG8 bits = _GetLE64( fPos);
+					Real real;
+					::memcpy( &real, &bits, sizeof( real));
+					outRecord.fFields->SetReal( key, real);
+				}
+				fPos += 8;
+				break;
+
+			case kFIELD_STRING:
+				if (outMatch)
+				{
+					if (!_GetString( stringValue))
+						return false;
+					outRecord.fFields->SetString( key, stringValue);
+				}
+				else
+				{
+					if (!_SkipString())
+						return false;
+				}
+				break;
+
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+
+bool VBinaryLogReader::_GetVarUInt( uLONG8& outValue)
+{
+	uLONG8 value = 0;
+	for( sLONG shift = 0 ; (shift < 64) && (fPos < fEnd) ; shift += 7)
+	{
+		uBYTE c = (uBYTE) *fPos++;
+		value |= (uLONG8) (c & 0x7f) << shift;
+		if ( (c & 0x80) == 0)
+		{
+			outValue = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+
+bool VBinaryLogReader::_GetVarInt( sLONG8& outValue)
+{
+	uLONG8 value;
+	if (!_GetVarUInt( value))
+		return false;
+	outValue = _UnZigZag( value);
+	return true;
+}
+
+
+bool VBinaryLogReader::_GetBytes( const char*& outData, uLONG8& outLength)
+{
+	if (!_GetVarUInt( outLength) || (outLength > (uLONG8) (fEnd - fPos)) )
+		return false;
+	outData = fPos;
+	fPos += outLength;
+	return true;
+}
+
+
+bool VBinaryLogReader::_GetString( VString& outString)
+{
+	const char *data;
+	uLONG8 length;
+	if (!_GetBytes( data, length))
+		return false;
+	outString.FromBlock( data, (VSize) length, VTC_UTF_8);
+	return true;
+}
+
+
+bool VBinaryLogReader::_SkipString()
+{
+	const char *data;
+	uLONG8 length;
+	return _GetBytes( data, length);
+}
+
+
+VError VBinaryLogReader::WriteAsLog4j( VStream *inStream)
+{
+	VError err = VE_OK;
+	VBinaryLogRecord record;
+	VString loggerID, message;
+	StStringConverter<char> converter( VTC_UTF_8);
+	VTime time;
+	char szTime[64];
+	while( (err == VE_OK) && Next( record))
+	{
+		VValueBag *bag = record.CreateBag();
+		if (bag != NULL)
+		{
+			VLog4jMsgFileLogger::BuildMessageFromBag( bag, loggerID, message, false);
+			bag->Release();
+		}
+
+		// the time of the record, as VLog4jMsgFileLogger::Log() formats it
+		sWORD year, month, day, hour, minute, second, millisecond;
+		record.GetTime( time);
+		time.GetLocalTime( year, month, day, hour, minute, second, millisecond);
+		::sprintf( szTime, "%04d-%02d-%02d %02d:%02d:%02d", year, month, day, hour, minute, second);
+
+		VStringBuilder builder( 256);
+		builder.AppendCString( szTime).AppendCString( " [").AppendString( loggerID).AppendCString( "] ");
+		builder.AppendCString( VLog4jMsgFileLogger::GetLevelName( record.GetLevel())).AppendCString( " - ").AppendString( message).AppendUniChar( '\n');
+		builder.GetString( message);
+
+		const char *line = converter.ConvertString( message);
+		err = inStream->PutData( line, converter.GetSize());
+	}
+
+	if ( (err == VE_OK) && fMapping.IsDamaged())
+	{
+		err = vThrowError( VE_STREAM_CANNOT_READ);
+	}
+	return err;
+}
+
+
+VError VBinaryLogReader::ConvertToLog4j( const VFile& inBinaryLog, const VFile& inTextLog, const VBinaryLogFilter& inFilter)
+{
+	VBinaryLogReader reader;
+	VError err = reader.Open( inBinaryLog);
+	if (err == VE_OK)
+	{
+		reader.SetFilter( inFilter);
+
+		VFileStream stream( &inTextLog, FO_CreateIfNotFound | FO_Overwrite);
+		err = stream.OpenWriting();
+		if (err == VE_OK)
+		{
+			err = reader.WriteAsLog4j( &stream);
+			VError closeErr = stream.CloseWriting();
+			if (err == VE_OK)
+				err = closeErr;
+		}
+	}
+	return err;
+}
@@ -0,0 +1,267 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VBinaryLog__
+#define __VBinaryLog__
+
+#include "Kernel/Sources/VObject.h"
+#include "Kernel/Sources/VString.h"
+#include "Kernel/Sources/VTime.h"
+#include "Kernel/Sources/VMemoryBuffer.h"
+#include "Kernel/Sources/VSyncObject.h"
+#include "Kernel/Sources/VFileMapping.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+// Needed declarations
+class VFile;
+class VFileDesc;
+class VStream;
+class VValueBag;
+
+
+/*!
+	@class	VBinaryLogWriter
+	@abstract	Writes log messages in the binary log format (.xblog files).
+	@discussion
+		Where VLog4jMsgFileLogger flattens a message bag into one text line, the binary log keeps its fields:
+		level, time, task id, error code and component are fixed fields, the other bag attributes are kept with their type.
+
+		Records are grouped in blocks of about 64Kb. Each block header tells the time range of its records,
+		their levels and (as a bloom mask) their components, so that a VBinaryLogReader skips whole blocks
+		that can't match a filter. Keys are written once per block and each block can be decoded alone.
+		Close() appends an index of the blocks; a file that has not been closed is still readable block by block.
+
+		All numbers are little endian, strings are utf-8.
+
+		Thread safe. A record is copied in the current block, the file is only written when the block is full.
+*/
+class XTOOLBOX_API VBinaryLogWriter : public VObject
+{
+public:
+											VBinaryLogWriter();
+	virtual									~VBinaryLogWriter();
+
+			// with inCreateEmptyFile false, records are appended to an existing file.
+			VError							Open( const VFile& inFile, bool inCreateEmptyFile);
+
+			// writes the current block and the index
+			VError							Close();
+			bool							IsOpen() const									{ return fFileDesc != NULL;}
+
+			// records a message bag (see ILoggerBagKeys). If the bag has no task name, the current task one is recorded.
+			VError							LogBag( const VValueBag& inMessage);
+			VError							Log( EMessageLevel inLevel, const VString& inSource, const VString& inMessage);
+
+			// writes the current block, even if it's not full
+			VError							Flush();
+
+			// file size including the current block
+			sLONG8							GetSize() const;
+
+private:
+											VBinaryLogWriter( const VBinaryLogWriter&);
+			VBinaryLogWriter&				operator=( const VBinaryLogWriter&);
+
+			typedef struct BlockInfo
+			{
+				sLONG8						fOffset;
+				sLONG8						fFirstTime;
+				sLONG8						fLastTime;
+				uLONG						fLevels;
+				uLONG						fCount;
+				uLONG8						fComponents;
+				sLONG8						fBaseTime;		// not in the index
+			} BlockInfo;
+
+			VError							_Recover();
+			VError							_WriteBlock();
+			void							_BeginRecord( sLONG8 inTime, EMessageLevel inLevel, sLONG inTaskID, VError inErrorCode, OsType inComponent);
+			void							_PutVarUInt( uLONG8 inValue);
+			void							_PutVarInt( sLONG8 inValue);
+			void							_PutString( const VString& inString);
+			void							_PutKey( const VString& inKey);
+
+	mutable	VCriticalSection				fMutex;
+			VFileDesc*						fFileDesc;
+			sLONG8							fEnd;			// where the next block goes
+			VMemoryBuffer<>					fBlock;			// current block, header included
+			VMemoryBuffer<>					fScratch;
+			BlockInfo						fBlockInfo;
+			VectorOfVString					fBlockKeys;		// keys already written in the current block
+			std::vector<BlockInfo>			fBlocks;
+};
+
+
+/*!
+	@class	VBinaryLogRecord
+	@abstract	One message read by a VBinaryLogReader.
+*/
+class XTOOLBOX_API VBinaryLogRecord : public VObject
+{
+public:
+											VBinaryLogRecord();
+	virtual									~VBinaryLogRecord();
+
+			// milliseconds as VTime::GetMilliseconds
+			sLONG8							GetMilliseconds() const							{ return fMilliseconds;}
+			void							GetTime( VTime& outTime) const					{ outTime.FromMilliseconds( fMilliseconds);}
+
+			EMessageLevel					GetLevel() const								{ return fLevel;}
+			sLONG							GetTaskID() const								{ return fTaskID;}		// -1 if unknown
+			VError							GetErrorCode() const							{ return fErrorCode;}
+			OsType							GetComponent() const							{ return fComponent;}	// 0 if unknown
+			const VString&					GetSource() const								{ return fSource;}
+			const VString&					GetMessage() const								{ return fMessage;}
+
+			// other attributes of the message bag
+			const VValueBag&				GetFields() const								{ return *fFields;}
+
+			// rebuilds the message bag as it was given to VBinaryLogWriter::LogBag (you must release it)
+			VValueBag*						CreateBag() const;
+
+private:
+	friend class VBinaryLogReader;
+
+											VBinaryLogRecord( const VBinaryLogRecord&);
+			VBinaryLogRecord&				operator=( const VBinaryLogRecord&);
+
+			sLONG8							fMilliseconds;
+			EMessageLevel					fLevel;
+			sLONG							fTaskID;
+			VError							fErrorCode;
+			OsType							fComponent;
+			VString							fSource;
+			VString							fMessage;
+			VValueBag*						fFields;
+};
+
+
+/*!
+	@class	VBinaryLogFilter
+	@abstract	Selects the records returned by a VBinaryLogReader.
+*/
+class XTOOLBOX_API VBinaryLogFilter
+{
+public:
+											VBinaryLogFilter();
+
+			// records with inFrom <= time <= inTo
+			void							SetTimeRange( const VTime& inFrom, const VTime& inTo)	{ fFrom = inFrom.GetMilliseconds(); fTo = inTo.GetMilliseconds();}
+
+			// bit field of EMessageLevel (1 << EML_Error) | ...
+			void							SetLevels( uLONG inLevels)						{ fLevels = inLevels;}
+
+			// inComponent 0 means any component
+			void							SetComponent( OsType inComponent)				{ fComponent = inComponent;}
+
+			bool							MatchBlock( sLONG8 inFirstTime, sLONG8 inLastTime, uLONG inLevels, uLONG8 inComponents) const;
+			bool							MatchRecord( sLONG8 inTime, EMessageLevel inLevel, OsType inComponent) const;
+
+	static	uLONG8							GetComponentMask( OsType inComponent);
+
+private:
+			sLONG8							fFrom;
+			sLONG8							fTo;
+			uLONG							fLevels;
+			OsType							fComponent;
+};
+
+
+/*!
+	@class	VBinaryLogReader
+	@abstract	Reads a binary log written by VBinaryLogWriter.
+	@discussion
+		The file is memory mapped. The block table comes from the index written by VBinaryLogWriter::Close()
+		or, if the file was not closed, from a walk through the block headers.
+		Only the blocks that may hold matching records are decoded.
+
+		VBinaryLogReader reader;
+		if (reader.Open( file) == VE_OK)
+		{
+			VBinaryLogFilter filter;
+			filter.SetLevels( (1 << EML_Error) | (1 << EML_Fatal));
+			reader.SetFilter( filter);
+			VBinaryLogRecord record;
+			while( reader.Next( record))
+				...
+		}
+*/
+class XTOOLBOX_API VBinaryLogReader : public VObject
+{
+public:
+											VBinaryLogReader();
+	virtual									~VBinaryLogReader();
+
+			VError							Open( const VFile& inFile);
+			void							Close();
+
+			sLONG							GetBlocksCount() const							{ return (sLONG) fBlocks.size();}
+			bool							HasIndex() const								{ return fHasIndex;}
+
+			// restarts reading from the first record
+			void							SetFilter( const VBinaryLogFilter& inFilter);
+
+			// returns false once all matching records have been read (or if the file is damaged)
+			bool							Next( VBinaryLogRecord& outRecord);
+
+			// writes the matching records as VLog4jMsgFileLogger text lines (utf-8)
+			VError							WriteAsLog4j( VStream *inStream);
+
+			// writes the records of inBinaryLog matching inFilter in the text file inTextLog (overwritten)
+	static	VError							ConvertToLog4j( const VFile& inBinaryLog, const VFile& inTextLog, const VBinaryLogFilter& inFilter);
+
+private:
+											VBinaryLogReader( const VBinaryLogReader&);
+			VBinaryLogReader&				operator=( const VBinaryLogReader&);
+
+			typedef struct BlockInfo
+			{
+				sLONG8						fOffset;
+				sLONG8						fFirstTime;
+				sLONG8						fLastTime;
+				uLONG						fLevels;
+				uLONG						fCount;
+				uLONG8						fComponents;
+			} BlockInfo;
+
+			bool							_ReadIndex();
+			void							_ScanBlocks();
+			bool							_OpenBlock( sLONG inIndex);
+			bool							_ReadRecord( VBinaryLogRecord& outRecord, bool& outMatch);
+			bool							_GetVarUInt( uLONG8& outValue);
+			bool							_GetVarInt( sLONG8& outValue);
+			bool							_GetBytes( const char*& outData, uLONG8& outLength);
+			bool							_GetString( VString& outString);
+			bool							_SkipString();
+
+			VFileMapping					fMapping;
+			const char*						fData;
+			VSize							fSize;
+			bool							fHasIndex;
+			std::vector<BlockInfo>			fBlocks;
+
+			VBinaryLogFilter				fFilter;
+			sLONG							fBlock;			// current block
+			sLONG8							fBlockTime;
+			const char*						fPos;			// in current block
+			const char*						fEnd;
+			std::vector<VString>			fKeys;			// keys of current block
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
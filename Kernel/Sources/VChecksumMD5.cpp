@@ -17,8 +17,15 @@
 #include "VKernelPrecompiled.h"
 #include "VChecksumMD5.h"
 #include "VString.h"
+#include "VByteSwap.h"
+#include "VErrorContext.h"
 #include "Base64Coder.h"
 
+#if WITH_X86_EXTENSIONS
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
 /*
  ***********************************************************************
  ** Copyright (C) 1990, RSA Data Security, Inc. All rights reserved.	**
@@ -656,3 +663,744 @@ void VChecksumSHA1::SHA1Final(SHA1& digest, SHA1_CTX *context)
 	}
 }
 
+
+
+//================================================================================
+
+static inline uLONG _ReadBigEndian32( const uBYTE *inData)
+{
+	return ((uLONG) inData[0] << 24) | ((uLONG) inData[1] << 16) | ((uLONG) inData[2] << 8) | (uLONG) inData[3];
+}
+
+
+static inline void _WriteBigEndian32( uBYTE *outData, uLONG inValue)
+{
+	outData[0] = (uBYTE) (inValue >> 24);
+	outData[1] = (uBYTE) (inValue >> 16);
+	outData[2] = (uBYTE) (inValue >> 8);
+	outData[3] = (uBYTE) inValue;
+}
+
+
+static inline uLONG _ReadLittleEndian32( const uBYTE *inData)
+{
+	uLONG value;
+	::memcpy( &value, inData, sizeof( value));
+#if BIGENDIAN
+	value = ByteSwapValue( value);
+#endif
+	return value;
+}
+
+
+static inline uLONG8 _ReadLittleEndian64( const uBYTE *inData)
+{
+	uLONG8 value;
+	::memcpy( &value, inData, sizeof( value));
+#if BIGENDIAN
+	value = ByteSwapValue( value);
+#endif
+	return value;
+}
+
+
+#if WITH_X86_EXTENSIONS
+
+// cpuid 1: ecx bit 9 ssse3, bit 19 sse4.1, bit 20 sse4.2. cpuid 7: ebx bit 29 sha.
+static bool _HasSSE42()
+{
+	unsigned int eax, ebx, ecx, edx;
+	return (__get_cpuid( 1, &eax, &ebx, &ecx, &edx) != 0) && ((ecx & (1 << 20)) != 0);
+}
+
+
+static bool _HasSHAExtensions()
+{
+	unsigned int eax, ebx, ecx, edx;
+	if ( (__get_cpuid( 1, &eax, &ebx, &ecx, &edx) == 0) || ((ecx & ((1 << 9) | (1 << 19))) != ((1 << 9) | (1 << 19))) )
+		return false;
+	if (__get_cpuid_max( 0, NULL) < 7)
+		return false;
+	__cpuid_count( 7, 0, eax, ebx, ecx, edx);
+	return (ebx & (1 << 29)) != 0;
+}
+
+#endif
+
+
+//================================================================================
+
+
+static const uLONG sSHA256K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+typedef void (*SHA256TransformProc)( uLONG ioState[8], const uBYTE *inBlocks, size_t inCount);
+
+
+#define SHA256_ROTR(x, n)	(((x) >> (n)) | ((x) << (32 - (n))))
+
+static void _SHA256Transform( uLONG ioState[8], const uBYTE *inBlocks, size_t inCount)
+{
+	uLONG w[64];
+	for( ; inCount > 0 ; --inCount, inBlocks += 64)
+	{
+		for( sLONG i = 0 ; i < 16 ; ++i)
+			w[i] = _ReadBigEndian32( inBlocks + 4 * i);
+		for( sLONG i = 16 ; i < 64 ; ++i)
+		{
+			uLONG s0 = SHA256_ROTR( w[i-15], 7) ^ SHA256_ROTR( w[i-15], 18) ^ (w[i-15] >> 3);
+			uLONG s1 = SHA256_ROTR( w[i-2], 17) ^ SHA256_ROTR( w[i-2], 19) ^ (w[i-2] >> 10);
+			w[i] = w[i-16] + s0 + w[i-7] + s1;
+		}
+
+		uLONG a = ioState[0], b = ioState[1], c = ioState[2], d = ioState[3];
+		uLONG e = ioState[4], f = ioState[5], g = ioState[6], h = ioState[7];
+		for( sLONG i = 0 ; i < 64 ; ++i)
+		{
+			uLONG t1 = h + (SHA256_ROTR( e, 6) ^ SHA256_ROTR( e, 11) ^ SHA256_ROTR( e, 25)) + ((e & f) ^ (~e & g)) + sSHA256K[i] + w[i];
+			uLONG t2 = (SHA256_ROTR( a, 2) ^ SHA256_ROTR( a, 13) ^ SHA256_ROTR( a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+			h = g;
+			g = f;
+			f = e;
+			e = d + t1;
+			d = c;
+			c = b;
+			b = a;
+			a = t1 + t2;
+		}
+		ioState[0] += a; ioState[1] += b; ioState[2] += c; ioState[3] += d;
+		ioState[4] += e; ioState[5] += f; ioState[6] += g; ioState[7] += h;
+	}
+}
+
+#undef SHA256_ROTR
+
+
+#if WITH_X86_EXTENSIONS
+
+/*
+	sha256rnds2 does two rounds on the state split in ABEF and CDGH,
+	sha256msg1 and sha256msg2 compute the message schedule 4 words at a time.
+*/
+__attribute__((target("sha,sse4.1,ssse3")))
+static void _SHA256TransformSHA( uLONG ioState[8], const uBYTE *inBlocks, size_t inCount)
+{
+	const __m128i byteSwap = _mm_set_epi64x( 0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	__m128i tmp = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*) &ioState[0]), 0xb1);		// CDAB
+	__m128i state1 = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i*) &ioState[4]), 0x1b);	// EFGH
+	__m128i state0 = _mm_alignr_epi8( tmp, state1, 8);												// ABEF
+	state1 = _mm_blend_epi16( state1, tmp, 0xf0);													// CDGH
+
+	for( ; inCount > 0 ; --inCount, inBlocks += 64)
+	{
+		__m128i saveState0 = state0;
+		__m128i saveState1 = state1;
+		__m128i w0 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (inBlocks + 0)), byteSwap);
+		__m128i w1 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (inBlocks + 16)), byteSwap);
+		__m128i w2 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (inBlocks + 32)), byteSwap);
+		__m128i w3 = _mm_shuffle_epi8( _mm_loadu_si128( (const __m128i*) (inBlocks + 48)), byteSwap);
+
+		// 4 rounds with the words w, then the schedule of the words 16 rounds later: w0 w1 w2 w3 roll
+		#define SHA256_ROUNDS( w, i) \
+			tmp = _mm_add_epi32( w, _mm_loadu_si128( (const __m128i*) &sSHA256K[i])); \
+			state1 = _mm_sha256rnds2_epu32( state1, state0, tmp); \
+			state0 = _mm_sha256rnds2_epu32( state0, state1, _mm_shuffle_epi32( tmp, 0x0e));
+
+		#define SHA256_SCHEDULE( w0, w1, w2, w3) \
+			w0 = _mm_sha256msg2_epu32( _mm_add_epi32( _mm_sha256msg1_epu32( w0, w1), _mm_alignr_epi8( w3, w2, 4)), w3);
+
+		for( sLONG i = 0 ; i < 48 ; i += 16)
+		{
+			SHA256_ROUNDS( w0, i)
+			SHA256_SCHEDULE( w0, w1, w2, w3)
+			SHA256_ROUNDS( w1, i + 4)
+			SHA256_SCHEDULE( w1, w2, w3, w0)
+			SHA256_ROUNDS( w2, i + 8)
+			SHA256_SCHEDULE( w2, w3, w0, w1)
+			SHA256_ROUNDS( w3, i + 12)
+			SHA256_SCHEDULE( w3, w0, w1, w2)
+		}
+		SHA256_ROUNDS( w0, 48)
+		SHA256_ROUNDS( w1, 52)
+		SHA256_ROUNDS( w2, 56)
+		SHA256_ROUNDS( w3, 60)
+
+		#undef SHA256_ROUNDS
+		#undef SHA256_SCHEDULE
+
+		state0 = _mm_add_epi32( state0, saveState0);
+		state1 = _mm_add_epi32( state1, saveState1);
+	}
+
+	tmp = _mm_shuffle_epi32( state0, 0x1b);					// FEBA
+	state1 = _mm_shuffle_epi32( state1, 0xb1);				// DCHG
+	state0 = _mm_blend_epi16( tmp, state1, 0xf0);			// DCBA
+	state1 = _mm_alignr_epi8( state1, tmp, 8);				// HGFE
+	_mm_storeu_si128( (__m128i*) &ioState[0], state0);
+	_mm_storeu_si128( (__m128i*) &ioState[4], state1);
+}
+
+#endif
+
+
+static SHA256TransformProc _GetSHA256Transform()
+{
+#if WITH_X86_EXTENSIONS
+	static SHA256TransformProc sTransform = _HasSHAExtensions() ? _SHA256TransformSHA : _SHA256Transform;
+	return sTransform;
+#else
+	return _SHA256Transform;
+#endif
+}
+
+
+VChecksumSHA256::VChecksumSHA256()
+{
+	Clear();
+}
+
+
+void VChecksumSHA256::Clear()
+{
+	fState[0] = 0x6a09e667;
+	fState[1] = 0xbb67ae85;
+	fState[2] = 0x3c6ef372;
+	fState[3] = 0xa54ff53a;
+	fState[4] = 0x510e527f;
+	fState[5] = 0x9b05688c;
+	fState[6] = 0x1f83d9ab;
+	fState[7] = 0x5be0cd19;
+	fCount = 0;
+}
+
+
+void VChecksumSHA256::Update( const void *inData, size_t inSize)
+{
+	if ( (inData == NULL) || (inSize == 0) )
+		return;
+
+	const uBYTE *data = (const uBYTE*) inData;
+	size_t used = (size_t) (fCount % SHA256_BLOCK_LENGTH);
+	fCount += inSize;
+
+	if (used > 0)
+	{
+		size_t count = Min( inSize, (size_t) SHA256_BLOCK_LENGTH - used);
+		::memcpy( fBuffer + used, data, count);
+		data += count;
+		inSize -= count;
+		if (used + count < SHA256_BLOCK_LENGTH)
+			return;
+		_GetSHA256Transform()( fState, fBuffer, 1);
+	}
+
+	// whole blocks are hashed in place
+	if (inSize >= SHA256_BLOCK_LENGTH)
+	{
+		size_t blocks = inSize / SHA256_BLOCK_LENGTH;
+		_GetSHA256Transform()( fState, data, blocks);
+		data += blocks * SHA256_BLOCK_LENGTH;
+		inSize -= blocks * SHA256_BLOCK_LENGTH;
+	}
+
+	if (inSize > 0)
+		::memcpy( fBuffer, data, inSize);
+}
+
+
+void VChecksumSHA256::GetChecksum( SHA256& outChecksum)
+{
+	// padding: 0x80, zeros up to 56 mod 64, then the size in bits
+	uLONG8 bits = fCount * 8;
+	size_t used = (size_t) (fCount % SHA256_BLOCK_LENGTH);
+	fBuffer[used++] = 0x80;
+	if (used > SHA256_BLOCK_LENGTH - 8)
+	{
+		::memset( fBuffer + used, 0, SHA256_BLOCK_LENGTH - used);
+		_GetSHA256Transform()( fState, fBuffer, 1);
+		used = 0;
+	}
+	::memset( fBuffer + used, 0, SHA256_BLOCK_LENGTH - 8 - used);
+	_WriteBigEndian32( fBuffer + 56, (uLONG) (bits >> 32));
+	_WriteBigEndian32( fBuffer + 60, (uLONG) bits);
+	_GetSHA256Transform()( fState, fBuffer, 1);
+
+	for( sLONG i = 0 ; i < 8 ; ++i)
+		_WriteBigEndian32( outChecksum + 4 * i, fState[i]);
+
+	Clear();
+}
+
+
+/*
+	static
+*/
+bool VChecksumSHA256::IsAccelerated()
+{
+	return _GetSHA256Transform() != _SHA256Transform;
+}
+
+
+/*
+	static
+*/
+void VChecksumSHA256::EncodeChecksumBase64( const SHA256& inDigest, VString& outChecksumBase64)
+{
+	_EncodeChecksumBase64( inDigest, sizeof( inDigest), outChecksumBase64);
+}
+
+
+/*
+	static
+*/
+void VChecksumSHA256::EncodeChecksumHexa( const SHA256& inDigest, VString& outHexaDigest)
+{
+	_EncodeChecksumHexa( inDigest, sizeof( inDigest), outHexaDigest);
+}
+
+/*
+	static
+*/
+void VChecksumSHA256::GetChecksumFromBytes( const void *inBytes, size_t inSize, SHA256& outChecksum)
+{
+	VChecksumSHA256	checksum;
+	checksum.Update( inBytes, inSize);
+	checksum.GetChecksum( outChecksum);
+}
+
+/*
+	static
+*/
+void VChecksumSHA256::GetChecksumFromBytesHexa( const void *inBytes, size_t inSize, VString& outHexaChecksum)
+{
+	SHA256 checksum;
+	GetChecksumFromBytes( inBytes, inSize, checksum);
+	EncodeChecksumHexa( checksum, outHexaChecksum);
+}
+
+/*
+	static
+*/
+void VChecksumSHA256::GetChecksumFromStringUTF8( const VString& inString, SHA256& outChecksum)
+{
+	VStringConvertBuffer buffer( inString, VTC_UTF_8);
+	GetChecksumFromBytes( buffer.GetCPointer(), buffer.GetSize(), outChecksum);
+}
+
+/*
+	static
+*/
+void VChecksumSHA256::GetChecksumFromStringUTF8Hexa( const VString& inString, VString& outHexaChecksum)
+{
+	SHA256 checksum;
+	GetChecksumFromStringUTF8( inString, checksum);
+	EncodeChecksumHexa( checksum, outHexaChecksum);
+}
+
+
+//================================================================================
+
+
+/*
+	Software crc32c: "slicing by 8", 8 bytes per step with 8 tables of 256 entries
+	(table k gives the crc of a byte followed by k zero bytes).
+*/
+class VCRC32CTables
+{
+public:
+	VCRC32CTables()
+	{
+		for( uLONG i = 0 ; i < 256 ; ++i)
+		{
+			uLONG crc = i;
+			for( sLONG j = 0 ; j < 8 ; ++j)
+				crc = (crc >> 1) ^ ((crc & 1) ? 0x82f63b78 : 0);	// reversed Castagnoli polynomial
+			fTable[0][i] = crc;
+		}
+		for( uLONG i = 0 ; i < 256 ; ++i)
+		{
+			for( sLONG k = 1 ; k < 8 ; ++k)
+				fTable[k][i] = (fTable[k-1][i] >> 8) ^ fTable[0][fTable[k-1][i] & 0xff];
+		}
+	}
+
+	uLONG	fTable[8][256];
+};
+
+
+static const VCRC32CTables& _GetCRC32CTables()
+{
+	static VCRC32CTables sTables;
+	return sTables;
+}
+
+
+static uLONG _CRC32C( uLONG inCRC, const uBYTE *inData, size_t inSize)
+{
+	const uLONG (*t)[256] = _GetCRC32CTables().fTable;
+	uLONG crc = inCRC;
+	for( ; (inSize > 0) && (((uintptr_t) inData & 7) != 0) ; --inSize)
+		crc = (crc >> 8) ^ t[0][(crc ^ *inData++) & 0xff];
+
+	for( ; inSize >= 8 ; inSize -= 8, inData += 8)
+	{
+		uLONG low = _ReadLittleEndian32( inData) ^ crc;
+		uLONG high = _ReadLittleEndian32( inData + 4);
+		crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+			^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+	}
+
+	for( ; inSize > 0 ; --inSize)
+		crc = (crc >> 8) ^ t[0][(crc ^ *inData++) & 0xff];
+	return crc;
+}
+
+
+#if WITH_X86_EXTENSIONS
+
+__attribute__((target("sse4.2")))
+static uLONG _CRC32CSSE42( uLONG inCRC, const uBYTE *inData, size_t inSize)
+{
+	uLONG crc = inCRC;
+	for( ; (inSize > 0) && (((uintptr_t) inData & 7) != 0) ; --inSize)
+		crc = _mm_crc32_u8( crc, *inData++);
+
+	uLONG8 crc64 = crc;
+	for( ; inSize >= 8 ; inSize -= 8, inData += 8)
+		crc64 = _mm_crc32_u64( crc64, *(const uLONG8*) inData);
+	crc = (uLONG) crc64;
+
+	for( ; inSize > 0 ; --inSize)
+		crc = _mm_crc32_u8( crc, *inData++);
+	return crc;
+}
+
+#endif
+
+
+typedef uLONG (*CRC32CProc)( uLONG inCRC, const uBYTE *inData, size_t inSize);
+
+static CRC32CProc _GetCRC32CProc()
+{
+#if WITH_X86_EXTENSIONS
+	static CRC32CProc sProc = _HasSSE42() ? _CRC32CSSE42 : _CRC32C;
+	return sProc;
+#else
+	return _CRC32C;
+#endif
+}
+
+
+/*
+	static
+*/
+uLONG VChecksumCRC32C::Extend( uLONG inCRC, const void *inData, size_t inSize)
+{
+	if ( (inData == NULL) || (inSize == 0) )
+		return inCRC;
+	return ~_GetCRC32CProc()( ~inCRC, (const uBYTE*) inData, inSize);
+}
+
+
+/*
+	static
+*/
+bool VChecksumCRC32C::IsAccelerated()
+{
+	return _GetCRC32CProc() != _CRC32C;
+}
+
+
+void VChecksumCRC32C::GetChecksumBytes( uBYTE *outChecksum)
+{
+	_WriteBigEndian32( outChecksum, fCRC);
+}
+
+
+//================================================================================
+
+
+static const uLONG8 kXXH_PRIME64_1 = 0x9e3779b185ebca87ULL;
+static const uLONG8 kXXH_PRIME64_2 = 0xc2b2ae3d27d4eb4fULL;
+static const uLONG8 kXXH_PRIME64_3 = 0x165667b19e3779f9ULL;
+static const uLONG8 kXXH_PRIME64_4 = 0x85ebca77c2b2ae63ULL;
+static const uLONG8 kXXH_PRIME64_5 = 0x27d4eb2f165667c5ULL;
+
+static inline uLONG8 _XXHRotate( uLONG8 inValue, sLONG inBits)
+{
+	return (inValue << inBits) | (inValue >> (64 - inBits));
+}
+
+
+static inline uLONG8 _XXHRound( uLONG8 inAccumulator, uLONG8 inInput)
+{
+	inAccumulator += inInput * kXXH_PRIME64_2;
+	return _XXHRotate( inAccumulator, 31) * kXXH_PRIME64_1;
+}
+
+
+static inline uLONG8 _XXHMergeRound( uLONG8 inAccumulator, uLONG8 inValue)
+{
+	inAccumulator ^= _XXHRound( 0, inValue);
+	return inAccumulator * kXXH_PRIME64_1 + kXXH_PRIME64_4;
+}
+
+
+// 32 bytes stripes, returns the count of bytes consumed
+static size_t _XXHConsumeStripes( uLONG8 ioAccumulators[4], const uBYTE *inData, size_t inSize)
+{
+	uLONG8 v1 = ioAccumulators[0], v2 = ioAccumulators[1], v3 = ioAccumulators[2], v4 = ioAccumulators[3];
+	const uBYTE *p = inData;
+	for( const uBYTE *end = inData + (inSize & ~(size_t) 31) ; p < end ; p += 32)
+	{
+		v1 = _XXHRound( v1, _ReadLittleEndian64( p));
+		v2 = _XXHRound( v2, _ReadLittleEndian64( p + 8));
+		v3 = _XXHRound( v3, _ReadLittleEndian64( p + 16));
+		v4 = _XXHRound( v4, _ReadLittleEndian64( p + 24));
+	}
+	ioAccumulators[0] = v1; ioAccumulators[1] = v2; ioAccumulators[2] = v3; ioAccumulators[3] = v4;
+	return p - inData;
+}
+
+
+VChecksumXXH64::VChecksumXXH64( uLONG8 inSeed)
+: fSeed( inSeed)
+{
+	Clear();
+}
+
+
+void VChecksumXXH64::Clear()
+{
+	fAccumulators[0] = fSeed + kXXH_PRIME64_1 + kXXH_PRIME64_2;
+	fAccumulators[1] = fSeed + kXXH_PRIME64_2;
+	fAccumulators[2] = fSeed;
+	fAccumulators[3] = fSeed - kXXH_PRIME64_1;
+	fTotalSize = 0;
+	fBufferSize = 0;
+}
+
+
+void VChecksumXXH64::Update( const void *inData, size_t inSize)
+{
+	if ( (inData == NULL) || (inSize == 0) )
+		return;
+
+	const uBYTE *data = (const uBYTE*) inData;
+	fTotalSize += inSize;
+
+	if (fBufferSize > 0)
+	{
+		size_t count = Min( inSize, sizeof( fBuffer) - fBufferSize);
+		::memcpy( fBuffer + fBufferSize, data, count);
+		fBufferSize += count;
+		data += count;
+		inSize -= count;
+		if (fBufferSize < sizeof( fBuffer))
+			return;
+		_XXHConsumeStripes( fAccumulators, fBuffer, sizeof( fBuffer));
+		fBufferSize = 0;
+	}
+
+	size_t consumed = _XXHConsumeStripes( fAccumulators, data, inSize);
+	fBufferSize = inSize - consumed;
+	if (fBufferSize > 0)
+		::memcpy( fBuffer, data + consumed, fBufferSize);
+}
+
+
+uLONG8 VChecksumXXH64::GetChecksum() const
+{
+	uLONG8 h;
+	if (fTotalSize >= 32)
+	{
+		const uLONG8 *v = fAccumulators;
+		h = _XXHRotate( v[0], 1) + _XXHRotate( v[1], 7) + _XXHRotate( v[2], 12) + _XXHRotate( v[3], 18);
+		h = _XXHMergeRound( h, v[0]);
+		h = _XXHMergeRound( h, v[1]);
+		h = _XXHMergeRound( h, v[2]);
+		h = _XXHMergeRound( h, v[3]);
+	}
+	else
+	{
+		h = fSeed + kXXH_PRIME64_5;
+	}
+	h += fTotalSize;
+
+	// the bytes left in the buffer
+	const uBYTE *p = fBuffer;
+	size_t size = fBufferSize;
+	for( ; size >= 8 ; size -= 8, p += 8)
+	{
+		h ^= _XXHRound( 0, _ReadLittleEndian64( p));
+		h = _XXHRotate( h, 27) * kXXH_PRIME64_1 + kXXH_PRIME64_4;
+	}
+	if (size >= 4)
+	{
+		h ^= (uLONG8) _ReadLittleEndian32( p) * kXXH_PRIME64_1;
+		h = _XXHRotate( h, 23) * kXXH_PRIME64_2 + kXXH_PRIME64_3;
+		size -= 4;
+		p += 4;
+	}
+	for( ; size > 0 ; --size, ++p)
+	{
+		h ^= *p * kXXH_PRIME64_5;
+		h = _XXHRotate( h, 11) * kXXH_PRIME64_1;
+	}
+
+	// avalanche
+	h ^= h >> 33;
+	h *= kXXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= kXXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+
+void VChecksumXXH64::GetChecksumBytes( uBYTE *outChecksum)
+{
+	uLONG8 checksum = GetChecksum();
+	_WriteBigEndian32( outChecksum, (uLONG) (checksum >> 32));
+	_WriteBigEndian32( outChecksum + 4, (uLONG) checksum);
+}
+
+
+/*
+	static
+*/
+uLONG8 VChecksumXXH64::GetChecksumFromBytes( const void *inData, size_t inSize, uLONG8 inSeed)
+{
+	VChecksumXXH64 checksum( inSeed);
+	checksum.Update( inData, inSize);
+	return checksum.GetChecksum();
+}
+
+
+//================================================================================
+
+
+VChecksumStream::VChecksumStream( VStream *inStream, IChecksum *inChecksum)
+: fStream( inStream)
+, fChecksum( inChecksum)
+, fStartPos( 0)
+, fChecksumCount( 0)
+, fOwnsOpening( false)
+{
+	xbox_assert( (inStream != NULL) && (inChecksum != NULL));
+}
+
+
+VChecksumStream::~VChecksumStream()
+{
+	xbox_assert( !IsReading() && !IsWriting());
+}
+
+
+VError VChecksumStream::DoOpenReading()
+{
+	fOwnsOpening = !fStream->IsReading();
+	VError err = fOwnsOpening ? fStream->OpenReading() : VE_OK;
+	fStartPos = fStream->GetPos();
+	fChecksumCount = 0;
+	return err;
+}
+
+
+VError VChecksumStream::DoOpenWriting()
+{
+	fOwnsOpening = !fStream->IsWriting();
+	VError err = fOwnsOpening ? fStream->OpenWriting() : VE_OK;
+	fStartPos = fStream->GetPos();
+	fChecksumCount = 0;
+	return err;
+}
+
+
+VError VChecksumStream::DoCloseReading()
+{
+	VError err = fOwnsOpening ? fStream->CloseReading() : VE_OK;
+	fOwnsOpening = false;
+	return err;
+}
+
+
+VError VChecksumStream::DoCloseWriting( Boolean inSetSize)
+{
+	VError err = fOwnsOpening ? fStream->CloseWriting( inSetSize != 0) : VE_OK;
+	fOwnsOpening = false;
+	return err;
+}
+
+
+VError VChecksumStream::DoGetData( void* inBuffer, VSize* ioCount)
+{
+	VError err = fStream->GetData( inBuffer, *ioCount, ioCount);
+
+	// bytes read again after an unget or a backward move have already been counted
+	sLONG8 pos = GetPos();
+	sLONG8 end = pos + (sLONG8) *ioCount;
+	if (end > fChecksumCount)
+	{
+		xbox_assert( pos <= fChecksumCount);
+		sLONG8 skip = fChecksumCount - pos;
+		fChecksum->Update( (const char*) inBuffer + skip, (size_t) (end - fChecksumCount));
+		fChecksumCount = end;
+	}
+	return err;
+}
+
+
+VError VChecksumStream::DoUngetData( const void* inBuffer, VSize inNbBytes)
+{
+	return fStream->UngetData( inBuffer, inNbBytes);
+}
+
+
+VError VChecksumStream::DoPutData( const void* inBuffer, VSize inNbBytes)
+{
+	VError err = fStream->PutData( inBuffer, inNbBytes);
+	if (err == VE_OK)
+	{
+		fChecksum->Update( inBuffer, inNbBytes);
+		fChecksumCount += inNbBytes;
+	}
+	return err;
+}
+
+
+sLONG8 VChecksumStream::DoGetSize()
+{
+	return fStream->GetSize() - fStartPos;
+}
+
+
+VError VChecksumStream::DoSetSize( sLONG8 /*inNewSize*/)
+{
+	return vThrowError( VE_STREAM_CANNOT_SET_SIZE);
+}
+
+
+VError VChecksumStream::DoSetPos( sLONG8 inNewPos)
+{
+	// the checksum can't skip or rewrite bytes
+	if ( (inNewPos > fChecksumCount) || (IsWriting() && (inNewPos != GetPos())) )
+		return vThrowError( VE_STREAM_CANNOT_SET_POS);
+
+	return fStream->SetPos( fStartPos + inNewPos);
+}
+
+
+VError VChecksumStream::DoFlush()
+{
+	return fStream->Flush();
+}
@@ -16,15 +16,38 @@
 #ifndef __VChecksumMD5__
 #define __VChecksumMD5__
 
+#include "Kernel/Sources/VStream.h"
+
 BEGIN_TOOLBOX_NAMESPACE
 
 class VString;
 
+
+/*!
+	@class	IChecksum
+	@abstract	Incremental computation common to all checksums (see VChecksumStream).
+*/
+class XTOOLBOX_API IChecksum
+{
+public:
+	virtual			~IChecksum()	{;}
+
+	virtual	void	Clear() = 0;
+	virtual	void	Update( const void *inData, size_t inSize) = 0;
+
+	// size of the checksum in bytes
+	virtual	size_t	GetChecksumSize() const = 0;
+
+	// writes GetChecksumSize() bytes. Integer checksums (crc32c, xxhash64) are written big endian, the order they are printed in.
+	virtual	void	GetChecksumBytes( uBYTE *outChecksum) = 0;
+};
+
+
 /* Data structure for MD5 (Message-Digest) computation */
 const size_t MD5_SIZE = 16;
 typedef uBYTE MD5[MD5_SIZE];
 
-class XTOOLBOX_API VChecksumMD5 : public VObject
+class XTOOLBOX_API VChecksumMD5 : public VObject, public IChecksum
 {
 public:
 
@@ -40,9 +63,13 @@ public:
 
 	// incremental computation
 					VChecksumMD5();
-			void	Clear();
-			void	Update( const void *inData, size_t inSize );
+	virtual	void	Clear();
+	virtual	void	Update( const void *inData, size_t inSize );
 			void	GetChecksum( MD5& outChecksum );
+
+	// inherited from IChecksum
+	virtual	size_t	GetChecksumSize() const								{ return MD5_SIZE;}
+	virtual	void	GetChecksumBytes( uBYTE *outChecksum)				{ GetChecksum( *reinterpret_cast<MD5*>( outChecksum));}
 	
 private:
 					VChecksumMD5( const VChecksumMD5&);
@@ -62,7 +89,7 @@ private:
 const size_t	SHA1_SIZE = 20;
 typedef uBYTE SHA1[SHA1_SIZE];
 
-class XTOOLBOX_API VChecksumSHA1 : public VObject
+class XTOOLBOX_API VChecksumSHA1 : public VObject, public IChecksum
 {
 public:
 	// common checksum computation
@@ -77,9 +104,13 @@ public:
 
 	// incremental computation
 					VChecksumSHA1();
-			void	Clear();
-			void	Update( const void *inData, size_t inSize );
+	virtual	void	Clear();
+	virtual	void	Update( const void *inData, size_t inSize );
 			void	GetChecksum( SHA1& outChecksum );
+
+	// inherited from IChecksum
+	virtual	size_t	GetChecksumSize() const								{ return SHA1_SIZE;}
+	virtual	void	GetChecksumBytes( uBYTE *outChecksum)				{ GetChecksum( *reinterpret_cast<SHA1*>( outChecksum));}
 	
 private:
 	enum { SHA1_BLOCK_LENGTH = 64};
@@ -102,6 +133,174 @@ private:
 };
 
 
+const size_t	SHA256_SIZE = 32;
+typedef uBYTE SHA256[SHA256_SIZE];
+
+/*!
+	@class	VChecksumSHA256
+	@abstract	SHA-256 (FIPS 180-4).
+	@discussion	Blocks are hashed with the sha extensions of the processor when it has them.
+*/
+class XTOOLBOX_API VChecksumSHA256 : public VObject, public IChecksum
+{
+public:
+	// common checksum computation
+	static	void	GetChecksumFromBytes( const void *inData, size_t inSize, SHA256& outChecksum);
+	static	void	GetChecksumFromBytesHexa( const void *inData, size_t inSize, VString& outChecksumHexa);
+
+	static	void	GetChecksumFromStringUTF8( const VString& inString, SHA256& outChecksum);
+	static	void	GetChecksumFromStringUTF8Hexa( const VString& inString, VString& outChecksumHexa);
+
+	static	void	EncodeChecksumHexa( const SHA256& inDigest, VString& outChecksumHexa);
+	static	void	EncodeChecksumBase64( const SHA256& inDigest, VString& outChecksumBase64);
+
+	// true if the processor sha extensions are used
+	static	bool	IsAccelerated();
+
+	// incremental computation
+					VChecksumSHA256();
+	virtual	void	Clear();
+	virtual	void	Update( const void *inData, size_t inSize );
+			void	GetChecksum( SHA256& outChecksum );
+
+	// inherited from IChecksum
+	virtual	size_t	GetChecksumSize() const								{ return SHA256_SIZE;}
+	virtual	void	GetChecksumBytes( uBYTE *outChecksum)				{ GetChecksum( *reinterpret_cast<SHA256*>( outChecksum));}
+
+private:
+	enum { SHA256_BLOCK_LENGTH = 64};
+
+					VChecksumSHA256( const VChecksumSHA256&);
+					VChecksumSHA256& operator=( const VChecksumSHA256&);
+
+			uLONG	fState[8];
+			uLONG8	fCount;		// bytes
+			uBYTE	fBuffer[SHA256_BLOCK_LENGTH];
+};
+
+
+/*!
+	@class	VChecksumCRC32C
+	@abstract	CRC-32C (Castagnoli polynomial, as used by iSCSI, ext4 or snappy).
+	@discussion	Uses the sse4.2 crc32 instruction when the processor has it.
+				Much faster than a digest but only meant to detect accidental changes.
+*/
+class XTOOLBOX_API VChecksumCRC32C : public VObject, public IChecksum
+{
+public:
+	static	uLONG	GetChecksumFromBytes( const void *inData, size_t inSize)				{ return Extend( 0, inData, inSize);}
+
+	// continues the crc inCRC of previous bytes (0 if none)
+	static	uLONG	Extend( uLONG inCRC, const void *inData, size_t inSize);
+
+	// true if the sse4.2 crc32 instruction is used
+	static	bool	IsAccelerated();
+
+	// incremental computation
+					VChecksumCRC32C():fCRC( 0)											{;}
+	virtual	void	Clear()																{ fCRC = 0;}
+	virtual	void	Update( const void *inData, size_t inSize)							{ fCRC = Extend( fCRC, inData, inSize);}
+			uLONG	GetChecksum() const													{ return fCRC;}
+
+	// inherited from IChecksum
+	virtual	size_t	GetChecksumSize() const												{ return sizeof( uLONG);}
+	virtual	void	GetChecksumBytes( uBYTE *outChecksum);
+
+private:
+			uLONG	fCRC;
+};
+
+
+/*!
+	@class	VChecksumXXH64
+	@abstract	xxHash64, a fast non cryptographic hash.
+	@discussion	Gives the same values as the reference implementation (XXH64).
+*/
+class XTOOLBOX_API VChecksumXXH64 : public VObject, public IChecksum
+{
+public:
+	static	uLONG8	GetChecksumFromBytes( const void *inData, size_t inSize, uLONG8 inSeed = 0);
+
+	// incremental computation
+	explicit		VChecksumXXH64( uLONG8 inSeed = 0);
+	virtual	void	Clear();
+	virtual	void	Update( const void *inData, size_t inSize);
+
+	// the computation may go on after GetChecksum()
+			uLONG8	GetChecksum() const;
+
+	// inherited from IChecksum
+	virtual	size_t	GetChecksumSize() const												{ return sizeof( uLONG8);}
+	virtual	void	GetChecksumBytes( uBYTE *outChecksum);
+
+private:
+			uLONG8	fSeed;
+			uLONG8	fTotalSize;
+			uLONG8	fAccumulators[4];
+			uBYTE	fBuffer[32];
+			size_t	fBufferSize;
+};
+
+
+/*!
+	@class	VChecksumStream
+	@abstract	Computes a checksum of the data read from or written to another stream.
+	@discussion
+		Reads and writes go to inStream and the bytes are given to the checksum in stream order,
+		so that a file can be copied and checksummed in one pass.
+		Bytes read again after UngetData() or after moving backward are not counted twice.
+		While writing, the position can't be changed and the size can't be set.
+
+		inStream is opened and closed with the VChecksumStream if it's not already opened.
+		Neither inStream nor inChecksum are owned.
+
+		VChecksumSHA256 sha;
+		VChecksumStream checksumStream( &fileStream, &sha);
+		if (checksumStream.OpenReading() == VE_OK)
+		{
+			... read checksumStream ...
+			checksumStream.CloseReading();
+			sha.GetChecksum( digest);
+		}
+*/
+class XTOOLBOX_API VChecksumStream : public VStream
+{
+public:
+							VChecksumStream( VStream *inStream, IChecksum *inChecksum);
+	virtual					~VChecksumStream();
+
+			VStream*		GetStream() const						{ return fStream;}
+			IChecksum*		GetChecksum() const						{ return fChecksum;}
+
+			// count of bytes given to the checksum
+			sLONG8			GetChecksumCount() const				{ return fChecksumCount;}
+
+protected:
+	// Inherited from VStream
+	virtual VError			DoOpenReading();
+	virtual VError			DoOpenWriting();
+	virtual VError			DoCloseReading();
+	virtual VError			DoCloseWriting( Boolean inSetSize);
+	virtual VError			DoPutData( const void* inBuffer, VSize inNbBytes);
+	virtual VError			DoGetData( void* inBuffer, VSize* ioCount);
+	virtual VError			DoUngetData( const void* inBuffer, VSize inNbBytes);
+	virtual sLONG8			DoGetSize();
+	virtual VError			DoSetSize( sLONG8 inNewSize);
+	virtual VError			DoSetPos( sLONG8 inNewPos);
+	virtual VError			DoFlush();
+
+private:
+							VChecksumStream( const VChecksumStream&);
+			VChecksumStream&	operator=( const VChecksumStream&);
+
+			VStream*		fStream;
+			IChecksum*		fChecksum;
+			sLONG8			fStartPos;			// position of fStream when opened
+			sLONG8			fChecksumCount;		// the first fChecksumCount bytes have been given to fChecksum
+			bool			fOwnsOpening;		// fStream opened by this stream
+};
+
+
 END_TOOLBOX_NAMESPACE
 
 #endif
\ No newline at end of file
@@ -33,6 +33,8 @@
 #include "VUnicodeRanges.h"
 #include "VUnicodeTableFull.h"
 #include "VProfiler.h"
+#include "VParallel.h"
+#include "VString_ExtendedSTL.h"
 
 #if USE_ICU
 #include "unicode/uclean.h"
@@ -57,6 +59,9 @@ inline bool IsIgnorableBasicLatin( UniChar inChar)
 
 UniChar VCollator::sDefaultWildChar = CHAR_COMMERCIAL_AT;
 
+const sLONG		kMAX_CACHED_SORT_KEYS		= 1024;		// per strength
+const sLONG		kMAX_CACHED_STRING_LENGTH	= 64;		// longer strings are not worth caching
+
 
 /************************************************************************/
 // collator base class
@@ -364,6 +369,226 @@ CompareResult VCollator::CompareString_Like( const UniChar* inText, sLONG inText
 }
 
 
+/*
+	Most recently used sort keys, one list per strength (most recent first).
+*/
+class VCollator::SortKeyCache
+{
+public:
+			bool					Get( const VString& inString, bool inWithDiacritics, std::vector<uBYTE>& outKey);
+			void					Put( const VString& inString, bool inWithDiacritics, const std::vector<uBYTE>& inKey);
+
+private:
+	typedef std::pair<VString,std::vector<uBYTE> >					Entry;
+	typedef std::list<Entry>										ListOfEntry;
+	typedef unordered_map_VString<ListOfEntry::iterator>			MapOfEntry;
+
+			VCriticalSection		fLock;
+			ListOfEntry				fEntries[2];
+			MapOfEntry				fMaps[2];
+};
+
+
+bool VCollator::SortKeyCache::Get( const VString& inString, bool inWithDiacritics, std::vector<uBYTE>& outKey)
+{
+	bool found = false;
+
+	fLock.Lock();
+
+	MapOfEntry& map = fMaps[inWithDiacritics ? 1 : 0];
+	MapOfEntry::iterator i = map.find( inString);
+	if (i != map.end())
+	{
+		ListOfEntry& entries = fEntries[inWithDiacritics ? 1 : 0];
+		entries.splice( entries.begin(), entries, i->second);
+		outKey = i->second->second;
+		found = true;
+	}
+
+	fLock.Unlock();
+
+	return found;
+}
+
+
+void VCollator::SortKeyCache::Put( const VString& inString, bool inWithDiacritics, const std::vector<uBYTE>& inKey)
+{
+	fLock.Lock();
+
+	MapOfEntry& map = fMaps[inWithDiacritics ? 1 : 0];
+	ListOfEntry& entries = fEntries[inWithDiacritics ? 1 : 0];
+	if (map.find( inString) == map.end())
+	{
+		try
+		{
+			entries.push_front( Entry( inString, inKey));
+			map[inString] = entries.begin();
+
+			if (map.size() > kMAX_CACHED_SORT_KEYS)
+			{
+				map.erase( entries.back().first);
+				entries.pop_back();
+			}
+		}
+		catch(...)
+		{
+			if (!entries.empty() && (map.find( entries.front().first) == map.end()))
+				entries.pop_front();
+		}
+	}
+
+	fLock.Unlock();
+}
+
+
+/*
+	Sorts references on a buffer holding all the keys
+*/
+class VSortKeyLess
+{
+public:
+	struct Ref
+	{
+		VString*	fString;
+		size_t		fOffset;
+		size_t		fSize;
+	};
+
+			VSortKeyLess( const uBYTE *inKeys, bool inDescending):fKeys( inKeys), fDescending( inDescending)	{;}
+
+			bool	operator()( const Ref& inRef1, const Ref& inRef2) const
+			{
+				return fDescending
+					? (VCollator::CompareSortKeys( fKeys + inRef2.fOffset, inRef2.fSize, fKeys + inRef1.fOffset, inRef1.fSize) == CR_SMALLER)
+					: (VCollator::CompareSortKeys( fKeys + inRef1.fOffset, inRef1.fSize, fKeys + inRef2.fOffset, inRef2.fSize) == CR_SMALLER);
+			}
+
+private:
+	const	uBYTE*	fKeys;
+			bool	fDescending;
+};
+
+
+class VCollatorStringLess
+{
+public:
+			VCollatorStringLess( VCollator *inCollator, bool inWithDiacritics, bool inDescending):fCollator( inCollator), fWithDiacritics( inWithDiacritics), fDescending( inDescending)	{;}
+
+			bool	operator()( const VString *inString1, const VString *inString2) const
+			{
+				return fDescending ? _Less( inString2, inString1) : _Less( inString1, inString2);
+			}
+
+private:
+			bool	_Less( const VString *inString1, const VString *inString2) const
+			{
+				if (inString2 == NULL)
+					return false;
+				if (inString1 == NULL)
+					return true;
+				return fCollator->CompareString( inString1->GetCPointer(), inString1->GetLength(), inString2->GetCPointer(), inString2->GetLength(), fWithDiacritics) == CR_SMALLER;
+			}
+
+			VCollator*	fCollator;
+			bool		fWithDiacritics;
+			bool		fDescending;
+};
+
+
+VCollator::~VCollator()
+{
+	delete fSortKeyCache;
+}
+
+
+bool VCollator::AppendSortKey( const UniChar* /*inText*/, sLONG /*inSize*/, bool /*inWithDiacritics*/, std::vector<uBYTE>& /*ioKeys*/)
+{
+	return false;
+}
+
+
+bool VCollator::GetSortKey( const UniChar* inText, sLONG inSize, bool inWithDiacritics, std::vector<uBYTE>& outKey)
+{
+	outKey.clear();
+
+	if (inSize > kMAX_CACHED_STRING_LENGTH)
+		return AppendSortKey( inText, inSize, inWithDiacritics, outKey);
+
+	if (fSortKeyCache == NULL)
+	{
+		SortKeyCache *cache = new SortKeyCache;
+		if ( (cache != NULL) && (VInterlocked::CompareExchangePtr( (void**) &fSortKeyCache, NULL, cache) != NULL) )
+			delete cache;
+		if (fSortKeyCache == NULL)
+			return AppendSortKey( inText, inSize, inWithDiacritics, outKey);
+	}
+
+	VString string( inText, inSize * sizeof( UniChar), VTC_UTF_16);
+	if (fSortKeyCache->Get( string, inWithDiacritics, outKey))
+		return true;
+
+	if (!AppendSortKey( inText, inSize, inWithDiacritics, outKey))
+		return false;
+
+	fSortKeyCache->Put( string, inWithDiacritics, outKey);
+	return true;
+}
+
+
+/*
+	static
+*/
+CompareResult VCollator::CompareSortKeys( const uBYTE *inKey1, size_t inSize1, const uBYTE *inKey2, size_t inSize2)
+{
+	int result = ::memcmp( inKey1, inKey2, Min( inSize1, inSize2));
+	if (result == 0)
+		return (inSize1 == inSize2) ? CR_EQUAL : ((inSize1 < inSize2) ? CR_SMALLER : CR_BIGGER);
+	return (result < 0) ? CR_SMALLER : CR_BIGGER;
+}
+
+
+void VCollator::SortStrings( VString** ioStrings, sLONG inCount, bool inWithDiacritics, bool inDescending)
+{
+	if (inCount < 2)
+		return;
+
+	std::vector<uBYTE> keys;
+	std::vector<VSortKeyLess::Ref> refs;
+	bool withKeys;
+	try
+	{
+		// one collation pass per string, all keys in one buffer
+		refs.resize( inCount);
+		withKeys = true;
+		for( sLONG i = 0 ; (i < inCount) && withKeys ; ++i)
+		{
+			VSortKeyLess::Ref& ref = refs[i];
+			ref.fString = ioStrings[i];
+			ref.fOffset = keys.size();
+			if (ref.fString != NULL)
+				withKeys = AppendSortKey( ref.fString->GetCPointer(), ref.fString->GetLength(), inWithDiacritics, keys);
+			ref.fSize = keys.size() - ref.fOffset;	// NULL strings have an empty key which comes first
+		}
+	}
+	catch(...)
+	{
+		withKeys = false;
+	}
+
+	if (withKeys)
+	{
+		// keys are compared with memcmp so that the sort can run in parallel
+		VParallel::Sort( &refs[0], inCount, VSortKeyLess( keys.empty() ? NULL : &keys[0], inDescending));
+		for( sLONG i = 0 ; i < inCount ; ++i)
+			ioStrings[i] = refs[i].fString;
+	}
+	else
+	{
+		std::stable_sort( ioStrings, ioStrings + inCount, VCollatorStringLess( this, inWithDiacritics, inDescending));
+	}
+}
+
+
 bool VCollator::EqualString_Like( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize, bool inWithDiacritics)
 {
 	const UniChar *p1 = inText;
@@ -1219,6 +1444,38 @@ bool VICUCollator::EqualString(const UniChar* inText1, sLONG inSize1, const UniC
 }
 
 
+bool VICUCollator::AppendSortKey( const UniChar* inText, sLONG inSize, bool inWithDiacritics, std::vector<uBYTE>& ioKeys)
+{
+	static const UniChar nullStr[] = {0};
+
+	// icu doesn't accept null pointer even if the associated size parameter is zero
+	if (inText == NULL)
+		inText = nullStr;
+
+	const xbox_icu::Collator *collator = inWithDiacritics ? fTertiaryCollator : fPrimaryCollator;
+
+	// keys of latin text rarely need more than 4 bytes per char. The terminating zero is kept.
+	size_t start = ioKeys.size();
+	int32_t capacity = 4 * inSize + 16;
+	ioKeys.resize( start + capacity);
+	int32_t length = collator->getSortKey( inText, inSize, &ioKeys[start], capacity);
+	if (length > capacity)
+	{
+		ioKeys.resize( start + length);
+		length = collator->getSortKey( inText, inSize, &ioKeys[start], length);
+	}
+
+	if (!testAssert( length > 0))
+	{
+		ioKeys.resize( start);
+		return false;
+	}
+
+	ioKeys.resize( start + length);
+	return true;
+}
+
+
 VICUCollator* VICUCollator::Create( DialectCode inDialect, const xbox_icu::Locale *inLocale, CollatorOptions inOptions)
 {
 	VICUCollator* col = NULL;
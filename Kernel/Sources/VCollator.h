@@ -33,6 +33,8 @@ BEGIN_TOOLBOX_NAMESPACE
 class XTOOLBOX_API VCollator : public VObject, public IRefCountable
 {
 public:
+	virtual							~VCollator();
+
 	virtual	CompareResult			CompareString( const UniChar* inText1, sLONG inSize1, const UniChar* inText2, sLONG inSize2, bool inWithDiacritics) = 0;
 			CompareResult			CompareString_Like( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize, bool inWithDiacritics);
 	virtual	bool					EqualString( const UniChar* inText1, sLONG inSize1, const UniChar* inText2, sLONG inSize2, bool inWithDiacritics) = 0;
@@ -46,6 +48,23 @@ public:
 
 	virtual	VCollator*				Clone() const = 0;
 
+			/*
+				Binary sort keys: comparing keys with CompareSortKeys gives the same order as CompareString,
+				so that sorting or indexing many strings needs only one collation pass per string.
+
+				AppendSortKey appends the key of inText to ioKeys. Returns false if the collator has no sort keys (system collators).
+				GetSortKey does the same but looks first in a cache of the keys of recently used short strings.
+			*/
+	virtual	bool					AppendSortKey( const UniChar* inText, sLONG inSize, bool inWithDiacritics, std::vector<uBYTE>& ioKeys);
+			bool					GetSortKey( const UniChar* inText, sLONG inSize, bool inWithDiacritics, std::vector<uBYTE>& outKey);
+	static	CompareResult			CompareSortKeys( const uBYTE *inKey1, size_t inSize1, const uBYTE *inKey2, size_t inSize2);
+
+			/*
+				Sorts strings in place like CompareString would (NULL strings first), equal strings keep their order.
+				Strings are sorted on their sort key if available.
+			*/
+			void					SortStrings( VString** ioStrings, sLONG inCount, bool inWithDiacritics, bool inDescending);
+
 			UniChar					GetWildChar() const					{ return fWildChar;}
 	virtual	void					SetWildChar( UniChar inWildChar);
 
@@ -66,8 +85,8 @@ protected:
 	virtual	CompareResult			_CompareString_Like_IgnoreWildCharInMiddle( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize, bool inWithDiacritics);
 	virtual	CompareResult			_CompareString_Like_SupportWildCharInMiddle( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize, bool inWithDiacritics);
 
-									VCollator( const VCollator& inCollator) : fDialect( inCollator.fDialect), fWildChar( inCollator.fWildChar), fOptions( inCollator.fOptions)	{;}
-									VCollator( DialectCode inDialect, CollatorOptions inOptions) : fDialect( inDialect), fWildChar( sDefaultWildChar), fOptions( inOptions)	{;}
+									VCollator( const VCollator& inCollator) : fDialect( inCollator.fDialect), fWildChar( inCollator.fWildChar), fOptions( inCollator.fOptions), fSortKeyCache( NULL)	{;}
+									VCollator( DialectCode inDialect, CollatorOptions inOptions) : fDialect( inDialect), fWildChar( sDefaultWildChar), fOptions( inOptions), fSortKeyCache( NULL)	{;}
 	
 	static	UniChar					sDefaultWildChar;
 	
@@ -75,6 +94,10 @@ protected:
 			UniChar					fWildChar;
 			CollatorOptions			fOptions;
 
+private:
+	class SortKeyCache;
+
+			SortKeyCache*			fSortKeyCache;	// allocated at first use
 };
 
 
@@ -149,6 +172,8 @@ public:
 	static	VICUCollator*				Create( DialectCode inDialect, const xbox_icu::Locale *inLocale, CollatorOptions inOptions);
 	virtual VICUCollator*				Clone() const	{ return new VICUCollator(*this);}
 
+	virtual	bool						AppendSortKey( const UniChar* inText, sLONG inSize, bool inWithDiacritics, std::vector<uBYTE>& ioKeys);
+
 	virtual	void						SetWildChar( UniChar inWildChar);
 
 	static	void						GetLocalesHavingCollator( const xbox_icu::Locale& inDisplayNameLocale, std::vector<const char*>& outLocales, std::vector<VString>& outCollatorDisplayNames);
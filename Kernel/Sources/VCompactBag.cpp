@@ -0,0 +1,837 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VCompactBag.h"
+#include "VStream.h"
+#include "VErrorContext.h"
+#include "VTextConverter.h"
+
+
+// Class constants
+const uLONG		kCOMPACT_BAG_SIGNATURE		= 'CBAG';
+const uWORD		kCOMPACT_BAG_MAJOR_VERSION	= 1;		// increment this if not backward compatible
+const uWORD		kCOMPACT_BAG_MINOR_VERSION	= 0;
+const uLONG		kCOMPACT_BAG_BYTE_ORDER		= 0x01020304;
+const uLONG		kINDEX_THRESHOLD			= 5;		// same as VPackedDictionary_base::threshold_for_hashkeymap
+const sLONG		kMAX_DEPTH					= 1024;		// protects the CreateBag stack against a corrupted image
+const VSize		kMAX_KEY_LENGTH				= 255;		// utf-8 bytes, the key length is stored in one byte
+
+
+BEGIN_TOOLBOX_NAMESPACE
+
+/*
+	Image layout (native byte order, all offsets are from the start of the image):
+
+	_VCompactBagHeader
+	then in any order:
+		keys:		uBYTE length, utf-8 bytes, 0
+		nodes:		_VCompactBagNodeHeader, _VCompactBagAttribute[fAttributeCount], _VCompactBagElement[fElementNameCount]
+		indexes:	uLONG[count] entry positions sorted by hash code (only for more than kINDEX_THRESHOLD entries)
+		values:		VValue backstore (VValueSingle::WriteToPtr), 8 bytes aligned
+		elements:	uLONG[fCount] node offsets
+*/
+
+struct _VCompactBagHeader
+{
+	uLONG	fSignature;
+	uWORD	fMajorVersion;
+	uWORD	fMinorVersion;
+	uLONG	fByteOrder;
+	uLONG	fSize;
+	uLONG	fRoot;
+	uLONG	fReserved;
+};
+
+
+struct _VCompactBagNodeHeader
+{
+	uLONG	fAttributeCount;
+	uLONG	fElementNameCount;
+	uLONG	fAttributeIndex;	// 0 if no index
+	uLONG	fElementIndex;		// 0 if no index
+};
+
+
+struct _VCompactBagAttribute
+{
+	uLONG	fKey;
+	uLONG	fHash;
+	uLONG	fValue;
+	uLONG	fSize;
+	uWORD	fKind;				// true value kind
+	uWORD	fReserved;
+};
+
+
+struct _VCompactBagElement
+{
+	uLONG	fKey;
+	uLONG	fHash;
+	uLONG	fCount;
+	uLONG	fNodes;
+};
+
+
+/*
+	Private class
+
+	Builds an image in a VMemoryBuffer.
+*/
+class VCompactBagWriter
+{
+public:
+								VCompactBagWriter( VMemoryBuffer<>& outBuffer):fBuffer( outBuffer), fMemoryFull( false), fKeyTooLong( false)	{;}
+
+			VError				Write( const VValueBag& inBag);
+
+private:
+	typedef std::map<std::string,uLONG>	MapOfKeys;
+
+	template<class ENTRY>
+	class LessHash
+	{
+	public:
+		LessHash( const std::vector<ENTRY>& inEntries):fEntries( inEntries)	{;}
+		bool operator()( uLONG inLeft, uLONG inRight) const { return fEntries[inLeft].fHash < fEntries[inRight].fHash;}
+	private:
+		const std::vector<ENTRY>& fEntries;
+	};
+
+			uLONG				_WriteNode( const VValueBag& inBag);
+			uLONG				_WriteKey( const VString& inName, uLONG& outHash);
+			template<class ENTRY>
+			uLONG				_WriteIndex( const std::vector<ENTRY>& inEntries);
+
+			uLONG				_Append( const void *inData, VSize inSize);
+			uLONG				_Align( VSize inAlignment);
+			void				_Put( uLONG inOffset, const void *inData, VSize inSize);
+			uLONG				_GetLength() const							{ return (uLONG) fBuffer.GetDataSize();}
+
+			VMemoryBuffer<>&	fBuffer;
+			std::vector<char>	fValueData;
+			MapOfKeys			fKeys;
+			bool				fMemoryFull;
+			bool				fKeyTooLong;		// a key is longer than kMAX_KEY_LENGTH
+};
+
+
+VError VCompactBagWriter::Write( const VValueBag& inBag)
+{
+	fBuffer.SetSize( 0);
+	fKeys.clear();
+	fMemoryFull = false;
+	fKeyTooLong = false;
+
+	_VCompactBagHeader header;
+	header.fSignature = kCOMPACT_BAG_SIGNATURE;
+	header.fMajorVersion = kCOMPACT_BAG_MAJOR_VERSION;
+	header.fMinorVersion = kCOMPACT_BAG_MINOR_VERSION;
+	header.fByteOrder = kCOMPACT_BAG_BYTE_ORDER;
+	header.fSize = 0;
+	header.fRoot = 0;
+	header.fReserved = 0;
+	_Append( &header, sizeof( header));
+
+	try
+	{
+		header.fRoot = _WriteNode( inBag);
+	}
+	catch(...)
+	{
+		fMemoryFull = true;
+	}
+
+	if (fKeyTooLong)
+	{
+		fBuffer.Clear();
+		return vThrowError( VE_INVALID_PARAMETER);
+	}
+
+	if (fMemoryFull || (fBuffer.GetDataSize() > (VSize) kMAX_uLONG))
+	{
+		fBuffer.Clear();
+		return vThrowError( VE_MEMORY_FULL);
+	}
+
+	header.fSize = _GetLength();
+	_Put( 0, &header, sizeof( header));
+
+	return VE_OK;
+}
+
+
+uLONG VCompactBagWriter::_WriteNode( const VValueBag& inBag)
+{
+	VIndex attributesCount = inBag.GetAttributesCount();
+	VIndex elementNamesCount = inBag.GetElementNamesCount();
+
+	_VCompactBagNodeHeader node;
+	node.fAttributeCount = attributesCount;
+	node.fElementNameCount = elementNamesCount;
+	node.fAttributeIndex = 0;
+	node.fElementIndex = 0;
+
+	std::vector<_VCompactBagAttribute> attributes( attributesCount);
+	std::vector<_VCompactBagElement> elements( elementNamesCount);
+
+	// attribute values
+	VString name;
+	for( VIndex i = 0 ; i < attributesCount ; ++i)
+	{
+		_VCompactBagAttribute& entry = attributes[i];
+		const VValueSingle *value = inBag.GetNthAttribute( i + 1, &name);
+		entry.fKey = _WriteKey( name, entry.fHash);
+		entry.fKind = (uWORD) ((value != NULL) ? value->GetTrueValueKind() : (ValueKind) VK_EMPTY);
+		entry.fReserved = 0;
+		entry.fValue = 0;
+		entry.fSize = 0;
+		if (value != NULL)
+		{
+			entry.fSize = (uLONG) value->GetSpace();
+			fValueData.resize( entry.fSize + 1);
+			value->WriteToPtr( &fValueData.front());
+			_Align( 8);
+			entry.fValue = _Append( &fValueData.front(), entry.fSize);
+		}
+	}
+
+	// elements
+	for( VIndex i = 0 ; i < elementNamesCount ; ++i)
+	{
+		_VCompactBagElement& entry = elements[i];
+		const VBagArray *array = inBag.GetNthElementName( i + 1, &name);
+		entry.fKey = _WriteKey( name, entry.fHash);
+		entry.fCount = (array != NULL) ? array->GetCount() : 0;
+		std::vector<uLONG> nodes( entry.fCount);
+		for( VIndex j = 0 ; j < (VIndex) entry.fCount ; ++j)
+			nodes[j] = _WriteNode( *array->GetNth( j + 1));
+		_Align( 4);
+		entry.fNodes = nodes.empty() ? 0 : _Append( &nodes.front(), nodes.size() * sizeof( uLONG));
+	}
+
+	if (attributes.size() > kINDEX_THRESHOLD)
+		node.fAttributeIndex = _WriteIndex( attributes);
+
+	if (elements.size() > kINDEX_THRESHOLD)
+		node.fElementIndex = _WriteIndex( elements);
+
+	// the node itself
+	uLONG offset = _Align( 4);
+	_Append( &node, sizeof( node));
+	if (!attributes.empty())
+		_Append( &attributes.front(), attributes.size() * sizeof( _VCompactBagAttribute));
+	if (!elements.empty())
+		_Append( &elements.front(), elements.size() * sizeof( _VCompactBagElement));
+
+	return offset;
+}
+
+
+uLONG VCompactBagWriter::_WriteKey( const VString& inName, uLONG& outHash)
+{
+	// StPackedDictionaryKey would silently make an empty key of a too long name
+	char buffer[kMAX_KEY_LENGTH + 1];
+	VFromUnicodeConverter_UTF8 converter;
+	VIndex charsConsumed;
+	VSize bytesProduced;
+	if (!converter.Convert( inName.GetCPointer(), inName.GetLength(), &charsConsumed, buffer, kMAX_KEY_LENGTH, &bytesProduced) || (charsConsumed != inName.GetLength()))
+	{
+		fKeyTooLong = true;
+		outHash = 0;
+		return 0;
+	}
+	buffer[bytesProduced] = 0;
+
+	StPackedDictionaryKey key( buffer, bytesProduced, true);
+	outHash = (uLONG) key.GetHashCode();
+
+	std::string utf8( key.GetKeyAdress(), key.GetKeyLength());
+	MapOfKeys::const_iterator i = fKeys.find( utf8);
+	if (i != fKeys.end())
+		return i->second;
+
+	uBYTE length = (uBYTE) key.GetKeyLength();
+	uLONG offset = _Append( &length, 1);
+	_Append( key.GetKeyAdress(), key.GetKeyLength());
+	_Append( "", 1);
+
+	fKeys.insert( MapOfKeys::value_type( utf8, offset));
+	return offset;
+}
+
+
+template<class ENTRY>
+uLONG VCompactBagWriter::_WriteIndex( const std::vector<ENTRY>& inEntries)
+{
+	std::vector<uLONG> index( inEntries.size());
+	for( size_t i = 0 ; i < index.size() ; ++i)
+		index[i] = (uLONG) i;
+
+	// stable so that the first of duplicate keys is found first like with VPackedDictionary
+	std::stable_sort( index.begin(), index.end(), LessHash<ENTRY>( inEntries));
+
+	_Align( 4);
+	return _Append( &index.front(), index.size() * sizeof( uLONG));
+}
+
+
+uLONG VCompactBagWriter::_Append( const void *inData, VSize inSize)
+{
+	uLONG offset = _GetLength();
+	if (!fBuffer.PutDataAmortized( offset, inData, inSize))
+		fMemoryFull = true;
+	return offset;
+}
+
+
+uLONG VCompactBagWriter::_Align( VSize inAlignment)
+{
+	static const char sZeros[8] = { 0};
+	xbox_assert( inAlignment <= sizeof( sZeros));
+	VSize padding = (inAlignment - (fBuffer.GetDataSize() % inAlignment)) % inAlignment;
+	if (padding > 0)
+		_Append( sZeros, padding);
+	return _GetLength();
+}
+
+
+void VCompactBagWriter::_Put( uLONG inOffset, const void *inData, VSize inSize)
+{
+	if (!fBuffer.PutData( inOffset, inData, inSize))
+		fMemoryFull = true;
+}
+
+
+//================================================================================================================
+
+
+template<class ENTRY>
+static const ENTRY *_FindEntry( const VCompactBag *inBag, const ENTRY *inEntries, uLONG inCount, const uLONG *inIndex, const StPackedDictionaryKey& inKey)
+{
+	uLONG hash = (uLONG) inKey.GetHashCode();
+	size_t length = inKey.GetKeyLength();
+	const uBYTE *data = (const uBYTE*) inBag->GetData();
+	VSize size = inBag->GetDataSize();
+
+	uLONG first = 0;
+	uLONG last = inCount;
+	if (inIndex != NULL)
+	{
+		// binary search on hash code for first matching entry
+		while( first < last)
+		{
+			uLONG middle = first + (last - first) / 2;
+			if (inIndex[middle] >= inCount)
+				return NULL;
+			if (inEntries[inIndex[middle]].fHash < hash)
+				first = middle + 1;
+			else
+				last = middle;
+		}
+		last = inCount;
+	}
+
+	for( uLONG i = first ; i < last ; ++i)
+	{
+		uLONG position = (inIndex != NULL) ? inIndex[i] : i;
+		if (position >= inCount)
+			return NULL;
+
+		const ENTRY *entry = &inEntries[position];
+		if (entry->fHash != hash)
+		{
+			if (inIndex != NULL)
+				break;
+			continue;
+		}
+
+		if ( (entry->fKey < size) && (data[entry->fKey] == length) && (length + 1 <= size - entry->fKey) && (::memcmp( data + entry->fKey + 1, inKey.GetKeyAdress(), length) == 0) )
+			return entry;
+	}
+
+	return NULL;
+}
+
+
+const _VCompactBagNodeHeader *VCompactBagNode::_GetHeader() const
+{
+	if ( (fBag == NULL) || !fBag->_Check( fNode, sizeof( _VCompactBagNodeHeader)) )
+		return NULL;
+
+	const _VCompactBagNodeHeader *header = reinterpret_cast<const _VCompactBagNodeHeader*>( fBag->_Get( fNode));
+	VSize tables = (VSize) header->fAttributeCount * sizeof( _VCompactBagAttribute) + (VSize) header->fElementNameCount * sizeof( _VCompactBagElement);
+	if ( (header->fAttributeCount > kMAX_sLONG) || (header->fElementNameCount > kMAX_sLONG) || !fBag->_Check( fNode + sizeof( _VCompactBagNodeHeader), tables) )
+		return NULL;
+
+	if ( (header->fAttributeIndex != 0) && !fBag->_Check( header->fAttributeIndex, (VSize) header->fAttributeCount * sizeof( uLONG)) )
+		return NULL;
+
+	if ( (header->fElementIndex != 0) && !fBag->_Check( header->fElementIndex, (VSize) header->fElementNameCount * sizeof( uLONG)) )
+		return NULL;
+
+	return header;
+}
+
+
+const _VCompactBagAttribute *VCompactBagNode::_FindAttribute( const StKey& inAttributeName) const
+{
+	const _VCompactBagNodeHeader *header = _GetHeader();
+	if (header == NULL)
+		return NULL;
+
+	const _VCompactBagAttribute *entries = reinterpret_cast<const _VCompactBagAttribute*>( header + 1);
+	const uLONG *index = (header->fAttributeIndex != 0) ? reinterpret_cast<const uLONG*>( fBag->_Get( header->fAttributeIndex)) : NULL;
+	return _FindEntry( fBag, entries, header->fAttributeCount, index, inAttributeName);
+}
+
+
+const _VCompactBagAttribute *VCompactBagNode::_GetNthAttribute( VIndex inIndex) const
+{
+	const _VCompactBagNodeHeader *header = _GetHeader();
+	if ( (header == NULL) || (inIndex < 1) || ((uLONG) inIndex > header->fAttributeCount) )
+		return NULL;
+
+	return reinterpret_cast<const _VCompactBagAttribute*>( header + 1) + inIndex - 1;
+}
+
+
+const _VCompactBagElement *VCompactBagNode::_FindElement( const StKey& inElementName) const
+{
+	const _VCompactBagNodeHeader *header = _GetHeader();
+	if (header == NULL)
+		return NULL;
+
+	const _VCompactBagElement *entries = reinterpret_cast<const _VCompactBagElement*>( reinterpret_cast<const _VCompactBagAttribute*>( header + 1) + header->fAttributeCount);
+	const uLONG *index = (header->fElementIndex != 0) ? reinterpret_cast<const uLONG*>( fBag->_Get( header->fElementIndex)) : NULL;
+	return _FindEntry( fBag, entries, header->fElementNameCount, index, inElementName);
+}
+
+
+const _VCompactBagElement *VCompactBagNode::_GetNthElement( VIndex inIndex) const
+{
+	const _VCompactBagNodeHeader *header = _GetHeader();
+	if ( (header == NULL) || (inIndex < 1) || ((uLONG) inIndex > header->fElementNameCount) )
+		return NULL;
+
+	return reinterpret_cast<const _VCompactBagElement*>( reinterpret_cast<const _VCompactBagAttribute*>( header + 1) + header->fAttributeCount) + inIndex - 1;
+}
+
+
+const void *VCompactBagNode::_GetValueData( const _VCompactBagAttribute *inEntry) const
+{
+	if ( (inEntry == NULL) || (inEntry->fKind == VK_EMPTY) || !fBag->_Check( inEntry->fValue, inEntry->fSize) )
+		return NULL;
+
+	if ( (inEntry->fKind == VK_STRING) && (inEntry->fSize < sizeof( uLONG)) )
+		return NULL;
+
+	// the backstore size is read from the data itself
+	const void *data = fBag->_Get( inEntry->fValue);
+	const VValueInfo *info = VValue::ValueInfoFromValueKind( (ValueKind) inEntry->fKind);
+	if ( (info == NULL) || (info->GetSizeOfValueDataPtr( data) > inEntry->fSize) )
+		return NULL;
+
+	return data;
+}
+
+
+VValueSingle *VCompactBagNode::_CreateValue( const _VCompactBagAttribute *inEntry) const
+{
+	const void *data = _GetValueData( inEntry);
+	if (data == NULL)
+		return NULL;
+
+	const VValueInfo *info = VValue::ValueInfoFromValueKind( (ValueKind) inEntry->fKind);
+	return static_cast<VValueSingle*>( info->LoadFromPtr( data, false));
+}
+
+
+bool VCompactBagNode::_GetValue( const _VCompactBagAttribute *inEntry, VValueSingle& outValue) const
+{
+	const void *data = _GetValueData( inEntry);
+	if (data == NULL)
+		return false;
+
+	if (outValue.GetTrueValueKind() == inEntry->fKind)
+	{
+		// exactly same kind -> load from backstore
+		outValue.LoadFromPtr( data, false);
+	}
+	else
+	{
+		// degenerate case -> load it and ask conversion
+		VValueSingle *value = _CreateValue( inEntry);
+		if (value == NULL)
+			return false;
+		value->GetValue( outValue);
+		delete value;
+	}
+	return true;
+}
+
+
+bool VCompactBagNode::_GetKey( uLONG inKey, VString *outName) const
+{
+	if (outName == NULL)
+		return true;
+
+	if (!fBag->_Check( inKey, 1) || !fBag->_Check( inKey + 1, *(const uBYTE*) fBag->_Get( inKey)))
+	{
+		outName->Clear();
+		return false;
+	}
+
+	outName->FromBlock( fBag->_Get( inKey + 1), *(const uBYTE*) fBag->_Get( inKey), VTC_UTF_8);
+	return true;
+}
+
+
+VIndex VCompactBagNode::GetAttributesCount() const
+{
+	const _VCompactBagNodeHeader *header = _GetHeader();
+	return (header != NULL) ? (VIndex) header->fAttributeCount : 0;
+}
+
+
+VIndex VCompactBagNode::GetAttributeIndex( const StKey& inAttributeName) const
+{
+	const _VCompactBagAttribute *entry = _FindAttribute( inAttributeName);
+	return (entry != NULL) ? (VIndex) (entry - reinterpret_cast<const _VCompactBagAttribute*>( _GetHeader() + 1)) + 1 : 0;
+}
+
+
+ValueKind VCompactBagNode::GetAttributeKind( const StKey& inAttributeName) const
+{
+	const _VCompactBagAttribute *entry = _FindAttribute( inAttributeName);
+	return (entry != NULL) ? (ValueKind) entry->fKind : (ValueKind) VK_EMPTY;
+}
+
+
+bool VCompactBagNode::GetLong( const StKey& inAttributeName, sLONG& outValue) const
+{
+	VLong v;
+	bool found = _GetValue( _FindAttribute( inAttributeName), v);
+	outValue = v.GetLong();
+	return found;
+}
+
+
+bool VCompactBagNode::GetLong8( const StKey& inAttributeName, sLONG8& outValue) const
+{
+	VLong8 v;
+	bool found = _GetValue( _FindAttribute( inAttributeName), v);
+	outValue = v.GetLong8();
+	return found;
+}
+
+
+bool VCompactBagNode::GetReal( const StKey& inAttributeName, Real& outValue) const
+{
+	VReal v;
+	bool found = _GetValue( _FindAttribute( inAttributeName), v);
+	outValue = v.GetReal();
+	return found;
+}
+
+
+bool VCompactBagNode::GetBool( const StKey& inAttributeName, bool& outValue) const
+{
+	VBoolean v;
+	bool found = _GetValue( _FindAttribute( inAttributeName), v);
+	outValue = v.GetBoolean() != 0;
+	return found;
+}
+
+
+bool VCompactBagNode::GetString( const StKey& inAttributeName, VString& outValue) const
+{
+	bool found = _GetValue( _FindAttribute( inAttributeName), outValue);
+	if (!found)
+		outValue.Clear();
+	return found;
+}
+
+
+bool VCompactBagNode::GetAttribute( const StKey& inAttributeName, VValueSingle& outValue) const
+{
+	bool found = _GetValue( _FindAttribute( inAttributeName), outValue);
+	if (!found)
+		outValue.Clear();
+	return found;
+}
+
+
+bool VCompactBagNode::GetStringView( const StKey& inAttributeName, VCompactBagString& outValue) const
+{
+	const _VCompactBagAttribute *entry = _FindAttribute( inAttributeName);
+	const void *data = ( (entry != NULL) && (entry->fKind == VK_STRING) ) ? _GetValueData( entry) : NULL;
+	if (data == NULL)
+	{
+		outValue = VCompactBagString();
+		return false;
+	}
+
+	// VString backstore: uLONG length followed by the chars
+	outValue = VCompactBagString( reinterpret_cast<const UniChar*>( data) + 2, (VIndex) *reinterpret_cast<const uLONG*>( data));
+	return true;
+}
+
+
+VValueSingle *VCompactBagNode::CreateAttribute( const StKey& inAttributeName) const
+{
+	return _CreateValue( _FindAttribute( inAttributeName));
+}
+
+
+VValueSingle *VCompactBagNode::CreateNthAttribute( VIndex inIndex, VString *outName) const
+{
+	const _VCompactBagAttribute *entry = _GetNthAttribute( inIndex);
+	if (entry == NULL)
+	{
+		if (outName != NULL)
+			outName->Clear();
+		return NULL;
+	}
+
+	_GetKey( entry->fKey, outName);
+	return _CreateValue( entry);
+}
+
+
+VIndex VCompactBagNode::GetElementNamesCount() const
+{
+	const _VCompactBagNodeHeader *header = _GetHeader();
+	return (header != NULL) ? (VIndex) header->fElementNameCount : 0;
+}
+
+
+VIndex VCompactBagNode::GetNthElementName( VIndex inIndex, VString *outName) const
+{
+	const _VCompactBagElement *entry = _GetNthElement( inIndex);
+	if (entry == NULL)
+	{
+		if (outName != NULL)
+			outName->Clear();
+		return 0;
+	}
+
+	_GetKey( entry->fKey, outName);
+	return (VIndex) entry->fCount;
+}
+
+
+VIndex VCompactBagNode::GetElementsCount( const StKey& inElementName) const
+{
+	const _VCompactBagElement *entry = _FindElement( inElementName);
+	return (entry != NULL) ? (VIndex) entry->fCount : 0;
+}
+
+
+VCompactBagNode VCompactBagNode::GetNthElement( const StKey& inElementName, VIndex inIndex) const
+{
+	const _VCompactBagElement *entry = _FindElement( inElementName);
+	if ( (entry == NULL) || (inIndex < 1) || ((uLONG) inIndex > entry->fCount) || !fBag->_Check( entry->fNodes, (VSize) entry->fCount * sizeof( uLONG)) )
+		return VCompactBagNode();
+
+	return VCompactBagNode( fBag, reinterpret_cast<const uLONG*>( fBag->_Get( entry->fNodes))[inIndex - 1]);
+}
+
+
+VCompactBagNode VCompactBagNode::GetUniqueElement( const StKey& inElementName) const
+{
+	return (GetElementsCount( inElementName) == 1) ? GetNthElement( inElementName, 1) : VCompactBagNode();
+}
+
+
+VValueBag *VCompactBagNode::CreateBag() const
+{
+	// a valid image has each node once, so it can't hold more nodes than headers fit in it.
+	// Without this limit a corrupted image sharing nodes between elements would cost exponential time.
+	VSize nodesLeft = fBag->GetDataSize() / sizeof( _VCompactBagNodeHeader);
+
+	VValueBag *bag = new VValueBag;
+	if ( (bag != NULL) && !_FillBag( *bag, 0, nodesLeft) )
+		ReleaseRefCountable( &bag);
+	return bag;
+}
+
+
+bool VCompactBagNode::_FillBag( VValueBag& ioBag, sLONG inDepth, VSize& ioNodesLeft) const
+{
+	const _VCompactBagNodeHeader *header = _GetHeader();
+	if ( (header == NULL) || (inDepth > kMAX_DEPTH) || (ioNodesLeft == 0) )
+		return false;
+	--ioNodesLeft;
+
+	bool ok = true;
+	VString name;
+
+	for( VIndex i = 1 ; ok && (i <= (VIndex) header->fAttributeCount) ; ++i)
+	{
+		const _VCompactBagAttribute *entry = _GetNthAttribute( i);
+		VValueSingle *value = _CreateValue( entry);
+		ok = (value != NULL) && _GetKey( entry->fKey, &name);
+		if (ok)
+			ioBag.SetAttribute( name, value);
+		else
+			delete value;
+	}
+
+	for( VIndex i = 1 ; ok && (i <= (VIndex) header->fElementNameCount) ; ++i)
+	{
+		const _VCompactBagElement *entry = _GetNthElement( i);
+		ok = _GetKey( entry->fKey, &name) && fBag->_Check( entry->fNodes, (VSize) entry->fCount * sizeof( uLONG));
+		if (ok)
+		{
+			StKey key( name);
+			const uLONG *nodes = reinterpret_cast<const uLONG*>( fBag->_Get( entry->fNodes));
+			for( uLONG j = 0 ; ok && (j < entry->fCount) ; ++j)
+			{
+				// elements are written before their parent node
+				VValueBag *bag = (nodes[j] < fNode) ? new VValueBag : NULL;
+				ok = (bag != NULL) && VCompactBagNode( fBag, nodes[j])._FillBag( *bag, inDepth + 1, ioNodesLeft);
+				if (ok)
+					ioBag.AddElement( key, bag);
+				ReleaseRefCountable( &bag);
+			}
+		}
+	}
+
+	return ok;
+}
+
+
+//================================================================================================================
+
+
+VCompactBag::VCompactBag()
+: fData( NULL)
+, fSize( 0)
+, fRoot( 0)
+{
+}
+
+
+VCompactBag::~VCompactBag()
+{
+}
+
+
+VError VCompactBag::SetData( const void *inData, VSize inSize)
+{
+	Clear();
+	return _Open( inData, inSize);
+}
+
+
+VError VCompactBag::_Open( const void *inData, VSize inSize)
+{
+	if ( (inData == NULL) || (inSize < sizeof( _VCompactBagHeader)) )
+		return vThrowError( VE_STREAM_BAD_SIGNATURE);
+
+	const _VCompactBagHeader *header = reinterpret_cast<const _VCompactBagHeader*>( inData);
+	if (header->fSignature != kCOMPACT_BAG_SIGNATURE)
+	{
+		// a swapped signature is an image from a machine with another byte order
+		uLONG signature = header->fSignature;
+		ByteSwap( &signature);
+		if (signature == kCOMPACT_BAG_SIGNATURE)
+			return vThrowError( VE_STREAM_BAD_VERSION);
+		return vThrowError( VE_STREAM_BAD_SIGNATURE);
+	}
+
+	if ( (header->fMajorVersion != kCOMPACT_BAG_MAJOR_VERSION) || (header->fByteOrder != kCOMPACT_BAG_BYTE_ORDER) )
+		return vThrowError( VE_STREAM_BAD_VERSION);
+
+	if ( (header->fSize < sizeof( _VCompactBagHeader)) || (header->fSize > inSize) || (header->fRoot >= header->fSize) )
+		return vThrowError( VE_STREAM_BAD_SIGNATURE);
+
+	fData = reinterpret_cast<const char*>( inData);
+	fSize = header->fSize;
+	fRoot = header->fRoot;
+
+	return VE_OK;
+}
+
+
+VError VCompactBag::ReadFromStream( VStream *inStream)
+{
+	Clear();
+
+	_VCompactBagHeader header;
+	VError err = inStream->GetData( &header, sizeof( header));
+	if (err == VE_OK)
+	{
+		if ( (header.fSignature != kCOMPACT_BAG_SIGNATURE) || (header.fSize < sizeof( header)) )
+		{
+			// let _Open report what's wrong
+			err = _Open( &header, sizeof( header));
+			if (err == VE_OK)
+				err = vThrowError( VE_STREAM_BAD_SIGNATURE);
+		}
+		else if (fBuffer.SetSize( header.fSize))
+		{
+			::memcpy( fBuffer.GetDataPtr(), &header, sizeof( header));
+			err = inStream->GetData( (char*) fBuffer.GetDataPtr() + sizeof( header), header.fSize - sizeof( header));
+			if (err == VE_OK)
+				err = _Open( fBuffer.GetDataPtr(), fBuffer.GetDataSize());
+		}
+		else
+		{
+			err = vThrowError( VE_MEMORY_FULL);
+		}
+	}
+
+	if (err != VE_OK)
+		Clear();
+
+	return err;
+}
+
+
+void VCompactBag::Clear()
+{
+	fData = NULL;
+	fSize = 0;
+	fRoot = 0;
+	fBuffer.Clear();
+}
+
+
+VCompactBagNode VCompactBag::GetRoot() const
+{
+	return (fData != NULL) ? VCompactBagNode( this, fRoot) : VCompactBagNode();
+}
+
+
+VError VCompactBag::WriteBag( const VValueBag& inBag, VMemoryBuffer<>& outBuffer)
+{
+	VCompactBagWriter writer( outBuffer);
+	return writer.Write( inBag);
+}
+
+
+VError VCompactBag::WriteBag( const VValueBag& inBag, VStream *inStream)
+{
+	VMemoryBuffer<> buffer;
+	VError err = WriteBag( inBag, buffer);
+	if (err == VE_OK)
+		err = inStream->PutData( buffer.GetDataPtr(), buffer.GetDataSize());
+	return err;
+}
+
+
+END_TOOLBOX_NAMESPACE
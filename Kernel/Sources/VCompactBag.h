@@ -0,0 +1,201 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VCompactBag__
+#define __VCompactBag__
+
+#include "Kernel/Sources/VValueBag.h"
+#include "Kernel/Sources/VMemoryBuffer.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+// Defined bellow
+class VCompactBag;
+class VCompactBagNode;
+
+// Private (image layout, see VCompactBag.cpp)
+struct _VCompactBagNodeHeader;
+struct _VCompactBagAttribute;
+struct _VCompactBagElement;
+
+
+/*!
+	@class	VCompactBagString
+	@abstract	Zero-copy view on a string attribute of a VCompactBag.
+	@discussion	Valid as long as the VCompactBag data is.
+*/
+class XTOOLBOX_API VCompactBagString
+{
+public:
+										VCompactBagString():fChars( NULL), fLength( 0)						{;}
+										VCompactBagString( const UniChar *inChars, VIndex inLength):fChars( inChars), fLength( inLength)	{;}
+
+			const UniChar*				GetCPointer() const													{ return fChars;}
+			VIndex						GetLength() const													{ return fLength;}
+			bool						IsEmpty() const														{ return fLength == 0;}
+
+			void						GetString( VString& outString) const								{ outString.FromBlock( fChars, fLength * sizeof( UniChar), VTC_UTF_16);}
+			bool						EqualToString( const VString& inString) const						{ return (inString.GetLength() == fLength) && (::memcmp( inString.GetCPointer(), fChars, fLength * sizeof( UniChar)) == 0);}
+
+private:
+			const UniChar*				fChars;
+			VIndex						fLength;
+};
+
+
+/*!
+	@class	VCompactBagNode
+	@abstract	Read-only access to one bag of a VCompactBag.
+	@discussion
+		Nothing is deserialized until asked: looking for an attribute or an element only reads
+		the node tables, and attribute values are read from their backstore form (see VValue::LoadFromPtr).
+
+		A VCompactBagNode is as cheap to copy as two pointers and is valid as long as its VCompactBag is.
+		A null node is returned for missing elements or corrupted data.
+*/
+class XTOOLBOX_API VCompactBagNode
+{
+public:
+	typedef VValueBag::StKey	StKey;
+
+										VCompactBagNode():fBag( NULL), fNode( 0)							{;}
+
+			bool						IsNull() const														{ return fBag == NULL;}
+
+	// attributes
+			VIndex						GetAttributesCount() const;
+			VIndex						GetAttributeIndex( const StKey& inAttributeName) const;
+			bool						AttributeExists( const StKey& inAttributeName) const				{ return GetAttributeIndex( inAttributeName) > 0;}
+
+			// returns VK_EMPTY if not found
+			ValueKind					GetAttributeKind( const StKey& inAttributeName) const;
+
+			// same conversion rules than VValueBag
+			bool						GetLong( const StKey& inAttributeName, sLONG& outValue) const;
+			bool						GetLong8( const StKey& inAttributeName, sLONG8& outValue) const;
+			bool						GetReal( const StKey& inAttributeName, Real& outValue) const;
+			bool						GetBool( const StKey& inAttributeName, bool& outValue) const;
+			bool						GetString( const StKey& inAttributeName, VString& outValue) const;
+			bool						GetAttribute( const StKey& inAttributeName, VValueSingle& outValue) const;
+
+			// no copy. Returns false if the attribute is missing or is not a string.
+			bool						GetStringView( const StKey& inAttributeName, VCompactBagString& outValue) const;
+
+			// returns a new VValueSingle you have to delete (NULL if not found).
+			VValueSingle*				CreateAttribute( const StKey& inAttributeName) const;
+			VValueSingle*				CreateNthAttribute( VIndex inIndex, VString *outName) const;
+
+	// elements
+			VIndex						GetElementNamesCount() const;
+			VIndex						GetNthElementName( VIndex inIndex, VString *outName) const;	// returns the count of elements
+			VIndex						GetElementsCount( const StKey& inElementName) const;
+			VCompactBagNode				GetNthElement( const StKey& inElementName, VIndex inIndex) const;	// 1-based
+			VCompactBagNode				GetUniqueElement( const StKey& inElementName) const;
+
+	// deserialize this node and all its elements
+			VValueBag*					CreateBag() const;
+
+private:
+	friend class VCompactBag;
+
+										VCompactBagNode( const VCompactBag *inBag, uLONG inNode):fBag( inBag), fNode( inNode)	{;}
+
+			const _VCompactBagNodeHeader*	_GetHeader() const;
+			const _VCompactBagAttribute*	_FindAttribute( const StKey& inAttributeName) const;
+			const _VCompactBagAttribute*	_GetNthAttribute( VIndex inIndex) const;
+			const _VCompactBagElement*	_FindElement( const StKey& inElementName) const;
+			const _VCompactBagElement*	_GetNthElement( VIndex inIndex) const;
+			const void*					_GetValueData( const _VCompactBagAttribute *inEntry) const;
+			VValueSingle*				_CreateValue( const _VCompactBagAttribute *inEntry) const;
+			bool						_GetValue( const _VCompactBagAttribute *inEntry, VValueSingle& outValue) const;
+			bool						_GetKey( uLONG inKey, VString *outName) const;
+			bool						_FillBag( VValueBag& ioBag, sLONG inDepth, VSize& ioNodesLeft) const;
+
+			const VCompactBag*			fBag;
+			uLONG						fNode;
+};
+
+
+/*!
+	@class	VCompactBag
+	@abstract	Binary image of a VValueBag read lazily.
+	@discussion
+		VValueBag::ReadFromStream rebuilds every attribute and every sub-bag.
+		A VCompactBag image instead has offset tables so that it can be used where it lies
+		(memory mapped file, resource, blob) and only the accessed attributes are read.
+
+		Keys are stored once as utf-8 with their StPackedDictionaryKey hash code.
+		WriteBag refuses keys longer than 255 utf-8 bytes with VE_INVALID_PARAMETER.
+		Nodes with more than a few keys have an index sorted by hash code for a binary search
+		(like the VPackedDictionary hash map but nothing to build).
+
+		The image is written in native byte order. An image with a different byte order,
+		or a newer major version, is refused with VE_STREAM_BAD_VERSION: keep the VValueBag stream format for exchanges.
+
+		// writing
+		VCompactBag::WriteBag( *bag, stream);
+
+		// reading
+		VCompactBag compact;
+		if (compact.SetData( mappedAddress, mappedSize) == VE_OK)
+		{
+			VCompactBagString name;
+			compact.GetRoot().GetUniqueElement( "settings").GetStringView( "name", name);
+		}
+*/
+class XTOOLBOX_API VCompactBag : public VObject, public IRefCountable
+{
+public:
+										VCompactBag();
+	virtual								~VCompactBag();
+
+			// use an image lying in memory. The data must stay valid as long as this VCompactBag is used.
+			VError						SetData( const void *inData, VSize inSize);
+
+			// read an image into an internal buffer
+			VError						ReadFromStream( VStream *inStream);
+
+			void						Clear();
+
+			bool						IsEmpty() const														{ return fData == NULL;}
+			const void*					GetData() const														{ return fData;}
+			VSize						GetDataSize() const													{ return fSize;}
+
+			VCompactBagNode				GetRoot() const;
+
+	// writing
+	static	VError						WriteBag( const VValueBag& inBag, VStream *inStream);
+	static	VError						WriteBag( const VValueBag& inBag, VMemoryBuffer<>& outBuffer);
+
+private:
+	friend class VCompactBagNode;
+
+										VCompactBag( const VCompactBag&);
+			VCompactBag&				operator=( const VCompactBag&);
+
+			VError						_Open( const void *inData, VSize inSize);
+			bool						_Check( uLONG inOffset, VSize inSize) const							{ return (inOffset <= fSize) && (inSize <= fSize - inOffset);}
+			const char*					_Get( uLONG inOffset) const											{ return fData + inOffset;}
+
+			const char*					fData;
+			VSize						fSize;
+			uLONG						fRoot;
+			VMemoryBuffer<>				fBuffer;
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
@@ -0,0 +1,446 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VExecutor.h"
+#include "VSystem.h"
+#include "VString.h"
+
+
+// Class constants
+const OsType	kExecutorWorkerTaskKind		= 'XWRK';
+const sLONG		kWORKER_WAIT_TIMEOUT		= 1000;	// let the worker check for death regularly
+
+
+// Class statics
+VExecutor*		VExecutor::sShared = NULL;
+SpinLockType	VExecutor::sSharedLock = 0;
+
+
+BEGIN_TOOLBOX_NAMESPACE
+
+class VExecutorWorker : public VTask
+{
+public:
+								VExecutorWorker( VExecutor *inExecutor)
+									: VTask( NULL, 0, eTaskStylePreemptive, NULL)
+									, fCurrentJob( NULL)
+									, fExecutor( inExecutor)
+									{
+										SetKind( kExecutorWorkerTaskKind);
+										SetKindData( (sLONG_PTR) this);
+									}
+
+			VExecutor*			GetExecutor() const							{ return fExecutor;}
+
+			void				PushJob( VJob *inJob)
+								{
+									fQueueMutex.Lock();
+									fQueue.push_back( inJob);
+									fQueueMutex.Unlock();
+								}
+
+			// the owner takes the most recent job (better cache locality for nested jobs)
+			VJob*				PopJob()
+								{
+									VJob *job = NULL;
+									fQueueMutex.Lock();
+									if (!fQueue.empty())
+									{
+										job = fQueue.back();
+										fQueue.pop_back();
+									}
+									fQueueMutex.Unlock();
+									return job;
+								}
+
+			// thieves take the oldest job
+			VJob*				StealJob()
+								{
+									VJob *job = NULL;
+									if (fQueueMutex.TryToLock())
+									{
+										if (!fQueue.empty())
+										{
+											job = fQueue.front();
+											fQueue.pop_front();
+										}
+										fQueueMutex.Unlock();
+									}
+									return job;
+								}
+
+			VJob*				fCurrentJob;
+
+protected:
+	virtual	Boolean				DoRun()
+								{
+									fExecutor->_RunOneJob( this, kWORKER_WAIT_TIMEOUT);
+									return true;
+								}
+
+private:
+			VExecutor*			fExecutor;
+			VCriticalSection	fQueueMutex;
+			std::deque<VJob*>	fQueue;		// retained jobs
+};
+
+END_TOOLBOX_NAMESPACE
+
+
+//================================================================================================================
+
+
+VJob::VJob()
+: fState( eJobPending)
+, fCancelled( 0)
+, fExecutor( NULL)
+, fSpinLock( 0)
+, fErrorContext( NULL)
+{
+}
+
+
+VJob::~VJob()
+{
+	xbox_assert( fContinuations.empty());
+	ReleaseRefCountable( &fErrorContext);
+}
+
+
+void VJob::Cancel()
+{
+	VInterlocked::Exchange( &fCancelled, 1);
+}
+
+
+bool VJob::Wait( sLONG inTimeoutMilliseconds)
+{
+	if (IsFinished())
+		return true;
+
+	VExecutorWorker *worker = (fExecutor != NULL) ? fExecutor->_GetCurrentWorker() : NULL;
+	if (worker != NULL)
+	{
+		// help the pool instead of blocking one of its workers
+		uLONG t1 = VSystem::GetCurrentTime() + inTimeoutMilliseconds;
+		while( !IsFinished())
+		{
+			if (!fExecutor->_RunOneJob( worker, 0))
+				fFinishedEvent.Lock( 1);
+
+			if ( (inTimeoutMilliseconds >= 0) && (VSystem::GetCurrentTime() >= t1) )
+				break;
+		}
+		return IsFinished();
+	}
+
+	if (inTimeoutMilliseconds < 0)
+		return fFinishedEvent.Lock();
+
+	return fFinishedEvent.Lock( inTimeoutMilliseconds);
+}
+
+
+void VJob::Then( VJob *inNext, VExecutor *inExecutor)
+{
+	if (inNext == NULL)
+		return;
+
+	bool submitNow;
+	SpinLockThread( fSpinLock);
+	submitNow = IsFinished();
+	if (!submitNow)
+	{
+		inNext->Retain();
+		fContinuations.push_back( Continuation( inNext, inExecutor));
+	}
+	SpinUnlock( fSpinLock);
+
+	if (submitNow)
+	{
+		VExecutor *executor = (inExecutor != NULL) ? inExecutor : (fExecutor != NULL) ? fExecutor : VExecutor::GetShared();
+		executor->Submit( inNext);
+	}
+}
+
+
+VJob* VJob::GetCurrent()
+{
+	VTask *task = VTask::GetCurrent();
+	if ( (task == NULL) || (task->GetKind() != kExecutorWorkerTaskKind) )
+		return NULL;
+	return reinterpret_cast<VExecutorWorker*>( task->GetKindData())->fCurrentJob;
+}
+
+
+void VJob::_Execute()
+{
+	if (IsCancelled() || (VInterlocked::CompareExchange( &fState, eJobPending, eJobRunning) != eJobPending))
+	{
+		_Finish( eJobCancelled);
+		return;
+	}
+
+	{
+		// keep the errors of this job apart
+		StErrorContextInstaller errorContext( false, true);
+		DoExecute();
+		if (errorContext.GetLastError() != VE_OK)
+			CopyRefCountable( &fErrorContext, errorContext.GetContext());
+	}
+
+	_Finish( eJobDone);
+}
+
+
+void VJob::_Finish( EJobState inState)
+{
+	VectorOfContinuations continuations;
+
+	SpinLockThread( fSpinLock);
+	VInterlocked::Exchange( &fState, inState);
+	continuations.swap( fContinuations);
+	SpinUnlock( fSpinLock);
+
+	fFinishedEvent.Unlock();
+
+	for( VectorOfContinuations::iterator i = continuations.begin() ; i != continuations.end() ; ++i)
+	{
+		VExecutor *executor = (i->second != NULL) ? i->second : (fExecutor != NULL) ? fExecutor : VExecutor::GetShared();
+		executor->Submit( i->first);
+		i->first->Release();
+	}
+}
+
+
+//================================================================================================================
+
+
+VExecutor::VExecutor( sLONG inWorkerCount, const VString& inName)
+: fPendingJobs( 0, kMAX_sLONG)
+, fNextQueue( 0)
+, fShutDown( 0)
+, fSubmitting( 0)
+{
+	if (inWorkerCount <= 0)
+		inWorkerCount = VSystem::GetNumberOfProcessors();
+	if (inWorkerCount <= 0)
+		inWorkerCount = 1;
+
+	// all queues must exist before any worker runs
+	for( sLONG i = 0 ; i < inWorkerCount ; ++i)
+	{
+		VExecutorWorker *worker = new VExecutorWorker( this);
+		if (worker != NULL)
+		{
+			VString name( inName);
+			name.AppendPrintf( " worker %d", i + 1);
+			worker->SetName( name);
+			fWorkers.push_back( worker);
+		}
+	}
+
+	for( std::vector<VExecutorWorker*>::iterator i = fWorkers.begin() ; i != fWorkers.end() ; ++i)
+		(*i)->Run();
+}
+
+
+VExecutor::~VExecutor()
+{
+	Shutdown();
+
+	// a worker that outlived the Shutdown() timeout still uses this executor: wait for it whatever it takes
+	for( std::vector<VExecutorWorker*>::iterator i = fWorkers.begin() ; i != fWorkers.end() ; ++i)
+	{
+		while( !(*i)->WaitForDeath( kWORKER_WAIT_TIMEOUT))
+			;
+		(*i)->Release();
+	}
+}
+
+
+bool VExecutor::Submit( VJob *inJob)
+{
+	if (!testAssert( (inJob != NULL) && (inJob->fExecutor == NULL || inJob->fExecutor == this) && (inJob->fState == eJobPending) ))
+		return false;
+
+	inJob->fExecutor = this;
+
+	// Shutdown() sets fShutDown then waits for fSubmitting to drop to zero before draining the queues:
+	// either we see the flag here or the job is pushed before the drain.
+	VInterlocked::Increment( &fSubmitting);
+	if ( (VInterlocked::AtomicGet( &fShutDown) != 0) || fWorkers.empty())
+	{
+		VInterlocked::Decrement( &fSubmitting);
+		inJob->Cancel();
+		inJob->_Finish( eJobCancelled);
+		return false;
+	}
+
+	VExecutorWorker *worker = _GetCurrentWorker();
+	if (worker == NULL)
+	{
+		uLONG index = (uLONG) VInterlocked::Increment( &fNextQueue);
+		worker = fWorkers[index % fWorkers.size()];
+	}
+
+	inJob->Retain();
+	worker->PushJob( inJob);
+	fPendingJobs.Unlock();
+
+	VInterlocked::Decrement( &fSubmitting);
+
+	return true;
+}
+
+
+VExecutorWorker *VExecutor::_GetCurrentWorker() const
+{
+	VTask *task = VTask::GetCurrent();
+	if ( (task == NULL) || (task->GetKind() != kExecutorWorkerTaskKind) )
+		return NULL;
+
+	VExecutorWorker *worker = reinterpret_cast<VExecutorWorker*>( task->GetKindData());
+	return (worker->GetExecutor() == this) ? worker : NULL;
+}
+
+
+VJob *VExecutor::_TakeJob( VExecutorWorker *inWorker)
+{
+	// one unit of fPendingJobs has been acquired so at least one job is queued somewhere
+	// but some other worker may be stealing it right now: loop.
+	size_t count = fWorkers.size();
+	size_t first = 0;
+	while( (first < count) && (fWorkers[first] != inWorker) )
+		++first;
+
+	do {
+		VJob *job = inWorker->PopJob();
+		if (job != NULL)
+			return job;
+
+		for( size_t i = 1 ; i < count ; ++i)
+		{
+			job = fWorkers[(first + i) % count]->StealJob();
+			if (job != NULL)
+				return job;
+		}
+
+		VTask::YieldNow();
+	} while( !IsShutDown());
+
+	return NULL;
+}
+
+
+bool VExecutor::_RunOneJob( VExecutorWorker *inWorker, sLONG inTimeoutMilliseconds)
+{
+	bool gotOne = (inTimeoutMilliseconds > 0) ? fPendingJobs.Lock( inTimeoutMilliseconds) : fPendingJobs.TryToLock();
+	if (!gotOne)
+		return false;
+
+	VJob *job = _TakeJob( inWorker);
+	if (job == NULL)
+		return false;
+
+	VJob *previousJob = inWorker->fCurrentJob;
+	inWorker->fCurrentJob = job;
+	job->_Execute();
+	inWorker->fCurrentJob = previousJob;
+
+	job->Release();
+
+	return true;
+}
+
+
+void VExecutor::Shutdown( sLONG inTimeoutMilliseconds)
+{
+	if (VInterlocked::Exchange( &fShutDown, 1) != 0)
+		return;
+
+	xbox_assert( !IsCurrentWorker());
+
+	// let Submit() calls that have not seen fShutDown push their job
+	while( VInterlocked::AtomicGet( &fSubmitting) != 0)
+		VTask::YieldNow();
+
+	for( std::vector<VExecutorWorker*>::iterator i = fWorkers.begin() ; i != fWorkers.end() ; ++i)
+		(*i)->Kill();
+
+	// wake up idle workers
+	for( size_t i = 0 ; i < fWorkers.size() ; ++i)
+		fPendingJobs.Unlock();
+
+	for( std::vector<VExecutorWorker*>::iterator i = fWorkers.begin() ; i != fWorkers.end() ; ++i)
+		(*i)->WaitForDeath( inTimeoutMilliseconds);
+
+	// cancel remaining jobs. A worker still alive only takes jobs under its queue mutex too:
+	// each job is either run by it or cancelled here.
+	for( std::vector<VExecutorWorker*>::iterator i = fWorkers.begin() ; i != fWorkers.end() ; ++i)
+	{
+		VJob *job;
+		while( (job = (*i)->PopJob()) != NULL)
+		{
+			job->Cancel();
+			job->_Finish( eJobCancelled);
+			job->Release();
+		}
+	}
+	// the workers are released by the destructor once dead: a worker that did not die in time still reads fWorkers.
+}
+
+
+VExecutor *VExecutor::GetCurrent()
+{
+	VTask *task = VTask::GetCurrent();
+	if ( (task == NULL) || (task->GetKind() != kExecutorWorkerTaskKind) )
+		return NULL;
+	return reinterpret_cast<VExecutorWorker*>( task->GetKindData())->GetExecutor();
+}
+
+
+VExecutor *VExecutor::GetShared()
+{
+	// the interlocked read and write are full barriers: the executor is fully constructed before any task can see it
+	VExecutor *executor = (VExecutor*) VInterlocked::CompareExchangePtr( (void**) &sShared, NULL, NULL);
+	if (executor == NULL)
+	{
+		SpinLockThread( sSharedLock);
+		executor = sShared;
+		if (executor == NULL)
+		{
+			executor = new VExecutor( 0, CVSTR( "Shared executor"));
+			VInterlocked::ExchangePtr( &sShared, executor);
+		}
+		SpinUnlock( sSharedLock);
+	}
+	return executor;
+}
+
+
+void VExecutor::DeInit()
+{
+	SpinLockThread( sSharedLock);
+	VExecutor *executor = VInterlocked::ExchangePtr( &sShared, (VExecutor*) NULL);
+	SpinUnlock( sSharedLock);
+
+	if (executor != NULL)
+	{
+		executor->Shutdown();
+		executor->Release();
+	}
+}
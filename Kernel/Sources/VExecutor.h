@@ -0,0 +1,282 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VExecutor__
+#define __VExecutor__
+
+#include <deque>
+
+#include "Kernel/Sources/VTask.h"
+#include "Kernel/Sources/VSyncObject.h"
+#include "Kernel/Sources/VMessageCall.h"
+#include "Kernel/Sources/VErrorContext.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+// Defined bellow
+class VExecutor;
+class VExecutorWorker;
+
+
+typedef enum
+{
+	eJobPending = 0,	// submitted or not yet submitted
+	eJobRunning,
+	eJobDone,
+	eJobCancelled		// cancelled before it could run
+} EJobState;
+
+
+/*!
+	@class	VJob
+	@abstract	Unit of work executed by a VExecutor.
+	@discussion
+		Override DoExecute().
+
+		Cancel() follows VTask::Kill() semantics: it only sets a flag.
+		A pending job won't be executed, a running job must check IsCancelled() by itself.
+
+		Errors thrown by DoExecute() are kept in the job (see GetErrorContext) instead of
+		being mixed with other jobs of the same worker task.
+*/
+class XTOOLBOX_API VJob : public VObject, public IRefCountable
+{
+public:
+										VJob();
+
+			EJobState					GetState() const								{ return (EJobState) fState;}
+			bool						IsFinished() const								{ return fState >= eJobDone;}
+
+			void						Cancel();
+			bool						IsCancelled() const								{ return fCancelled != 0;}
+
+	// waits until the job is done or cancelled (negative timeout means infinite).
+	// If called from a worker of the executor, it runs other jobs meanwhile so that nested waits can't starve the pool.
+			bool						Wait( sLONG inTimeoutMilliseconds = -1);
+
+	// continuation: inNext is submitted to inExecutor (default is the executor of this job) once this job is finished.
+	// If this job is already finished, inNext is submitted immediately.
+			void						Then( VJob *inNext, VExecutor *inExecutor = NULL);
+
+	// errors thrown while executing the job (NULL if none).
+			VErrorContext*				GetErrorContext() const							{ return fErrorContext;}
+
+	// the job being executed by current task (NULL if none)
+	static	VJob*						GetCurrent();
+
+protected:
+	virtual								~VJob();
+	virtual	void						DoExecute() = 0;
+
+private:
+	friend class VExecutor;
+	friend class VFileIOEngine;		// completes asynchronous i/o requests outside of any executor
+
+			typedef std::pair<VJob*,VExecutor*>	Continuation;
+			typedef std::vector<Continuation>	VectorOfContinuations;
+
+			void						_Execute();
+			void						_Finish( EJobState inState);
+
+			sLONG						fState;
+			sLONG						fCancelled;
+			VExecutor*					fExecutor;
+			VSyncEvent					fFinishedEvent;
+			SpinLockType				fSpinLock;			// protects fContinuations
+			VectorOfContinuations		fContinuations;
+			VErrorContext*				fErrorContext;
+};
+
+
+/*!
+	@class	VCallable
+	@abstract	A VJob that produces a result (see VFuture).
+	@discussion
+		Override DoExecute() and set fResult.
+		Use VoidType as RESULT for jobs with no result.
+*/
+template<class RESULT>
+class VCallable : public VJob
+{
+public:
+			const RESULT&				GetResult() const								{ return fResult;}
+
+			RESULT						fResult;
+};
+
+
+/*!
+	@class	VMethodCallJob
+	@abstract	A VCallable calling a method with up to 4 arguments (see VExecutor::SubmitCall).
+*/
+template<class OBJECT, class METHOD, class RESULT_TYPE, class ARG1_TYPE = VoidType, class ARG2_TYPE = VoidType, class ARG3_TYPE = VoidType, class ARG4_TYPE = VoidType>
+class VMethodCallJob : public VCallable<RESULT_TYPE>
+{
+public:
+	VMethodCallJob( OBJECT *inObject, METHOD inMethod, ARG1_TYPE inArg1, ARG2_TYPE inArg2, ARG3_TYPE inArg3, ARG4_TYPE inArg4)
+		: fObject( inObject)
+		, fMethod( inMethod)
+		, fArg1( inArg1)
+		, fArg2( inArg2)
+		, fArg3( inArg3)
+		, fArg4( inArg4)
+		{
+		}
+
+	virtual	void DoExecute()
+	{
+		MessageCaller<VMethodCallJob, RESULT_TYPE, ARG1_TYPE, ARG2_TYPE, ARG3_TYPE, ARG4_TYPE>::Call( this);
+	}
+
+	OBJECT*				fObject;
+	METHOD				fMethod;
+	ARG1_TYPE			fArg1;
+	ARG2_TYPE			fArg2;
+	ARG3_TYPE			fArg3;
+	ARG4_TYPE			fArg4;
+};
+
+
+/*!
+	@class	VFuture
+	@abstract	Handle on the result of a VCallable submitted to a VExecutor.
+	@discussion
+		Copying a VFuture shares the same job.
+		Get() returns a default constructed result if the job has been cancelled before it could run.
+*/
+template<class RESULT>
+class VFuture
+{
+public:
+										VFuture()										{;}
+	explicit							VFuture( VCallable<RESULT> *inJob):fJob( inJob)	{;}
+
+			bool						IsValid() const									{ return !fJob.IsNull();}
+			bool						IsReady() const									{ return fJob->IsFinished();}
+			bool						IsCancelled() const								{ return fJob->GetState() == eJobCancelled;}
+
+			bool						Wait( sLONG inTimeoutMilliseconds = -1) const	{ return fJob->Wait( inTimeoutMilliseconds);}
+			const RESULT&				Get() const										{ fJob->Wait(); return fJob->fResult;}
+
+			void						Cancel() const									{ fJob->Cancel();}
+			void						Then( VJob *inNext, VExecutor *inExecutor = NULL) const	{ fJob->Then( inNext, inExecutor);}
+
+			VCallable<RESULT>*			GetJob() const									{ return fJob.Get();}
+
+private:
+			VRefPtr<VCallable<RESULT> >	fJob;
+};
+
+
+/*!
+	@class	VExecutor
+	@abstract	Runs VJob on a fixed set of worker tasks.
+	@discussion
+		Each worker owns a run queue. Jobs submitted from a worker go to its own queue
+		and are run in LIFO order by that worker, other jobs are dispatched round robin.
+		An idle worker steals the oldest job from the other queues.
+
+		Shutdown() cancels pending jobs and kills the workers (see VTask::Kill):
+		running jobs are expected to check VJob::IsCancelled() or VTask::IsDying().
+*/
+class XTOOLBOX_API VExecutor : public VObject, public IRefCountable
+{
+public:
+	// inWorkerCount == 0 means one worker per processor.
+										VExecutor( sLONG inWorkerCount = 0, const VString& inName = CVSTR( "Executor"));
+
+	// retains the job. Returns false if the executor is shut down (then the job is cancelled).
+			bool						Submit( VJob *inJob);
+
+	template<class RESULT>
+			VFuture<RESULT>				Submit( VCallable<RESULT> *inJob)				{ Submit( static_cast<VJob*>( inJob)); return VFuture<RESULT>( inJob);}
+
+	// submits a call to inObject->*inMethod( args...).
+	template<class RESULT, class OBJECT, class METHOD>
+			VFuture<RESULT>				SubmitCall( OBJECT *inObject, METHOD inMethod)
+										{
+											return _SubmitRetained( new VMethodCallJob<OBJECT, METHOD, RESULT>( inObject, inMethod, VoidType(), VoidType(), VoidType(), VoidType()));
+										}
+
+	template<class RESULT, class OBJECT, class METHOD, class ARG1>
+			VFuture<RESULT>				SubmitCall( OBJECT *inObject, METHOD inMethod, ARG1 inArg1)
+										{
+											return _SubmitRetained( new VMethodCallJob<OBJECT, METHOD, RESULT, ARG1>( inObject, inMethod, inArg1, VoidType(), VoidType(), VoidType()));
+										}
+
+	template<class RESULT, class OBJECT, class METHOD, class ARG1, class ARG2>
+			VFuture<RESULT>				SubmitCall( OBJECT *inObject, METHOD inMethod, ARG1 inArg1, ARG2 inArg2)
+										{
+											return _SubmitRetained( new VMethodCallJob<OBJECT, METHOD, RESULT, ARG1, ARG2>( inObject, inMethod, inArg1, inArg2, VoidType(), VoidType()));
+										}
+
+	template<class RESULT, class OBJECT, class METHOD, class ARG1, class ARG2, class ARG3>
+			VFuture<RESULT>				SubmitCall( OBJECT *inObject, METHOD inMethod, ARG1 inArg1, ARG2 inArg2, ARG3 inArg3)
+										{
+											return _SubmitRetained( new VMethodCallJob<OBJECT, METHOD, RESULT, ARG1, ARG2, ARG3>( inObject, inMethod, inArg1, inArg2, inArg3, VoidType()));
+										}
+
+	template<class RESULT, class OBJECT, class METHOD, class ARG1, class ARG2, class ARG3, class ARG4>
+			VFuture<RESULT>				SubmitCall( OBJECT *inObject, METHOD inMethod, ARG1 inArg1, ARG2 inArg2, ARG3 inArg3, ARG4 inArg4)
+										{
+											return _SubmitRetained( new VMethodCallJob<OBJECT, METHOD, RESULT, ARG1, ARG2, ARG3, ARG4>( inObject, inMethod, inArg1, inArg2, inArg3, inArg4));
+										}
+
+	// cancels pending jobs, kills the workers and waits for their death.
+	// The destructor waits for workers that outlive inTimeoutMilliseconds.
+			void						Shutdown( sLONG inTimeoutMilliseconds = 5000);
+			bool						IsShutDown() const								{ return fShutDown != 0;}
+
+			sLONG						GetWorkerCount() const							{ return IsShutDown() ? 0 : (sLONG) fWorkers.size();}
+
+	// tells if current task is a worker of this executor
+			bool						IsCurrentWorker() const							{ return _GetCurrentWorker() != NULL;}
+
+	// the executor of calling worker task (NULL if the current task is not a worker)
+	static	VExecutor*					GetCurrent();
+
+	// process wide executor with one worker per processor, created on first use.
+	// It is shut down by VProcess.
+	static	VExecutor*					GetShared();
+	static	void						DeInit();
+
+protected:
+	virtual								~VExecutor();
+
+private:
+	friend class VJob;
+	friend class VExecutorWorker;
+
+			template<class RESULT>
+			VFuture<RESULT>				_SubmitRetained( VCallable<RESULT> *inJob)		{ VFuture<RESULT> future( Submit( inJob)); inJob->Release(); return future;}
+
+			VExecutorWorker*			_GetCurrentWorker() const;
+			VJob*						_TakeJob( VExecutorWorker *inWorker);
+			bool						_RunOneJob( VExecutorWorker *inWorker, sLONG inTimeoutMilliseconds);
+
+			std::vector<VExecutorWorker*>	fWorkers;
+			VSemaphore					fPendingJobs;		// one unit per queued job
+			sLONG						fNextQueue;			// round robin for jobs submitted from outside
+			sLONG						fShutDown;
+			sLONG						fSubmitting;		// Submit() calls in progress
+
+	static	VExecutor*					sShared;
+	static	SpinLockType				sSharedLock;
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
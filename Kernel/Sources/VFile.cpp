@@ -15,6 +15,7 @@
 */
 #include "VKernelPrecompiled.h"
 #include "VFile.h"
+#include "VFileMapping.h"
 #include "VFolder.h"
 #include "VURL.h"
 #include "VFileStream.h"
@@ -28,6 +29,7 @@
 #include "VValueBag.h"
 #include "VTime.h"
 #include "VTextConverter.h"
+#include "VProgressIndicator.h"
 
 
 BEGIN_TOOLBOX_NAMESPACE
@@ -49,9 +51,10 @@ END_TOOLBOX_NAMESPACE
 // --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---
 
 
-VFileDesc::VFileDesc( const VFile *inFile, FileDescSystemRef inSystemRef, FileAccess inMode )
+VFileDesc::VFileDesc( const VFile *inFile, FileDescSystemRef inSystemRef, FileAccess inMode, FileOpenOptions inOpenOptions )
 : fFile( inFile)
 , fMode( inMode)
+, fOpenOptions( inOpenOptions)
 , fImpl( inSystemRef)
 {
 	if (fFile)
@@ -129,9 +132,42 @@ VError VFileDesc::GetData( void *outData, VSize inCount, sLONG8 inOffset, VSize
 }
 
 
+VError VFileDesc::GetDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, sLONG8 inOffset, VSize *outActualCount) const
+{
+	xbox_assert( inSegmentsCount >= 0);
+
+	VSize count = 0;
+	for( sLONG i = 0 ; i < inSegmentsCount ; ++i)
+		count += inSegments[i].fSize;
+
+	VSize size = count;
+	VError err = fImpl.GetDataV( inSegments, inSegmentsCount, size, inOffset);
+	xbox_assert( (size == count) || (err != VE_OK) );
+
+	if (outActualCount)
+		*outActualCount = size;
+
+	if (IS_NATIVE_VERROR( err))
+	{
+		StThrowFileError errThrow( fFile, VE_STREAM_CANNOT_GET_DATA, err);
+		errThrow->SetLong8( "count", count);
+		errThrow->SetLong8( "offset", inOffset);
+
+		sLONG8 dsize;
+		if (fImpl.GetSize( &dsize) == VE_OK)
+			errThrow->SetLong8( "size", dsize);
+
+		err = errThrow.GetError();
+	}
+
+	return err;
+}
+
+
 VError VFileDesc::GetDataAtPos( void *outData, VSize inCount, sLONG8 inOffset, VSize *outActualCount) const
 {
 	xbox_assert( inCount >= 0);
+	xbox_assert( (fOpenOptions & FO_ConcurrentAccess) == 0);	// no current pos with concurrent access
 
 	VSize size = inCount;
 	VError err = fImpl.GetData( outData, size, inOffset, false);
@@ -189,9 +225,42 @@ VError VFileDesc::PutData( const void *inData, VSize inCount, sLONG8 inOffset, V
 }
 
 
+VError VFileDesc::PutDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, sLONG8 inOffset, VSize *outActualCount) const
+{
+	xbox_assert( inSegmentsCount >= 0);
+
+	VSize count = 0;
+	for( sLONG i = 0 ; i < inSegmentsCount ; ++i)
+		count += inSegments[i].fSize;
+
+	VSize size = count;
+	VError err = fImpl.PutDataV( inSegments, inSegmentsCount, size, inOffset);
+	xbox_assert( (size == count) || (err != VE_OK) );
+
+	if (outActualCount)
+		*outActualCount = size;
+
+	if (IS_NATIVE_VERROR( err))
+	{
+		StThrowFileError errThrow( fFile, VE_STREAM_CANNOT_PUT_DATA, err);
+		errThrow->SetLong8( "count", count);
+		errThrow->SetLong8( "offset", inOffset);
+
+		sLONG8 dsize;
+		if (fImpl.GetSize( &dsize) == VE_OK)
+			errThrow->SetLong8( "size", dsize);
+
+		err = errThrow.GetError();
+	}
+
+	return err;
+}
+
+
 VError VFileDesc::PutDataAtPos( const void *inData, VSize inCount, sLONG8 inOffset, VSize *outActualCount) const
 {
 	xbox_assert( inCount >= 0);
+	xbox_assert( (fOpenOptions & FO_ConcurrentAccess) == 0);	// no current pos with concurrent access
 
 	VSize size = inCount;
 	VError err = fImpl.PutData( inData, size, inOffset, false);
@@ -282,6 +351,41 @@ VError VFileDesc::Flush() const
 }
 
 
+#pragma mark  -
+#pragma mark VFileCopyProgress
+// --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---
+
+VFileCopyProgress::VFileCopyProgress( VProgressIndicator *inIndicator)
+: fIndicator( RetainRefCountable( inIndicator))
+, fCopiedBytes( 0)
+, fCancelled( 0)
+{
+}
+
+
+VFileCopyProgress::~VFileCopyProgress()
+{
+	ReleaseRefCountable( &fIndicator);
+}
+
+
+bool VFileCopyProgress::Add( sLONG8 inBytes)
+{
+	VTaskLock lock( &fMutex);
+
+	fCopiedBytes += inBytes;
+
+	// VProgressIndicator is not thread safe
+	if ( (fIndicator != NULL) && (fCancelled == 0) )
+	{
+		if (!fIndicator->Increment( inBytes))
+			fCancelled = 1;
+	}
+
+	return fCancelled == 0;
+}
+
+
 #pragma mark  -
 #pragma mark VFile
 // --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---
@@ -407,7 +511,32 @@ VError VFile::Create( FileCreateOptions inOptions) const
 }
 
 
-VError VFile::CopyTo( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions ) const
+VError VFile::CopyTo( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions, VProgressIndicator *inProgress ) const
+{
+	VFileCopyProgress progress( inProgress);
+
+	if (inProgress != NULL)
+	{
+		sLONG8 size = 0;
+		{
+			StErrorContextInstaller errorContext( false);
+			GetSize( &size);
+		}
+		VString name;
+		GetName( name);
+		inProgress->BeginSession( size, name, true);
+	}
+
+	VError err = CopyTo( inDestination, outFile, inOptions, progress);
+
+	if (inProgress != NULL)
+		inProgress->EndSession();
+
+	return err;
+}
+
+
+VError VFile::CopyTo( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions, VFileCopyProgress& ioProgress ) const
 {
 	xbox_assert( outFile == NULL || *outFile != this);	// prevent file->Copy( path, &file);	because of refcounting leak
 
@@ -418,7 +547,8 @@ VError VFile::CopyTo( const VFilePath& inDestination, VFile** outFile, FileCopyO
 	bool needThrow;
 	if (GetPath().IsValid() && inDestination.IsValid())
 	{
-		err = fImpl.Copy( inDestination, outFile, inOptions);
+		// a cancelled copy returns VE_USER_ABORT without throwing
+		err = fImpl.Copy( inDestination, outFile, inOptions, &ioProgress);
 		needThrow = IS_NATIVE_VERROR( err);
 	}
 	else
@@ -439,46 +569,21 @@ VError VFile::CopyTo( const VFilePath& inDestination, VFile** outFile, FileCopyO
 }
 
 
-VError VFile::CopyTo( const VFile& inDestinationFile, FileCopyOptions inOptions ) const
+VError VFile::CopyTo( const VFile& inDestinationFile, FileCopyOptions inOptions, VProgressIndicator *inProgress ) const
 {
-	VError err = fImpl.Copy( inDestinationFile.GetPath(), NULL, inOptions);
-
-	if (IS_NATIVE_VERROR( err))
-	{
-		StThrowFileError errThrow( this, VE_FILE_CANNOT_COPY, err);
-		errThrow->SetString( "destination", inDestinationFile.GetPath().GetPath());
-		errThrow->SetLong( "options", inOptions);
-		err = errThrow.GetError();
-	}
-
-	return err;
+	return CopyTo( inDestinationFile.GetPath(), NULL, inOptions, inProgress);
 }
 
 
-VError VFile::CopyTo( const VFolder& inDestinationFolder, VFile** outFile, FileCopyOptions inOptions ) const
+VError VFile::CopyTo( const VFolder& inDestinationFolder, VFile** outFile, FileCopyOptions inOptions, VProgressIndicator *inProgress ) const
 {
-	xbox_assert( outFile == NULL || *outFile != this);	// prevent file->Copy( path, &file);	because of refcounting leak
-
-	if (outFile)
-		*outFile = NULL;
-
-	VError err = fImpl.Copy( inDestinationFolder.GetPath(), outFile, inOptions);
-
-	if (IS_NATIVE_VERROR( err))
-	{
-		StThrowFileError errThrow( this, VE_FILE_CANNOT_COPY, err);
-		errThrow->SetString( "destination", inDestinationFolder.GetPath().GetPath());
-		errThrow->SetLong( "options", inOptions);
-		err = errThrow.GetError();
-	}
-
-	return err;
+	return CopyTo( inDestinationFolder.GetPath(), outFile, inOptions, inProgress);
 }
 
 
 VError VFile::CopyFrom( const VFile& inSource, FileCopyOptions inOptions ) const
 {
-	VError err = inSource.fImpl.Copy( GetPath(), NULL, inOptions);
+	VError err = inSource.fImpl.Copy( GetPath(), NULL, inOptions, NULL);
 
 	if (IS_NATIVE_VERROR( err))
 	{
@@ -1271,16 +1376,38 @@ VError VFile::SetContent( const void *inDataPtr, size_t inDataSize) const
 VError VFile::GetContentAsString( VString& outContent, CharSet inDefaultSet, ECarriageReturnMode inCRMode) const
 {
 	StErrorContextInstaller errorContext( true);	// catch VString errors
-	VMemoryBuffer<> buffer;
-	VError err = GetContent( buffer);
-	if (err == VE_OK)
+
+	// the text is converted straight from the file pages, no intermediate buffer
+	VFileMapping mapping;
+	bool mapped;
+	{
+		StErrorContextInstaller mapErrorContext( false, true);	// the file is read if it can't be mapped
+		mapped = (mapping.Map( *this) == VE_OK);
+	}
+	if (mapped)
 	{
-		outContent.FromBlockWithOptionalBOM( buffer.GetDataPtr(), buffer.GetDataSize(), inDefaultSet);
+		mapping.Advise( eFileMappingSequential);
+		outContent.FromBlockWithOptionalBOM( mapping.GetDataPtr(), mapping.GetDataSize(), inDefaultSet);
 		outContent.ConvertCarriageReturns( inCRMode);
+		if (mapping.IsDamaged())
+		{
+			StThrowFileError errThrow( this, VE_STREAM_CANNOT_READ);
+			outContent.Clear();
+		}
 	}
 	else
 	{
-		outContent.Clear();
+		VMemoryBuffer<> buffer;
+		VError err = GetContent( buffer);
+		if (err == VE_OK)
+		{
+			outContent.FromBlockWithOptionalBOM( buffer.GetDataPtr(), buffer.GetDataSize(), inDefaultSet);
+			outContent.ConvertCarriageReturns( inCRMode);
+		}
+		else
+		{
+			outContent.Clear();
+		}
 	}
 	return errorContext.GetLastError();
 }
@@ -1363,18 +1490,23 @@ VFileKind *VFileKindManager::RetainFileKind( const VString& inID)
 {
 	VRefPtr<VFileKind> ptr_kind;
 
-	MapOfVFileKind::const_iterator i = fMap.find( inID);
-	if (i != fMap.end())
 	{
-		ptr_kind = i->second;
+		StReadLocker lock( &fMapLock);
+		MapOfVFileKind::const_iterator i = fMap.find( inID);
+		if (i != fMap.end())
+			ptr_kind = i->second;
 	}
-	else
+
+	if (ptr_kind == NULL)
 	{
 		// see if that's a public kind not already registered
 		ptr_kind.Adopt( XFileImpl::CreatePublicFileKind( inID));
 		if (ptr_kind != NULL)
 		{
-			fMap[inID] = ptr_kind;
+			StWriteLocker lock( &fMapLock);
+			std::pair<MapOfVFileKind::iterator,bool> inserted = fMap.insert( MapOfVFileKind::value_type( inID, ptr_kind));
+			if (!inserted.second)
+				ptr_kind = inserted.first->second;	// registered by another task in between
 		}
 	}
 
@@ -1416,6 +1548,7 @@ void VFileKindManager::RegisterPrivateFileKind( const VString& inID, const Vecto
 	VRefPtr<VFileKind> ptr_kind( VFileKind::Create( inID, inOsKind, inDescription, inExtensions, inParentIDs, false), false);
 #endif	
 	
+	StWriteLocker lock( &fMapLock);
 	fMap[inID] = ptr_kind;
 }
 
@@ -1442,13 +1575,16 @@ void VFileKindManager::GetLocalizedString(long inWhich,VString &outString)
 VFileKind* VFileKindManager::RetainFirstFileKindMatchingWithExtension( const VString& inExtension )
 {
 	VFileKind *result = NULL;
-	for ( MapOfVFileKind::const_iterator iter = fMap.begin(); iter != fMap.end(); ++iter )
 	{
-		if ( iter->second->MatchExtension(inExtension) )
+		StReadLocker lock( &fMapLock);
+		for ( MapOfVFileKind::const_iterator iter = fMap.begin(); iter != fMap.end(); ++iter )
 		{
-			result = iter->second;
-			result->Retain();
-			break;
+			if ( iter->second->MatchExtension(inExtension) )
+			{
+				result = iter->second;
+				result->Retain();
+				break;
+			}
 		}
 	}
 
@@ -1457,7 +1593,8 @@ VFileKind* VFileKindManager::RetainFirstFileKindMatchingWithExtension( const VSt
 		result = XFileImpl::CreatePublicFileKindFromExtension( inExtension);
 		if (result != NULL)
 		{
-			if (testAssert( fMap.find(result->GetID()) == fMap.end() ))
+			StWriteLocker lock( &fMapLock);
+			if (fMap.find(result->GetID()) == fMap.end())
 			{
 				fMap[result->GetID()] = VRefPtr<VFileKind>(result);		// sc 27/09/2011 optimization
 			}
@@ -1470,13 +1607,16 @@ VFileKind* VFileKindManager::RetainFirstFileKindMatchingWithExtension( const VSt
 VFileKind* VFileKindManager::RetainFirstFileKindMatchingWithOsKind( const VString& inOsKind )
 {
 	VFileKind *result = NULL;
-	for ( MapOfVFileKind::const_iterator iter = fMap.begin(); iter != fMap.end(); ++iter )
 	{
-		if ( iter->second->MatchOsKind( inOsKind ) )
+		StReadLocker lock( &fMapLock);
+		for ( MapOfVFileKind::const_iterator iter = fMap.begin(); iter != fMap.end(); ++iter )
 		{
-			result = iter->second;
-			result->Retain();
-			break;
+			if ( iter->second->MatchOsKind( inOsKind ) )
+			{
+				result = iter->second;
+				result->Retain();
+				break;
+			}
 		}
 	}
 
@@ -35,6 +35,7 @@ BEGIN_TOOLBOX_NAMESPACE
 
 class VFileKind;
 class VVolumeInfo;
+class VProgressIndicator;
 
 // you can not create a VFileDesc by yourself, you have to get one by calling the method VFile::Open
 // or "create" with a VFile
@@ -60,18 +61,27 @@ public:
 
 			// read inCount bytes at inOffset from beginning.
 			// if outActualCount is not NULL, it receives the actual count of read bytes (returns an error if not equal to inCount).
-			// current pos is moved accordingly.
+			// current pos is moved accordingly (unless opened with FO_ConcurrentAccess).
 			VError				GetData( void *outData, VSize inCount, sLONG8 inOffset, VSize *outActualCount = NULL) const;
 
+			// read consecutive bytes at inOffset from beginning into inSegmentsCount buffers, with one system call where available.
+			// if outActualCount is not NULL, it receives the actual count of read bytes (returns eof if less than the buffers total size).
+			// current pos is moved accordingly (unless opened with FO_ConcurrentAccess).
+			VError				GetDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, sLONG8 inOffset, VSize *outActualCount = NULL) const;
+
 			// read inCount bytes at inOffset from current position.
 			// if outActualCount is not NULL, it receives the actual count of read bytes (returns eof if not equal to inCount).
 			// current pos is moved accordingly.
 			VError				GetDataAtPos( void *outData, VSize inCount, sLONG8 inOffset = 0, VSize *outActualCount = NULL) const;
 
 			// write inCount bytes at inOffset from beginning.
-			// current pos is moved accordingly.
+			// current pos is moved accordingly (unless opened with FO_ConcurrentAccess).
 			VError				PutData( const void *inData, VSize inCount, sLONG8 inOffset, VSize *outActualCount = NULL) const;
 
+			// write inSegmentsCount buffers as consecutive bytes at inOffset from beginning, with one system call where available.
+			// current pos is moved accordingly (unless opened with FO_ConcurrentAccess).
+			VError				PutDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, sLONG8 inOffset, VSize *outActualCount = NULL) const;
+
 			// write inCount bytes at inOffset from current position.
 			// current pos is moved accordingly.
 			VError				PutDataAtPos( const void *inData, VSize inCount, sLONG8 inOffset = 0, VSize *outActualCount = NULL) const;
@@ -84,6 +94,7 @@ public:
 			VError				Flush() const; 
 
 			FileAccess			GetMode() const											{ return fMode; }
+			FileOpenOptions		GetOpenOptions() const									{ return fOpenOptions; }
 			
 			FileDescSystemRef	GetSystemRef() const									{ return fImpl.GetSystemRef(); }
 			
@@ -91,18 +102,52 @@ public:
 
 protected:
 								// the only good way to create a VFileDesc.
-								VFileDesc( const VFile *inFile, FileDescSystemRef inSystemRef, FileAccess inMode );
+								VFileDesc( const VFile *inFile, FileDescSystemRef inSystemRef, FileAccess inMode, FileOpenOptions inOpenOptions = FO_Default );
 
 private:
 								VFileDesc( const VFileDesc& inOther);	// no copy
 								VFileDesc&	operator=( const VFileDesc& inOther);	// no copy
 
 			FileAccess			fMode;
+			FileOpenOptions		fOpenOptions;
 			const VFile*		fFile;	// essentially for info on error
 			XFileDescImpl		fImpl;
 };
 
 
+/*!
+	@class	VFileCopyProgress
+	@abstract	Progress and cancellation of a file or folder copy.
+	@discussion
+		Counts the copied bytes and forwards them to a VProgressIndicator if any.
+		Thread safe: the files of a folder copied with FCP_Parallel all report to the same VFileCopyProgress.
+		The copy stops with VE_USER_ABORT once Cancel() has been called or the indicator has been interrupted.
+*/
+class XTOOLBOX_API VFileCopyProgress : public VObject
+{
+public:
+	explicit					VFileCopyProgress( VProgressIndicator *inIndicator = NULL);
+	virtual						~VFileCopyProgress();
+
+			// inBytes more have been copied. Returns false if the copy must stop.
+			bool				Add( sLONG8 inBytes);
+
+			void				Cancel()												{ fCancelled = 1;}
+			bool				IsCancelled() const										{ return fCancelled != 0;}
+
+			sLONG8				GetCopiedBytes() const									{ return fCopiedBytes;}
+
+private:
+								VFileCopyProgress( const VFileCopyProgress&);
+			VFileCopyProgress&	operator=( const VFileCopyProgress&);
+
+			VProgressIndicator*	fIndicator;
+			VCriticalSection	fMutex;
+			sLONG8				fCopiedBytes;
+			sLONG				fCancelled;
+};
+
+
 class XTOOLBOX_API VFile : public VObject, public IRefCountable
 {
 public:
@@ -158,9 +203,13 @@ public:
 			// Copy this file to destination.
 			// Destination folder must exist.
 			// outFile (may be null) returns new file.
-			VError				CopyTo( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions = FCP_Default ) const;
-			VError				CopyTo( const VFile& inDestinationFile, FileCopyOptions inOptions = FCP_Default ) const;
-			VError				CopyTo( const VFolder& inDestinationFolder, VFile** outFile, FileCopyOptions inOptions = FCP_Default ) const;
+			// inProgress (may be null) gets a session counting the copied bytes, the copy can be cancelled with VProgressIndicator::UserAbort.
+			VError				CopyTo( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions = FCP_Default, VProgressIndicator *inProgress = NULL ) const;
+			VError				CopyTo( const VFile& inDestinationFile, FileCopyOptions inOptions = FCP_Default, VProgressIndicator *inProgress = NULL ) const;
+			VError				CopyTo( const VFolder& inDestinationFolder, VFile** outFile, FileCopyOptions inOptions = FCP_Default, VProgressIndicator *inProgress = NULL ) const;
+
+			// reports to a VFileCopyProgress that may be shared by several copies (no session is opened)
+			VError				CopyTo( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions, VFileCopyProgress& ioProgress ) const;
 			VError				CopyFrom( const VFile& inSource, FileCopyOptions inOptions = FCP_Default ) const;
 
 			// Rename the file with the given name ( foo.html ).
@@ -363,6 +412,7 @@ public:
 private:
 	static	VFileKindManager*			sManager;
 
+			VReadWriteLock				fMapLock;	// lookups are far more frequent than registrations
 			MapOfVFileKind				fMap;
 			VString fStringAll;
 			VString fStringAllReadableDocuments;
@@ -0,0 +1,712 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VFileIOEngine.h"
+#include "VFileSystemObject.h"
+#include "VValueBag.h"
+#include "VSystem.h"
+
+#if VERSION_LINUX
+#include "XLinuxIOUring.h"
+#endif
+
+
+// Class constants
+const sLONG		kDEFAULT_WORKER_COUNT		= 8;	// thread pool size when io_uring is not available
+const sLONG		kMAX_COMPLETIONS_PER_REAP	= 64;
+
+
+// Class statics
+VFileIOEngine*	VFileIOEngine::sShared = NULL;
+SpinLockType	VFileIOEngine::sSharedLock = 0;
+
+
+BEGIN_TOOLBOX_NAMESPACE
+
+class VFileIOReaper;
+
+
+/*
+	io_uring backend: requests are handed to the kernel under fMutex
+	and completed by one reaper task blocked on the completion ring.
+*/
+class VFileIORing : public VObject
+{
+public:
+	// returns NULL if io_uring is not available
+	static	VFileIORing*		Create( VFileIOEngine *inEngine, sLONG inQueueDepth, const VString& inName);
+
+	virtual						~VFileIORing();
+
+			void				Submit( VFileIORequest * const *inRequests, sLONG inCount);
+
+			// asks the kernel to cancel the requests. Each one still completes through the reaper task.
+			void				Cancel( const std::vector<VFileIORequest*>& inRequests);
+
+			// stops the reaper task and waits for its death, so that the ring can be deleted
+			void				Stop();
+
+			// reaper task loop
+			void				Reap();
+
+private:
+								VFileIORing( VFileIOEngine *inEngine);
+
+			bool				_Prepare( VFileIORequest *inRequest);
+			void				_Flush();
+
+			VFileIOEngine*		fEngine;
+			VCriticalSection	fMutex;		// serializes submissions
+			VFileIOReaper*		fReaper;
+#if VERSION_LINUX
+			XLinuxIOUring		fRing;
+#endif
+};
+
+
+class VFileIOReaper : public VTask
+{
+public:
+								VFileIOReaper( VFileIORing *inRing)
+									: VTask( NULL, 0, eTaskStylePreemptive, NULL)
+									, fRing( inRing)
+									{
+									}
+
+protected:
+	virtual	Boolean				DoRun()
+								{
+									fRing->Reap();
+									return true;
+								}
+
+private:
+			VFileIORing*		fRing;
+};
+
+
+/*
+	thread pool backend: runs a retained request synchronously.
+*/
+class VFileIOPoolJob : public VJob
+{
+public:
+								VFileIOPoolJob( VFileIOEngine *inEngine, VFileIORequest *inRequest):fEngine( inEngine), fRequest( inRequest)	{;}
+
+protected:
+	virtual	void				DoExecute()										{ fEngine->_Complete( fRequest);}
+
+private:
+			VFileIOEngine*		fEngine;
+			VFileIORequest*		fRequest;
+};
+
+END_TOOLBOX_NAMESPACE
+
+
+//================================================================================================================
+
+
+VFileIORequest::VFileIORequest( EFileIOOperation inOperation, const VFileDesc *inFileDesc, void *inData, VSize inSize, sLONG8 inOffset)
+: fOperation( inOperation)
+, fFileDesc( inFileDesc)
+, fData( inData)
+, fSize( inSize)
+, fOffset( inOffset)
+, fActualCount( 0)
+, fAsyncDone( false)
+, fAsyncError( VE_OK)
+, fAsyncCount( 0)
+{
+	// what a cancelled request returns
+	fResult = VE_USER_ABORT;
+}
+
+
+VFileIORequest::~VFileIORequest()
+{
+}
+
+
+void VFileIORequest::DoExecute()
+{
+	VError err;
+	if (!fAsyncDone)
+	{
+		err = _ExecuteSync( 0);
+	}
+	else if (fAsyncError != VE_OK)
+	{
+		fActualCount = 0;
+		err = _ThrowError( fAsyncError);
+	}
+	else
+	{
+		fActualCount = fAsyncCount;
+		if ( (fOperation != eFileIORead) && (fOperation != eFileIOWrite) )
+			err = VE_OK;
+		else if (fActualCount == fSize)
+			err = VE_OK;
+		else if ( (fOperation == eFileIORead) && (fActualCount == 0) )
+			err = VE_STREAM_EOF;
+		else
+			err = _ExecuteSync( fActualCount);	// resume a short transfer
+	}
+	fResult = err;
+}
+
+
+VError VFileIORequest::_ExecuteSync( VSize inDone)
+{
+	VError err = VE_OK;
+	switch( fOperation)
+	{
+		case eFileIORead:
+			{
+				VSize count = 0;
+				err = fFileDesc->GetData( (char*) fData + inDone, fSize - inDone, fOffset + inDone, &count);
+				fActualCount = inDone + count;
+				break;
+			}
+
+		case eFileIOWrite:
+			{
+				VSize count = 0;
+				err = fFileDesc->PutData( (const char*) fData + inDone, fSize - inDone, fOffset + inDone, &count);
+				fActualCount = inDone + count;
+				break;
+			}
+
+		case eFileIOFlush:
+			err = fFileDesc->Flush();
+			break;
+
+		case eFileIOAllocate:
+			{
+#if VERSION_LINUX_STRICT
+				int r = posix_fallocate( fFileDesc->GetSystemRef(), fOffset, (off_t) fSize);
+				if (r != 0)
+					err = _ThrowError( MAKE_NATIVE_VERROR( r));
+#else
+				sLONG8 end = fOffset + (sLONG8) fSize;
+				if (fFileDesc->GetSize() < end)
+					err = fFileDesc->SetSize( end);
+#endif
+				break;
+			}
+
+		default:
+			xbox_assert( false);
+			err = VE_INVALID_PARAMETER;
+			break;
+	}
+	return err;
+}
+
+
+VError VFileIORequest::_ThrowError( VError inNativeError) const
+{
+	VError errCode;
+	switch( fOperation)
+	{
+		case eFileIORead:		errCode = VE_STREAM_CANNOT_GET_DATA; break;
+		case eFileIOWrite:		errCode = VE_STREAM_CANNOT_PUT_DATA; break;
+		case eFileIOFlush:		errCode = VE_STREAM_CANNOT_FLUSH; break;
+		default:				errCode = VE_STREAM_CANNOT_SET_SIZE; break;
+	}
+
+	StThrowFileError errThrow( fFileDesc->GetParentVFile(), errCode, inNativeError);
+	if (fOperation != eFileIOFlush)
+	{
+		errThrow->SetLong8( "count", fSize);
+		errThrow->SetLong8( "offset", fOffset);
+	}
+
+	return errThrow.GetError();
+}
+
+
+//================================================================================================================
+
+
+VFileIORing::VFileIORing( VFileIOEngine *inEngine)
+: fEngine( inEngine)
+, fReaper( NULL)
+{
+}
+
+
+VFileIORing::~VFileIORing()
+{
+	xbox_assert( fReaper == NULL);
+}
+
+
+VFileIORing *VFileIORing::Create( VFileIOEngine *inEngine, sLONG inQueueDepth, const VString& inName)
+{
+	VFileIORing *ring = NULL;
+
+#if VERSION_LINUX
+	ring = new VFileIORing( inEngine);
+	if (ring != NULL)
+	{
+		// the thread pool is better than a ring that can only do nops
+		if (!ring->fRing.Init( inQueueDepth) || !ring->fRing.SupportsFileOperations())
+		{
+			delete ring;
+			return NULL;
+		}
+
+		ring->fReaper = new VFileIOReaper( ring);
+		if (ring->fReaper == NULL)
+		{
+			delete ring;
+			return NULL;
+		}
+
+		VString name( inName);
+		name += CVSTR( " completions");
+		ring->fReaper->SetName( name);
+		ring->fReaper->Run();
+	}
+#endif
+
+	return ring;
+}
+
+
+void VFileIORing::Submit( VFileIORequest * const *inRequests, sLONG inCount)
+{
+	VTaskLock lock( &fMutex);
+
+	for( sLONG i = 0 ; i < inCount ; ++i)
+	{
+		// ring full: hand over what is queued
+		while( !_Prepare( inRequests[i]))
+			_Flush();
+	}
+
+	_Flush();
+}
+
+
+bool VFileIORing::_Prepare( VFileIORequest *inRequest)
+{
+#if VERSION_LINUX
+	int fd = inRequest->fFileDesc->GetSystemRef();
+	uLONG8 userData = (uLONG8) (uLONG_PTR) inRequest;
+
+	switch( inRequest->fOperation)
+	{
+		case eFileIORead:		return fRing.PrepareRead( fd, inRequest->fData, inRequest->fSize, inRequest->fOffset, userData);
+		case eFileIOWrite:		return fRing.PrepareWrite( fd, inRequest->fData, inRequest->fSize, inRequest->fOffset, userData);
+		case eFileIOFlush:		return fRing.PrepareFsync( fd, userData);
+		case eFileIOAllocate:	return fRing.PrepareFallocate( fd, inRequest->fOffset, (sLONG8) inRequest->fSize, userData);
+		default:				xbox_assert( false); return fRing.PrepareNop( userData);
+	}
+#else
+	return false;
+#endif
+}
+
+
+void VFileIORing::_Flush()
+{
+#if VERSION_LINUX
+	sLONG r;
+	while( (r = fRing.Submit()) != 0)
+	{
+		if (r > 0)
+			continue;	// some entries may have been left
+
+		if ( (r == -EAGAIN) || (r == -EBUSY) )
+		{
+			VTask::YieldNow();	// wait for the reaper to free some room
+			continue;
+		}
+
+		xbox_assert( false);	// valid entries are never refused
+		break;
+	}
+#endif
+}
+
+
+void VFileIORing::Reap()
+{
+#if VERSION_LINUX
+	XLinuxIOUring::Completion completions[kMAX_COMPLETIONS_PER_REAP];
+	sLONG count = fRing.GetCompletions( completions, kMAX_COMPLETIONS_PER_REAP, true);
+	if (count < 0)
+		VTask::Sleep( 1);	// should not happen: don't spin
+
+	for( sLONG i = 0 ; i < count ; ++i)
+	{
+		// nop sent by Stop() to wake us up or cancellation sent by Cancel()
+		if (completions[i].fUserData == 0)
+			continue;
+
+		VFileIORequest *request = (VFileIORequest*) (uLONG_PTR) completions[i].fUserData;
+		sLONG result = completions[i].fResult;
+		if (result == -ECANCELED)
+		{
+			fEngine->_Abandon( request);
+			continue;
+		}
+
+		if ( (result == -EAGAIN) || (result == -EINTR) )
+		{
+			// not done: DoExecute does it synchronously
+		}
+		else if (result < 0)
+		{
+			request->fAsyncDone = true;
+			request->fAsyncError = MAKE_NATIVE_VERROR( -result);
+		}
+		else
+		{
+			request->fAsyncDone = true;
+			request->fAsyncCount = (VSize) result;
+		}
+		fEngine->_Complete( request);
+	}
+#endif
+}
+
+
+void VFileIORing::Cancel( const std::vector<VFileIORequest*>& inRequests)
+{
+#if VERSION_LINUX
+	VTaskLock lock( &fMutex);
+	for( std::vector<VFileIORequest*>::const_iterator i = inRequests.begin() ; i != inRequests.end() ; ++i)
+	{
+		// a request that has completed meanwhile is not found by the kernel: no harm
+		while( !fRing.PrepareCancel( (uLONG8) (uLONG_PTR) *i, 0))
+			_Flush();
+	}
+	_Flush();
+#endif
+}
+
+
+void VFileIORing::Stop()
+{
+	if (fReaper == NULL)
+		return;
+
+	fReaper->Kill();
+
+#if VERSION_LINUX
+	{
+		VTaskLock lock( &fMutex);
+		while( !fRing.PrepareNop( 0))
+			_Flush();
+		_Flush();
+	}
+#endif
+
+	// the reaper uses the ring until it returns from GetCompletions
+	while( !fReaper->WaitForDeath( 1000))
+		;
+	fReaper->Release();
+	fReaper = NULL;
+}
+
+
+//================================================================================================================
+
+
+VFileIOEngine::VFileIOEngine( sLONG inQueueDepth, sLONG inWorkerCount, const VString& inName)
+: fQueueDepth( Max( inQueueDepth, (sLONG) 1))
+, fSlots( fQueueDepth, fQueueDepth)
+, fRing( NULL)
+, fWorkers( NULL)
+, fShutDown( 0)
+, fInFlight( 0)
+, fMaxInFlight( 0)
+, fSubmitted( 0)
+, fCompleted( 0)
+, fSubmitCalls( 0)
+, fQueueDepthSum( 0)
+{
+	fRing = VFileIORing::Create( this, fQueueDepth, inName);
+	if (fRing == NULL)
+		fWorkers = new VExecutor( (inWorkerCount > 0) ? inWorkerCount : kDEFAULT_WORKER_COUNT, inName);
+}
+
+
+VFileIOEngine::~VFileIOEngine()
+{
+	Shutdown();
+	delete fRing;
+	ReleaseRefCountable( &fWorkers);
+}
+
+
+bool VFileIOEngine::Submit( VFileIORequest *inRequest)
+{
+	return SubmitBatch( &inRequest, 1) == 1;
+}
+
+
+sLONG VFileIOEngine::SubmitBatch( VFileIORequest * const *inRequests, sLONG inCount)
+{
+	sLONG accepted = 0;
+	while( (accepted < inCount) && !IsShutDown())
+	{
+		// wait for one slot then take the free ones without blocking
+		if (!fSlots.Lock())
+			break;
+
+		sLONG count = 1;
+		while( (accepted + count < inCount) && fSlots.TryToLock())
+			++count;
+
+		// Shutdown() sets fShutDown under the same lock: once checked, the requests are dispatched before it can look at fRequests
+		VTaskLock lock( &fDispatchMutex);
+		if (IsShutDown())
+		{
+			for( sLONG i = 0 ; i < count ; ++i)
+				fSlots.Unlock();
+			break;
+		}
+
+		_Dispatch( inRequests + accepted, count);
+		accepted += count;
+	}
+
+	for( sLONG i = accepted ; i < inCount ; ++i)
+		_Cancel( inRequests[i]);
+
+	return accepted;
+}
+
+
+VFuture<VError> VFileIOEngine::Read( const VFileDesc *inFileDesc, void *outData, VSize inSize, sLONG8 inOffset)
+{
+	return _SubmitRetained( new VFileIORequest( eFileIORead, inFileDesc, outData, inSize, inOffset));
+}
+
+
+VFuture<VError> VFileIOEngine::Write( const VFileDesc *inFileDesc, const void *inData, VSize inSize, sLONG8 inOffset)
+{
+	return _SubmitRetained( new VFileIORequest( eFileIOWrite, inFileDesc, const_cast<void*>( inData), inSize, inOffset));
+}
+
+
+VFuture<VError> VFileIOEngine::Flush( const VFileDesc *inFileDesc)
+{
+	return _SubmitRetained( new VFileIORequest( eFileIOFlush, inFileDesc, NULL, 0, 0));
+}
+
+
+VFuture<VError> VFileIOEngine::Allocate( const VFileDesc *inFileDesc, sLONG8 inOffset, sLONG8 inSize)
+{
+	return _SubmitRetained( new VFileIORequest( eFileIOAllocate, inFileDesc, NULL, (VSize) inSize, inOffset));
+}
+
+
+VFuture<VError> VFileIOEngine::_SubmitRetained( VFileIORequest *inRequest)
+{
+	VFuture<VError> future( inRequest);
+	Submit( inRequest);
+	inRequest->Release();
+	return future;
+}
+
+
+void VFileIOEngine::_Dispatch( VFileIORequest * const *inRequests, sLONG inCount)
+{
+	for( sLONG i = 0 ; i < inCount ; ++i)
+	{
+		VFileIORequest *request = inRequests[i];
+		xbox_assert( (request->fExecutor == NULL) && (request->GetState() == eJobPending) );
+		request->Retain();
+
+		sLONG inFlight = VInterlocked::Increment( &fInFlight);
+		VInterlocked::AtomicAdd( &fQueueDepthSum, (sLONG8) inFlight);
+
+		sLONG maxInFlight = fMaxInFlight;
+		while( (inFlight > maxInFlight) && (VInterlocked::CompareExchange( &fMaxInFlight, maxInFlight, inFlight) != maxInFlight) )
+			maxInFlight = fMaxInFlight;
+	}
+
+	VInterlocked::AtomicAdd( &fSubmitted, (sLONG8) inCount);
+	VInterlocked::AtomicAdd( &fSubmitCalls, (sLONG8) 1);
+
+	// before the hand over: a request may complete right away
+	fRequestsMutex.Lock();
+	fRequests.insert( inRequests, inRequests + inCount);
+	fRequestsMutex.Unlock();
+
+	if (fRing != NULL)
+	{
+		fRing->Submit( inRequests, inCount);
+	}
+	else
+	{
+		for( sLONG i = 0 ; i < inCount ; ++i)
+		{
+			VFileIOPoolJob *job = new VFileIOPoolJob( this, inRequests[i]);
+			fWorkers->Submit( job);
+			job->Release();
+		}
+	}
+}
+
+
+void VFileIOEngine::_Cancel( VFileIORequest *inRequest)
+{
+	if (inRequest->GetState() == eJobPending)
+	{
+		inRequest->Cancel();
+		inRequest->_Finish( eJobCancelled);
+	}
+}
+
+
+void VFileIOEngine::_Complete( VFileIORequest *inRequest)
+{
+	// Shutdown() may have given up waiting for this request and cancelled it
+	fRequestsMutex.Lock();
+	bool owned = (fRequests.erase( inRequest) != 0);
+	fRequestsMutex.Unlock();
+
+	if (owned)
+	{
+		// reports the result and runs the continuations
+		inRequest->_Execute();
+		_Release( inRequest);
+	}
+}
+
+
+void VFileIOEngine::_Abandon( VFileIORequest *inRequest)
+{
+	fRequestsMutex.Lock();
+	bool owned = (fRequests.erase( inRequest) != 0);
+	fRequestsMutex.Unlock();
+
+	if (owned)
+	{
+		_Cancel( inRequest);
+		_Release( inRequest);
+	}
+}
+
+
+void VFileIOEngine::_Release( VFileIORequest *inRequest)
+{
+	inRequest->Release();
+
+	VInterlocked::AtomicAdd( &fCompleted, (sLONG8) 1);
+	VInterlocked::Decrement( &fInFlight);
+	fSlots.Unlock();
+}
+
+
+void VFileIOEngine::GetStatistics( VFileIOStatistics& outStatistics) const
+{
+	outStatistics.fSubmitted = fSubmitted;
+	outStatistics.fCompleted = fCompleted;
+	outStatistics.fSubmitCalls = fSubmitCalls;
+	outStatistics.fQueueDepthSum = fQueueDepthSum;
+	outStatistics.fInFlight = fInFlight;
+	outStatistics.fMaxInFlight = fMaxInFlight;
+	outStatistics.fQueueDepth = fQueueDepth;
+	outStatistics.fUsesIOUring = (fRing != NULL);
+}
+
+
+void VFileIOEngine::Shutdown( sLONG inTimeoutMilliseconds)
+{
+	{
+		// no dispatch is in progress once we have the lock and none will start after
+		VTaskLock lock( &fDispatchMutex);
+		if (VInterlocked::Exchange( &fShutDown, 1) != 0)
+			return;
+	}
+
+	uLONG t0 = VSystem::GetCurrentTime();
+	while( (VInterlocked::AtomicGet( &fInFlight) > 0) && (VSystem::GetCurrentTime() - t0 < (uLONG) inTimeoutMilliseconds) )
+		VTask::Sleep( 1);
+
+	if (fRing != NULL)
+	{
+		// the kernel may still be using the buffers of the requests in flight: their waiters must not get them back
+		// before the kernel does. The requests are cancelled and we wait for all their completions.
+		std::vector<VFileIORequest*> pending;
+		fRequestsMutex.Lock();
+		pending.assign( fRequests.begin(), fRequests.end());
+		fRequestsMutex.Unlock();
+
+		if (!pending.empty())
+			fRing->Cancel( pending);
+
+		while( VInterlocked::AtomicGet( &fInFlight) > 0)
+			VTask::Sleep( 1);
+
+		fRing->Stop();
+	}
+
+	if (fWorkers != NULL)
+	{
+		// cancels the jobs that have not started. A worker removes its request from fRequests before executing it.
+		fWorkers->Shutdown( inTimeoutMilliseconds);
+
+		// nobody will complete the requests left: cancel them so that their waiters don't hang
+		std::vector<VFileIORequest*> abandoned;
+		fRequestsMutex.Lock();
+		abandoned.assign( fRequests.begin(), fRequests.end());
+		fRequestsMutex.Unlock();
+
+		for( std::vector<VFileIORequest*>::iterator i = abandoned.begin() ; i != abandoned.end() ; ++i)
+			_Abandon( *i);
+	}
+}
+
+
+VFileIOEngine *VFileIOEngine::GetShared()
+{
+	// the interlocked read and write are full barriers: the engine is fully constructed before any task can see it
+	VFileIOEngine *engine = (VFileIOEngine*) VInterlocked::CompareExchangePtr( (void**) &sShared, NULL, NULL);
+	if (engine == NULL)
+	{
+		SpinLockThread( sSharedLock);
+		engine = sShared;
+		if (engine == NULL)
+		{
+			engine = new VFileIOEngine( 256, 0, CVSTR( "Shared file I/O"));
+			VInterlocked::ExchangePtr( &sShared, engine);
+		}
+		SpinUnlock( sSharedLock);
+	}
+	return engine;
+}
+
+
+void VFileIOEngine::DeInit()
+{
+	SpinLockThread( sSharedLock);
+	VFileIOEngine *engine = VInterlocked::ExchangePtr( &sShared, (VFileIOEngine*) NULL);
+	SpinUnlock( sSharedLock);
+
+	if (engine != NULL)
+	{
+		engine->Shutdown();
+		engine->Release();
+	}
+}
@@ -0,0 +1,204 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VFileIOEngine__
+#define __VFileIOEngine__
+
+#include "Kernel/Sources/VExecutor.h"
+#include "Kernel/Sources/VFile.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+// Defined bellow
+class VFileIOEngine;
+
+// Private (see VFileIOEngine.cpp)
+class VFileIORing;
+
+
+typedef enum
+{
+	eFileIORead = 0,
+	eFileIOWrite,
+	eFileIOFlush,
+	eFileIOAllocate		// reserve disk blocks (the file size grows if needed)
+} EFileIOOperation;
+
+
+/*!
+	@class	VFileIORequest
+	@abstract	One asynchronous file operation (see VFileIOEngine).
+	@discussion
+		A VFileIORequest is a VCallable<VError>: get its result with a VFuture or chain a completion job with Then().
+		The result is VE_USER_ABORT if the request has been cancelled before it could run.
+		Errors are thrown in the job error context like VFileDesc does (see VJob::GetErrorContext).
+
+		The VFileDesc and the buffer must stay valid until the request is finished.
+		Open the file with FO_ConcurrentAccess if several requests on the same VFileDesc may be in flight.
+
+		A read that reaches the end of file returns VE_STREAM_EOF, GetActualCount() tells how many bytes were read.
+*/
+class XTOOLBOX_API VFileIORequest : public VCallable<VError>
+{
+public:
+										VFileIORequest( EFileIOOperation inOperation, const VFileDesc *inFileDesc, void *inData, VSize inSize, sLONG8 inOffset);
+
+			EFileIOOperation			GetOperation() const							{ return fOperation;}
+			const VFileDesc*			GetFileDesc() const								{ return fFileDesc;}
+			void*						GetData() const									{ return fData;}
+			VSize						GetSize() const									{ return fSize;}
+			sLONG8						GetOffset() const								{ return fOffset;}
+
+			VSize						GetActualCount() const							{ return fActualCount;}
+			VError						GetError() const								{ return fResult;}
+
+protected:
+	virtual								~VFileIORequest();
+	virtual	void						DoExecute();
+
+private:
+	friend class VFileIOEngine;
+	friend class VFileIORing;
+
+			VError						_ExecuteSync( VSize inDone);
+			VError						_ThrowError( VError inNativeError) const;
+
+			EFileIOOperation			fOperation;
+			const VFileDesc*			fFileDesc;
+			void*						fData;
+			VSize						fSize;
+			sLONG8						fOffset;
+			VSize						fActualCount;
+
+			// set when the operation has been done asynchronously, DoExecute only reports the result
+			bool						fAsyncDone;
+			VError						fAsyncError;		// native error
+			VSize						fAsyncCount;
+};
+
+
+/*!
+	@struct	VFileIOStatistics
+	@abstract	Counters of a VFileIOEngine.
+*/
+typedef struct VFileIOStatistics
+{
+	sLONG8		fSubmitted;			// requests accepted
+	sLONG8		fCompleted;			// requests finished (done or cancelled)
+	sLONG8		fSubmitCalls;		// hand overs to the kernel or to the thread pool (a batch is one hand over)
+	sLONG8		fQueueDepthSum;		// sum of the requests in flight seen by each submitted request
+	sLONG		fInFlight;
+	sLONG		fMaxInFlight;
+	sLONG		fQueueDepth;		// max requests in flight allowed
+	bool		fUsesIOUring;
+
+	// average count of requests in flight when a request is submitted
+	Real		GetAverageQueueDepth() const	{ return (fSubmitted > 0) ? (Real) fQueueDepthSum / fSubmitted : 0;}
+} VFileIOStatistics;
+
+
+/*!
+	@class	VFileIOEngine
+	@abstract	Asynchronous file i/o: submit reads, writes, flushes and allocations, get called back on completion.
+	@discussion
+		On linux the requests are handed to an io_uring instance and completed by one reaper task,
+		so that thousands of i/o may be in flight without as many threads.
+		Elsewhere (or if io_uring is not available) they are executed with positional i/o by a private VExecutor.
+
+		Submit() blocks while the queue depth is reached.
+		SubmitBatch() hands several requests over in one system call.
+
+		Continuations (VJob::Then) of requests completed by io_uring go to the shared VExecutor by default:
+		don't do heavy work in the reaper task.
+
+		VFileIOEngine *engine = VFileIOEngine::GetShared();
+		VFuture<VError> header = engine->Read( desc, &header, sizeof( header), 0);
+		VFuture<VError> data = engine->Read( desc, buffer, size, offset);
+		if ( (header.Get() == VE_OK) && (data.Get() == VE_OK) )
+			...
+*/
+class XTOOLBOX_API VFileIOEngine : public VObject, public IRefCountable
+{
+public:
+	// inQueueDepth is the max count of requests in flight.
+	// inWorkerCount is the size of the thread pool if io_uring is not available (0 means default).
+										VFileIOEngine( sLONG inQueueDepth = 256, sLONG inWorkerCount = 0, const VString& inName = CVSTR( "File I/O"));
+
+	// retains the request. Returns false if the engine is shut down (then the request is cancelled).
+			bool						Submit( VFileIORequest *inRequest);
+
+	// returns the count of accepted requests (the others are cancelled).
+			sLONG						SubmitBatch( VFileIORequest * const *inRequests, sLONG inCount);
+
+			VFuture<VError>				Read( const VFileDesc *inFileDesc, void *outData, VSize inSize, sLONG8 inOffset);
+			VFuture<VError>				Write( const VFileDesc *inFileDesc, const void *inData, VSize inSize, sLONG8 inOffset);
+			VFuture<VError>				Flush( const VFileDesc *inFileDesc);
+			VFuture<VError>				Allocate( const VFileDesc *inFileDesc, sLONG8 inOffset, sLONG8 inSize);
+
+			void						GetStatistics( VFileIOStatistics& outStatistics) const;
+			bool						UsesIOUring() const								{ return fRing != NULL;}
+
+	// waits for the requests in flight, then stops the workers.
+	// Requests that are not finished once inTimeoutMilliseconds has elapsed are cancelled.
+	// With io_uring, Shutdown then waits for the kernel to give them back since it may still be using their buffers.
+			void						Shutdown( sLONG inTimeoutMilliseconds = 5000);
+			bool						IsShutDown() const								{ return fShutDown != 0;}
+
+	// process wide engine, created on first use. It is shut down by VProcess.
+	static	VFileIOEngine*				GetShared();
+	static	void						DeInit();
+
+protected:
+	virtual								~VFileIOEngine();
+
+private:
+	friend class VFileIORing;
+	friend class VFileIOPoolJob;
+
+										VFileIOEngine( const VFileIOEngine&);
+			VFileIOEngine&				operator=( const VFileIOEngine&);
+
+			VFuture<VError>				_SubmitRetained( VFileIORequest *inRequest);
+			void						_Dispatch( VFileIORequest * const *inRequests, sLONG inCount);
+			void						_Cancel( VFileIORequest *inRequest);
+			void						_Complete( VFileIORequest *inRequest);
+			void						_Abandon( VFileIORequest *inRequest);	// cancels inRequest if it has not been completed
+			void						_Release( VFileIORequest *inRequest);
+
+			sLONG						fQueueDepth;
+			VSemaphore					fSlots;				// one unit per request that may be submitted
+			VFileIORing*				fRing;				// NULL if io_uring is not used
+			VExecutor*					fWorkers;			// NULL if io_uring is used
+			sLONG						fShutDown;
+			VCriticalSection			fDispatchMutex;		// serializes dispatch against Shutdown()
+			VCriticalSection			fRequestsMutex;		// protects fRequests
+			std::set<VFileIORequest*>	fRequests;			// dispatched requests not yet completed
+
+			// statistics
+			sLONG						fInFlight;
+			sLONG						fMaxInFlight;
+			sLONG8						fSubmitted;
+			sLONG8						fCompleted;
+			sLONG8						fSubmitCalls;
+			sLONG8						fQueueDepthSum;
+
+	static	VFileIOEngine*				sShared;
+	static	SpinLockType				sSharedLock;
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
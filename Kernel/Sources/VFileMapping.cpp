@@ -0,0 +1,429 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VFileMapping.h"
+#include "VFile.h"
+#include "VFileSystemObject.h"
+#include "VSystem.h"
+#include "VValueBag.h"
+
+#if VERSIONMAC || VERSION_LINUX
+#include <sys/mman.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+
+
+// Class constants
+const sLONG	kMAX_GUARDED_RANGES = 256;	// mappings beyond this count are not protected against SIGBUS
+
+
+#if VERSIONMAC || VERSION_LINUX
+
+/*
+	Pages of a mapping beyond the end of file (after a truncation) or that can't be read make the system raise SIGBUS.
+	The handler looks up the faulting address in the guarded ranges, maps a page of zeros over the faulty one
+	and flags the VFileMapping as damaged. The faulting instruction is then restarted and reads zeros.
+
+	The handler doesn't lock anything: a range is published by setting its start last and withdrawn by clearing its start first.
+	The handler counts itself in sHandlersRunning while it looks at the ranges: a withdrawn range is only unmapped
+	and its slot reused once no handler may still be using it.
+	Signals that don't concern a guarded range are passed to the previous handler.
+*/
+
+typedef struct GuardedRange
+{
+	void*		fStart;		// NULL if the slot is free
+	char*		fEnd;
+	sLONG*		fDamaged;
+} GuardedRange;
+
+static GuardedRange		sGuardedRanges[kMAX_GUARDED_RANGES];
+static bool				sGuardedSlotsUsed[kMAX_GUARDED_RANGES];
+static SpinLockType		sGuardLock = 0;
+static bool				sGuardInstalled = false;
+static sLONG			sHandlersRunning = 0;
+static VSize			sGuardPageSize = 0;
+static struct sigaction	sPreviousBusAction;
+
+
+static void _BusErrorHandler( int inSignal, siginfo_t *inInfo, void *inContext)
+{
+	char *address = (char*) inInfo->si_addr;
+	bool handled = false;
+
+	VInterlocked::Increment( &sHandlersRunning);
+	for( sLONG i = 0 ; i < kMAX_GUARDED_RANGES ; ++i)
+	{
+		char *start = (char*) sGuardedRanges[i].fStart;
+		if ( (start != NULL) && (address >= start) && (address < sGuardedRanges[i].fEnd) )
+		{
+			// the range start is page aligned
+			char *page = start + ((address - start) & ~(sGuardPageSize - 1));
+			if (mmap( page, sGuardPageSize, PROT_READ, MAP_PRIVATE | MAP_ANON | MAP_FIXED, -1, 0) != MAP_FAILED)
+			{
+				*sGuardedRanges[i].fDamaged = 1;
+				handled = true;
+			}
+			break;
+		}
+	}
+	VInterlocked::Decrement( &sHandlersRunning);
+
+	if (handled)
+		return;
+
+	if (sPreviousBusAction.sa_flags & SA_SIGINFO)
+	{
+		if (sPreviousBusAction.sa_sigaction != NULL)
+			sPreviousBusAction.sa_sigaction( inSignal, inInfo, inContext);
+	}
+	else if ( (sPreviousBusAction.sa_handler != SIG_DFL) && (sPreviousBusAction.sa_handler != SIG_IGN) )
+	{
+		sPreviousBusAction.sa_handler( inSignal);
+	}
+	else if ( (sPreviousBusAction.sa_handler == SIG_IGN) && (inInfo->si_code <= 0) )
+	{
+		// sent by kill() or sigqueue(): ignored as before we were installed
+	}
+	else
+	{
+		// default behavior (the system also kills a process that ignores a bus error fault):
+		// the signal is raised again right now with the default action, which terminates the process in here.
+		struct sigaction defaultAction;
+		memset( &defaultAction, 0, sizeof( defaultAction));
+		defaultAction.sa_handler = SIG_DFL;
+		sigemptyset( &defaultAction.sa_mask);
+		sigaction( SIGBUS, &defaultAction, NULL);
+
+		sigset_t signals;
+		sigemptyset( &signals);
+		sigaddset( &signals, SIGBUS);
+		pthread_sigmask( SIG_UNBLOCK, &signals, NULL);
+		raise( SIGBUS);
+	}
+}
+
+
+static sLONG _GuardRange( void *inStart, VSize inSize, sLONG *inDamaged)
+{
+	sLONG slot = -1;
+
+	SpinLockThread( sGuardLock);
+
+	if (!sGuardInstalled)
+	{
+		sGuardPageSize = VSystem::GetVMPageSize();
+
+		struct sigaction action;
+		memset( &action, 0, sizeof( action));
+		action.sa_sigaction = _BusErrorHandler;
+		action.sa_flags = SA_SIGINFO | SA_ONSTACK | SA_RESTART;
+		sigemptyset( &action.sa_mask);
+		sGuardInstalled = (sigaction( SIGBUS, &action, &sPreviousBusAction) == 0);
+	}
+
+	if (sGuardInstalled)
+	{
+		for( sLONG i = 0 ; (i < kMAX_GUARDED_RANGES) && (slot < 0) ; ++i)
+		{
+			if (!sGuardedSlotsUsed[i])
+			{
+				sGuardedSlotsUsed[i] = true;
+				sGuardedRanges[i].fEnd = (char*) inStart + inSize;
+				sGuardedRanges[i].fDamaged = inDamaged;
+				VInterlocked::ExchangeVoidPtr( &sGuardedRanges[i].fStart, inStart);	// publish
+				slot = i;
+			}
+		}
+	}
+
+	SpinUnlock( sGuardLock);
+
+	return slot;
+}
+
+
+static void _UnguardRange( sLONG inSlot)
+{
+	SpinLockThread( sGuardLock);
+
+	VInterlocked::ExchangeVoidPtr( &sGuardedRanges[inSlot].fStart, NULL);
+
+	// a handler that has seen the range may still be mapping its page of zeros: wait for it before the range can be unmapped
+	while( VInterlocked::AtomicGet( &sHandlersRunning) != 0)
+		VTask::YieldNow();
+
+	sGuardedRanges[inSlot].fEnd = NULL;
+	sGuardedRanges[inSlot].fDamaged = NULL;
+	sGuardedSlotsUsed[inSlot] = false;
+
+	SpinUnlock( sGuardLock);
+}
+
+#elif VERSIONWIN
+
+// no c++ object in here (C2712)
+static bool _CopyGuarded( void *outData, const void *inData, VSize inSize)
+{
+	__try
+	{
+		::memcpy( outData, inData, inSize);
+	}
+	__except( (GetExceptionCode() == EXCEPTION_IN_PAGE_ERROR) ? EXCEPTION_EXECUTE_HANDLER : EXCEPTION_CONTINUE_SEARCH)
+	{
+		return false;
+	}
+	return true;
+}
+
+#endif
+
+
+VFileMapping::VFileMapping()
+: fBase( NULL)
+, fBaseSize( 0)
+, fData( NULL)
+, fDataSize( 0)
+, fOffset( 0)
+, fFileSize( 0)
+, fGuardSlot( -1)
+, fDamaged( 0)
+{
+}
+
+
+VFileMapping::~VFileMapping()
+{
+	Unmap();
+}
+
+
+VSize VFileMapping::GetAlignment()
+{
+#if VERSIONWIN
+	static VSize sGranularity = 0;
+	if (sGranularity == 0)
+	{
+		SYSTEM_INFO info;
+		::GetSystemInfo( &info);
+		sGranularity = info.dwAllocationGranularity;
+	}
+	return sGranularity;
+#else
+	return VSystem::GetVMPageSize();
+#endif
+}
+
+
+VError VFileMapping::Map( const VFile& inFile, sLONG8 inOffset, sLONG8 inSize)
+{
+	Unmap();
+
+	if (!testAssert( inOffset >= 0))
+		return VE_INVALID_PARAMETER;
+
+	VError err = VE_OK;
+
+#if VERSIONMAC
+	VString path;
+	inFile.GetPath( path, FPS_POSIX);
+	VStringConvertBuffer buffer( path, VTC_UTF_8);
+	int fd = open( buffer.GetCPointer(), O_RDONLY);
+	if (fd < 0)
+	{
+		StThrowFileError errThrow( &inFile, VE_FILE_CANNOT_OPEN, (VNativeError) errno);
+		return errThrow.GetError();
+	}
+	struct stat fileInfo;
+	fFileSize = (fstat( fd, &fileInfo) == 0) ? fileInfo.st_size : 0;
+#else
+	VFileDesc *desc = NULL;
+	err = inFile.Open( FA_READ, &desc);
+	if (err != VE_OK)
+		return err;
+	fFileSize = desc->GetSize();
+#endif
+
+	sLONG8 end = ( (inSize < 0) || (inSize > fFileSize - inOffset) ) ? fFileSize : inOffset + inSize;
+	if (end > inOffset)
+	{
+		sLONG8 base = inOffset & ~((sLONG8) GetAlignment() - 1);
+		if ((uLONG8) (end - base) > (uLONG8) kMAX_VSize)
+		{
+			StThrowFileError errThrow( &inFile, VE_FILE_CANNOT_MAP);
+			err = errThrow.GetError();
+		}
+		else
+		{
+			fBaseSize = (VSize) (end - base);
+
+		#if VERSIONWIN
+			HANDLE mapping = ::CreateFileMappingW( desc->GetSystemRef(), NULL, PAGE_READONLY, 0, 0, NULL);
+			if (mapping != NULL)
+			{
+				fBase = ::MapViewOfFile( mapping, FILE_MAP_READ, (DWORD) (base >> 32), (DWORD) base, fBaseSize);
+				::CloseHandle( mapping);	// the view keeps the mapping object alive
+			}
+			if (fBase == NULL)
+			{
+				StThrowFileError errThrow( &inFile, VE_FILE_CANNOT_MAP, (VNativeError) ::GetLastError());
+				err = errThrow.GetError();
+			}
+		#else
+			#if VERSIONMAC
+			void *addr = mmap( NULL, fBaseSize, PROT_READ, MAP_SHARED, fd, base);
+			#else
+			void *addr = mmap( NULL, fBaseSize, PROT_READ, MAP_SHARED, desc->GetSystemRef(), base);
+			#endif
+			if (addr != MAP_FAILED)
+			{
+				fBase = addr;
+				fGuardSlot = _GuardRange( fBase, fBaseSize, &fDamaged);
+			}
+			else
+			{
+				StThrowFileError errThrow( &inFile, VE_FILE_CANNOT_MAP, (VNativeError) errno);
+				err = errThrow.GetError();
+			}
+		#endif
+
+			if (fBase != NULL)
+			{
+				fData = (const char*) fBase + (inOffset - base);
+				fDataSize = (VSize) (end - inOffset);
+				fOffset = inOffset;
+			}
+			else
+			{
+				fBaseSize = 0;
+			}
+		}
+	}
+	else
+	{
+		fOffset = Min( inOffset, fFileSize);
+	}
+
+	// the mapping doesn't need the file to stay open
+#if VERSIONMAC
+	close( fd);
+#else
+	delete desc;
+#endif
+
+	return err;
+}
+
+
+void VFileMapping::Unmap()
+{
+	if (fBase != NULL)
+	{
+	#if VERSIONWIN
+		::UnmapViewOfFile( fBase);
+	#else
+		if (fGuardSlot >= 0)
+			_UnguardRange( fGuardSlot);
+		munmap( fBase, fBaseSize);
+	#endif
+	}
+
+	fBase = NULL;
+	fBaseSize = 0;
+	fData = NULL;
+	fDataSize = 0;
+	fOffset = 0;
+	fFileSize = 0;
+	fGuardSlot = -1;
+	fDamaged = 0;
+}
+
+
+VError VFileMapping::Advise( EFileMappingAdvice inAdvice, VSize inOffset, VSize inSize) const
+{
+	if ( (fBase == NULL) || (inOffset >= fDataSize) )
+		return VE_OK;
+
+	if ( (inSize == 0) || (inSize > fDataSize - inOffset) )
+		inSize = fDataSize - inOffset;
+
+#if VERSIONMAC || VERSION_LINUX
+	// madvise wants a page aligned address
+	char *start = (char*) fData + inOffset;
+	char *alignedStart = (char*) fBase + (((start - (char*) fBase)) & ~(VSystem::GetVMPageSize() - 1));
+
+	int advice;
+	switch( inAdvice)
+	{
+		case eFileMappingSequential:	advice = MADV_SEQUENTIAL; break;
+		case eFileMappingRandom:		advice = MADV_RANDOM; break;
+		case eFileMappingWillNeed:		advice = MADV_WILLNEED; break;
+		case eFileMappingDontNeed:		advice = MADV_DONTNEED; break;
+		default:						advice = MADV_NORMAL; break;
+	}
+
+	int r = madvise( alignedStart, (start - alignedStart) + inSize, advice);
+	return (r == 0) ? VE_OK : MAKE_NATIVE_VERROR( errno);
+#else
+	// no hint on windows: the memory manager already reads ahead on sequential faults
+	return VE_OK;
+#endif
+}
+
+
+VError VFileMapping::GetData( void *outData, VSize inSize, VSize inOffset, VSize *outActualCount) const
+{
+	VSize count = (inOffset >= fDataSize) ? 0 : Min( inSize, fDataSize - inOffset);
+
+	bool ok;
+	if (count > 0)
+	{
+	#if VERSIONWIN
+		ok = _CopyGuarded( outData, (const char*) fData + inOffset, count);
+		if (!ok)
+			fDamaged = 1;
+	#else
+		::memcpy( outData, (const char*) fData + inOffset, count);
+		ok = !IsDamaged();
+	#endif
+	}
+	else
+	{
+		ok = true;
+	}
+
+	if (outActualCount != NULL)
+		*outActualCount = ok ? count : 0;
+
+	VError err;
+	if (!ok)
+	{
+		StThrowError<> errThrow( VE_STREAM_CANNOT_READ);
+		err = errThrow.GetError();
+	}
+	else if (count == inSize)
+	{
+		err = VE_OK;
+	}
+	else
+	{
+		err = VE_STREAM_EOF;
+	}
+
+	return err;
+}
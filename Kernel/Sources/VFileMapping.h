@@ -0,0 +1,114 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VFileMapping__
+#define __VFileMapping__
+
+#include "Kernel/Sources/VObject.h"
+#include "Kernel/Sources/VInterlocked.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+// Needed declarations
+class VFile;
+
+
+typedef enum
+{
+	eFileMappingNormal = 0,		// default read ahead
+	eFileMappingSequential,		// aggressive read ahead, pages may be dropped soon after being read
+	eFileMappingRandom,			// no read ahead
+	eFileMappingWillNeed,		// starts reading now
+	eFileMappingDontNeed		// pages may be dropped
+} EFileMappingAdvice;
+
+
+/*!
+	@class	VFileMapping
+	@abstract	Read-only view of a file or of a range of a file in memory.
+	@discussion
+		The file content is paged in by the system on access instead of being copied in a heap buffer.
+		The file is opened only while mapping: the view remains valid until Unmap() or the destructor.
+
+		If the file gets truncated while mapped, reading the pages past the new end of file
+		makes the system raise SIGBUS (mac and linux). Ranges mapped by a VFileMapping are guarded:
+		these pages then read as zeros and IsDamaged() becomes true, check it once the data has been used.
+		Same thing for pages that the system fails to read (i/o error, network drive disconnected).
+		On windows a mapped file cannot be truncated and i/o errors are only caught by GetData().
+
+		VFileMapping mapping;
+		if (mapping.Map( file) == VE_OK)
+		{
+			mapping.Advise( eFileMappingSequential);
+			Parse( mapping.GetDataPtr(), mapping.GetDataSize());
+			if (mapping.IsDamaged())
+				...
+		}
+*/
+class XTOOLBOX_API VFileMapping : public VObject
+{
+public:
+										VFileMapping();
+	virtual								~VFileMapping();
+
+	// maps inSize bytes of the file starting at inOffset (-1 means up to the end of file).
+	// The range is clipped to the file size. Mapping an empty range succeeds with a NULL data pointer.
+			VError						Map( const VFile& inFile, sLONG8 inOffset = 0, sLONG8 inSize = -1);
+			void						Unmap();
+
+			bool						IsMapped() const								{ return fBase != NULL;}
+
+			const void*					GetDataPtr() const								{ return fData;}
+			VSize						GetDataSize() const								{ return fDataSize;}
+
+			// offset in file of the first byte of data
+			sLONG8						GetOffset() const								{ return fOffset;}
+
+			// file size when it was mapped
+			sLONG8						GetFileSize() const								{ return fFileSize;}
+
+			// tells the system how the range will be accessed (inSize == 0 means up to the end of data).
+			// it's only a hint: failures are not thrown.
+			VError						Advise( EFileMappingAdvice inAdvice, VSize inOffset = 0, VSize inSize = 0) const;
+
+			// true if some page could not be read (the file has been truncated or an i/o error occured).
+			// it's a barrier: the compiler can't move it before the reads of the data.
+			bool						IsDamaged() const								{ return VInterlocked::AtomicGet( &fDamaged) != 0;}
+
+			// copies data from the mapping. Throws VE_STREAM_CANNOT_READ if the pages are damaged.
+			// inOffset is relative to GetOffset(). Reading beyond end of data gives VE_STREAM_EOF.
+			VError						GetData( void *outData, VSize inSize, VSize inOffset, VSize *outActualCount = NULL) const;
+
+	// mapping alignment constraint for the offset (page size or windows allocation granularity)
+	static	VSize						GetAlignment();
+
+private:
+										VFileMapping( const VFileMapping&);
+			VFileMapping&				operator=( const VFileMapping&);
+
+			void*						fBase;			// aligned start of the view
+			VSize						fBaseSize;
+			const void*					fData;
+			VSize						fDataSize;
+			sLONG8						fOffset;
+			sLONG8						fFileSize;
+			sLONG						fGuardSlot;		// -1 if not guarded
+	mutable	sLONG						fDamaged;		// set by the SIGBUS handler
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
@@ -18,6 +18,247 @@
 #include "VValueBag.h"
 #include "VFile.h"
 #include "VURL.h"
+#include "VErrorContext.h"
+#include "VProgressIndicator.h"
+#include "VParallel.h"
+
+#if VERSION_LINUX
+#include "XLinuxFsHelpers.h"
+#endif
+
+
+// Class constants
+const sLONG	kMAX_PARALLEL_COPIES = 8;	// more concurrent copies only add seeks
+const size_t	kWALK_BATCH_SIZE = 256;		// entries given at once to IFolderWalker
+
+
+// one file of a folder copy
+typedef struct VFolderCopyItem
+{
+	VFile*			fFile;
+	const VFolder*	fDestination;
+	sLONG8			fSize;
+	VError			fError;
+} VFolderCopyItem;
+
+typedef std::vector<VFolderCopyItem> VectorOfFolderCopyItem;
+
+
+/*
+	Copies the files of a folder copy.
+	Each worker picks the next file until there's none left, so that one big file doesn't hold a whole chunk of small ones.
+	Errors are collected to be pushed in the calling task error context.
+*/
+class VFolderCopyBody
+{
+public:
+	VFolderCopyBody( VectorOfFolderCopyItem& inItems, FileCopyOptions inOptions, VFileCopyProgress& inProgress)
+	: fItems( inItems), fOptions( inOptions), fProgress( inProgress), fNext( 0), fErrors( true, true)
+	{
+	}
+
+	void operator()( sLONG /*inBegin*/, sLONG /*inEnd*/) const
+	{
+		for(;;)
+		{
+			sLONG index = VInterlocked::AtomicAdd( &fNext, 1);
+			if ( (index >= (sLONG) fItems.size()) || fProgress.IsCancelled() )
+				break;
+
+			VFolderCopyItem& item = fItems[index];
+
+			StErrorContextInstaller errorContext( false, true);
+			item.fError = item.fFile->CopyTo( item.fDestination->GetPath(), NULL, fOptions, fProgress);
+
+			if (item.fError != VE_OK)
+			{
+				if (item.fError != VE_USER_ABORT)
+				{
+					VTaskLock lock( &fMutex);
+					fErrors.PushErrors( *errorContext.GetContext());
+				}
+				if ((fOptions & FCP_ContinueOnError) == 0)
+					fProgress.Cancel();
+			}
+		}
+	}
+
+	const VErrorContext&	GetErrors() const	{ return fErrors;}
+
+private:
+			VectorOfFolderCopyItem&		fItems;
+			FileCopyOptions				fOptions;
+			VFileCopyProgress&			fProgress;
+	mutable	sLONG						fNext;
+	mutable	VCriticalSection			fMutex;
+	mutable	VErrorContext				fErrors;
+};
+
+
+// creates the sub folders of inSource in inDestination and lists the files to copy
+static VError _PrepareFolderCopy( const VFolder& inSource, const VFolder& inDestination, FileCopyOptions inOptions, VectorOfFolderCopyItem& ioItems, sLONG8& ioTotalSize)
+{
+	VError err = VE_OK;
+	bool ok = true;
+
+	for( VFolderIterator folderIterator( &inSource, FI_WANT_FOLDERS | FI_WANT_INVISIBLES) ; folderIterator.IsValid() && ok ; ++folderIterator)
+	{
+		VString name;
+		folderIterator->GetName( name);
+
+		// the items of the sub folder retain their destination, so it must not live on the stack
+		VFolder *folder = new VFolder( inDestination, name);
+		VError err2 = VE_OK;
+		if ( ( (inOptions & FCP_Overwrite) != 0) && folder->Exists() )
+			err2 = folder->Delete( true);
+		if (err2 == VE_OK)
+			err2 = folder->Create();
+		if (err2 == VE_OK)
+			err2 = _PrepareFolderCopy( *folderIterator, *folder, inOptions, ioItems, ioTotalSize);
+		ReleaseRefCountable( &folder);
+
+		if (err == VE_OK)
+			err = err2;
+		ok = (err == VE_OK) | ((inOptions & FCP_ContinueOnError) != 0);
+	}
+
+	for( VFileIterator fileIterator( &inSource, FI_WANT_FILES | FI_WANT_INVISIBLES) ; fileIterator.IsValid() && ok ; ++fileIterator)
+	{
+		VFolderCopyItem item;
+		item.fFile = RetainRefCountable( fileIterator.Current());
+		item.fDestination = RetainRefCountable( &inDestination);
+		item.fSize = 0;
+		item.fError = VE_OK;
+		{
+			StErrorContextInstaller errorContext( false);
+			item.fFile->GetSize( &item.fSize);
+		}
+		ioTotalSize += item.fSize;
+		ioItems.push_back( item);
+	}
+
+	return err;
+}
+
+
+
+
+/*
+	State of a VFolderEnumerator::Walk.
+	With FI_PARALLEL each folder is a job of the shared executor. The jobs retain the walk
+	so that the event signaling the end remains valid while the last job unlocks it.
+*/
+class VFolderWalk : public VObject, public IRefCountable
+{
+public:
+	VFolderWalk( FileIteratorOptions inOptions, IFolderWalker *inWalker, VExecutor *inExecutor)
+	: fOptions( inOptions), fWalker( inWalker), fExecutor( inExecutor), fPending( 0), fStopped( 0)
+	{
+	}
+
+			bool				IsStopped() const	{ return fStopped != 0;}
+
+			// lists inFolder, then walks its sub folders or submits them
+			void				WalkFolder( const VFolder& inFolder);
+
+			// parallel walk only
+			void				SubmitFolder( const VFolder *inFolder);
+			void				RunFolder( const VFolder& inFolder);
+			void				Wait()				{ fDone.Lock();}
+
+private:
+			FileIteratorOptions	fOptions;
+			IFolderWalker*		fWalker;
+			VExecutor*			fExecutor;
+			sLONG				fPending;		// submitted folders not yet walked
+			sLONG				fStopped;
+			VSyncEvent			fDone;
+};
+
+
+class VFolderWalkJob : public VJob
+{
+public:
+	VFolderWalkJob( VFolderWalk *inWalk, const VFolder *inFolder)
+	: fWalk( RetainRefCountable( inWalk)), fFolder( RetainRefCountable( inFolder))
+	{
+	}
+
+protected:
+	virtual ~VFolderWalkJob()
+	{
+		ReleaseRefCountable( &fFolder);
+		ReleaseRefCountable( &fWalk);
+	}
+
+	virtual	void DoExecute()
+	{
+		fWalk->RunFolder( *fFolder);
+	}
+
+private:
+			VFolderWalk*		fWalk;
+			const VFolder*		fFolder;
+};
+
+
+void VFolderWalk::WalkFolder( const VFolder& inFolder)
+{
+	const FileIteratorOptions wanted = fOptions & (FI_WANT_FILES | FI_WANT_FOLDERS);
+
+	// sub folders are needed even if the walker doesn't want them
+	VFolderEnumerator enumerator( &inFolder, fOptions | FI_WANT_FOLDERS);
+	VectorOfFolderEntry entries;
+	VectorOfFolderEntry visited;
+	VectorOfVFolder subFolders;
+
+	while( !IsStopped() && enumerator.NextBatch( entries, kWALK_BATCH_SIZE))
+	{
+		for( VectorOfFolderEntry::const_iterator i = entries.begin() ; i != entries.end() ; ++i)
+		{
+			if (i->fIsFolder && !i->fIsLink)
+				subFolders.push_back( VRefPtr<VFolder>( new VFolder( inFolder, i->fName), false));
+
+			if ( (wanted != (FI_WANT_FILES | FI_WANT_FOLDERS)) && ((i->fIsFolder ? FI_WANT_FOLDERS : FI_WANT_FILES) & wanted) )
+				visited.push_back( *i);
+		}
+
+		const VectorOfFolderEntry& batch = (wanted == (FI_WANT_FILES | FI_WANT_FOLDERS)) ? entries : visited;
+		if (!batch.empty() && !fWalker->VisitEntries( inFolder, batch))
+			VInterlocked::Exchange( &fStopped, 1);
+		visited.clear();
+	}
+
+	for( VectorOfVFolder::const_iterator i = subFolders.begin() ; (i != subFolders.end()) && !IsStopped() ; ++i)
+	{
+		if (fExecutor != NULL)
+			SubmitFolder( *i);
+		else
+			WalkFolder( **i);
+	}
+}
+
+
+void VFolderWalk::SubmitFolder( const VFolder *inFolder)
+{
+	VInterlocked::Increment( &fPending);
+
+	VFolderWalkJob *job = new VFolderWalkJob( this, inFolder);
+	if (!fExecutor->Submit( job))
+		RunFolder( *inFolder);	// the executor has been shut down meanwhile
+	job->Release();
+}
+
+
+void VFolderWalk::RunFolder( const VFolder& inFolder)
+{
+	if (!IsStopped())
+		WalkFolder( inFolder);
+
+	if (VInterlocked::Decrement( &fPending) == 0)
+		fDone.Unlock();
+}
+
 
 
 VFolder::VFolder( const VFilePath& inPath)
@@ -413,7 +654,7 @@ VError VFolder::Move( const VFolder& inNewParent, VFolder** outFolder ) const
 }
 
 
-VError VFolder::CopyTo( const VFolder& inDestinationFolder, VFolder **outFolder, FileCopyOptions inOptions) const
+VError VFolder::CopyTo( const VFolder& inDestinationFolder, VFolder **outFolder, FileCopyOptions inOptions, VProgressIndicator *inProgress) const
 {
 	VError err = VE_OK;
 	VFolder *folder = NULL;
@@ -435,7 +676,7 @@ VError VFolder::CopyTo( const VFolder& inDestinationFolder, VFolder **outFolder,
 			if ( ( (inOptions & FCP_Overwrite) != 0) && folder->Exists() )
 				err = folder->Delete( true);
 			if (err == VE_OK)
-				err = CopyContentsTo( *folder, inOptions);
+				err = CopyContentsTo( *folder, inOptions, inProgress);
 		}
 		else
 		{
@@ -455,7 +696,7 @@ VError VFolder::CopyTo( const VFolder& inDestinationFolder, VFolder **outFolder,
 }
 
 
-VError VFolder::CopyContentsTo( const VFolder& inDestinationFolder, FileCopyOptions inOptions) const
+VError VFolder::CopyContentsTo( const VFolder& inDestinationFolder, FileCopyOptions inOptions, VProgressIndicator *inProgress) const
 {
 	VError err = VE_OK;
 	if (!inDestinationFolder.Exists())
@@ -472,22 +713,55 @@ VError VFolder::CopyContentsTo( const VFolder& inDestinationFolder, FileCopyOpti
 
 	if (err == VE_OK)
 	{
-		bool ok = true;
-		
-		for( VFolderIterator folderIterator( this, FI_WANT_FOLDERS | FI_WANT_INVISIBLES) ; folderIterator.IsValid() && ok ; ++folderIterator)
+		// the whole tree is listed first so that the progress knows the total size
+		VectorOfFolderCopyItem items;
+		sLONG8 totalSize = 0;
+		err = _PrepareFolderCopy( *this, inDestinationFolder, inOptions, items, totalSize);
+
+		if ( ( (err == VE_OK) || ((inOptions & FCP_ContinueOnError) != 0) ) && !items.empty() )
 		{
-			VError err2 = folderIterator->CopyTo( inDestinationFolder, NULL, inOptions);
+			if (inProgress != NULL)
+			{
+				VString name;
+				GetName( name);
+				inProgress->BeginSession( totalSize, name, true);
+			}
+
+			VFileCopyProgress progress( inProgress);
+			VFolderCopyBody body( items, inOptions, progress);
+
+			VExecutor *executor = VExecutor::GetShared();
+			sLONG workers = 1;
+			if ( ((inOptions & FCP_Parallel) != 0) && (executor != NULL) )
+				workers = Min( Min( executor->GetWorkerCount(), kMAX_PARALLEL_COPIES), (sLONG) items.size());
+
+			if (workers > 1)
+				VParallel::For( 0, workers, body, 1, executor);
+			else
+				body( 0, 1);
+
+			if (inProgress != NULL)
+				inProgress->EndSession();
+
+			VTask::PushErrors( &body.GetErrors());
+
+			// first error in listing order, a cancellation only if nothing else failed
+			VError copyErr = VE_OK;
+			for( VectorOfFolderCopyItem::const_iterator i = items.begin() ; i != items.end() ; ++i)
+			{
+				if ( (i->fError != VE_OK) && ( (copyErr == VE_OK) || (copyErr == VE_USER_ABORT) ) )
+					copyErr = i->fError;
+			}
+			if ( (err == VE_OK) && (copyErr == VE_OK) && progress.IsCancelled() )
+				copyErr = VE_USER_ABORT;
 			if (err == VE_OK)
-				err = err2;
-			ok = (err == VE_OK) | ((inOptions & FCP_ContinueOnError) != 0);
+				err = copyErr;
 		}
-		
-		for( VFileIterator fileIterator( this, FI_WANT_FILES | FI_WANT_INVISIBLES) ; fileIterator.IsValid() && ok ; ++fileIterator)
+
+		for( VectorOfFolderCopyItem::iterator i = items.begin() ; i != items.end() ; ++i)
 		{
-			VError err2 = fileIterator->CopyTo( inDestinationFolder, NULL, inOptions);
-			if (err == VE_OK)
-				err = err2;
-			ok = (err == VE_OK) | ((inOptions & FCP_ContinueOnError) != 0);
+			ReleaseRefCountable( &i->fFile);
+			ReleaseRefCountable( &i->fDestination);
 		}
 	}
 	
@@ -798,3 +1072,163 @@ VFolder *VFolder::CreateAndResolveAlias( const VFolder& inParentFolder, const VS
 	return folder;
 }
 
+
+
+VFolderEnumerator::VFolderEnumerator( const VFolder *inFolder, FileIteratorOptions inOptions)
+: fFolder( RetainRefCountable( inFolder))
+, fOptions( inOptions)
+#if VERSION_LINUX
+, fReaddir( NULL)
+#else
+, fFolders( NULL)
+, fFiles( NULL)
+#endif
+{
+	xbox_assert( fFolder != NULL);
+
+#if VERSION_LINUX
+	PathBuffer path;
+	if (path.Init( fFolder->GetPath()) == VE_OK)
+		fReaddir = new ReaddirHelper( path, fOptions);
+#else
+	// no batch listing there, the entries come from the iterators
+	FileIteratorOptions options = fOptions & ~(FI_WANT_ATTRIBUTES | FI_PARALLEL);
+	if ((fOptions & FI_WANT_FOLDERS) != 0)
+		fFolders = new VFolderIterator( fFolder, options);
+	if ((fOptions & FI_WANT_FILES) != 0)
+		fFiles = new VFileIterator( fFolder, options);
+#endif
+}
+
+
+VFolderEnumerator::~VFolderEnumerator()
+{
+#if VERSION_LINUX
+	delete fReaddir;
+#else
+	delete fFolders;
+	delete fFiles;
+#endif
+	ReleaseRefCountable( &fFolder);
+}
+
+
+#if !VERSION_LINUX
+// with FI_RESOLVE_ALIASES the iterators give the target of an alias, which usually lives in another folder
+static void _SetLinkTarget( const VFolder& inFolder, const VFilePath& inPath, VFolderEntry& ioEntry)
+{
+	VFilePath parent;
+	if (inPath.GetParent( parent) && (parent != inFolder.GetPath()))
+	{
+		ioEntry.fIsLink = true;
+		ioEntry.fTarget = inPath;
+	}
+}
+#endif
+
+
+bool VFolderEnumerator::NextBatch( VectorOfFolderEntry& outEntries, size_t inMaxCount)
+{
+	outEntries.clear();
+
+#if VERSION_LINUX
+	if (fReaddir == NULL)
+		return false;
+
+	bool resolveLinks = (fOptions & FI_RESOLVE_ALIASES) != 0;
+	uBYTE type = DT_UNKNOWN;
+	const char *name = NULL;
+
+	while( (outEntries.size() < inMaxCount) && ((name = fReaddir->NextEntry( &type)) != NULL) )
+	{
+		if ( (name[0] == '.') && ((fOptions & FI_WANT_INVISIBLES) == 0) )
+			continue;
+
+		bool isLink = false;
+		FileIteratorOptions kind = fReaddir->GetKind( name, type, resolveLinks, &isLink);
+		if ((kind & fOptions) == 0)
+			continue;
+
+		outEntries.resize( outEntries.size() + 1);
+		VFolderEntry& entry = outEntries.back();
+		entry.fName.FromBlock( name, strlen( name), VTC_UTF_8);
+		entry.fIsFolder = (kind == FI_WANT_FOLDERS);
+		entry.fIsLink = isLink;
+		entry.fSize = 0;
+
+		if ((fOptions & FI_WANT_ATTRIBUTES) != 0)
+		{
+			StatHelper statHlp;
+			if (resolveLinks)
+				statHlp.SetFlags( StatHelper::followLinks);
+			if (statHlp.StatAt( fReaddir->GetFd(), name) == VE_OK)
+			{
+				entry.fSize = (sLONG8) statHlp.GetSize();
+				entry.fLastModification = statHlp.GetLastModification();
+			}
+		}
+	}
+#else
+	for( ; (outEntries.size() < inMaxCount) && (fFolders != NULL) && fFolders->IsValid() ; ++(*fFolders))
+	{
+		outEntries.resize( outEntries.size() + 1);
+		VFolderEntry& entry = outEntries.back();
+		fFolders->Current()->GetName( entry.fName);
+		entry.fIsFolder = true;
+		entry.fIsLink = false;
+		entry.fSize = 0;
+		_SetLinkTarget( *fFolder, fFolders->Current()->GetPath(), entry);
+		if ((fOptions & FI_WANT_ATTRIBUTES) != 0)
+			fFolders->Current()->GetTimeAttributes( &entry.fLastModification);
+	}
+
+	for( ; (outEntries.size() < inMaxCount) && (fFiles != NULL) && fFiles->IsValid() ; ++(*fFiles))
+	{
+		outEntries.resize( outEntries.size() + 1);
+		VFolderEntry& entry = outEntries.back();
+		fFiles->Current()->GetName( entry.fName);
+		entry.fIsFolder = false;
+		entry.fIsLink = fFiles->Current()->IsAliasFile();
+		entry.fSize = 0;
+		_SetLinkTarget( *fFolder, fFiles->Current()->GetPath(), entry);
+		if ((fOptions & FI_WANT_ATTRIBUTES) != 0)
+		{
+			fFiles->Current()->GetSize( &entry.fSize);
+			fFiles->Current()->GetTimeAttributes( &entry.fLastModification);
+		}
+	}
+#endif
+
+	return !outEntries.empty();
+}
+
+
+/*
+	static
+*/
+bool VFolderEnumerator::Walk( const VFolder *inFolder, FileIteratorOptions inOptions, IFolderWalker *inWalker)
+{
+	if (!testAssert( (inFolder != NULL) && (inWalker != NULL) ))
+		return false;
+
+	// a worker waiting for the walk would hold a thread the jobs need
+	VExecutor *executor = ((inOptions & FI_PARALLEL) != 0) ? VExecutor::GetShared() : NULL;
+	if ( (executor != NULL) && (executor->IsShutDown() || (executor->GetWorkerCount() < 2) || executor->IsCurrentWorker()) )
+		executor = NULL;
+
+	VFolderWalk *walk = new VFolderWalk( inOptions, inWalker, executor);
+	if (executor != NULL)
+	{
+		walk->SubmitFolder( inFolder);
+		walk->Wait();
+	}
+	else
+	{
+		walk->WalkFolder( *inFolder);
+	}
+
+	bool completed = !walk->IsStopped();
+	walk->Release();
+
+	return completed;
+}
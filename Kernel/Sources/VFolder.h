@@ -48,6 +48,7 @@ typedef enum
 END_TOOLBOX_NAMESPACE
 
 #include "Kernel/Sources/VSyncObject.h"
+#include "Kernel/Sources/VTime.h"
 
 
 #if VERSIONMAC
@@ -63,6 +64,11 @@ BEGIN_TOOLBOX_NAMESPACE
 // Needed declarations
 class VArrayLong;
 class VArrayString;
+class VProgressIndicator;
+class VFileIterator;
+#if VERSION_LINUX
+class ReaddirHelper;
+#endif
 
 class XTOOLBOX_API VFolder : public VObject, public IRefCountable
 { 
@@ -118,12 +124,14 @@ public:
 			// Destination folder must exist.
 			// outFolder (may be NULL) returns new folder.
 			// if a folder with the same name already exists in destination folder, it is first deleted if FCP_Overwrite is passed else an error is returned.
-			VError				CopyTo( const VFolder& inDestinationFolder, VFolder **outFolder, FileCopyOptions inOptions = FCP_Default ) const;
+			VError				CopyTo( const VFolder& inDestinationFolder, VFolder **outFolder, FileCopyOptions inOptions = FCP_Default, VProgressIndicator *inProgress = NULL ) const;
 			
 			// Copy this folder contents recursively inside destination folder.
 			// Destination folder is created if necessary (but not recursive).
 			// if files in source folder already exist in destination folder, they are replaced if FCP_Overwrite is passed else an error is returned.
-			VError				CopyContentsTo( const VFolder& inDestinationFolder, FileCopyOptions inOptions = FCP_Default ) const;
+			// The sub folders are created first, then the files are copied, several at once with FCP_Parallel.
+			// inProgress (may be null) gets one session counting the bytes of all files, the copy can be cancelled with VProgressIndicator::UserAbort.
+			VError				CopyContentsTo( const VFolder& inDestinationFolder, FileCopyOptions inOptions = FCP_Default, VProgressIndicator *inProgress = NULL ) const;
 			
 			VFolder*			RetainParentFolder() const;
 
@@ -288,6 +296,86 @@ public:
 typedef std::vector<XBOX::VRefPtr<XBOX::VFolder> >	VectorOfVFolder;
 
 
+/*!
+	@struct	VFolderEntry
+	@abstract	One entry listed by VFolderEnumerator.
+*/
+typedef struct VFolderEntry
+{
+	VString						fName;
+	bool						fIsFolder;
+	bool						fIsLink;			// with FI_RESOLVE_ALIASES, fIsFolder tells the kind of the link target
+	VFilePath					fTarget;			// resolved link that is not reachable as folder/fName (mac and windows aliases), empty otherwise
+	sLONG8						fSize;				// FI_WANT_ATTRIBUTES only
+	VTime						fLastModification;	// FI_WANT_ATTRIBUTES only
+} VFolderEntry;
+
+typedef std::vector<VFolderEntry>	VectorOfFolderEntry;
+
+
+/*!
+	@class	IFolderWalker
+	@abstract	Receives the entries of the folders walked by VFolderEnumerator::Walk.
+*/
+class XTOOLBOX_API IFolderWalker
+{
+public:
+	virtual								~IFolderWalker()																{;}
+
+	// inEntries are in inFolder. Returning false stops the walk.
+	// With FI_PARALLEL it's called from VExecutor workers, for several folders at the same time.
+	virtual	bool						VisitEntries( const VFolder& inFolder, const VectorOfFolderEntry& inEntries) = 0;
+};
+
+
+/*!
+	@class	VFolderEnumerator
+	@abstract	Lists a folder by batches of entries.
+	@discussion
+		Unlike VFileIterator and VFolderIterator, there's no VFile or VFolder object per entry.
+		On linux the kind of an entry comes with its name (getdents64 d_type): an entry is only stat'ed if it's
+		a link to resolve (FI_RESOLVE_ALIASES), if the file system doesn't tell the kind, or for FI_WANT_ATTRIBUTES.
+
+		Options are FI_WANT_FILES, FI_WANT_FOLDERS, FI_WANT_INVISIBLES, FI_RESOLVE_ALIASES and FI_WANT_ATTRIBUTES.
+		NextBatch() doesn't recurse, see Walk() for a whole tree.
+
+		VFolderEnumerator enumerator( folder, FI_WANT_FILES | FI_WANT_ATTRIBUTES);
+		VectorOfFolderEntry entries;
+		while( enumerator.NextBatch( entries))
+			...
+*/
+class XTOOLBOX_API VFolderEnumerator : public VObject
+{
+public:
+										VFolderEnumerator( const VFolder *inFolder, FileIteratorOptions inOptions = FI_WANT_FILES | FI_WANT_FOLDERS | FI_RESOLVE_ALIASES);
+	virtual								~VFolderEnumerator();
+
+			// replaces outEntries with the next entries (at most inMaxCount). Returns false once there's none left.
+			bool						NextBatch( VectorOfFolderEntry& outEntries, size_t inMaxCount = 256);
+
+			const VFolder&				GetFolder() const																{ return *fFolder;}
+			FileIteratorOptions			GetOptions() const																{ return fOptions;}
+
+	// gives inWalker the entries of inFolder and of its sub folders (links to folders are not followed).
+	// With FI_PARALLEL, folders are listed by the workers of the shared VExecutor.
+	// Returns false if inWalker stopped the walk.
+	static	bool						Walk( const VFolder *inFolder, FileIteratorOptions inOptions, IFolderWalker *inWalker);
+
+private:
+										VFolderEnumerator( const VFolderEnumerator&);	// no copy
+			VFolderEnumerator&			operator=( const VFolderEnumerator&);			// no copy
+
+			const VFolder*				fFolder;
+			FileIteratorOptions			fOptions;
+#if VERSION_LINUX
+			ReaddirHelper*				fReaddir;
+#else
+			VFolderIterator*			fFolders;
+			VFileIterator*				fFiles;
+#endif
+};
+
+
 END_TOOLBOX_NAMESPACE
 
 #endif
@@ -81,6 +81,24 @@ sLONG VInterlocked::AtomicAdd( sLONG* inValue, sLONG inAddValue)
 }
 
 
+sLONG8 VInterlocked::AtomicAdd( sLONG8* inValue, sLONG8 inAddValue)
+{
+#if VERSIONWIN
+
+    return ::InterlockedExchangeAdd64( inValue, inAddValue);
+
+#elif VERSIONMAC
+
+    return ::OSAtomicAdd64Barrier( inAddValue, reinterpret_cast<int64_t*>( inValue)) - inAddValue;
+
+#elif VERSION_LINUX
+
+    return __sync_fetch_and_add(inValue, inAddValue);
+
+#endif
+}
+
+
 sLONG VInterlocked::CompareExchange( sLONG* inValue, sLONG inCompareValue, sLONG inNewValue)
 {
 #if VERSIONWIN
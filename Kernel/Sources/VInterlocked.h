@@ -38,6 +38,7 @@ public:
 	static	sLONG		Increment           (sLONG* inValue);
 	static	sLONG		Decrement           (sLONG* inValue);
 	static  sLONG		AtomicAdd           (sLONG* inValue, sLONG inAddValue);
+	static  sLONG8		AtomicAdd           (sLONG8* inValue, sLONG8 inAddValue);	// returns intial content of inValue
 
     static  sLONG		AtomicGet           (sLONG* inValue)  { return AtomicAdd(inValue, 0); }
 
@@ -0,0 +1,825 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VJSONParser.h"
+#include "VStream.h"
+#include "VErrorContext.h"
+
+#if WITH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if VERSIONWIN
+#include <intrin.h>
+#endif
+
+
+// Class constants
+const VSize		kSTREAM_BUFFER_SIZE		= 64 * 1024;
+const size_t	kMAX_NUMBER_LENGTH		= 512;
+const UniChar	kREPLACEMENT_CHARACTER	= 0xFFFD;
+
+
+// exact powers of ten for the fast number conversion path
+static const double sPowersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+static inline bool _IsDigit( sLONG inByte)
+{
+	return (inByte >= '0') && (inByte <= '9');
+}
+
+
+static inline uLONG _CountTrailingZeros( uLONG inMask)
+{
+#if VERSIONWIN
+	unsigned long index;
+	_BitScanForward( &index, inMask);
+	return (uLONG) index;
+#else
+	return (uLONG) __builtin_ctz( inMask);
+#endif
+}
+
+
+// returns the first byte that is a quote, a backslash, a control char or not ASCII
+static const uBYTE *_FindStringSpecialByte( const uBYTE *inBegin, const uBYTE *inEnd)
+{
+	const uBYTE *p = inBegin;
+
+#if WITH_SSE2
+	const __m128i quote = _mm_set1_epi8( '"');
+	const __m128i backslash = _mm_set1_epi8( '\\');
+	const __m128i space = _mm_set1_epi8( 0x20);
+	while( inEnd - p >= 16)
+	{
+		__m128i bytes = _mm_loadu_si128( (const __m128i*) p);
+		// signed compare: non ASCII bytes are negative so they are less than a space like control chars
+		__m128i special = _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( bytes, quote), _mm_cmpeq_epi8( bytes, backslash)), _mm_cmplt_epi8( bytes, space));
+		uLONG mask = (uLONG) _mm_movemask_epi8( special);
+		if (mask != 0)
+			return p + _CountTrailingZeros( mask);
+		p += 16;
+	}
+#endif
+
+	while( (p < inEnd) && (*p != '"') && (*p != '\\') && (*p >= 0x20) && (*p < 0x80))
+		++p;
+
+	return p;
+}
+
+
+static void _WidenASCII( const uBYTE *inSource, VSize inCount, UniChar *outDestination)
+{
+#if WITH_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	while( inCount >= 16)
+	{
+		__m128i bytes = _mm_loadu_si128( (const __m128i*) inSource);
+		_mm_storeu_si128( (__m128i*) outDestination, _mm_unpacklo_epi8( bytes, zero));
+		_mm_storeu_si128( (__m128i*) (outDestination + 8), _mm_unpackhi_epi8( bytes, zero));
+		inSource += 16;
+		outDestination += 16;
+		inCount -= 16;
+	}
+#endif
+
+	while( inCount-- > 0)
+		*outDestination++ = *inSource++;
+}
+
+
+static double _CStringToReal( const char *inString)
+{
+	// JSON numbers always use '.' whatever the current locale
+	Real result;
+#if VERSIONWIN
+	static _locale_t sCLocale = _create_locale( LC_NUMERIC, "C");
+	result = _strtod_l( inString, NULL, sCLocale);
+#elif VERSIONMAC
+	static locale_t sCLocale = newlocale( LC_NUMERIC_MASK, NULL, NULL);
+	result = strtod_l( inString, NULL, sCLocale);
+#else
+	static locale_t sCLocale = newlocale( LC_NUMERIC_MASK, "C", NULL);
+	locale_t oldLocale = uselocale( sCLocale);
+	result = strtod( inString, NULL);
+	uselocale( oldLocale);
+#endif
+	return result;
+}
+
+
+//================================================================================================================
+
+
+VJSONParser::VJSONParser( IJSONEventHandler *inHandler)
+: fHandler( inHandler)
+, fCur( NULL)
+, fEnd( NULL)
+, fBufferStart( NULL)
+, fBufferOffset( 0)
+, fStream( NULL)
+, fCharCount( 0)
+, fErrorOffset( -1)
+{
+}
+
+
+VJSONParser::~VJSONParser()
+{
+}
+
+
+VError VJSONParser::Parse( const void *inData, VSize inSize)
+{
+	fStream = NULL;
+	fBufferStart = fCur = (const uBYTE*) inData;
+	fEnd = fCur + inSize;
+	fBufferOffset = 0;
+
+	return _Parse();
+}
+
+
+VError VJSONParser::Parse( VStream *inStream)
+{
+	if (!testAssert( inStream != NULL))
+		return VE_INVALID_PARAMETER;
+
+	fStream = inStream;
+	fStreamBuffer.resize( kSTREAM_BUFFER_SIZE);
+	fBufferStart = fCur = fEnd = &fStreamBuffer[0];
+	fBufferOffset = 0;
+
+	VError err;
+	{
+		// reaching the end of the stream is expected
+		StErrorContextInstaller filter( VE_STREAM_EOF, VE_OK);
+		err = _Parse();
+	}
+
+	if (fStream->GetLastError() == VE_STREAM_EOF)
+		fStream->ResetLastError();
+
+	fStream = NULL;
+
+	return err;
+}
+
+
+bool VJSONParser::_Fill()
+{
+	if (fStream == NULL)
+		return false;
+
+	if ( (fStream->GetLastError() != VE_OK) && (fStream->GetLastError() != VE_STREAM_EOF) )
+		return false;
+
+	fBufferOffset += fEnd - fBufferStart;
+
+	VSize read = 0;
+	fStream->GetData( &fStreamBuffer[0], fStreamBuffer.size(), &read);
+
+	fBufferStart = fCur = &fStreamBuffer[0];
+	fEnd = fCur + read;
+
+	return read > 0;
+}
+
+
+sLONG VJSONParser::_PeekNonSpace()
+{
+	for(;;)
+	{
+		while( fCur < fEnd)
+		{
+			uBYTE c = *fCur;
+			if ( (c != ' ') && (c != '\n') && (c != '\r') && (c != '\t') )
+				return c;
+			++fCur;
+		}
+		if (!_Fill())
+			return -1;
+	}
+}
+
+
+UniChar *VJSONParser::_GrowChars( VSize inCount)
+{
+	if (fCharCount + inCount > fChars.size())
+		fChars.resize( Max( fChars.size() * 2, (size_t) (fCharCount + inCount + 64)));
+
+	UniChar *p = &fChars[fCharCount];
+	fCharCount += inCount;
+	return p;
+}
+
+
+VError VJSONParser::_ThrowError()
+{
+	fErrorOffset = fBufferOffset + (fCur - fBufferStart);
+	return vThrowError( VE_MALFORMED_JSON_DESCRIPTION);
+}
+
+
+VError VJSONParser::_Parse()
+{
+	fErrorOffset = -1;
+	fCharCount = 0;
+
+	// skip UTF-8 BOM
+	if ( (_PeekByte() == 0xEF) && (fEnd - fCur >= 3) && (fCur[1] == 0xBB) && (fCur[2] == 0xBF) )
+		fCur += 3;
+
+	std::vector<char> containers;	// '{' or '[' for each open container
+	bool expectValue = true;
+	VError err = VE_OK;
+
+	while( err == VE_OK)
+	{
+		sLONG c = _PeekNonSpace();
+
+		if (expectValue)
+		{
+			if (c < 0)
+			{
+				err = _ThrowError();
+				break;
+			}
+
+			++fCur;
+			expectValue = false;
+			switch( c)
+			{
+				case '{':
+					err = fHandler->OnBeginObject();
+					if (err == VE_OK)
+					{
+						if (_PeekNonSpace() == '}')
+						{
+							++fCur;
+							err = fHandler->OnEndObject();
+						}
+						else
+						{
+							containers.push_back( '{');
+							err = _ParseProperty();
+							expectValue = true;
+						}
+					}
+					break;
+
+				case '[':
+					err = fHandler->OnBeginArray();
+					if (err == VE_OK)
+					{
+						if (_PeekNonSpace() == ']')
+						{
+							++fCur;
+							err = fHandler->OnEndArray();
+						}
+						else
+						{
+							containers.push_back( '[');
+							expectValue = true;
+						}
+					}
+					break;
+
+				case '"':
+					err = _ParseString();
+					if (err == VE_OK)
+						err = fHandler->OnString( fChars.empty() ? NULL : &fChars[0], (VIndex) fCharCount);
+					break;
+
+				case 't':
+					err = _ParseLiteral( "rue");
+					if (err == VE_OK)
+						err = fHandler->OnBool( true);
+					break;
+
+				case 'f':
+					err = _ParseLiteral( "alse");
+					if (err == VE_OK)
+						err = fHandler->OnBool( false);
+					break;
+
+				case 'n':
+					err = _ParseLiteral( "ull");
+					if (err == VE_OK)
+						err = fHandler->OnNull();
+					break;
+
+				default:
+					if ( (c == '-') || _IsDigit( c))
+						err = _ParseNumber( (uBYTE) c);
+					else
+					{
+						--fCur;
+						err = _ThrowError();
+					}
+					break;
+			}
+		}
+		else if (containers.empty())
+		{
+			// only spaces are allowed after the value
+			if (c >= 0)
+				err = _ThrowError();
+			break;
+		}
+		else if (c == ',')
+		{
+			++fCur;
+			if (containers.back() == '{')
+				err = _ParseProperty();
+			expectValue = true;
+		}
+		else if ( (c == '}') && (containers.back() == '{') )
+		{
+			++fCur;
+			containers.pop_back();
+			err = fHandler->OnEndObject();
+		}
+		else if ( (c == ']') && (containers.back() == '[') )
+		{
+			++fCur;
+			containers.pop_back();
+			err = fHandler->OnEndArray();
+		}
+		else
+		{
+			err = _ThrowError();
+		}
+	}
+
+	return err;
+}
+
+
+VError VJSONParser::_ParseProperty()
+{
+	// "name" :
+	if (_PeekNonSpace() != '"')
+		return _ThrowError();
+	++fCur;
+
+	VError err = _ParseString();
+	if (err == VE_OK)
+	{
+		if (_PeekNonSpace() != ':')
+			return _ThrowError();
+		++fCur;
+		err = fHandler->OnPropertyName( fChars.empty() ? NULL : &fChars[0], (VIndex) fCharCount);
+	}
+	return err;
+}
+
+
+VError VJSONParser::_ParseLiteral( const char *inLiteral)
+{
+	for( const char *p = inLiteral ; *p != 0 ; ++p)
+	{
+		if (_PeekByte() != (uBYTE) *p)
+			return _ThrowError();
+		++fCur;
+	}
+	return VE_OK;
+}
+
+
+VError VJSONParser::_ParseString()
+{
+	// the opening quote has been consumed
+	fCharCount = 0;
+
+	for(;;)
+	{
+		// copy plain ASCII runs at once
+		const uBYTE *runEnd = _FindStringSpecialByte( fCur, fEnd);
+		if (runEnd > fCur)
+		{
+			VSize count = runEnd - fCur;
+			_WidenASCII( fCur, count, _GrowChars( count));
+			fCur = runEnd;
+		}
+
+		sLONG c = _NextByte();
+		if (c < 0)
+		{
+			return _ThrowError();	// unterminated string
+		}
+		else if (c == '"')
+		{
+			break;
+		}
+		else if (c == '\\')
+		{
+			c = _NextByte();
+			switch( c)
+			{
+				case '"':	_AppendChar( '"'); break;
+				case '\\':	_AppendChar( '\\'); break;
+				case '/':	_AppendChar( '/'); break;
+				case 'b':	_AppendChar( 0x08); break;
+				case 'f':	_AppendChar( 0x0C); break;
+				case 'n':	_AppendChar( 0x0A); break;
+				case 'r':	_AppendChar( 0x0D); break;
+				case 't':	_AppendChar( 0x09); break;
+				case 'u':
+					{
+						// surrogates are utf-16 code units already
+						UniChar u = 0;
+						for( sLONG i = 0 ; i < 4 ; ++i)
+						{
+							sLONG h = _NextByte();
+							if (_IsDigit( h))
+								u = (UniChar) ((u << 4) | (h - '0'));
+							else if ( (h >= 'a') && (h <= 'f') )
+								u = (UniChar) ((u << 4) | (h - 'a' + 10));
+							else if ( (h >= 'A') && (h <= 'F') )
+								u = (UniChar) ((u << 4) | (h - 'A' + 10));
+							else
+								return _ThrowError();
+						}
+						_AppendChar( u);
+						break;
+					}
+				default:
+					return _ThrowError();
+			}
+		}
+		else if (c < 0x20)
+		{
+			return _ThrowError();	// control chars must be escaped
+		}
+		else if (c < 0x80)
+		{
+			// only reached at the end of a buffer
+			_AppendChar( (UniChar) c);
+		}
+		else
+		{
+			_AppendUTF8Sequence( (uBYTE) c);
+		}
+	}
+
+	return VE_OK;
+}
+
+
+void VJSONParser::_AppendUTF8Sequence( uBYTE inLeadByte)
+{
+	// inLeadByte has been consumed.
+	// continuation bytes are only consumed if valid so that a truncated sequence produces a single U+FFFD.
+	sLONG count;
+	uLONG codePoint;
+	uLONG minCodePoint;
+	if ( (inLeadByte >= 0xC2) && (inLeadByte <= 0xDF) )
+	{
+		count = 1;
+		codePoint = inLeadByte & 0x1F;
+		minCodePoint = 0x80;
+	}
+	else if ( (inLeadByte >= 0xE0) && (inLeadByte <= 0xEF) )
+	{
+		count = 2;
+		codePoint = inLeadByte & 0x0F;
+		minCodePoint = 0x800;
+	}
+	else if ( (inLeadByte >= 0xF0) && (inLeadByte <= 0xF4) )
+	{
+		count = 3;
+		codePoint = inLeadByte & 0x07;
+		minCodePoint = 0x10000;
+	}
+	else
+	{
+		_AppendChar( kREPLACEMENT_CHARACTER);
+		return;
+	}
+
+	for( sLONG i = 0 ; i < count ; ++i)
+	{
+		sLONG c = _PeekByte();
+		if ( (c < 0x80) || (c > 0xBF) )
+		{
+			_AppendChar( kREPLACEMENT_CHARACTER);
+			return;
+		}
+		++fCur;
+		codePoint = (codePoint << 6) | (c & 0x3F);
+	}
+
+	if ( (codePoint < minCodePoint) || (codePoint > 0x10FFFF) || ((codePoint >= 0xD800) && (codePoint <= 0xDFFF)) )
+	{
+		_AppendChar( kREPLACEMENT_CHARACTER);
+	}
+	else if (codePoint >= 0x10000)
+	{
+		UniChar *p = _GrowChars( 2);
+		codePoint -= 0x10000;
+		p[0] = (UniChar) (0xD800 + (codePoint >> 10));
+		p[1] = (UniChar) (0xDC00 + (codePoint & 0x3FF));
+	}
+	else
+	{
+		_AppendChar( (UniChar) codePoint);
+	}
+}
+
+
+VError VJSONParser::_ParseNumber( uBYTE inFirstByte)
+{
+	// -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+	// the first byte has been consumed
+	char text[kMAX_NUMBER_LENGTH + 1];
+	size_t length = 0;
+	text[length++] = (char) inFirstByte;
+
+	uLONG8 mantissa = 0;
+	sLONG digits = 0;				// significant digits accumulated in mantissa
+	sLONG exponent = 0;				// decimal exponent to apply to mantissa
+	bool negative = (inFirstByte == '-');
+	bool exact = true;				// mantissa holds all the digits
+
+	sLONG c = negative ? _NextByte() : inFirstByte;
+	if (negative)
+	{
+		if (!_IsDigit( c))
+			return _ThrowError();
+		text[length++] = (char) c;
+	}
+
+	// integer part
+	if (c != '0')
+	{
+		for(;;)
+		{
+			if (digits < 19)
+				mantissa = mantissa * 10 + (c - '0');
+			else
+				++exponent;	// too many digits for the mantissa
+			++digits;
+			c = _PeekByte();
+			if (!_IsDigit( c))
+				break;
+			++fCur;
+			if (length >= kMAX_NUMBER_LENGTH)
+				return _ThrowError();
+			text[length++] = (char) c;
+		}
+	}
+	else
+	{
+		c = _PeekByte();
+	}
+	if (digits > 19)
+		exact = false;
+
+	// fraction
+	if (c == '.')
+	{
+		++fCur;
+		text[length++] = '.';
+		c = _PeekByte();
+		if (!_IsDigit( c))
+			return _ThrowError();
+		do
+		{
+			++fCur;
+			if (length >= kMAX_NUMBER_LENGTH)
+				return _ThrowError();
+			text[length++] = (char) c;
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (c - '0');
+				--exponent;
+				if ( (mantissa != 0) || (c != '0') )
+					++digits;
+			}
+			else
+			{
+				exact = false;
+			}
+			c = _PeekByte();
+		} while( _IsDigit( c));
+	}
+
+	// exponent
+	if ( (c == 'e') || (c == 'E') )
+	{
+		++fCur;
+		if (length >= kMAX_NUMBER_LENGTH)
+			return _ThrowError();
+		text[length++] = (char) c;
+
+		bool negativeExponent = false;
+		c = _PeekByte();
+		if ( (c == '+') || (c == '-') )
+		{
+			++fCur;
+			text[length++] = (char) c;
+			negativeExponent = (c == '-');
+			c = _PeekByte();
+		}
+		if (!_IsDigit( c))
+			return _ThrowError();
+
+		sLONG explicitExponent = 0;
+		do
+		{
+			++fCur;
+			if (length >= kMAX_NUMBER_LENGTH)
+				return _ThrowError();
+			text[length++] = (char) c;
+			if (explicitExponent < 100000)
+				explicitExponent = explicitExponent * 10 + (c - '0');
+			c = _PeekByte();
+		} while( _IsDigit( c));
+
+		exponent += negativeExponent ? -explicitExponent : explicitExponent;
+	}
+
+	double value;
+	if (exact && (mantissa <= (XBOX_LONG8( 1) << 53)) && (exponent >= -22) && (exponent <= 22))
+	{
+		// both mantissa and power of ten are exact doubles so the result is correctly rounded
+		value = (double) mantissa;
+		if (exponent < 0)
+			value /= sPowersOfTen[-exponent];
+		else
+			value *= sPowersOfTen[exponent];
+		if (negative)
+			value = -value;
+	}
+	else
+	{
+		text[length] = 0;
+		value = _CStringToReal( text);
+	}
+
+	return fHandler->OnNumber( value);
+}
+
+
+//================================================================================================================
+
+
+VJSONDOMBuilder::VJSONDOMBuilder()
+{
+}
+
+
+VJSONDOMBuilder::~VJSONDOMBuilder()
+{
+}
+
+
+VError VJSONDOMBuilder::Parse( const void *inData, VSize inSize, VJSONValue& outValue)
+{
+	VJSONDOMBuilder builder;
+	VJSONParser parser( &builder);
+	VError err = parser.Parse( inData, inSize);
+	if (err == VE_OK)
+		outValue = builder.GetValue();
+	else
+		outValue.SetUndefined();
+	return err;
+}
+
+
+VError VJSONDOMBuilder::Parse( VStream *inStream, VJSONValue& outValue)
+{
+	VJSONDOMBuilder builder;
+	VJSONParser parser( &builder);
+	VError err = parser.Parse( inStream);
+	if (err == VE_OK)
+		outValue = builder.GetValue();
+	else
+		outValue.SetUndefined();
+	return err;
+}
+
+
+VError VJSONDOMBuilder::_AddValue( const VJSONValue& inValue)
+{
+	if (fContainers.empty())
+	{
+		fValue = inValue;
+		return VE_OK;
+	}
+
+	const VJSONValue& container = fContainers.back();
+	bool ok;
+	if (container.IsArray())
+		ok = container.GetArray()->Push( inValue);
+	else
+		ok = container.GetObject()->SetProperty( fPropertyName, inValue);
+
+	return ok ? VE_OK : vThrowError( VE_MEMORY_FULL);
+}
+
+
+VError VJSONDOMBuilder::OnBeginObject()
+{
+	VJSONObject *object = new VJSONObject;
+	if (object == NULL)
+		return vThrowError( VE_MEMORY_FULL);
+
+	VJSONValue value( object);
+	ReleaseRefCountable( &object);
+
+	VError err = _AddValue( value);
+	if (err == VE_OK)
+		fContainers.push_back( value);
+	return err;
+}
+
+
+VError VJSONDOMBuilder::OnPropertyName( const UniChar *inName, VIndex inLength)
+{
+	fPropertyName.Clear();
+	fPropertyName.AppendUniChars( inName, inLength);
+	return VE_OK;
+}
+
+
+VError VJSONDOMBuilder::OnEndObject()
+{
+	xbox_assert( !fContainers.empty() && fContainers.back().IsObject());
+	fContainers.pop_back();
+	return VE_OK;
+}
+
+
+VError VJSONDOMBuilder::OnBeginArray()
+{
+	VJSONArray *array = new VJSONArray;
+	if (array == NULL)
+		return vThrowError( VE_MEMORY_FULL);
+
+	VJSONValue value( array);
+	ReleaseRefCountable( &array);
+
+	VError err = _AddValue( value);
+	if (err == VE_OK)
+		fContainers.push_back( value);
+	return err;
+}
+
+
+VError VJSONDOMBuilder::OnEndArray()
+{
+	xbox_assert( !fContainers.empty() && fContainers.back().IsArray());
+	fContainers.pop_back();
+	return VE_OK;
+}
+
+
+VError VJSONDOMBuilder::OnString( const UniChar *inString, VIndex inLength)
+{
+	// one allocation for the string buffer, shared by the VJSONValue
+	VInlineString s;
+	if (!s.InitWithUniChars( inString, inLength))
+		return vThrowError( VE_MEMORY_FULL);
+
+	VError err = _AddValue( VJSONValue( s));
+	s.Dispose();
+	return err;
+}
+
+
+VError VJSONDOMBuilder::OnNumber( double inNumber)
+{
+	return _AddValue( VJSONValue( inNumber));
+}
+
+
+VError VJSONDOMBuilder::OnBool( bool inValue)
+{
+	return _AddValue( inValue ? VJSONValue::sTrue : VJSONValue::sFalse);
+}
+
+
+VError VJSONDOMBuilder::OnNull()
+{
+	return _AddValue( VJSONValue::sNull);
+}
@@ -0,0 +1,160 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VJSONParser__
+#define __VJSONParser__
+
+#include "Kernel/Sources/VJSONValue.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+class VStream;
+
+
+/*!
+	@class	IJSONEventHandler
+	@abstract	Receives the events of a VJSONParser (SAX style).
+	@discussion
+		Strings and property names are given as UTF-16 characters that are only valid during the call
+		and that are not null terminated.
+		Returning an error stops the parsing and VJSONParser::Parse returns that error.
+*/
+class XTOOLBOX_API IJSONEventHandler
+{
+public:
+	virtual							~IJSONEventHandler()								{;}
+
+	virtual	VError					OnBeginObject() = 0;
+	virtual	VError					OnPropertyName( const UniChar *inName, VIndex inLength) = 0;
+	virtual	VError					OnEndObject() = 0;
+
+	virtual	VError					OnBeginArray() = 0;
+	virtual	VError					OnEndArray() = 0;
+
+	virtual	VError					OnString( const UniChar *inString, VIndex inLength) = 0;
+	virtual	VError					OnNumber( double inNumber) = 0;
+	virtual	VError					OnBool( bool inValue) = 0;
+	virtual	VError					OnNull() = 0;
+};
+
+
+/*!
+	@class	VJSONParser
+	@abstract	Streaming JSON parser consuming UTF-8 bytes.
+	@discussion
+		Unlike VJSONImporter, the input is not copied into a VString: bytes are read from a buffer
+		or from a VStream by chunks and decoded once, directly into a reusable UTF-16 buffer.
+		String contents are scanned 16 bytes at a time when SSE2 is available.
+
+		The parser is strict RFC 4627 (no unquoted names or values) and is not recursive.
+		Invalid UTF-8 sequences are replaced by U+FFFD. A leading UTF-8 BOM is skipped.
+
+		VE_MALFORMED_JSON_DESCRIPTION is thrown on syntax errors, see GetErrorOffset().
+*/
+class XTOOLBOX_API VJSONParser : public VObject
+{
+public:
+									VJSONParser( IJSONEventHandler *inHandler);
+	virtual							~VJSONParser();
+
+			// parse exactly one JSON value
+			VError					Parse( const void *inData, VSize inSize);
+
+			// reads the stream until its end. The stream must be opened for reading.
+			VError					Parse( VStream *inStream);
+
+			// offset in bytes of the malformed input
+			sLONG8					GetErrorOffset() const							{ return fErrorOffset;}
+
+private:
+									VJSONParser( const VJSONParser&);
+			VJSONParser&			operator=( const VJSONParser&);
+
+			VError					_Parse();
+			VError					_ParseString();
+			VError					_ParseNumber( uBYTE inFirstByte);
+			VError					_ParseLiteral( const char *inLiteral);
+			VError					_ParseProperty();
+			void					_AppendUTF8Sequence( uBYTE inLeadByte);
+			VError					_ThrowError();
+
+			bool					_Fill();
+			sLONG					_PeekNonSpace();
+			sLONG					_PeekByte()										{ return ((fCur < fEnd) || _Fill()) ? *fCur : -1;}
+			sLONG					_NextByte()										{ return ((fCur < fEnd) || _Fill()) ? *fCur++ : -1;}
+
+			UniChar*				_GrowChars( VSize inCount);
+			void					_AppendChar( UniChar inChar)					{ *_GrowChars( 1) = inChar;}
+
+			IJSONEventHandler*		fHandler;
+
+			const uBYTE*			fCur;
+			const uBYTE*			fEnd;
+			const uBYTE*			fBufferStart;
+			sLONG8					fBufferOffset;		// input offset of fBufferStart
+			VStream*				fStream;
+			std::vector<uBYTE>		fStreamBuffer;
+
+			std::vector<UniChar>	fChars;				// decoded string
+			VSize					fCharCount;
+
+			sLONG8					fErrorOffset;
+};
+
+
+/*!
+	@class	VJSONDOMBuilder
+	@abstract	IJSONEventHandler that builds a VJSONValue.
+	@discussion
+		String values are allocated directly from the parser buffer, without intermediate VString.
+
+		VJSONValue value;
+		VError err = VJSONDOMBuilder::Parse( utf8Buffer, size, value);
+*/
+class XTOOLBOX_API VJSONDOMBuilder : public VObject, public IJSONEventHandler
+{
+public:
+									VJSONDOMBuilder();
+	virtual							~VJSONDOMBuilder();
+
+			// the parsed value
+			const VJSONValue&		GetValue() const								{ return fValue;}
+
+	static	VError					Parse( const void *inData, VSize inSize, VJSONValue& outValue);
+	static	VError					Parse( VStream *inStream, VJSONValue& outValue);
+
+	// IJSONEventHandler
+	virtual	VError					OnBeginObject();
+	virtual	VError					OnPropertyName( const UniChar *inName, VIndex inLength);
+	virtual	VError					OnEndObject();
+	virtual	VError					OnBeginArray();
+	virtual	VError					OnEndArray();
+	virtual	VError					OnString( const UniChar *inString, VIndex inLength);
+	virtual	VError					OnNumber( double inNumber);
+	virtual	VError					OnBool( bool inValue);
+	virtual	VError					OnNull();
+
+private:
+			VError					_AddValue( const VJSONValue& inValue);
+
+			VJSONValue				fValue;
+			std::vector<VJSONValue>	fContainers;		// objects and arrays being built, innermost last
+			VString					fPropertyName;
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
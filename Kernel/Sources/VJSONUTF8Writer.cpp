@@ -0,0 +1,688 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VJSONUTF8Writer.h"
+#include "VStream.h"
+#include "VErrorContext.h"
+
+#if WITH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if COMPIL_VISUAL
+inline int finite( double a) { return _finite( a);}
+#endif
+
+
+// Class constants
+const VSize		kDEFAULT_FLUSH_SIZE		= 64 * 1024;
+const VIndex	kSTRING_CHUNK_LENGTH	= 256;			// strings are escaped by chunks so that reserved space stays small
+const VSize		kMAX_RESERVE_SIZE		= 6 * kSTRING_CHUNK_LENGTH + 16;
+const VSize		kNUMBER_MAX_LENGTH		= 32;
+
+static const char sHexDigits[] = "0123456789ABCDEF";
+
+
+static inline bool _IsPlainASCII( UniChar inChar)
+{
+	return (inChar >= 0x20) && (inChar < 0x7F) && (inChar != '"') && (inChar != '\\');
+}
+
+
+static char *_WriteUnicodeEscape( char *p, UniChar inChar)
+{
+	*p++ = '\\';
+	*p++ = 'u';
+	*p++ = sHexDigits[(inChar >> 12) & 0xF];
+	*p++ = sHexDigits[(inChar >> 8) & 0xF];
+	*p++ = sHexDigits[(inChar >> 4) & 0xF];
+	*p++ = sHexDigits[inChar & 0xF];
+	return p;
+}
+
+
+/*
+	Grisu2 (Florian Loitsch, "Printing floating-point numbers quickly and accurately with integers", PLDI 2010).
+	The double and its neighbour boundaries are scaled by a cached power of ten with 64 bits integer arithmetic,
+	then digits are generated until the result is inside the boundaries.
+	The result always reads back as the same double and is the shortest one for all but a very few doubles
+	(there it's one digit longer). No libc call, no locale.
+*/
+
+typedef struct DiyFp
+{
+	uLONG8		fF;		// significand
+	sLONG		fE;		// binary exponent
+} DiyFp;
+
+static const uLONG8 sCachedPowersF[] =
+{
+	XBOX_LONG8(0xfa8fd5a0081c0288), XBOX_LONG8(0xbaaee17fa23ebf76), XBOX_LONG8(0x8b16fb203055ac76), XBOX_LONG8(0xcf42894a5dce35ea),
+	XBOX_LONG8(0x9a6bb0aa55653b2d), XBOX_LONG8(0xe61acf033d1a45df), XBOX_LONG8(0xab70fe17c79ac6ca), XBOX_LONG8(0xff77b1fcbebcdc4f),
+	XBOX_LONG8(0xbe5691ef416bd60c), XBOX_LONG8(0x8dd01fad907ffc3c), XBOX_LONG8(0xd3515c2831559a83), XBOX_LONG8(0x9d71ac8fada6c9b5),
+	XBOX_LONG8(0xea9c227723ee8bcb), XBOX_LONG8(0xaecc49914078536d), XBOX_LONG8(0x823c12795db6ce57), XBOX_LONG8(0xc21094364dfb5637),
+	XBOX_LONG8(0x9096ea6f3848984f), XBOX_LONG8(0xd77485cb25823ac7), XBOX_LONG8(0xa086cfcd97bf97f4), XBOX_LONG8(0xef340a98172aace5),
+	XBOX_LONG8(0xb23867fb2a35b28e), XBOX_LONG8(0x84c8d4dfd2c63f3b), XBOX_LONG8(0xc5dd44271ad3cdba), XBOX_LONG8(0x936b9fcebb25c996),
+	XBOX_LONG8(0xdbac6c247d62a584), XBOX_LONG8(0xa3ab66580d5fdaf6), XBOX_LONG8(0xf3e2f893dec3f126), XBOX_LONG8(0xb5b5ada8aaff80b8),
+	XBOX_LONG8(0x87625f056c7c4a8b), XBOX_LONG8(0xc9bcff6034c13053), XBOX_LONG8(0x964e858c91ba2655), XBOX_LONG8(0xdff9772470297ebd),
+	XBOX_LONG8(0xa6dfbd9fb8e5b88f), XBOX_LONG8(0xf8a95fcf88747d94), XBOX_LONG8(0xb94470938fa89bcf), XBOX_LONG8(0x8a08f0f8bf0f156b),
+	XBOX_LONG8(0xcdb02555653131b6), XBOX_LONG8(0x993fe2c6d07b7fac), XBOX_LONG8(0xe45c10c42a2b3b06), XBOX_LONG8(0xaa242499697392d3),
+	XBOX_LONG8(0xfd87b5f28300ca0e), XBOX_LONG8(0xbce5086492111aeb), XBOX_LONG8(0x8cbccc096f5088cc), XBOX_LONG8(0xd1b71758e219652c),
+	XBOX_LONG8(0x9c40000000000000), XBOX_LONG8(0xe8d4a51000000000), XBOX_LONG8(0xad78ebc5ac620000), XBOX_LONG8(0x813f3978f8940984),
+	XBOX_LONG8(0xc097ce7bc90715b3), XBOX_LONG8(0x8f7e32ce7bea5c70), XBOX_LONG8(0xd5d238a4abe98068), XBOX_LONG8(0x9f4f2726179a2245),
+	XBOX_LONG8(0xed63a231d4c4fb27), XBOX_LONG8(0xb0de65388cc8ada8), XBOX_LONG8(0x83c7088e1aab65db), XBOX_LONG8(0xc45d1df942711d9a),
+	XBOX_LONG8(0x924d692ca61be758), XBOX_LONG8(0xda01ee641a708dea), XBOX_LONG8(0xa26da3999aef774a), XBOX_LONG8(0xf209787bb47d6b85),
+	XBOX_LONG8(0xb454e4a179dd1877), XBOX_LONG8(0x865b86925b9bc5c2), XBOX_LONG8(0xc83553c5c8965d3d), XBOX_LONG8(0x952ab45cfa97a0b3),
+	XBOX_LONG8(0xde469fbd99a05fe3), XBOX_LONG8(0xa59bc234db398c25), XBOX_LONG8(0xf6c69a72a3989f5c), XBOX_LONG8(0xb7dcbf5354e9bece),
+	XBOX_LONG8(0x88fcf317f22241e2), XBOX_LONG8(0xcc20ce9bd35c78a5), XBOX_LONG8(0x98165af37b2153df), XBOX_LONG8(0xe2a0b5dc971f303a),
+	XBOX_LONG8(0xa8d9d1535ce3b396), XBOX_LONG8(0xfb9b7cd9a4a7443c), XBOX_LONG8(0xbb764c4ca7a44410), XBOX_LONG8(0x8bab8eefb6409c1a),
+	XBOX_LONG8(0xd01fef10a657842c), XBOX_LONG8(0x9b10a4e5e9913129), XBOX_LONG8(0xe7109bfba19c0c9d), XBOX_LONG8(0xac2820d9623bf429),
+	XBOX_LONG8(0x80444b5e7aa7cf85), XBOX_LONG8(0xbf21e44003acdd2d), XBOX_LONG8(0x8e679c2f5e44ff8f), XBOX_LONG8(0xd433179d9c8cb841),
+	XBOX_LONG8(0x9e19db92b4e31ba9), XBOX_LONG8(0xeb96bf6ebadf77d9), XBOX_LONG8(0xaf87023b9bf0ee6b)
+};
+
+static const sWORD sCachedPowersE[] =
+{
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954,
+	-927, -901, -874, -847, -821, -794, -768, -741, -715, -688, -661,
+	-635, -608, -582, -555, -529, -502, -475, -449, -422, -396, -369,
+	-343, -316, -289, -263, -236, -210, -183, -157, -130, -103, -77,
+	-50, -24, 3, 30, 56, 83, 109, 136, 162, 189, 216,
+	242, 269, 295, 322, 348, 375, 402, 428, 455, 481, 508,
+	534, 561, 588, 614, 641, 667, 694, 720, 747, 774, 800,
+	827, 853, 880, 907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const uLONG8 sPow10[] =
+{
+	XBOX_LONG8(1), XBOX_LONG8(10), XBOX_LONG8(100), XBOX_LONG8(1000), XBOX_LONG8(10000), XBOX_LONG8(100000), XBOX_LONG8(1000000),
+	XBOX_LONG8(10000000), XBOX_LONG8(100000000), XBOX_LONG8(1000000000), XBOX_LONG8(10000000000), XBOX_LONG8(100000000000),
+	XBOX_LONG8(1000000000000), XBOX_LONG8(10000000000000), XBOX_LONG8(100000000000000), XBOX_LONG8(1000000000000000),
+	XBOX_LONG8(10000000000000000), XBOX_LONG8(100000000000000000), XBOX_LONG8(1000000000000000000), XBOX_LONG8(0x8AC7230489E80000)
+};
+
+
+static inline DiyFp _MakeDiyFp( uLONG8 inF, sLONG inE)
+{
+	DiyFp d;
+	d.fF = inF;
+	d.fE = inE;
+	return d;
+}
+
+
+static DiyFp _Normalize( DiyFp inValue)
+{
+	while( (inValue.fF & (XBOX_LONG8(1) << 63)) == 0)
+	{
+		inValue.fF <<= 1;
+		--inValue.fE;
+	}
+	return inValue;
+}
+
+
+static DiyFp _Multiply( const DiyFp& inA, const DiyFp& inB)
+{
+	// upper 64 bits of the 128 bits product, rounded
+	const uLONG8 M32 = 0xFFFFFFFF;
+	uLONG8 a = inA.fF >> 32, b = inA.fF & M32, c = inB.fF >> 32, d = inB.fF & M32;
+	uLONG8 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uLONG8 middle = (bd >> 32) + (ad & M32) + (bc & M32) + (XBOX_LONG8(1) << 31);
+	return _MakeDiyFp( ac + (ad >> 32) + (bc >> 32) + (middle >> 32), inA.fE + inB.fE + 64);
+}
+
+
+static void _GrisuRound( char *ioBuffer, sLONG inLength, uLONG8 inDelta, uLONG8 inRest, uLONG8 inTenKappa, uLONG8 inDistance)
+{
+	// move the last digit down while it gets closer to the exact value and stays inside the boundaries
+	while( (inRest < inDistance) && (inDelta - inRest >= inTenKappa)
+			&& ( (inRest + inTenKappa < inDistance) || (inDistance - inRest > inRest + inTenKappa - inDistance) ) )
+	{
+		--ioBuffer[inLength - 1];
+		inRest += inTenKappa;
+	}
+}
+
+
+static sLONG _Grisu2( double inNumber, char *outDigits, sLONG *outExponent)
+{
+	const uLONG8 hiddenBit = XBOX_LONG8(0x0010000000000000);
+	uLONG8 bits;
+	::memcpy( &bits, &inNumber, sizeof( bits));
+	sLONG biasedExponent = (sLONG) ((bits >> 52) & 0x7FF);
+	uLONG8 significand = bits & (hiddenBit - 1);
+
+	DiyFp v = (biasedExponent != 0) ? _MakeDiyFp( significand + hiddenBit, biasedExponent - 1075) : _MakeDiyFp( significand, -1074);
+
+	// boundaries: half way to the neighbour doubles (the lower gap is smaller at a power of two)
+	DiyFp plus = _Normalize( _MakeDiyFp( (v.fF << 1) + 1, v.fE - 1));
+	DiyFp minus = (v.fF == hiddenBit) ? _MakeDiyFp( (v.fF << 2) - 1, v.fE - 2) : _MakeDiyFp( (v.fF << 1) - 1, v.fE - 1);
+	minus.fF <<= minus.fE - plus.fE;
+	minus.fE = plus.fE;
+
+	// cached power 10^-k bringing the exponent of plus in [-60, -32]
+	double dk = (-61 - plus.fE) * 0.30102999566398114 + 347;
+	sLONG k = (sLONG) dk;
+	if (dk - k > 0.0)
+		++k;
+	sLONG index = (k >> 3) + 1;
+	sLONG decimalExponent = -(-348 + index * 8);
+	DiyFp power = _MakeDiyFp( sCachedPowersF[index], sCachedPowersE[index]);
+
+	DiyFp w = _Multiply( _Normalize( v), power);
+	DiyFp wPlus = _Multiply( plus, power);
+	DiyFp wMinus = _Multiply( minus, power);
+	++wMinus.fF;
+	--wPlus.fF;
+
+	// digits generation
+	DiyFp one = _MakeDiyFp( XBOX_LONG8(1) << -wPlus.fE, wPlus.fE);
+	uLONG8 distance = wPlus.fF - w.fF;
+	uLONG8 delta = wPlus.fF - wMinus.fF;
+	uLONG p1 = (uLONG) (wPlus.fF >> -one.fE);
+	uLONG8 p2 = wPlus.fF & (one.fF - 1);
+
+	sLONG kappa = 1;
+	while( (kappa < 10) && (p1 >= sPow10[kappa]) )
+		++kappa;
+
+	sLONG length = 0;
+	while( kappa > 0)
+	{
+		uLONG digit = (uLONG) (p1 / sPow10[kappa - 1]);
+		p1 %= (uLONG) sPow10[kappa - 1];
+		if ( (digit != 0) || (length != 0) )
+			outDigits[length++] = (char) ('0' + digit);
+		--kappa;
+
+		uLONG8 rest = ((uLONG8) p1 << -one.fE) + p2;
+		if (rest <= delta)
+		{
+			*outExponent = decimalExponent + kappa;
+			_GrisuRound( outDigits, length, delta, rest, sPow10[kappa] << -one.fE, distance);
+			return length;
+		}
+	}
+
+	for(;;)
+	{
+		p2 *= 10;
+		delta *= 10;
+		char digit = (char) (p2 >> -one.fE);
+		if ( (digit != 0) || (length != 0) )
+			outDigits[length++] = (char) ('0' + digit);
+		p2 &= one.fF - 1;
+		--kappa;
+		if (p2 < delta)
+		{
+			*outExponent = decimalExponent + kappa;
+			_GrisuRound( outDigits, length, delta, p2, one.fF, distance * ((-kappa < 20) ? sPow10[-kappa] : 0));
+			return length;
+		}
+	}
+}
+
+
+static VSize _FormatNumber( double inNumber, char *outBuffer)
+{
+	if (!finite( inNumber))
+	{
+		::memcpy( outBuffer, "null", 4);
+		return 4;
+	}
+
+	// integers: no need for digits generation
+	if ( (inNumber == floor( inNumber)) && (inNumber > -1e15) && (inNumber < 1e15) )
+	{
+		sLONG8 n = (sLONG8) inNumber;
+		uLONG8 u = (n < 0) ? (uLONG8) -n : (uLONG8) n;
+		char digits[20];
+		char *d = digits + sizeof( digits);
+		do {
+			*--d = (char) ('0' + (u % 10));
+			u /= 10;
+		} while( u != 0);
+
+		char *p = outBuffer;
+		if (n < 0)
+			*p++ = '-';
+		::memcpy( p, d, digits + sizeof( digits) - d);
+		return (p - outBuffer) + (digits + sizeof( digits) - d);
+	}
+
+	char *p = outBuffer;
+	if (inNumber < 0)
+	{
+		*p++ = '-';
+		inNumber = -inNumber;
+	}
+
+	// the number is 0.digits * 10^point
+	char digits[18];
+	sLONG exponent = 0;
+	sLONG length = _Grisu2( inNumber, digits, &exponent);
+	sLONG point = length + exponent;
+
+	// same layout as JavaScript Number.toString()
+	if ( (length <= point) && (point <= 21) )
+	{
+		::memcpy( p, digits, length);
+		::memset( p + length, '0', point - length);
+		p += point;
+	}
+	else if ( (0 < point) && (point <= 21) )
+	{
+		::memcpy( p, digits, point);
+		p[point] = '.';
+		::memcpy( p + point + 1, digits + point, length - point);
+		p += length + 1;
+	}
+	else if ( (-6 < point) && (point <= 0) )
+	{
+		*p++ = '0';
+		*p++ = '.';
+		::memset( p, '0', -point);
+		p += -point;
+		::memcpy( p, digits, length);
+		p += length;
+	}
+	else
+	{
+		*p++ = digits[0];
+		if (length > 1)
+		{
+			*p++ = '.';
+			::memcpy( p, digits + 1, length - 1);
+			p += length - 1;
+		}
+		*p++ = 'e';
+		sLONG e = point - 1;
+		if (e < 0)
+		{
+			*p++ = '-';
+			e = -e;
+		}
+		else
+		{
+			*p++ = '+';
+		}
+		if (e >= 100)
+			*p++ = (char) ('0' + e / 100);
+		if (e >= 10)
+			*p++ = (char) ('0' + (e / 10) % 10);
+		*p++ = (char) ('0' + e % 10);
+	}
+
+	return (VSize) (p - outBuffer);
+}
+
+
+#if WITH_SSE2
+// returns the number of leading utf-16 chars that need no escaping and are ASCII, writing them as bytes.
+static VIndex _CopyPlainASCII( const UniChar *inString, VIndex inLength, char *outBuffer)
+{
+	const __m128i limit_low = _mm_set1_epi16( 0x20);
+	const __m128i limit_high = _mm_set1_epi16( 0x7E);
+	const __m128i quote = _mm_set1_epi16( '"');
+	const __m128i backslash = _mm_set1_epi16( '\\');
+
+	VIndex i = 0;
+	for( ; i + 8 <= inLength ; i += 8)
+	{
+		__m128i chars = _mm_loadu_si128( (const __m128i*) (inString + i));
+		// comparisons are signed: chars >= 0x8000 look negative and are caught by the low limit
+		__m128i special = _mm_or_si128(
+							_mm_or_si128( _mm_cmplt_epi16( chars, limit_low), _mm_cmpgt_epi16( chars, limit_high)),
+							_mm_or_si128( _mm_cmpeq_epi16( chars, quote), _mm_cmpeq_epi16( chars, backslash)));
+		if (_mm_movemask_epi8( special) != 0)
+			break;
+		_mm_storel_epi64( (__m128i*) (outBuffer + i), _mm_packus_epi16( chars, chars));
+	}
+
+	while( (i < inLength) && _IsPlainASCII( inString[i]) )
+	{
+		outBuffer[i] = (char) inString[i];
+		++i;
+	}
+
+	return i;
+}
+#else
+static VIndex _CopyPlainASCII( const UniChar *inString, VIndex inLength, char *outBuffer)
+{
+	VIndex i = 0;
+	while( (i < inLength) && _IsPlainASCII( inString[i]) )
+	{
+		outBuffer[i] = (char) inString[i];
+		++i;
+	}
+	return i;
+}
+#endif
+
+
+//================================================================================================================
+
+
+VJSONUTF8Writer::VJSONUTF8Writer( JSONOption inOptions)
+: fOptions( inOptions)
+, fLength( 0)
+, fMemoryFull( false)
+, fLevel( 0)
+, fStream( NULL)
+, fFlushSize( kDEFAULT_FLUSH_SIZE)
+, fCustomWriter( inOptions)
+{
+}
+
+
+VJSONUTF8Writer::~VJSONUTF8Writer()
+{
+}
+
+
+char *VJSONUTF8Writer::_Grow( VSize inCount)
+{
+	assert_compile( sizeof( fScratch) >= kMAX_RESERVE_SIZE);
+	xbox_assert( inCount <= kMAX_RESERVE_SIZE);
+
+	VSize size = Max( fBuffer.GetDataSize() * 2, fLength + Max( inCount, (VSize) 1024));
+	if (!fBuffer.SetSize( size))
+	{
+		fMemoryFull = true;
+		fLength = 0;
+		if (inCount > fBuffer.GetDataSize())
+			return fScratch;
+	}
+	return (char*) fBuffer.GetDataPtr() + fLength;
+}
+
+
+VError VJSONUTF8Writer::SetOutputStream( VStream *inStream)
+{
+	VError err = Flush();
+	fStream = inStream;
+	return err;
+}
+
+
+VError VJSONUTF8Writer::Flush()
+{
+	VError err = VE_OK;
+	if ( (fStream != NULL) && (fLength > 0) )
+	{
+		err = fStream->PutData( fBuffer.GetDataPtr(), fLength);
+		fLength = 0;
+	}
+	return err;
+}
+
+
+VError VJSONUTF8Writer::_End( VError inError)
+{
+	if ( (inError == VE_OK) && fMemoryFull)
+		inError = vThrowError( VE_MEMORY_FULL);
+
+	if (inError == VE_OK)
+	{
+		inError = Flush();
+	}
+	else
+	{
+		fLength = 0;
+		fLevel = 0;
+		fStack.clear();
+	}
+	fMemoryFull = false;
+
+	return inError;
+}
+
+
+VError VJSONUTF8Writer::WriteValue( const VJSONValue& inValue)
+{
+	return _End( _WriteValue( inValue));
+}
+
+
+VError VJSONUTF8Writer::WriteObject( const VJSONObject *inObject)
+{
+	return _End( _WriteObject( inObject));
+}
+
+
+VError VJSONUTF8Writer::WriteArray( const VJSONArray *inArray)
+{
+	return _End( _WriteArray( inArray));
+}
+
+
+void VJSONUTF8Writer::WriteString( const UniChar *inString, VIndex inLength)
+{
+	bool withQuotes = (fOptions & JSON_WithQuotesIfNecessary) != 0;
+	if (withQuotes)
+		_WriteChar( '"');
+	_WriteUTF8( inString, inLength, (fOptions & JSON_AlreadyEscapedChars) == 0);
+	if (withQuotes)
+		_WriteChar( '"');
+}
+
+
+void VJSONUTF8Writer::WriteNumber( double inNumber)
+{
+	char *p = _Reserve( kNUMBER_MAX_LENGTH);
+	fLength += _FormatNumber( inNumber, p);
+}
+
+
+void VJSONUTF8Writer::_WriteIndent()
+{
+	if ( (fOptions & JSON_PrettyFormatting) != 0)
+	{
+		_WriteChar( '\n');
+		for( sLONG i = 0 ; i < fLevel ; ++i)
+			_WriteChar( '\t');
+	}
+}
+
+
+void VJSONUTF8Writer::_WriteUTF8( const UniChar *inString, VIndex inLength, bool inEscape)
+{
+	const UniChar *s = inString;
+	const UniChar *end = inString + inLength;
+	while( s < end)
+	{
+		// at most 6 bytes per utf-16 char (\u escape or 3 bytes utf-8, surrogate pairs giving 4 bytes for 2 chars)
+		VIndex chunkLength = Min( (VIndex) (end - s), kSTRING_CHUNK_LENGTH);
+		const UniChar *chunkEnd = s + chunkLength;
+		char *begin = _Reserve( 6 * chunkLength + 4);
+		char *p = begin;
+
+		while( s < chunkEnd)
+		{
+			VIndex plain = _CopyPlainASCII( s, (VIndex) (chunkEnd - s), p);
+			s += plain;
+			p += plain;
+			if (s >= chunkEnd)
+				break;
+
+			UniChar c = *s++;
+			if (c < 0x80)
+			{
+				if (!inEscape)
+				{
+					*p++ = (char) c;
+					continue;
+				}
+				// same escaping as VString::GetJSONString
+				switch( c)
+				{
+					case '"':	*p++ = '\\'; *p++ = '"'; break;
+					case '\\':	*p++ = '\\'; *p++ = '\\'; break;
+					case 9:		*p++ = '\\'; *p++ = 't'; break;
+					case 13:	*p++ = '\\'; *p++ = 'r'; break;
+					case 10:	*p++ = '\\'; *p++ = 'n'; break;
+					case 12:	*p++ = '\\'; *p++ = 'f'; break;
+					case 8:		*p++ = '\\'; *p++ = 'b'; break;
+					default:	p = _WriteUnicodeEscape( p, c); break;
+				}
+			}
+			else if (c < 0x800)
+			{
+				*p++ = (char) (0xC0 | (c >> 6));
+				*p++ = (char) (0x80 | (c & 0x3F));
+			}
+			else if ( (c >= 0xD800) && (c <= 0xDFFF) )
+			{
+				// a surrogate pair may straddle the chunk boundary
+				if ( (c <= 0xDBFF) && (s < end) && (*s >= 0xDC00) && (*s <= 0xDFFF) )
+				{
+					uLONG codePoint = 0x10000 + (((uLONG) (c - 0xD800)) << 10) + (*s++ - 0xDC00);
+					*p++ = (char) (0xF0 | (codePoint >> 18));
+					*p++ = (char) (0x80 | ((codePoint >> 12) & 0x3F));
+					*p++ = (char) (0x80 | ((codePoint >> 6) & 0x3F));
+					*p++ = (char) (0x80 | (codePoint & 0x3F));
+					if (s > chunkEnd)
+						chunkEnd = s;
+				}
+				else
+				{
+					// lone surrogates can't be encoded in utf-8
+					p = _WriteUnicodeEscape( p, c);
+				}
+			}
+			else
+			{
+				*p++ = (char) (0xE0 | (c >> 12));
+				*p++ = (char) (0x80 | ((c >> 6) & 0x3F));
+				*p++ = (char) (0x80 | (c & 0x3F));
+			}
+		}
+
+		fLength += p - begin;
+	}
+}
+
+
+VError VJSONUTF8Writer::_WriteValue( const VJSONValue& inValue)
+{
+	VError err = VE_OK;
+	switch( inValue.GetType())
+	{
+		case JSON_undefined:	_WriteASCII( "undefined", 9); break;
+		case JSON_null:			_WriteASCII( "null", 4); break;
+		case JSON_true:			_WriteASCII( "true", 4); break;
+		case JSON_false:		_WriteASCII( "false", 5); break;
+		case JSON_string:		WriteString( inValue.fString.GetCPointer(), inValue.fString.GetLength()); break;
+		case JSON_number:		WriteNumber( inValue.fNumber); break;
+		case JSON_array:		err = _WriteArray( inValue.fArray); break;
+		case JSON_object:		err = _WriteObject( inValue.fObject); break;
+		default:				xbox_assert( false);
+	}
+
+	if ( (err == VE_OK) && (fStream != NULL) && (fLength >= fFlushSize) )
+		err = Flush();
+
+	return err;
+}
+
+
+VError VJSONUTF8Writer::_WriteObject( const VJSONObject *inObject)
+{
+	if (inObject == NULL)
+	{
+		_WriteASCII( "undefined", 9);
+		return VE_OK;
+	}
+
+	// a cycle makes the depth grow indefinitely so there's no need to look for one in shallow structures
+	if ( (fStack.size() >= 32) && (std::find( fStack.begin(), fStack.end(), inObject) != fStack.end()) )
+		return vThrowError( VE_JSON_STRINGIFY_CIRCULAR);
+
+	VError err = VE_OK;
+
+	fStack.push_back( inObject);
+
+	// overriden stringification
+	VString custom;
+	if (inObject->DoStringify( custom, fCustomWriter, &err))
+	{
+		if (err == VE_OK)
+			_WriteUTF8( custom.GetCPointer(), custom.GetLength(), false);
+	}
+	else if (inObject->fProperties.empty())
+	{
+		_WriteASCII( "{}", 2);
+	}
+	else
+	{
+		_WriteChar( '{');
+		++fLevel;
+		bool first = true;
+		for( VJSONPropertyConstIterator i( inObject) ; i.IsValid() && (err == VE_OK) ; ++i)
+		{
+			if (!first)
+				_WriteChar( ',');
+			first = false;
+			_WriteIndent();
+			WriteString( i.GetName());
+			_WriteChar( ':');
+			err = _WriteValue( i.GetValue());
+		}
+		--fLevel;
+		_WriteIndent();
+		_WriteChar( '}');
+	}
+
+	fStack.pop_back();
+
+	return err;
+}
+
+
+VError VJSONUTF8Writer::_WriteArray( const VJSONArray *inArray)
+{
+	if (inArray == NULL)
+	{
+		_WriteASCII( "undefined", 9);
+		return VE_OK;
+	}
+
+	if (inArray->IsEmpty())
+	{
+		_WriteASCII( "[]", 2);
+		return VE_OK;
+	}
+
+	VError err = VE_OK;
+
+	_WriteChar( '[');
+	++fLevel;
+	size_t count = inArray->GetCount();
+	for( size_t i = 0 ; (i < count) && (err == VE_OK) ; ++i)
+	{
+		if (i > 0)
+			_WriteChar( ',');
+		_WriteIndent();
+		err = _WriteValue( (*inArray)[i]);
+	}
+	--fLevel;
+	_WriteIndent();
+	_WriteChar( ']');
+
+	return err;
+}
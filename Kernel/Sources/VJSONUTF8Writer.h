@@ -0,0 +1,122 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VJSONUTF8Writer__
+#define __VJSONUTF8Writer__
+
+#include "Kernel/Sources/VJSONValue.h"
+#include "Kernel/Sources/VMemoryBuffer.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+class VStream;
+
+
+/*!
+	@class	VJSONUTF8Writer
+	@abstract	Stringifies VJSONValue directly as UTF-8 bytes.
+	@discussion
+		Same options as VJSONWriter but without intermediate VString:
+		bytes are appended to an internal buffer that is kept between calls so that
+		a writer used in a loop doesn't allocate once its buffer is large enough.
+
+		If an output stream is set, the buffer is flushed to the stream each time it exceeds
+		GetFlushSize() and at the end of each Write call, so the whole document is never held in memory.
+
+		The output is the same as VJSONWriter's except for numbers.
+		VJSONWriter uses VReal::GetJSONString ("%.14G", 14 significant digits).
+		This writer uses the fewest digits that read back to the same double (Grisu2),
+		laid out like JavaScript Number.toString() does:
+		0.1 + 0.2 is 0.30000000000000004 here and 0.3 with VJSONWriter, 1e21 is 1e+21 here and 1E+21 with VJSONWriter.
+		NaN and infinities are written as null by both.
+
+		VJSONUTF8Writer writer;
+		for( ...)
+		{
+			writer.Reset();
+			if (writer.WriteValue( value) == VE_OK)
+				socket->Write( writer.GetData(), writer.GetLength());
+		}
+*/
+class XTOOLBOX_API VJSONUTF8Writer : public VObject
+{
+public:
+			// pass option JSON_WithQuotesIfNecessary for standard JavaScript stringification
+	explicit						VJSONUTF8Writer( JSONOption inOptions = JSON_WithQuotesIfNecessary);
+	virtual							~VJSONUTF8Writer();
+
+			JSONOption				GetOptions() const								{ return fOptions;}
+
+			// Append the stringification of value, object or array.
+			// Cyclic structures are detected and throw error VE_JSON_STRINGIFY_CIRCULAR.
+			VError					WriteValue( const VJSONValue& inValue);
+			VError					WriteObject( const VJSONObject *inObject);
+			VError					WriteArray( const VJSONArray *inArray);
+
+			// Append a JSON string or a JSON number
+			void					WriteString( const UniChar *inString, VIndex inLength);
+			void					WriteString( const VString& inString)			{ WriteString( inString.GetCPointer(), inString.GetLength());}
+			void					WriteNumber( double inNumber);
+
+			// Bytes written since last Reset() or last flush to the output stream.
+			const char*				GetData() const									{ return (const char*) fBuffer.GetDataPtr();}
+			VSize					GetLength() const								{ return fLength;}
+
+			// Forget written bytes but keep the allocated buffer.
+			void					Reset()											{ fLength = 0;}
+
+			// Bytes are sent to inStream instead of being accumulated (pass NULL to stop).
+			// The stream must be opened for writing. Pending bytes are flushed first.
+			VError					SetOutputStream( VStream *inStream);
+			VStream*				GetOutputStream() const							{ return fStream;}
+			VError					Flush();
+
+			void					SetFlushSize( VSize inSize)						{ fFlushSize = inSize;}
+			VSize					GetFlushSize() const							{ return fFlushSize;}
+
+private:
+									VJSONUTF8Writer( const VJSONUTF8Writer&);
+			VJSONUTF8Writer&		operator=( const VJSONUTF8Writer&);
+
+			VError					_WriteValue( const VJSONValue& inValue);
+			VError					_WriteObject( const VJSONObject *inObject);
+			VError					_WriteArray( const VJSONArray *inArray);
+			VError					_End( VError inError);
+
+			void					_WriteIndent();
+			void					_WriteUTF8( const UniChar *inString, VIndex inLength, bool inEscape);
+			void					_WriteASCII( const char *inString, VSize inLength)	{ ::memcpy( _Reserve( inLength), inString, inLength); fLength += inLength;}
+			void					_WriteChar( char inChar)						{ *_Reserve( 1) = inChar; ++fLength;}
+
+			// returns where to write inCount bytes. fLength must be incremented afterwards.
+			char*					_Reserve( VSize inCount)						{ return (fLength + inCount <= fBuffer.GetDataSize()) ? (char*) fBuffer.GetDataPtr() + fLength : _Grow( inCount);}
+			char*					_Grow( VSize inCount);
+
+			JSONOption				fOptions;
+			VMemoryBuffer<>			fBuffer;			// its size is the capacity, fLength is the used part
+			VSize					fLength;
+			bool					fMemoryFull;
+			sLONG					fLevel;
+			std::vector<const VJSONObject*>	fStack;		// objects being written, innermost last
+			VStream*				fStream;
+			VSize					fFlushSize;
+			VJSONWriter				fCustomWriter;		// for VJSONObject::DoStringify
+			char					fScratch[6 * 256 + 16];	// where to write when fBuffer can't grow (see kMAX_RESERVE_SIZE)
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
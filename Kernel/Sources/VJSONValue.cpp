@@ -767,8 +767,8 @@ sLONG VJSONObject::Release( const char* inDebugInfo) const
 
 VJSONValue VJSONObject::GetProperty( const VString& inName) const
 {
-	MapType::const_iterator i = fMap.find( inName);
-	return (i == fMap.end()) ? VJSONValue::sUndefined : i->second;
+	MapType::const_iterator i = fMap.find( &inName);
+	return (i == fMap.end()) ? VJSONValue::sUndefined : i->second->second;
 }
 
 
@@ -778,12 +778,28 @@ bool VJSONObject::SetProperty( const VString& inName, const VJSONValue& inValue)
 	try
 	{
 		if (inValue.IsUndefined())
-			fMap.erase( inName);
+			VJSONObject::RemoveProperty( inName);
 		else
 		{
-			std::pair<MapType::iterator,bool> i = fMap.insert( MapType::value_type( inName, inValue));
-			if (!i.second)
-				i.first->second = inValue;
+			MapType::iterator i = fMap.find( &inName);
+			if (i != fMap.end())
+			{
+				i->second->second = inValue;
+			}
+			else
+			{
+				fProperties.push_back( Property( inName, inValue));
+				try
+				{
+					ListOfProperty::iterator property = --fProperties.end();
+					fMap.insert( MapType::value_type( &property->first, property));
+				}
+				catch(...)
+				{
+					fProperties.pop_back();
+					throw;
+				}
+			}
 				
 			VJSONGraph::Connect( &fGraph, inValue);
 		}
@@ -798,19 +814,26 @@ bool VJSONObject::SetProperty( const VString& inName, const VJSONValue& inValue)
 
 void VJSONObject::RemoveProperty( const VString& inName)
 {
-	fMap.erase( inName);
+	MapType::iterator i = fMap.find( &inName);
+	if (i != fMap.end())
+	{
+		ListOfProperty::iterator property = i->second;
+		fMap.erase( i);
+		fProperties.erase( property);
+	}
 }
 
 
 void VJSONObject::Clear()
 {
 	fMap.clear();
+	fProperties.clear();
 }
 
 
 bool VJSONObject::IsEmpty() const
 {
-	return fMap.empty();
+	return fProperties.empty();
 }
 
 
@@ -834,9 +857,9 @@ VError VJSONObject::Clone( VJSONValue& outValue, VJSONCloner& inCloner) const
 	VJSONObject *clone = new VJSONObject;
 	if (clone != NULL)
 	{
-		MapType clonedMap = fMap;
+		ListOfProperty clonedProperties = fProperties;
 
-		for( MapType::iterator i = clonedMap.begin() ; (i != clonedMap.end()) && (err == VE_OK) ; ++i)
+		for( ListOfProperty::iterator i = clonedProperties.begin() ; (i != clonedProperties.end()) && (err == VE_OK) ; ++i)
 		{
 			if (i->second.IsObject())
 			{
@@ -855,7 +878,12 @@ VError VJSONObject::Clone( VJSONValue& outValue, VJSONCloner& inCloner) const
 		}
 		
 		if (err == VE_OK)
-			clone->fMap.swap( clonedMap);
+		{
+			// the list nodes are kept by the swap
+			clone->fProperties.swap( clonedProperties);
+			for( ListOfProperty::iterator i = clone->fProperties.begin() ; i != clone->fProperties.end() ; ++i)
+				clone->fMap.insert( MapType::value_type( &i->first, i));
+		}
 	}
 	else
 	{
@@ -1101,7 +1129,7 @@ VError VJSONWriter::StringifyObject( const VJSONObject *inObject, VString& outSt
 	
 	if (!inObject->DoStringify( outString, *this, &err))
 	{
-		if (inObject->fMap.empty())
+		if (inObject->fProperties.empty())
 		{
 			outString = "{}";
 		}
@@ -1110,7 +1138,7 @@ VError VJSONWriter::StringifyObject( const VJSONObject *inObject, VString& outSt
 			IncrementLevel();
 
 			VectorOfVString array;
-			array.resize( inObject->fMap.size());
+			array.resize( inObject->fProperties.size());
 
 			VectorOfVString::iterator j = array.begin();
 			for( VJSONPropertyConstIterator i( inObject) ; i.IsValid() && (err == VE_OK) ; ++i, ++j)
@@ -19,6 +19,8 @@
 #include "Kernel/Sources/VString.h"
 #include "Kernel/Sources/VString_ExtendedSTL.h"
 
+#include <list>
+
 BEGIN_TOOLBOX_NAMESPACE
 
 
@@ -37,6 +39,7 @@ enum JSONType
 class VJSONObject;
 class VJSONArray;
 class VJSONWriter;
+class VJSONUTF8Writer;
 class VJSONCloner;
 class VJSONGraph;
 
@@ -69,6 +72,7 @@ class VJSONGraph;
 */
 class XTOOLBOX_API VJSONValue : public VObject
 {
+	friend class VJSONUTF8Writer;
 public:
 			// default constructor builds an undefined value.
 									VJSONValue():fType( JSON_undefined)	{}
@@ -199,7 +203,9 @@ protected:
 	key is a VString
 	value is a VJSONValue
 	
-	keys are unique and not ordered.
+	keys are unique and are iterated (and stringified) in insertion order as in JavaScript,
+	so that the output doesn't depend on the per process VString hash seed.
+	Setting an existing property keeps its place, removing it and setting it again moves it last.
 	Comparison for uniqueness test is based on utf-16 code point equality as in JavaScript.
 	
 	A property cannot have JSON_undefined as value.
@@ -215,6 +221,7 @@ class XTOOLBOX_API VJSONObject : public VObject, public IRefCountable
 	friend class VJSONPropertyIterator;
 	friend class VJSONPropertyConstIterator;
 	friend class VJSONWriter;
+	friend class VJSONUTF8Writer;
 public:
 			// construct an empty collection
 									VJSONObject();
@@ -260,8 +267,25 @@ protected:
 			void					Connect( VJSONGraph** inOtherGraph);
 
 private:
+									VJSONObject( const VJSONObject&);				// forbidden (the map points into the list)
+			VJSONObject&			operator=( const VJSONObject&);					// forbidden
+
 	static	sLONG					sCount;
-			typedef unordered_map_VString<VJSONValue>	MapType;
+			typedef std::pair<VString,VJSONValue>	Property;
+			typedef std::list<Property>				ListOfProperty;
+
+			// the map points to the names stored in the list
+			struct NameHash
+			{
+				size_t operator()( const VString *inName) const								{ return inName->GetHashValue();}
+			};
+			struct NameEqual
+			{
+				bool operator()( const VString *inName1, const VString *inName2) const		{ return hash_VString::equal_to()( *inName1, *inName2);}
+			};
+			typedef std::tr1::unordered_map<const VString*,ListOfProperty::iterator,NameHash,NameEqual>	MapType;
+
+			ListOfProperty			fProperties;	// in insertion order
 			MapType					fMap;
 	mutable	VJSONGraph*				fGraph;
 };
@@ -284,7 +308,7 @@ private:
 class VJSONPropertyIterator : public XBOX::VObject
 {
 public:
-			VJSONPropertyIterator( VJSONObject *inObject):fIterator( inObject->fMap.begin()), fIterator_end( inObject->fMap.end()) {}
+			VJSONPropertyIterator( VJSONObject *inObject):fIterator( inObject->fProperties.begin()), fIterator_end( inObject->fProperties.end()) {}
 	
 			const VString&			GetName() const		{ return fIterator->first;}
 			VJSONValue&				GetValue() const	{ return fIterator->second;}
@@ -296,14 +320,14 @@ public:
 private:
 			VJSONPropertyIterator( const VJSONPropertyIterator&);				// forbidden
 			VJSONPropertyIterator&	operator=( const VJSONPropertyIterator&);	// forbidden
-			VJSONObject::MapType::iterator	fIterator;
-			VJSONObject::MapType::iterator	fIterator_end;
+			VJSONObject::ListOfProperty::iterator	fIterator;
+			VJSONObject::ListOfProperty::iterator	fIterator_end;
 };
 
 class VJSONPropertyConstIterator : public XBOX::VObject
 {
 public:
-			VJSONPropertyConstIterator( const VJSONObject *inObject):fIterator( inObject->fMap.begin()), fIterator_end( inObject->fMap.end()) {}
+			VJSONPropertyConstIterator( const VJSONObject *inObject):fIterator( inObject->fProperties.begin()), fIterator_end( inObject->fProperties.end()) {}
 
 			const VString&			GetName() const		{ return fIterator->first;}
 			const VJSONValue&		GetValue() const	{ return fIterator->second;}
@@ -315,8 +339,8 @@ public:
 private:
 			VJSONPropertyConstIterator( const VJSONPropertyConstIterator&);				// forbidden
 			VJSONPropertyConstIterator&	operator=( const VJSONPropertyConstIterator&);	// forbidden
-			VJSONObject::MapType::const_iterator	fIterator;
-			VJSONObject::MapType::const_iterator	fIterator_end;
+			VJSONObject::ListOfProperty::const_iterator	fIterator;
+			VJSONObject::ListOfProperty::const_iterator	fIterator_end;
 };
 
 
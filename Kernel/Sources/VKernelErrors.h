@@ -109,6 +109,7 @@ DECLARE_VERROR( kCOMPONENT_XTOOLBOX, 615, VE_FILE_CANNOT_EXCHANGE)
 DECLARE_VERROR( kCOMPONENT_XTOOLBOX, 616, VE_FILE_ALREADY_EXISTS)
 DECLARE_VERROR( kCOMPONENT_XTOOLBOX, 617, VE_FILE_CANNOT_RESOLVE_ALIAS_TO_FILE)
 DECLARE_VERROR( kCOMPONENT_XTOOLBOX, 618, VE_FILE_CANNOT_RESOLVE_ALIAS_TO_FOLDER)
+DECLARE_VERROR( kCOMPONENT_XTOOLBOX, 619, VE_FILE_CANNOT_MAP)
 
 DECLARE_VERROR( kCOMPONENT_XTOOLBOX, 650, VE_FOLDER_NOT_FOUND)
 DECLARE_VERROR( kCOMPONENT_XTOOLBOX, 651, VE_FOLDER_NOT_EMPTY)
@@ -112,6 +112,39 @@
 	#define WITH_DEBUGMSG	VERSIONDEBUG
 #endif
 
+// Flag to enable SSE2 code paths (always available on x86_64)
+#ifndef WITH_SSE2
+	#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+		#define WITH_SSE2	1
+	#else
+		#define WITH_SSE2	0
+	#endif
+#endif
+
+// Flag to build the code paths using the sse4.2 crc32 instruction and the sha extensions.
+// They are only taken if the processor has them (see VChecksumCRC32C, VChecksumSHA256).
+#ifndef WITH_X86_EXTENSIONS
+	#if defined(__x86_64__) && defined(__GNUC__)
+		#define WITH_X86_EXTENSIONS	1
+	#else
+		#define WITH_X86_EXTENSIONS	0
+	#endif
+#endif
+
+// Compression methods available to VArchiveStream::SetCompression().
+// zlib comes with the linux build (ZLib target), zstd must be provided by the project.
+#ifndef WITH_ZLIB
+	#if VERSION_LINUX
+		#define WITH_ZLIB	1
+	#else
+		#define WITH_ZLIB	0
+	#endif
+#endif
+
+#ifndef WITH_ZSTD
+	#define WITH_ZSTD	0
+#endif
+
 // ICU configuration
 #if VERSION_LINUX
 	#define USE_ICU     1
@@ -291,9 +291,17 @@ enum {
 	FO_SequentialScan		= 8,	// The file is to be accessed sequentially from beginning to end
 	FO_RandomAccess			= 16,	// The file is to be accessed randomly
 	FO_WriteThrough			= 32,	// The data is written to the system cache, but is flushed to disk without delay
+	FO_ConcurrentAccess		= 64,	// Several tasks read and write at absolute offsets with the same VFileDesc (the current pos is not maintained)
 	FO_Default				= FO_SequentialScan		// file must exist
 };
 
+// one buffer of a vectored read or write (VFileDesc::GetDataV & PutDataV)
+typedef struct FileDataSegment
+{
+	void*	fData;
+	VSize	fSize;
+} FileDataSegment;
+
 typedef uLONG FileCreateOptions;	// options for VFile::Create
 enum {
 	FCR_Overwrite			= 4,	// overwrite destination file
@@ -304,6 +312,7 @@ typedef uLONG FileCopyOptions;	// options for VFile::Copy and VFile::Move
 enum {
 	FCP_Overwrite			= 4,	// overwrite destination file
 	FCP_ContinueOnError		= 8,	// while copying multiple files, tells one should continue copying remaining files.
+	FCP_Parallel			= 16,	// VFolder copy: several files are copied at once on the shared VExecutor.
 	FCP_Default				= 0
 };
 
@@ -325,6 +334,8 @@ enum {
 	FI_WANT_INVISIBLES	= 8,
 	FI_RESOLVE_ALIASES	= 16,
 	FI_ITERATE_DELETE	= 32, /* for mac only : to use if you want to iterate some file/folder that you want to delate ( during the iterate ) */
+	FI_WANT_ATTRIBUTES	= 64, /* VFolderEnumerator : fills the size and modification date of entries */
+	FI_PARALLEL			= 128, /* VFolderEnumerator::Walk : sub folders are listed by VExecutor workers */
 	FI_WANT_ALL	= FI_WANT_FILES | FI_WANT_FOLDERS | FI_WANT_INVISIBLES,
 	FI_NORMAL_FILES	= FI_WANT_FILES | FI_RESOLVE_ALIASES,
 	FI_NORMAL_FOLDERS	= FI_WANT_FOLDERS | FI_RESOLVE_ALIASES
@@ -17,10 +17,15 @@
 #include "VFolder.h"
 #include "VFile.h"
 #include "VLogger.h"
+#include "VBinaryLog.h"
 #include "VProcess.h"
+#include "VStringBuilder.h"
+#include "VTask.h"
 
 
 const sLONG kSPLITABLE_LOG_FILE_MAX = 10485760; // 10 * 1024L * 1024L
+const sLONG kLOG_WRITER_PERIOD = 100;			// ms the writer task waits for messages
+const sLONG kLOG_WRITER_BATCH = 256;			// messages formatted for one write
 
 VSplitableLogFile::VSplitableLogFile( const VFolder& inBasePath, const VString& inBaseName, sLONG inStartNumber)
 {
@@ -178,6 +183,17 @@ void VSplitableLogFile::AppendString( const char* inString)
 }
 
 
+void VSplitableLogFile::AppendData( const void* inData, size_t inSize)
+{
+	CheckLogSize();
+
+	if ( (fFile != NULL) && (inSize > 0) )
+	{
+		::fwrite( inData, 1, inSize, fFile);
+	}
+}
+
+
 void VSplitableLogFile::GetCurrentFileName( VString& outName) const
 {
 	VSplitableLogFile::BuildLogFileName( fLogName, fLogNumber, outName);
@@ -239,11 +255,313 @@ static const char *GetMessageLevelName( EMessageLevel inLevel)
 }
 
 
+BEGIN_TOOLBOX_NAMESPACE
+
+/*
+	Bounded queue of log messages: any number of logging tasks, one writer at a time.
+
+	Each cell carries a sequence number telling whether it is free for the position a producer
+	has reserved or filled for the position the writer expects (D. Vyukov's bounded queue).
+	Producers only compete on one compare-exchange of fTail, the writer never blocks them.
+	Positions are free-running 32 bits counters: differences are computed modulo 2^32.
+*/
+class VLogMessageQueue : public VObject
+{
+public:
+	typedef struct Message
+	{
+		EMessageLevel	fLevel;
+		time_t			fTime;
+		char*			fText;		// logger id, '\0', message, '\0' (malloc)
+	} Message;
+
+								VLogMessageQueue( sLONG inCapacity, ELogOverflowPolicy inPolicy);
+	virtual						~VLogMessageQueue();
+
+			// returns false if the message has been dropped
+			bool				Push( EMessageLevel inLevel, time_t inTime, const char *inLoggerID, const char *inMessage);
+
+			// writer only (the logger fLock must be held). Returns the count of messages moved in outMessages.
+			sLONG				Pop( Message *outMessages, sLONG inMaxCount);
+
+			// writer only: formats inMessage at the end of the write buffer
+			void				Format( const Message& inMessage);
+			const char*			GetBuffer() const					{ return fBuffer;}
+			size_t				GetBufferLength() const				{ return fBufferLength;}
+			void				ClearBuffer()						{ fBufferLength = 0;}
+			void				DidWrite( sLONG inCount);
+
+			bool				WaitForMessages( sLONG inTimeoutMilliseconds)	{ bool ok = fWakeUp.Lock( inTimeoutMilliseconds); fWakeUp.Reset(); return ok;}
+			void				WakeUp()										{ fWakeUp.Unlock();}
+
+			// once the writer is gone, Push drops the messages instead of waiting for room that will never come
+			void				SetWriterGone( bool inGone)						{ VInterlocked::Exchange( &fWriterGone, inGone ? 1 : 0); fWakeUp.Unlock();}
+
+			void				GetStatistics( VLogStatistics& outStatistics) const;
+
+private:
+								VLogMessageQueue( const VLogMessageQueue&);
+			VLogMessageQueue&	operator=( const VLogMessageQueue&);
+
+			typedef struct Cell
+			{
+				sLONG			fSequence;
+				Message			fMessage;
+			} Cell;
+
+			void				_Append( const char *inData, size_t inLength);
+
+			Cell*				fCells;
+			uLONG				fMask;
+			ELogOverflowPolicy	fPolicy;
+			sLONG				fTail;				// next position to reserve
+			char				fPadding[64];		// keeps producers and writer on different cache lines
+			sLONG				fHead;				// next position to read (writer only)
+			VSyncEvent			fWakeUp;
+			sLONG				fWriterGone;		// 1 while the logger is stopped
+
+			// write buffer and formatted time of the last second (writer only)
+			char*				fBuffer;
+			size_t				fBufferLength;
+			size_t				fBufferSize;
+			time_t				fCachedTime;
+			char				fCachedTimeString[64];
+			size_t				fCachedTimeLength;
+
+			sLONG8				fQueued;
+			sLONG8				fWritten;
+			sLONG8				fDropped;
+			sLONG8				fWaits;
+			sLONG8				fBatches;
+};
+
+
+class VLogWriterTask : public VTask
+{
+public:
+								VLogWriterTask( VLog4jMsgFileLogger *inLogger)
+									: VTask( NULL, 0, eTaskStylePreemptive, NULL)
+									, fLogger( inLogger)
+									{
+										SetName( CVSTR( "Log writer"));
+									}
+
+protected:
+	virtual	Boolean				DoRun()
+								{
+									fLogger->fQueue->WaitForMessages( kLOG_WRITER_PERIOD);
+									fLogger->_WriteQueuedMessages();
+									return true;
+								}
+
+private:
+			VLog4jMsgFileLogger*	fLogger;
+};
+
+END_TOOLBOX_NAMESPACE
+
+
+VLogMessageQueue::VLogMessageQueue( sLONG inCapacity, ELogOverflowPolicy inPolicy)
+: fPolicy( inPolicy)
+, fTail( 0)
+, fHead( 0)
+, fWriterGone( 1)
+, fBuffer( NULL)
+, fBufferLength( 0)
+, fBufferSize( 0)
+, fCachedTime( (time_t) -1)
+, fCachedTimeLength( 0)
+, fQueued( 0)
+, fWritten( 0)
+, fDropped( 0)
+, fWaits( 0)
+, fBatches( 0)
+{
+	// the capacity is rounded to a power of 2 so that a position gives its cell with a mask
+	uLONG capacity = 16;
+	while( (capacity < (uLONG) inCapacity) && (capacity < (1UL << 24)) )
+		capacity <<= 1;
+
+	fMask = capacity - 1;
+	fCells = new Cell[capacity];
+	for( uLONG i = 0 ; i < capacity ; ++i)
+	{
+		fCells[i].fSequence = (sLONG) i;
+		fCells[i].fMessage.fText = NULL;
+	}
+	fCachedTimeString[0] = 0;
+}
+
+
+VLogMessageQueue::~VLogMessageQueue()
+{
+	// messages never written (Pop clears the cells)
+	for( uLONG i = 0 ; i <= fMask ; ++i)
+		::free( fCells[i].fMessage.fText);
+	delete [] fCells;
+	::free( fBuffer);
+}
+
+
+bool VLogMessageQueue::Push( EMessageLevel inLevel, time_t inTime, const char *inLoggerID, const char *inMessage)
+{
+	if (VInterlocked::AtomicGet( &fWriterGone) != 0)
+	{
+		VInterlocked::AtomicAdd( &fDropped, 1);
+		return false;
+	}
+
+	size_t idLength = ::strlen( inLoggerID);
+	size_t messageLength = ::strlen( inMessage);
+	char *text = (char*) ::malloc( idLength + messageLength + 2);
+	if (text == NULL)
+	{
+		VInterlocked::AtomicAdd( &fDropped, 1);
+		return false;
+	}
+	::memcpy( text, inLoggerID, idLength + 1);
+	::memcpy( text + idLength + 1, inMessage, messageLength + 1);
+
+	// errors and fatal messages are never dropped and wake up the writer at once
+	bool important = (inLevel >= EML_Error);
+	bool waited = false;
+	for(;;)
+	{
+		sLONG pos = fTail;
+		Cell *cell = &fCells[(uLONG) pos & fMask];
+		sLONG diff = (sLONG) ((uLONG) VInterlocked::AtomicGet( &cell->fSequence) - (uLONG) pos);
+		if (diff == 0)
+		{
+			if (VInterlocked::CompareExchange( &fTail, pos, (sLONG) ((uLONG) pos + 1)) == pos)
+			{
+				cell->fMessage.fLevel = inLevel;
+				cell->fMessage.fTime = inTime;
+				cell->fMessage.fText = text;
+
+				// publishes the message to the writer
+				VInterlocked::Exchange( &cell->fSequence, (sLONG) ((uLONG) pos + 1));
+
+				// the writer is woken up when the queue is a quarter full
+				if (important || ((((uLONG) pos + 1) & (fMask >> 2)) == 0))
+					fWakeUp.Unlock();
+				break;
+			}
+		}
+		else if (diff < 0)
+		{
+			// the queue is full (nobody will make room if the logger is being stopped)
+			if ( ((fPolicy == eLogOverflowDrop) && !important) || (VInterlocked::AtomicGet( &fWriterGone) != 0) )
+			{
+				::free( text);
+				VInterlocked::AtomicAdd( &fDropped, 1);
+				return false;
+			}
+			if (!waited)
+			{
+				waited = true;
+				VInterlocked::AtomicAdd( &fWaits, 1);
+			}
+			fWakeUp.Unlock();
+			VTask::YieldNow();
+		}
+		// else another producer has just taken this position
+	}
+
+	VInterlocked::AtomicAdd( &fQueued, 1);
+	return true;
+}
+
+
+sLONG VLogMessageQueue::Pop( Message *outMessages, sLONG inMaxCount)
+{
+	sLONG count = 0;
+	while( count < inMaxCount)
+	{
+		Cell *cell = &fCells[(uLONG) fHead & fMask];
+		if (VInterlocked::AtomicGet( &cell->fSequence) != (sLONG) ((uLONG) fHead + 1))
+			break;	// not yet published
+
+		outMessages[count++] = cell->fMessage;
+		cell->fMessage.fText = NULL;
+
+		// the cell is free for the position one lap further
+		VInterlocked::Exchange( &cell->fSequence, (sLONG) ((uLONG) fHead + fMask + 1));
+		fHead = (sLONG) ((uLONG) fHead + 1);
+	}
+	return count;
+}
+
+
+void VLogMessageQueue::_Append( const char *inData, size_t inLength)
+{
+	if (fBufferLength + inLength > fBufferSize)
+	{
+		size_t size = Max( (size_t) 65536, (fBufferLength + inLength) * 2);
+		char *buffer = (char*) ::realloc( fBuffer, size);
+		if (buffer == NULL)
+			return;
+		fBuffer = buffer;
+		fBufferSize = size;
+	}
+	::memcpy( fBuffer + fBufferLength, inData, inLength);
+	fBufferLength += inLength;
+}
+
+
+void VLogMessageQueue::Format( const Message& inMessage)
+{
+	// strftime is called once per second at most
+	if (inMessage.fTime != fCachedTime)
+	{
+		fCachedTime = inMessage.fTime;
+		fCachedTimeLength = ::strftime( fCachedTimeString, sizeof( fCachedTimeString), "%Y-%m-%d %X", ::localtime( &inMessage.fTime));
+	}
+
+	const char *loggerID = inMessage.fText;
+	size_t idLength = ::strlen( loggerID);
+	const char *message = loggerID + idLength + 1;
+	const char *levelName = GetMessageLevelName( inMessage.fLevel);
+
+	// "%s [%s] %s - %s\n"
+	_Append( fCachedTimeString, fCachedTimeLength);
+	_Append( " [", 2);
+	_Append( loggerID, idLength);
+	_Append( "] ", 2);
+	_Append( levelName, ::strlen( levelName));
+	_Append( " - ", 3);
+	_Append( message, ::strlen( message));
+	_Append( "\n", 1);
+}
+
+
+void VLogMessageQueue::DidWrite( sLONG inCount)
+{
+	VInterlocked::AtomicAdd( &fWritten, (sLONG8) inCount);
+	VInterlocked::AtomicAdd( &fBatches, (sLONG8) 1);
+}
+
+
+void VLogMessageQueue::GetStatistics( VLogStatistics& outStatistics) const
+{
+	outStatistics.fQueued = fQueued;
+	outStatistics.fWritten = fWritten;
+	outStatistics.fDropped = fDropped;
+	outStatistics.fWaits = fWaits;
+	outStatistics.fBatches = fBatches;
+}
+
+
+//============================================================
+
+
 VLog4jMsgFileLogger::VLog4jMsgFileLogger( const VFolder& inLogFolder, const VString& inLogName)
 : fLogName(inLogName)
 , fOutput(NULL)
 , fIsStarted( false)
 , fFilter((1<<EML_Information) | (1<<EML_Warning) | (1<<EML_Error) | (1<<EML_Fatal) /*| (1<<EML_Trace) | (1<<EML_Dump)*/)
+, fQueue( NULL)
+, fWriter( NULL)
+, fBinaryLog( NULL)
 {
 	inLogFolder.GetPath( fFolderPath);
 }
@@ -252,6 +570,39 @@ VLog4jMsgFileLogger::VLog4jMsgFileLogger( const VFolder& inLogFolder, const VStr
 VLog4jMsgFileLogger::~VLog4jMsgFileLogger()
 {
 	Stop();
+	delete fQueue;
+}
+
+
+void VLog4jMsgFileLogger::SetAsynchronous( bool inAsynchronous, sLONG inCapacity, ELogOverflowPolicy inPolicy)
+{
+	fLock.Lock();
+	xbox_assert( fOutput == NULL);	// the logger must be stopped
+	if (fOutput == NULL)
+	{
+		delete fQueue;
+		fQueue = inAsynchronous ? new VLogMessageQueue( inCapacity, inPolicy) : NULL;
+	}
+	fLock.Unlock();
+}
+
+
+void VLog4jMsgFileLogger::SetBinaryLog( VBinaryLogWriter *inBinaryLog)
+{
+	fLock.Lock();
+	xbox_assert( fOutput == NULL);	// the logger must be stopped
+	if (fOutput == NULL)
+		fBinaryLog = inBinaryLog;
+	fLock.Unlock();
+}
+
+
+void VLog4jMsgFileLogger::GetStatistics( VLogStatistics& outStatistics) const
+{
+	if (fQueue != NULL)
+		fQueue->GetStatistics( outStatistics);
+	else
+		::memset( &outStatistics, 0, sizeof( outStatistics));
 }
 
 
@@ -283,6 +634,13 @@ void VLog4jMsgFileLogger::Start( sLONG inLogNumber)
 						(*iter)->DoStart( path);
 
 					fReadersLock.Unlock();
+
+					if (fQueue != NULL)
+					{
+						fQueue->SetWriterGone( false);
+						fWriter = new VLogWriterTask( this);
+						fWriter->Run();
+					}
 				}
 				else
 				{
@@ -324,7 +682,29 @@ void VLog4jMsgFileLogger::Start()
 
 void VLog4jMsgFileLogger::Stop()
 {
+	// the writer task needs fLock to write the last messages
 	fLock.Lock();
+	VLogWriterTask *writer = fWriter;
+	fWriter = NULL;
+	fIsStarted = false;
+	// producers waiting for room give up before the final drain
+	if (fQueue != NULL)
+		fQueue->SetWriterGone( true);
+	fLock.Unlock();
+
+	if (writer != NULL)
+	{
+		writer->Kill();
+		fQueue->WakeUp();
+		// the writer uses fQueue and fOutput until it dies, they can't be released before
+		while( !writer->WaitForDeath( kLOG_WRITER_PERIOD))
+			;
+		writer->Release();
+	}
+
+	fLock.Lock();
+	if (fQueue != NULL)
+		_WriteQueuedMessages();
 	if (fOutput != NULL)
 	{
 		fOutput->Close();
@@ -332,6 +712,9 @@ void VLog4jMsgFileLogger::Stop()
 		fOutput = NULL;
 		fIsStarted = false;
 	}
+	// the binary log is not ours to close, but its current block must reach the file
+	if (fBinaryLog != NULL)
+		fBinaryLog->Flush();
 	fStartTime.Clear();
 	fLock.Unlock();
 }
@@ -346,15 +729,80 @@ bool VLog4jMsgFileLogger::IsStarted() const
 void VLog4jMsgFileLogger::Flush()
 {
 	fLock.Lock();
+	if (fQueue != NULL)
+	{
+		// the messages queued by the calling task are written now
+		_WriteQueuedMessages();
+	}
 	if(fOutput != NULL)
 	{
 		fOutput->Flush();
 	}
+	if (fBinaryLog != NULL)
+	{
+		// message bags are kept in the current block until it's full
+		fBinaryLog->Flush();
+	}
+	fLock.Unlock();
+}
+
+
+void VLog4jMsgFileLogger::_WriteQueuedMessages()
+{
+	VLogMessageQueue::Message messages[kLOG_WRITER_BATCH];
+
+	fLock.Lock();
+	bool written = false;
+	for(;;)
+	{
+		sLONG count = fQueue->Pop( messages, kLOG_WRITER_BATCH);
+		if (count == 0)
+			break;
+
+		for( sLONG i = 0 ; i < count ; ++i)
+		{
+			fQueue->Format( messages[i]);
+			::free( messages[i].fText);
+		}
+
+		// the log file is split between batches only
+		if (fOutput != NULL)
+			fOutput->AppendData( fQueue->GetBuffer(), fQueue->GetBufferLength());
+		fQueue->ClearBuffer();
+		fQueue->DidWrite( count);
+		written = true;
+	}
+
+	if (written && (fOutput != NULL))
+		fOutput->Flush();
 	fLock.Unlock();
 }
 
 
 void VLog4jMsgFileLogger::LogBag( const VValueBag *inMessage)
+{
+	EMessageLevel level = ILoggerBagKeys::level.Get( inMessage);
+
+	if (fBinaryLog != NULL)
+	{
+		// the bag is recorded as is, no formatting
+		if (ShouldLog( level))
+			fBinaryLog->LogBag( *inMessage);
+		return;
+	}
+
+	// filter before building the text
+	if (!ShouldLog( level))
+		return;
+
+	VString loggerID, message;
+	BuildMessageFromBag( inMessage, loggerID, message, true);
+
+	Log( loggerID, level, message, NULL);
+}
+
+
+void VLog4jMsgFileLogger::BuildMessageFromBag( const VValueBag *inMessage, VString& outLoggerID, VString& outMessage, bool inWithCurrentTaskName)
 {
 	VString message;
 	ILoggerBagKeys::message.Get( inMessage, message);
@@ -362,179 +810,184 @@ void VLog4jMsgFileLogger::LogBag( const VValueBag *inMessage)
 	VError errorCode = VE_OK;
 	ILoggerBagKeys::error_code.Get( inMessage, errorCode);
 
-	EMessageLevel level = ILoggerBagKeys::level.Get( inMessage);
-	VString loggerID;
-	if (!ILoggerBagKeys::source.Get( inMessage, loggerID))
+	if (!ILoggerBagKeys::source.Get( inMessage, outLoggerID))
 	{
-		VProcess::Get()->GetProductName( loggerID);
+		VProcess::Get()->GetProductName( outLoggerID);
 		OsType componentSignature = 0;
 		if (!ILoggerBagKeys::component_signature.Get( inMessage, componentSignature))
 			componentSignature = COMPONENT_FROM_VERROR( errorCode);
 
 		if (componentSignature != 0)
 		{
-			loggerID.AppendUniChar( '.').AppendOsType( componentSignature);
+			outLoggerID.AppendUniChar( '.').AppendOsType( componentSignature);
 		}
 	}
 
+	// the message is built once from its fragments
+	VStringBuilder builder( 256);
 	if (errorCode != VE_OK)
 	{
-		VString s;
-		s.Printf( "[%d] ", ERRCODE_FROM_VERROR( errorCode));
-		message.Insert( s, 1);
+		builder.AppendUniChar( '[').AppendLong( ERRCODE_FROM_VERROR( errorCode)).AppendCString( "] ");
 	}
+	builder.AppendString( message);
 	
 	sLONG taskId=-1;
 	if (ILoggerBagKeys::task_id.Get(inMessage, taskId))
 	{
-		message.AppendString(CVSTR(", task #"));
-		message.AppendLong(taskId);
+		builder.AppendString(CVSTR(", task #"));
+		builder.AppendLong(taskId);
 	}
 	
 	VString taskName;
-	if (!ILoggerBagKeys::task_name.Get( inMessage, taskName))
+	if (!ILoggerBagKeys::task_name.Get( inMessage, taskName) && inWithCurrentTaskName)
 		VTask::GetCurrent()->GetName( taskName);
 	if (!taskName.IsEmpty())
 	{
-		message += ", ";
-		message += taskName;
+		builder += ", ";
+		builder += taskName;
 	}
 	
 	sLONG socketDescriptor=-1;
 	if (ILoggerBagKeys::socket.Get(inMessage, socketDescriptor))
 	{
-		message.AppendString(CVSTR(", socket "));
-		message.AppendLong(socketDescriptor);
+		builder.AppendString(CVSTR(", socket "));
+		builder.AppendLong(socketDescriptor);
 	}
 	
 	VString localAddr;
 	if (ILoggerBagKeys::local_addr.Get(inMessage, localAddr))
 	{
-		message.AppendString(CVSTR(", local addr is "));
-		message.AppendString(localAddr);
+		builder.AppendString(CVSTR(", local addr is "));
+		builder.AppendString(localAddr);
 	}
 	
 	VString peerAddr;
 	if (ILoggerBagKeys::peer_addr.Get(inMessage, peerAddr))
 	{
-		message.AppendString(CVSTR(", peer addr is "));
-		message.AppendString(peerAddr);
+		builder.AppendString(CVSTR(", peer addr is "));
+		builder.AppendString(peerAddr);
 	}
 	
 	bool exchangeEndPointID=false;
 	if (ILoggerBagKeys::exchange_id.Get(inMessage, exchangeEndPointID))
 	{
 		if(exchangeEndPointID)
-			message.AppendString(CVSTR(", exchange endpoint id "));
+			builder.AppendString(CVSTR(", exchange endpoint id "));
 		else
-			message.AppendString(CVSTR(", do not exchange endpoint id "));
+			builder.AppendString(CVSTR(", do not exchange endpoint id "));
 	}
 	
 	bool isBlocking=false;
 	if (ILoggerBagKeys::is_blocking.Get(inMessage, isBlocking))
 	{
 		if(isBlocking)
-			message.AppendString(CVSTR(", is blocking "));
+			builder.AppendString(CVSTR(", is blocking "));
 		else
-			message.AppendString(CVSTR(", is not blocking "));
+			builder.AppendString(CVSTR(", is not blocking "));
 	}
 	
 	bool isSSL=false;
 	if (ILoggerBagKeys::is_ssl.Get(inMessage, isSSL))
 	{
 		if(isSSL)
-			message.AppendString(CVSTR(", with SSL "));
+			builder.AppendString(CVSTR(", with SSL "));
 		else
-			message.AppendString(CVSTR(", without SSL"));
+			builder.AppendString(CVSTR(", without SSL"));
 	}
 	
 	bool isSelectIO=false;
 	if (ILoggerBagKeys::is_select_io.Get(inMessage, isSelectIO))
 	{
 		if(isSelectIO)
-			message.AppendString(CVSTR(", with SelectIO "));
+			builder.AppendString(CVSTR(", with SelectIO "));
 		else
-			message.AppendString(CVSTR(", without SelectIO"));
+			builder.AppendString(CVSTR(", without SelectIO"));
 	}
 	
 	sLONG ioTimeout=-1;
 	if (ILoggerBagKeys::ms_timeout.Get(inMessage, ioTimeout))
 	{
-		message.AppendString(CVSTR(", with "));
-		message.AppendLong(ioTimeout);
-		message.AppendString(CVSTR("ms timeout"));
+		builder.AppendString(CVSTR(", with "));
+		builder.AppendLong(ioTimeout);
+		builder.AppendString(CVSTR("ms timeout"));
 	}
 	
 	sLONG askedCount=-1;
 	if (ILoggerBagKeys::count_bytes_asked.Get(inMessage, askedCount))
 	{
-		message.AppendString(CVSTR(", asked for "));
-		message.AppendLong(askedCount);
-		message.AppendString(CVSTR(" byte(s)"));
+		builder.AppendString(CVSTR(", asked for "));
+		builder.AppendLong(askedCount);
+		builder.AppendString(CVSTR(" byte(s)"));
 	}
 	
 	sLONG sentCount=-1;
 	if (ILoggerBagKeys::count_bytes_sent.Get(inMessage, sentCount))
 	{
-		message.AppendString(CVSTR(", sent "));
-		message.AppendLong(sentCount);
-		message.AppendString(CVSTR(" byte(s)"));
+		builder.AppendString(CVSTR(", sent "));
+		builder.AppendLong(sentCount);
+		builder.AppendString(CVSTR(" byte(s)"));
 	}
 	
 	sLONG receivedCount=-1;
 	if (ILoggerBagKeys::count_bytes_received.Get(inMessage, receivedCount))
 	{
-		message.AppendString(CVSTR(", received "));
-		message.AppendLong(receivedCount);
-		message.AppendString(CVSTR(" byte(s)"));
+		builder.AppendString(CVSTR(", received "));
+		builder.AppendLong(receivedCount);
+		builder.AppendString(CVSTR(" byte(s)"));
 	}
 	
 	sLONG ioSpent=-1;
 	if (ILoggerBagKeys::ms_spent.Get(inMessage, ioSpent))
 	{
-		message.AppendString(CVSTR(", done in "));
-		message.AppendLong(ioSpent);
-		message.AppendString(CVSTR("ms"));
+		builder.AppendString(CVSTR(", done in "));
+		builder.AppendLong(ioSpent);
+		builder.AppendString(CVSTR("ms"));
 	}
 	
 	sLONG dumpOffset=-1;
 	if (ILoggerBagKeys::dump_offset.Get(inMessage, dumpOffset))
 	{
-		message.AppendString(CVSTR(", offset "));
-		message.AppendLong(dumpOffset);
+		builder.AppendString(CVSTR(", offset "));
+		builder.AppendLong(dumpOffset);
 	}
 	
 	VString dumpBuffer;
 	if (ILoggerBagKeys::dump_buffer.Get(inMessage, dumpBuffer))
 	{
-		message.AppendString(CVSTR(", data : "));
-		message.AppendString(dumpBuffer);
+		builder.AppendString(CVSTR(", data : "));
+		builder.AppendString(dumpBuffer);
 	}
 	
 	VString fileName;
 	if (ILoggerBagKeys::file_name.Get( inMessage, fileName))
 	{
-		message += ", ";
-		message += fileName;
+		builder += ", ";
+		builder += fileName;
 	}
 
 	sLONG lineNumber;
 	if (ILoggerBagKeys::line_number.Get( inMessage, lineNumber))
 	{
-		message += ", ";
-		message.AppendLong( lineNumber);
+		builder += ", ";
+		builder.AppendLong( lineNumber);
 	}
 	
 	VString stackCrawl;
 	if (ILoggerBagKeys::stack_crawl.Get( inMessage, stackCrawl))
 	{
-		message += ", {";
+		builder += ", {";
 		stackCrawl.ExchangeAll( CVSTR( "\n"), CVSTR( " ; "));
-		message += stackCrawl;
-		message += "}";
+		builder += stackCrawl;
+		builder += "}";
 	}
 
-	Log( loggerID, level, message, NULL);
+	builder.GetString( outMessage);
+}
+
+
+const char* VLog4jMsgFileLogger::GetLevelName( EMessageLevel inLevel)
+{
+	return GetMessageLevelName( inLevel);
 }
 
 
@@ -583,6 +1036,27 @@ void VLog4jMsgFileLogger::Log( const VString& inLoggerID, EMessageLevel inLevel,
 
 void VLog4jMsgFileLogger::Log( const char* inLoggerID, EMessageLevel inLevel, const char* inMessage, VString* outFormattedMessage)
 {
+	if (fQueue != NULL)
+	{
+		// asynchronous: no lock, no formatting, no i/o
+		if (ShouldLog( inLevel))
+		{
+			time_t now = ::time( NULL);
+			if (outFormattedMessage != NULL)
+			{
+				char szTime[512];
+				::strftime( szTime, sizeof( szTime),"%Y-%m-%d %X", ::localtime( &now));
+
+				VStringBuilder builder( 256);
+				builder.AppendCString( szTime).AppendCString( " [").AppendCString( inLoggerID).AppendCString( "] ");
+				builder.AppendCString( GetMessageLevelName( inLevel)).AppendCString( " - ").AppendCString( inMessage).AppendUniChar( '\n');
+				builder.GetString( *outFormattedMessage);
+			}
+			fQueue->Push( inLevel, now, inLoggerID, inMessage);
+		}
+		return;
+	}
+
 	fLock.Lock();
 	if (ShouldLog(inLevel))
 	{
@@ -28,6 +28,11 @@ BEGIN_TOOLBOX_NAMESPACE
 
 
 class VFolder;
+class VBinaryLogWriter;
+
+// Private (see VLogger.cpp)
+class VLogMessageQueue;
+class VLogWriterTask;
 
 
 /** @brief	Splitable log file management (no thread-safe)
@@ -85,6 +90,7 @@ public:
 						CheckLogSize() method is called before append the string so a new log file may be created. */
 			void		AppendFormattedString( const char* inFormat, ...);
 			void		AppendString( const char* inString);
+			void		AppendData( const void* inData, size_t inSize);
 
 			// Accessors
 			FILE*		GetFile() {return fFile;}
@@ -123,6 +129,24 @@ enum
 typedef EMessageLevel ELog4jMessageLevel;
 
 
+/** @brief	What Log() does when the queue of an asynchronous logger is full. */
+typedef enum
+{
+	eLogOverflowWait = 0,	// the logging task waits for the writer task
+	eLogOverflowDrop		// the message is dropped and counted (errors and fatal messages still wait)
+} ELogOverflowPolicy;
+
+
+typedef struct VLogStatistics
+{
+	sLONG8		fQueued;	// messages accepted by Log()
+	sLONG8		fWritten;
+	sLONG8		fDropped;
+	sLONG8		fWaits;		// messages for which a logging task had to wait for room in the queue
+	sLONG8		fBatches;	// writes done by the writer task
+} VLogStatistics;
+
+
 class XTOOLBOX_API VLog4jMsgFileLogger : public VObject, public ILogger, private VSplitableLogFile::IDelegate
 {
 public:
@@ -172,6 +196,11 @@ public:
 			
 	static	void					BuildLogFileName( const VString& inLogName, sLONG inLogNumber, VString& outName);
 
+			/** @brief	Builds the logger id and the text of a message bag as LogBag() writes them.
+						If inWithCurrentTaskName is true and the bag has no task name, the current task name is added. */
+	static	void					BuildMessageFromBag( const VValueBag *inMessage, VString& outLoggerID, VString& outMessage, bool inWithCurrentTaskName);
+	static	const char*				GetLevelName( EMessageLevel inLevel);
+
 			/** @brief	The logger never owns its readers. */
 			void					AttachReader( IReader *inReader);
 			void					DetachReader( IReader *inReader);
@@ -179,7 +208,27 @@ public:
 			void					SetLevelFilter( uLONG inFilter)			{ fFilter = inFilter;}
 			uLONG					GetLevelFilter() const					{ return fFilter;}
 
+			/** @brief	In asynchronous mode Log() only copies the message in a lock-free queue of inCapacity messages.
+						A background task formats and writes them by batches, and splits the log file when needed.
+						Flush() and Stop() wait for the queued messages to be written.
+						Must be called while the logger is stopped. */
+			void					SetAsynchronous( bool inAsynchronous, sLONG inCapacity = 4096, ELogOverflowPolicy inPolicy = eLogOverflowWait);
+			bool					IsAsynchronous() const					{ return fQueue != NULL;}
+
+			/** @brief	Counters of the asynchronous mode (all zeros if synchronous). */
+			void					GetStatistics( VLogStatistics& outStatistics) const;
+
+			/** @brief	Message bags given to LogBag() are recorded in inBinaryLog instead of being formatted as text
+						(see VBinaryLogReader::ConvertToLog4j). Messages given to Log() still go to the text file.
+						Pass NULL to go back to text. The logger never owns the binary log.
+						Flush() and Stop() flush it (Stop() doesn't close it).
+						Must be called while the logger is stopped. */
+			void					SetBinaryLog( VBinaryLogWriter *inBinaryLog);
+			VBinaryLogWriter*		GetBinaryLog() const					{ return fBinaryLog;}
+
 private:
+	friend class VLogWriterTask;
+
 
 			// Inherited from VSplitableLogFile::IDelegate
 	virtual	void					DoCreateNewLogFile( const VString& inFilePath);
@@ -188,6 +237,9 @@ private:
 
 			bool					WithTag(uLONG inTag, bool inFlag);
 
+			// called by the writer task
+			void					_WriteQueuedMessages();
+
 	
 	mutable	VCriticalSection		fLock;
 
@@ -200,6 +252,10 @@ private:
 
 			std::vector<IReader*>	fReaders;
 	mutable	VCriticalSection		fReadersLock;
+
+			VLogMessageQueue*		fQueue;		// NULL if synchronous
+			VLogWriterTask*			fWriter;	// running while started in asynchronous mode
+			VBinaryLogWriter*		fBinaryLog;
 };
 
 
@@ -22,16 +22,6 @@
 #include "VSyncObject.h"
 
 
-class IMessageableCompareTarget
-{
-public:
-	IMessageableCompareTarget( const IMessageable *inTarget):fTarget( inTarget)	{}
-	bool operator() ( const VMessage *inMessage) const		{ return inMessage->GetTarget() == fTarget;}
-
-	const IMessageable *fTarget;
-};
-
-
 VMessagingContext::VMessagingContext(IMessageable *inTarget)
 {
 	fTarget = inTarget;
@@ -66,6 +56,8 @@ VMessage::VMessage()
 , fIsAnswered( false)
 , fIsAborted( false)
 , fContext( NULL)
+, fNextInQueue( NULL)
+, fQueuedSignature( 0)
 {
 }
 
@@ -498,55 +490,125 @@ bool VMessage::DoCoalesce(const VMessage& /*inNewMessage*/)
 
 
 VMessageQueue::VMessageQueue()
+: fIncoming( NULL)
+, fCount( 0)
 {
 	fCriticalSection = new VCriticalSection;
 	fEvent = new VSyncEvent;
+	fCoalescingLock = new VCriticalSection;
 }
 
 
 VMessageQueue::~VMessageQueue()
 {
+	_DrainIncomingMessages();
 	fMessageBox.clear();
 	delete fCriticalSection;
+	delete fCoalescingLock;
 	ReleaseRefCountable( &fEvent);
 }
 
 
+void VMessageQueue::_PushMessage( VMessage* inMessage)
+{
+	inMessage->Retain();
+
+	// count first so that the consumer never sees more messages than counted
+	VInterlocked::Increment( &fCount);
+
+	VMessage *head;
+	do
+	{
+		head = fIncoming;
+		inMessage->fNextInQueue = head;
+	} while( VInterlocked::CompareExchangePtr( (void**) &fIncoming, head, inMessage) != head);
+
+	// optim: if the stack was not empty, no need to set the event because it should be already set.
+	if (head == NULL)
+		fEvent->Unlock();
+}
+
+
+void VMessageQueue::_DrainIncomingMessages()
+{
+	// must be called with fCriticalSection held: it's the single consumer of fIncoming.
+	VMessage *msg = VInterlocked::ExchangePtr( &fIncoming);
+	if (msg == NULL)
+		return;
+
+	// the stack is most recent first: reverse it
+	VMessage *previous = NULL;
+	while( msg != NULL)
+	{
+		VMessage *next = msg->fNextInQueue;
+		msg->fNextInQueue = previous;
+		previous = msg;
+		msg = next;
+	}
+
+	for( msg = previous ; msg != NULL ; )
+	{
+		VMessage *next = msg->fNextInQueue;
+		msg->fNextInQueue = NULL;
+		fMessageBox.push_back( VRefPtr<VMessage>( msg, false));	// adopts the retain done by _PushMessage
+		msg = next;
+	}
+}
+
+
+void VMessageQueue::_Unindex( VMessage* inMessage)
+{
+	if (inMessage->fQueuedSignature == 0)
+		return;
+
+	VTaskLock lock( fCoalescingLock);
+
+	MapOfCoalescingMessages::iterator i = fCoalescingIndex.find( inMessage->fQueuedSignature);
+	if (testAssert( i != fCoalescingIndex.end()))
+	{
+		std::deque<VMessage*>::iterator j = std::find( i->second.begin(), i->second.end(), inMessage);
+		if (testAssert( j != i->second.end()))
+			i->second.erase( j);
+		if (i->second.empty())
+			fCoalescingIndex.erase( i);
+	}
+	inMessage->fQueuedSignature = 0;
+}
+
+
 bool VMessageQueue::AddMessage( VMessage* inMessage)
 {
 	xbox_assert(!inMessage->Answered() /* on envoie un msg deja valide ??? */);
+	xbox_assert(inMessage->fNextInQueue == NULL);
 
 	// process special messages
 	bool isOK = true;
 	
 	OsType signature = inMessage->GetCoalescingSignature();
-	if (signature != 0)
+	if (signature == 0)
 	{
-		VTaskLock lock( fCriticalSection);
-		
-		DequeOfVMessage::iterator i = fMessageBox.begin();
-		for(  ; (i != fMessageBox.end()) && ((*i)->GetCoalescingSignature() != signature) ; ++i)
-			;
-
-		if (i != fMessageBox.end())
-		{
-			VMessage* tocoalesce = *i;
-			// warning: called from inside the task lock! (to avoid Getting this message while processing it)
-			isOK = tocoalesce->DoCoalesce( *inMessage);
-		}
+		inMessage->fQueuedSignature = 0;
+		_PushMessage( inMessage);
 	}
-
-	// push it
-	if (isOK)
+	else
 	{
-		VTaskLock lock( fCriticalSection);
+		VTaskLock lock( fCoalescingLock);
 
 		try
 		{
-			// optim: if the message box was not empty, no need to set the event because it should be already set.
-			if (fMessageBox.empty())
-				fEvent->Unlock();
-			fMessageBox.push_back( inMessage);
+			std::deque<VMessage*>& pending = fCoalescingIndex[signature];
+			if (!pending.empty())
+			{
+				// warning: called from inside the coalescing lock! (to avoid Getting this message while processing it)
+				isOK = pending.front()->DoCoalesce( *inMessage);
+			}
+
+			if (isOK)
+			{
+				pending.push_back( inMessage);
+				inMessage->fQueuedSignature = signature;
+				_PushMessage( inMessage);
+			}
 		}
 		catch(...)
 		{
@@ -558,14 +620,42 @@ bool VMessageQueue::AddMessage( VMessage* inMessage)
 }
 
 
+void VMessageQueue::_ResetEventIfEmpty()
+{
+	if (fMessageBox.empty() && (fIncoming == NULL))
+	{
+		fEvent->Reset();
+
+		// a producer may have pushed on the empty stack just before the reset
+		if (fIncoming != NULL)
+			fEvent->Unlock();
+	}
+}
+
+
 VMessage* VMessageQueue::_RetainFrontMessage()
 {
-	VMessage *msg = fMessageBox.front().Forget();
-	fMessageBox.pop_front();
-	XBOX_ASSERT_VOBJECT( msg);
-	xbox_assert(!msg->Answered() /* on envoie un msg deja executed ??? */);
 	if (fMessageBox.empty())
-		fEvent->Reset();
+		_DrainIncomingMessages();
+
+	VMessage *msg;
+	if (fMessageBox.empty())
+	{
+		msg = NULL;
+	}
+	else
+	{
+		msg = fMessageBox.front().Forget();
+		fMessageBox.pop_front();
+		VInterlocked::Decrement( &fCount);
+		XBOX_ASSERT_VOBJECT( msg);
+		xbox_assert(!msg->Answered() /* on envoie un msg deja executed ??? */);
+
+		// no more coalescing with a message about to be executed
+		_Unindex( msg);
+	}
+
+	_ResetEventIfEmpty();
 	
 	return msg;
 }
@@ -573,9 +663,13 @@ VMessage* VMessageQueue::_RetainFrontMessage()
 
 VMessage* VMessageQueue::RetainMessage()
 {
+	// fast path for idle loops
+	if (fCount <= 0)
+		return NULL;
+
 	VTaskLock lock( fCriticalSection);
 
-	return fMessageBox.empty() ? NULL : _RetainFrontMessage();
+	return _RetainFrontMessage();
 }
 
 
@@ -586,18 +680,27 @@ VMessage* VMessageQueue::RetainMessageWithTimeout( sLONG inTimeoutMilliseconds)
 	
 	VTaskLock lock( fCriticalSection);
 
-	VMessage *msg;
-	if (fMessageBox.empty())
-	{
-		// the event was triggered from the outside, we must reset here ourselves
-		fEvent->Reset();
-		msg = NULL;
-	}
-	else
+	// returns NULL if the event was triggered from the outside (_RetainFrontMessage then resets it)
+	return _RetainFrontMessage();
+}
+
+
+sLONG VMessageQueue::RetainMessages( VMessage **outMessages, sLONG inMaxCount)
+{
+	if (fCount <= 0)
+		return 0;
+
+	VTaskLock lock( fCriticalSection);
+
+	sLONG count = 0;
+	while( count < inMaxCount)
 	{
-		msg = _RetainFrontMessage();
+		VMessage *msg = _RetainFrontMessage();
+		if (msg == NULL)
+			break;
+		outMessages[count++] = msg;
 	}
-	return msg;
+	return count;
 }
 
 
@@ -605,15 +708,25 @@ void VMessageQueue::CancelMessages( IMessageable* inTarget)
 {
 	VTaskLock lock( fCriticalSection);
 
-	DequeOfVMessage::iterator i = std::remove_if( fMessageBox.begin(), fMessageBox.end(), IMessageableCompareTarget( inTarget));
-	
-	for( ; i != fMessageBox.end() ; ++i)
-		(*i)->Abort();
-	
-	fMessageBox.erase( i, fMessageBox.end());
+	_DrainIncomingMessages();
 
-	if (fMessageBox.empty())
-		fEvent->Reset();
+	DequeOfVMessage keptMessages;
+	for( DequeOfVMessage::iterator i = fMessageBox.begin() ; i != fMessageBox.end() ; ++i)
+	{
+		if ((*i)->GetTarget() == inTarget)
+		{
+			_Unindex( *i);
+			(*i)->Abort();
+			VInterlocked::Decrement( &fCount);
+		}
+		else
+		{
+			keptMessages.push_back( *i);
+		}
+	}
+	fMessageBox.swap( keptMessages);
+
+	_ResetEventIfEmpty();
 }
 
 
@@ -621,30 +734,38 @@ void VMessageQueue::CancelMessages()
 {
 	VTaskLock lock( fCriticalSection);
 
+	_DrainIncomingMessages();
+
 	DequeOfVMessage::iterator i = fMessageBox.begin();
 
 	for( ; i != fMessageBox.end() ; ++i)
+	{
+		_Unindex( *i);
 		(*i)->Abort();
+	}
 	
-	fMessageBox.erase( i, fMessageBox.end());
+	VInterlocked::AtomicAdd( &fCount, - (sLONG) fMessageBox.size());
+	fMessageBox.clear();
 
-	if (fMessageBox.empty())
-		fEvent->Reset();
+	_ResetEventIfEmpty();
 }
 
 
 bool VMessageQueue::RemoveMessage( VMessage* inMessage)
 {
 	VTaskLock lock( fCriticalSection);
+
+	_DrainIncomingMessages();
 	
 	DequeOfVMessage::iterator i = std::find( fMessageBox.begin(), fMessageBox.end(), VRefPtr<VMessage>( inMessage));
 
 	bool isFound = (i != fMessageBox.end());
 	if (isFound)
 	{
+		_Unindex( inMessage);
 		fMessageBox.erase( i);
-		if (fMessageBox.empty())
-			fEvent->Reset();
+		VInterlocked::Decrement( &fCount);
+		_ResetEventIfEmpty();
 	}
 
 	return isFound;
@@ -653,8 +774,7 @@ bool VMessageQueue::RemoveMessage( VMessage* inMessage)
 
 sLONG VMessageQueue::CountMessages() const
 {
-	VTaskLock lock( fCriticalSection);
-	return (sLONG) fMessageBox.size();
+	return (fCount > 0) ? fCount : 0;
 }
 
 
@@ -662,6 +782,8 @@ sLONG VMessageQueue::CountMessagesFor(IMessageable* inTarget) const
 {
 	VTaskLock lock( fCriticalSection);
 
+	const_cast<VMessageQueue*>( this)->_DrainIncomingMessages();
+
 	sLONG count = 0;
 	for( DequeOfVMessage::const_iterator i = fMessageBox.begin() ; i != fMessageBox.end() ; ++i)
 	{
@@ -674,9 +796,7 @@ sLONG VMessageQueue::CountMessagesFor(IMessageable* inTarget) const
 
 bool VMessageQueue::IsEmpty() const
 {
-	VTaskLock lock( fCriticalSection);
-	
-	return fMessageBox.empty();
+	return fCount <= 0;
 }
 
 
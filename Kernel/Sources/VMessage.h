@@ -17,6 +17,7 @@
 #define __VMessage__
 
 #include <deque>
+#include <map>
 
 #include "Kernel/Sources/VObject.h"
 #include "Kernel/Sources/IRefCountable.h"
@@ -299,6 +300,9 @@ private:
 			bool	_Send( VMessagingContext* inRetainedContext, sLONG inTimeoutMilliseconds, bool inIndefiniteTimeout);
 			bool	_Post( VMessagingContext* inRetainedContext, bool inSynchronousIfSameTask);
 			VTask*	_InstallContextAndRetainTask( VMessagingContext* inRetainedContext);
+
+			VMessage*	fNextInQueue;			// link in VMessageQueue incoming stack
+			OsType		fQueuedSignature;		// coalescing signature cached by VMessageQueue
 };
 
 
@@ -306,6 +310,14 @@ private:
 	@class	VMessageQueue
 	@abstract	Thread safe queue for VMessage
 	@discussion
+		Producers never lock: AddMessage pushes the message on an intrusive lock-free stack.
+		The consumer moves the whole stack into fMessageBox with one atomic exchange when it needs more messages.
+		fCriticalSection only protects fMessageBox, that is the consumer against CancelMessages, RemoveMessage or CountMessagesFor
+		called from other tasks.
+
+		Messages with a coalescing signature still go through fCoalescingLock
+		and are indexed by signature so that finding the message to coalesce with needs no scan.
+		fCoalescingLock may be taken while holding fCriticalSection, never the other way.
 */
 
 class XTOOLBOX_API VMessageQueue : public VObject
@@ -316,6 +328,10 @@ public:
 	
 			VMessage*			RetainMessage();
 			VMessage*			RetainMessageWithTimeout( sLONG inTimeoutMilliseconds);
+
+	// takes up to inMaxCount messages at once (each one is retained). Returns the number of messages.
+	// Beware messages taken that way can no longer be cancelled by CancelMessages.
+			sLONG				RetainMessages( VMessage **outMessages, sLONG inMaxCount);
 			
 			bool				AddMessage( VMessage* inMessage);
 			bool				RemoveMessage( VMessage* inMessage);
@@ -333,11 +349,21 @@ public:
 			VSyncEvent*			GetSyncEvent() const	{ return fEvent;}
 
 private:
+			typedef std::map<OsType, std::deque<VMessage*> >	MapOfCoalescingMessages;
+
+			void				_PushMessage( VMessage* inMessage);
+			void				_DrainIncomingMessages();
+			void				_ResetEventIfEmpty();
 			VMessage*			_RetainFrontMessage();
+			void				_Unindex( VMessage* inMessage);
 			
+			VMessage*			fIncoming;				// lock-free stack of retained messages, most recent first
+			sLONG				fCount;					// all pending messages (incoming + box)
 			DequeOfVMessage		fMessageBox;
-			VCriticalSection*	fCriticalSection;
+			VCriticalSection*	fCriticalSection;		// protects fMessageBox
 			VSyncEvent*			fEvent;
+			VCriticalSection*	fCoalescingLock;		// protects fCoalescingIndex
+			MapOfCoalescingMessages	fCoalescingIndex;	// pending messages by coalescing signature, oldest first
 };
 
 
@@ -18,6 +18,7 @@
 #include "VTextConverter.h"
 #include "VStream.h"
 #include "VPackedDictionary.h"
+#include "VAtom.h"
 
 
 const uLONG _VHashKeyMap::tag_empty = 0xffffffffu;
@@ -143,9 +144,30 @@ StPackedDictionaryKey::StPackedDictionaryKey( const wchar_t *inKey)
 
 
 StPackedDictionaryKey::StPackedDictionaryKey( const VString& inKey)
-: fKeyBuffer( new char_type[256])
+: fKeyBuffer( NULL)
 , fHashCode(0)
 {
+	_FromString( inKey);
+}
+
+
+StPackedDictionaryKey::StPackedDictionaryKey( const VAtom& inKey)
+: fKey( inKey.GetUTF8())
+, fLength( inKey.GetUTF8Length())
+, fKeyBuffer( NULL)
+, fHashCode( 0)
+{
+	if (fKey == NULL)
+		_FromString( inKey.GetString());	// no utf-8 form: null atom or longer than 255 bytes
+	else
+		fHashCode = GetHashCode( fKey, fLength);
+}
+
+
+void StPackedDictionaryKey::_FromString( const VString& inKey)
+{
+	fKeyBuffer = new char_type[256];
+
 	VFromUnicodeConverter_UTF8 converter;
 	VIndex charsConsumed;
 	VSize bytesProduced;
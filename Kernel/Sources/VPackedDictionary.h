@@ -20,6 +20,8 @@
 
 BEGIN_TOOLBOX_NAMESPACE
 
+class VAtom;
+
 //================================================================================================================
 
 /*
@@ -61,6 +63,7 @@ private:
 		char*		null terminated utf8 string (typically hard-coded C-string)
 		wchar_t*	null terminated wide char string (typically hard-coded C-string with L prefix)
 		VString&	a VString
+		VAtom&		an interned string (no conversion nor copy)
 		
 	Currently, the most optimized data type is char* but that could change in the future.
 	So let the compiler choose what constructor to use and don't use StPackedDictionaryKey directly.
@@ -80,6 +83,7 @@ public:
 	StPackedDictionaryKey( const char *inKey, size_t inLength, bool): fKey( inKey),fLength( inLength),fKeyBuffer(NULL),fHashCode(GetHashCode( inKey, inLength))	{;} // no copy
 	StPackedDictionaryKey( const wchar_t *inKey);
 	StPackedDictionaryKey( const VString& inKey);
+	StPackedDictionaryKey( const VAtom& inKey);	// no copy (uses the atom utf-8 form)
 	StPackedDictionaryKey( const StPackedDictionaryKey& inOther)	{ _CopyFrom( inOther);}
 	~StPackedDictionaryKey()										{ delete [] fKeyBuffer;}
 
@@ -110,6 +114,7 @@ public:
 
 private:
 				void				_CopyFrom( const StPackedDictionaryKey& inOther);
+				void				_FromString( const VString& inKey);
 				
 			const char_type*				fKey;
 			size_t							fLength;
@@ -0,0 +1,106 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VParallel.h"
+
+
+// Class constants
+const sLONG	kCHUNKS_PER_WORKER		= 4;	// for automatic grain size: leaves room for load balancing
+const sLONG	kMAX_CHUNKS_PER_WORKER	= 64;	// caps the number of jobs for tiny grain sizes
+
+
+BEGIN_TOOLBOX_NAMESPACE
+
+class VParallelRangeJob : public VJob
+{
+public:
+								VParallelRangeJob( IParallelRange *inBody, sLONG inBegin, sLONG inEnd)
+									: fBody( inBody), fBegin( inBegin), fEnd( inEnd)		{;}
+
+	virtual	void				DoExecute()													{ fBody->Run( fBegin, fEnd);}
+
+			IParallelRange*		fBody;
+			sLONG				fBegin;
+			sLONG				fEnd;
+};
+
+END_TOOLBOX_NAMESPACE
+
+
+sLONG VParallel::GetChunkCount( sLONG inCount, sLONG inGrainSize, VExecutor *inExecutor)
+{
+	if ( (inCount <= 1) || (inExecutor == NULL) || inExecutor->IsShutDown())
+		return 1;
+
+	sLONG workers = inExecutor->GetWorkerCount();
+	if (workers <= 1)
+		return 1;
+
+	sLONG count;
+	if (inGrainSize <= 0)
+		count = workers * kCHUNKS_PER_WORKER;
+	else
+		count = (sLONG) (((sLONG8) inCount + inGrainSize - 1) / inGrainSize);
+
+	if (count > workers * kMAX_CHUNKS_PER_WORKER)
+		count = workers * kMAX_CHUNKS_PER_WORKER;
+	if (count > inCount)
+		count = inCount;
+
+	return (count > 1) ? count : 1;
+}
+
+
+void VParallel::ForRange( sLONG inBegin, sLONG inEnd, IParallelRange& inBody, sLONG inGrainSize, VExecutor *inExecutor)
+{
+	if (inEnd <= inBegin)
+		return;
+
+	if (inExecutor == NULL)
+		inExecutor = VExecutor::GetShared();
+
+	sLONG count = inEnd - inBegin;
+	sLONG chunks = GetChunkCount( count, inGrainSize, inExecutor);
+	if (chunks <= 1)
+	{
+		inBody.Run( inBegin, inEnd);
+		return;
+	}
+
+	std::vector<VParallelRangeJob*> jobs;
+	jobs.reserve( chunks - 1);
+	for( sLONG i = 1 ; i < chunks ; ++i)
+	{
+		sLONG begin = inBegin + (sLONG) (((sLONG8) count * i) / chunks);
+		sLONG end = inBegin + (sLONG) (((sLONG8) count * (i + 1)) / chunks);
+		VParallelRangeJob *job = new VParallelRangeJob( &inBody, begin, end);
+		inExecutor->Submit( job);
+		jobs.push_back( job);
+	}
+
+	inBody.Run( inBegin, inBegin + (sLONG) (count / chunks));
+
+	for( std::vector<VParallelRangeJob*>::iterator i = jobs.begin() ; i != jobs.end() ; ++i)
+	{
+		(*i)->Wait();
+
+		// the executor may have been shut down meanwhile
+		if ((*i)->GetState() == eJobCancelled)
+			inBody.Run( (*i)->fBegin, (*i)->fEnd);
+
+		(*i)->Release();
+	}
+}
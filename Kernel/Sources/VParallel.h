@@ -0,0 +1,264 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VParallel__
+#define __VParallel__
+
+#include <algorithm>
+
+#include "Kernel/Sources/VExecutor.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+
+/*!
+	@class	IParallelRange
+	@abstract	Body of VParallel::ForRange.
+	@discussion
+		Run() is called concurrently on disjoint sub ranges [inBegin, inEnd[.
+*/
+class XTOOLBOX_API IParallelRange
+{
+public:
+	virtual						~IParallelRange()						{;}
+	virtual	void				Run( sLONG inBegin, sLONG inEnd) = 0;
+};
+
+
+template<class BODY>
+class VParallelRangeAdapter : public IParallelRange
+{
+public:
+								VParallelRangeAdapter( const BODY& inBody):fBody( inBody)	{;}
+	virtual	void				Run( sLONG inBegin, sLONG inEnd)							{ fBody( inBegin, inEnd);}
+
+private:
+								VParallelRangeAdapter( const VParallelRangeAdapter&);
+			VParallelRangeAdapter&	operator=( const VParallelRangeAdapter&);
+
+			const BODY&			fBody;
+};
+
+
+/*!
+	@class	VParallel
+	@abstract	Data parallel algorithms running on a VExecutor (default is VExecutor::GetShared()).
+	@discussion
+		The range is cut into chunks of at least inGrainSize items (0 means automatic: a few chunks per worker).
+		The calling task runs the first chunk itself and then waits for the others, helping the pool if it's one of its workers.
+		If the executor is shut down, everything runs in the calling task.
+
+		Bodies are functors taking a [begin, end[ range:
+
+		class MyBody
+		{
+		public:
+			void operator()( sLONG inBegin, sLONG inEnd) const { ... }
+		};
+
+		VParallel::For( 0, count, MyBody());
+*/
+class XTOOLBOX_API VParallel
+{
+public:
+	// inBody( begin, end) is called concurrently on disjoint sub ranges of [inBegin, inEnd[.
+	template<class BODY>
+	static	void				For( sLONG inBegin, sLONG inEnd, const BODY& inBody, sLONG inGrainSize = 0, VExecutor *inExecutor = NULL)
+								{
+									VParallelRangeAdapter<BODY> adapter( inBody);
+									ForRange( inBegin, inEnd, adapter, inGrainSize, inExecutor);
+								}
+
+	static	void				ForRange( sLONG inBegin, sLONG inEnd, IParallelRange& inBody, sLONG inGrainSize = 0, VExecutor *inExecutor = NULL);
+
+	/*
+		inBody.Map( begin, end) computes the partial result of a sub range,
+		inBody.Join( a, b) combines two partial results (a being the one of the lower range).
+		Partial results are joined in range order so the result doesn't depend on the number of workers
+		as long as Join is associative.
+	*/
+	template<class T, class BODY>
+	static	T					Reduce( sLONG inBegin, sLONG inEnd, const T& inIdentity, const BODY& inBody, sLONG inGrainSize = 0, VExecutor *inExecutor = NULL)
+								{
+									if (inEnd <= inBegin)
+										return inIdentity;
+									if (inExecutor == NULL)
+										inExecutor = VExecutor::GetShared();
+
+									sLONG count = GetChunkCount( inEnd - inBegin, inGrainSize, inExecutor);
+									std::vector<T> partials( count, inIdentity);
+									For( 0, count, _MapChunks<T,BODY>( inBegin, inEnd, count, inBody, &partials[0]), 1, inExecutor);
+
+									T result( partials[0]);
+									for( sLONG i = 1 ; i < count ; ++i)
+										result = inBody.Join( result, partials[i]);
+									return result;
+								}
+
+	/*
+		Stable merge sort.
+		Runs are sorted concurrently with std::stable_sort then merged pairwise, each merge being split on binary searched pivots
+		so that all workers are busy until the last pass. Needs a temporary buffer of inCount items.
+	*/
+	template<class T, class LESS>
+	static	void				Sort( T *inBase, sLONG inCount, LESS inLess, VExecutor *inExecutor = NULL)
+								{
+									if (inExecutor == NULL)
+										inExecutor = VExecutor::GetShared();
+
+									sLONG runs = (inCount >= 2 * kMIN_SORT_RUN_SIZE) ? GetChunkCount( inCount, kMIN_SORT_RUN_SIZE, inExecutor) : 1;
+									if (runs <= 1)
+									{
+										std::stable_sort( inBase, inBase + inCount, inLess);
+										return;
+									}
+
+									std::vector<sLONG> bounds( runs + 1);
+									for( sLONG i = 0 ; i <= runs ; ++i)
+										bounds[i] = (sLONG) (((sLONG8) inCount * i) / runs);
+
+									For( 0, runs, _SortRuns<T,LESS>( inBase, &bounds[0], inLess), 1, inExecutor);
+
+									std::vector<T> buffer( inCount);
+									T *source = inBase;
+									T *destination = &buffer[0];
+									for( sLONG width = 1 ; width < runs ; width *= 2)
+									{
+										sLONG pairs = (runs + 2 * width - 1) / (2 * width);
+										sLONG segments = std::max<sLONG>( 1, runs / pairs);
+										For( 0, pairs * segments, _MergeRuns<T,LESS>( source, destination, &bounds[0], runs, width, segments, inLess), 1, inExecutor);
+										std::swap( source, destination);
+									}
+
+									if (source != inBase)
+										For( 0, inCount, _Copy<T>( source, inBase), kMIN_SORT_RUN_SIZE, inExecutor);
+								}
+
+	// number of chunks ForRange would use for inCount items
+	static	sLONG				GetChunkCount( sLONG inCount, sLONG inGrainSize, VExecutor *inExecutor);
+
+	enum {
+		kMIN_SORT_RUN_SIZE		= 4096		// smaller arrays are not worth dispatching
+	};
+
+private:
+	template<class T, class BODY>
+	class _MapChunks
+	{
+	public:
+		_MapChunks( sLONG inBegin, sLONG inEnd, sLONG inChunkCount, const BODY& inBody, T *outPartials)
+			: fBegin( inBegin), fCount( inEnd - inBegin), fChunkCount( inChunkCount), fBody( inBody), fPartials( outPartials)	{;}
+
+		void operator()( sLONG inFirstChunk, sLONG inEndChunk) const
+		{
+			for( sLONG i = inFirstChunk ; i < inEndChunk ; ++i)
+			{
+				sLONG begin = fBegin + (sLONG) (((sLONG8) fCount * i) / fChunkCount);
+				sLONG end = fBegin + (sLONG) (((sLONG8) fCount * (i + 1)) / fChunkCount);
+				fPartials[i] = fBody.Map( begin, end);
+			}
+		}
+
+		sLONG			fBegin;
+		sLONG			fCount;
+		sLONG			fChunkCount;
+		const BODY&		fBody;
+		T*				fPartials;
+	};
+
+	template<class T, class LESS>
+	class _SortRuns
+	{
+	public:
+		_SortRuns( T *inBase, const sLONG *inBounds, LESS inLess):fBase( inBase), fBounds( inBounds), fLess( inLess)	{;}
+
+		void operator()( sLONG inFirstRun, sLONG inEndRun) const
+		{
+			for( sLONG i = inFirstRun ; i < inEndRun ; ++i)
+				std::stable_sort( fBase + fBounds[i], fBase + fBounds[i+1], fLess);
+		}
+
+		T*				fBase;
+		const sLONG*	fBounds;
+		LESS			fLess;
+	};
+
+	// merges runs [2p*width, (2p+1)*width[ and [(2p+1)*width, (2p+2)*width[ for each pair p.
+	// each merge is cut into segments: the left run is split evenly and the matching right run split points are found with lower_bound,
+	// which keeps the merge stable (equal items of the left run go first).
+	template<class T, class LESS>
+	class _MergeRuns
+	{
+	public:
+		_MergeRuns( const T *inSource, T *inDestination, const sLONG *inBounds, sLONG inRunCount, sLONG inWidth, sLONG inSegments, LESS inLess)
+			: fSource( inSource), fDestination( inDestination), fBounds( inBounds), fRunCount( inRunCount), fWidth( inWidth), fSegments( inSegments), fLess( inLess)	{;}
+
+		void operator()( sLONG inBegin, sLONG inEnd) const
+		{
+			for( sLONG i = inBegin ; i < inEnd ; ++i)
+			{
+				sLONG pair = i / fSegments;
+				sLONG segment = i % fSegments;
+
+				sLONG lo = fBounds[std::min( 2 * pair * fWidth, fRunCount)];
+				sLONG mid = fBounds[std::min( (2 * pair + 1) * fWidth, fRunCount)];
+				sLONG hi = fBounds[std::min( (2 * pair + 2) * fWidth, fRunCount)];
+
+				sLONG leftStart = lo + (sLONG) (((sLONG8) (mid - lo) * segment) / fSegments);
+				sLONG leftEnd = lo + (sLONG) (((sLONG8) (mid - lo) * (segment + 1)) / fSegments);
+				sLONG rightStart = (segment == 0) ? mid : _SplitRight( leftStart, mid, hi);
+				sLONG rightEnd = (segment == fSegments - 1) ? hi : _SplitRight( leftEnd, mid, hi);
+
+				std::merge( fSource + leftStart, fSource + leftEnd, fSource + rightStart, fSource + rightEnd, fDestination + leftStart + (rightStart - mid), fLess);
+			}
+		}
+
+	private:
+		sLONG _SplitRight( sLONG inLeftIndex, sLONG inMid, sLONG inHi) const
+		{
+			if (inLeftIndex >= inMid)
+				return inHi;
+			return (sLONG) (std::lower_bound( fSource + inMid, fSource + inHi, fSource[inLeftIndex], fLess) - fSource);
+		}
+
+		const T*		fSource;
+		T*				fDestination;
+		const sLONG*	fBounds;
+		sLONG			fRunCount;
+		sLONG			fWidth;
+		sLONG			fSegments;
+		LESS			fLess;
+	};
+
+	template<class T>
+	class _Copy
+	{
+	public:
+		_Copy( const T *inSource, T *inDestination):fSource( inSource), fDestination( inDestination)	{;}
+
+		void operator()( sLONG inBegin, sLONG inEnd) const
+		{
+			std::copy( fSource + inBegin, fSource + inEnd, fDestination + inBegin);
+		}
+
+		const T*		fSource;
+		T*				fDestination;
+	};
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
@@ -23,6 +23,9 @@
 #include "VErrorContext.h"
 #include "VMemory.h"
 #include "VMemoryCpp.h"
+#include "VExecutor.h"
+#include "VFileIOEngine.h"
+#include "VRegexMatcher.h"
 #include "VProgressIndicator.h"
 #include "VTextConverter.h"
 #include "ILogger.h"
@@ -215,6 +218,8 @@ void VProcess::_DeInit()
 #endif
 	
 	ReleaseRefCountable( &fLogger);
+	VFileIOEngine::DeInit();	// its completions go to the shared executor
+	VExecutor::DeInit();
 	VErrorBase::DeInit();
 	VTaskMgr::DeInit();
 #if WITH_RESOURCE_FILE
@@ -223,6 +228,9 @@ void VProcess::_DeInit()
 	VFileKindManager::DeInit();
 	VFile::DeInit();
 	VProgressManager::Deinit();
+#if USE_ICU
+	VRegexMatcher::DeInit();
+#endif
 	XBOX::ReleaseRefCountable( &fIntlManager);
 }
 
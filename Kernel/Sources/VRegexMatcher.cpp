@@ -17,14 +17,140 @@
 
 #if USE_ICU
 #include "unicode/regex.h"
+#include <list>
 
 #include "VString.h"
 #include "VValueBag.h"
 #include "VError.h"
+#include "VSyncObject.h"
+#include "VString_ExtendedSTL.h"
 #include "VRegexMatcher.h"
 
+
+// Class constants
+const size_t	kMAX_CACHED_PATTERNS		= 256;
+const VIndex	kMIN_LITERAL_LENGTH			= 2;
+
+
 BEGIN_TOOLBOX_NAMESPACE
 
+/*
+	A compiled pattern shared by all the matchers created from it.
+	RegexPattern is thread safe, RegexMatcher is not.
+*/
+class VRegexPattern : public VObject, public IRefCountable
+{
+public:
+									VRegexPattern( RegexPattern *inPattern, RegexOptions inOptions):fPattern( inPattern), fOptions( inOptions)	{;}
+
+			RegexPattern*			fPattern;
+			RegexOptions			fOptions;
+
+private:
+									~VRegexPattern()		{ delete fPattern;}
+};
+
+
+class VRegexPatternCache
+{
+public:
+	static	VRegexPattern*			RetainPattern( const VString& inPattern, RegexOptions inOptions, UErrorCode& ioStatus);
+	static	void					Clear();
+	static	void					DeInit();
+
+private:
+	typedef std::pair<VString,VRegexPattern*>					Entry;	// key and pattern
+	typedef std::list<Entry>									ListOfEntry;
+	typedef unordered_map_VString<ListOfEntry::iterator>		MapOfEntry;
+
+	static	void					_MakeKey( const VString& inPattern, RegexOptions inOptions, VString& outKey);
+
+	static	VCriticalSection*		_GetLock();
+
+	static	ListOfEntry*			sEntries;	// most recently used first
+	static	MapOfEntry*				sMap;
+	static	VCriticalSection*		sLock;
+	static	SpinLockType			sLockCreation;
+};
+
+
+VRegexPatternCache::ListOfEntry*	VRegexPatternCache::sEntries = NULL;
+VRegexPatternCache::MapOfEntry*		VRegexPatternCache::sMap = NULL;
+VCriticalSection*					VRegexPatternCache::sLock = NULL;
+SpinLockType						VRegexPatternCache::sLockCreation = 0;
+
+
+static uint32_t _GetICUFlags( RegexOptions inOptions)
+{
+	uint32_t flags = 0;
+	if (inOptions & RGX_CaseInsensitive)
+		flags |= UREGEX_CASE_INSENSITIVE;
+	if (inOptions & RGX_MultiLine)
+		flags |= UREGEX_MULTILINE;
+	if (inOptions & RGX_DotAll)
+		flags |= UREGEX_DOTALL;
+	if (inOptions & RGX_Comments)
+		flags |= UREGEX_COMMENTS;
+	return flags;
+}
+
+
+/*
+	Literal that any match must contain: the beginning of the pattern up to the first meta char.
+	Left empty when not sure (alternatives, options changing the meaning of chars).
+*/
+static void _GetRequiredLiteral( const VString& inPattern, RegexOptions inOptions, VString& outLiteral)
+{
+	outLiteral.Clear();
+
+	if ( (inOptions & (RGX_CaseInsensitive | RGX_Comments)) != 0)
+		return;
+
+	const UniChar *p = inPattern.GetCPointer();
+	const UniChar *end = p + inPattern.GetLength();
+
+	for( const UniChar *q = p ; q != end ; ++q)
+	{
+		if (*q == CHAR_VERTICAL_LINE)
+			return;
+	}
+
+	if ( (p != end) && (*p == CHAR_CIRCUMFLEX_ACCENT) )
+		++p;
+
+	while( p != end)
+	{
+		UniChar c = *p;
+		const UniChar *next = p + 1;
+
+		if ( (c >= 0xD800) && (c <= 0xDFFF) )
+			break;	// a quantifier would apply to the whole surrogate pair
+		
+		if (c == CHAR_REVERSE_SOLIDUS)
+		{
+			// escaped ascii punctuation only
+			if ( (next == end) || (*next >= 128) || ::isalnum( *next) )
+				break;
+			c = *next++;
+		}
+		else if ( (c < 128) && (::strchr( ".[](){}*+?^$#", (char) c) != NULL) )
+		{
+			break;
+		}
+
+		// a quantifier makes this char optional
+		if ( (next != end) && ((*next == CHAR_ASTERISK) || (*next == CHAR_QUESTION_MARK) || (*next == CHAR_LEFT_CURLY_BRACKET)) )
+			break;
+
+		outLiteral.AppendUniChar( c);
+		p = next;
+	}
+
+	if (outLiteral.GetLength() < kMIN_LITERAL_LENGTH)
+		outLiteral.Clear();
+}
+
+
 static void _CheckError( const VString& inPattern, UErrorCode inStatus, VError *outError)
 {
 	if (outError != NULL)
@@ -48,20 +174,156 @@ static void _CheckError( const VString& inPattern, UErrorCode inStatus, VError *
 }
 
 
+//================================================================================================================
+
+
+VCriticalSection *VRegexPatternCache::_GetLock()
+{
+	// sLock is published last so that sEntries and sMap are valid for whoever sees it
+	VCriticalSection *lock = (VCriticalSection*) VInterlocked::CompareExchangePtr( (void**) &sLock, NULL, NULL);
+	if (lock == NULL)
+	{
+		SpinLockThread( sLockCreation);
+		lock = sLock;
+		if (lock == NULL)
+		{
+			sEntries = new ListOfEntry;
+			sMap = new MapOfEntry;
+			lock = new VCriticalSection;
+			VInterlocked::ExchangePtr( &sLock, lock);
+		}
+		SpinUnlock( sLockCreation);
+	}
+	return lock;
+}
+
+
+void VRegexPatternCache::_MakeKey( const VString& inPattern, RegexOptions inOptions, VString& outKey)
+{
+	outKey.Clear();
+	outKey.AppendLong( (sLONG) inOptions);
+	outKey.AppendUniChar( CHAR_COLON);
+	outKey.AppendString( inPattern);
+}
+
+
+VRegexPattern *VRegexPatternCache::RetainPattern( const VString& inPattern, RegexOptions inOptions, UErrorCode& ioStatus)
+{
+	VString key;
+	_MakeKey( inPattern, inOptions, key);
+
+	VCriticalSection *lock = _GetLock();
+
+	VRegexPattern *pattern = NULL;
+	{
+		StLocker<VCriticalSection> locker( lock);
+		MapOfEntry::iterator i = sMap->find( key);
+		if (i != sMap->end())
+		{
+			sEntries->splice( sEntries->begin(), *sEntries, i->second);
+			pattern = RetainRefCountable( i->second->second);
+		}
+	}
+
+	if (pattern == NULL)
+	{
+		// compile out of the lock
+		xbox_icu::UnicodeString string( FALSE, inPattern.GetCPointer(), inPattern.GetLength());
+		RegexPattern *icu_pattern = RegexPattern::compile( string, _GetICUFlags( inOptions), ioStatus);
+		if (!U_SUCCESS( ioStatus))
+		{
+			delete icu_pattern;
+			return NULL;
+		}
+
+		pattern = new VRegexPattern( icu_pattern, inOptions);
+
+		StLocker<VCriticalSection> locker( lock);
+		MapOfEntry::iterator i = sMap->find( key);
+		if (i != sMap->end())
+		{
+			// compiled by another thread meanwhile
+			ReleaseRefCountable( &pattern);
+			pattern = RetainRefCountable( i->second->second);
+		}
+		else
+		{
+			sEntries->push_front( Entry( key, RetainRefCountable( pattern)));
+			(*sMap)[key] = sEntries->begin();
+
+			if (sMap->size() > kMAX_CACHED_PATTERNS)
+			{
+				sMap->erase( sEntries->back().first);
+				sEntries->back().second->Release();
+				sEntries->pop_back();
+			}
+		}
+	}
+
+	return pattern;
+}
+
+
+void VRegexPatternCache::Clear()
+{
+	if (sLock != NULL)
+	{
+		StLocker<VCriticalSection> locker( sLock);
+		for( ListOfEntry::iterator i = sEntries->begin() ; i != sEntries->end() ; ++i)
+			i->second->Release();
+		sEntries->clear();
+		sMap->clear();
+	}
+}
+
+
+void VRegexPatternCache::DeInit()
+{
+	Clear();
+
+	SpinLockThread( sLockCreation);
+	VCriticalSection *lock = VInterlocked::ExchangePtr( &sLock, (VCriticalSection*) NULL);
+	delete sEntries;
+	delete sMap;
+	delete lock;
+	sEntries = NULL;
+	sMap = NULL;
+	SpinUnlock( sLockCreation);
+}
+
+
+//================================================================================================================
+
+
+VRegexMatcher::VRegexMatcher( const VString& inPattern, VRegexPattern *inCompiledPattern, xbox_icu::RegexMatcher *inMatcher)
+: fMatcher( inMatcher)
+, fPattern( inPattern)
+, fCompiledPattern( RetainRefCountable( inCompiledPattern))
+{
+}
+
+
 VRegexMatcher::~VRegexMatcher()
 {
 	delete fMatcher;
+	ReleaseRefCountable( &fCompiledPattern);
 }
 
 
 VRegexMatcher *VRegexMatcher::Create( const VString& inPattern, VError *outError)
+{
+	return Create( inPattern, 0, outError);
+}
+
+
+VRegexMatcher *VRegexMatcher::Create( const VString& inPattern, RegexOptions inOptions, VError *outError)
 {
 	UErrorCode status = U_ZERO_ERROR;
 	
 	VRegexMatcher *matcher;
 	
-	xbox_icu::UnicodeString string( FALSE, inPattern.GetCPointer(), inPattern.GetLength());
-    RegexMatcher *icu_matcher = new RegexMatcher( string, 0 /*flags*/, status);
+	VRegexPattern *compiledPattern = VRegexPatternCache::RetainPattern( inPattern, inOptions, status);
+	RegexMatcher *icu_matcher = (compiledPattern != NULL) ? compiledPattern->fPattern->matcher( status) : NULL;
 
 	if ( !U_SUCCESS( status) )
 	{
@@ -73,13 +335,46 @@ VRegexMatcher *VRegexMatcher::Create( const VString& inPattern, VError *outError
 	}
 	else
 	{
-		matcher = new VRegexMatcher( inPattern, icu_matcher);
+		matcher = new VRegexMatcher( inPattern, compiledPattern, icu_matcher);
 	}
 
+	ReleaseRefCountable( &compiledPattern);
+
 	return matcher;
 }
 
 
+VRegexMatcher *VRegexMatcher::Clone() const
+{
+	UErrorCode status = U_ZERO_ERROR;
+	RegexMatcher *icu_matcher = fCompiledPattern->fPattern->matcher( status);
+	if (!U_SUCCESS( status))
+	{
+		delete icu_matcher;
+		return NULL;
+	}
+	return new VRegexMatcher( fPattern, fCompiledPattern, icu_matcher);
+}
+
+
+RegexOptions VRegexMatcher::GetOptions() const
+{
+	return fCompiledPattern->fOptions;
+}
+
+
+void VRegexMatcher::ClearCache()
+{
+	VRegexPatternCache::Clear();
+}
+
+
+void VRegexMatcher::DeInit()
+{
+	VRegexPatternCache::DeInit();
+}
+
+
 bool VRegexMatcher::Find( const VString& inText, VIndex inStart, bool inContinueSearching, VError *outError)
 {
 	UErrorCode status = U_ZERO_ERROR;
@@ -132,6 +427,105 @@ bool VRegexMatcher::IsSamePattern( const VString& inPattern) const
 	return (inPattern.GetLength() == fPattern.GetLength()) && (::memcmp( inPattern.GetCPointer(), fPattern.GetCPointer(), inPattern.GetLength()*sizeof(UniChar)) == 0);
 }
 
+//================================================================================================================
+
+
+VRegexMatcherSet::VRegexMatcherSet()
+{
+}
+
+
+VRegexMatcherSet::~VRegexMatcherSet()
+{
+	for( std::vector<Entry>::iterator i = fEntries.begin() ; i != fEntries.end() ; ++i)
+		i->fMatcher->Release();
+}
+
+
+VIndex VRegexMatcherSet::AddPattern( const VString& inPattern, RegexOptions inOptions, VError *outError)
+{
+	VRegexMatcher *matcher = VRegexMatcher::Create( inPattern, inOptions, outError);
+	if (matcher == NULL)
+		return -1;
+
+	Entry entry;
+	entry.fMatcher = matcher;
+	_GetRequiredLiteral( inPattern, inOptions, entry.fLiteral);
+	fEntries.push_back( entry);
+
+	return (VIndex) fEntries.size() - 1;
+}
+
+
+VRegexMatcherSet *VRegexMatcherSet::Clone() const
+{
+	VRegexMatcherSet *set = new VRegexMatcherSet;
+	if (set != NULL)
+	{
+		set->fEntries.reserve( fEntries.size());
+		for( std::vector<Entry>::const_iterator i = fEntries.begin() ; i != fEntries.end() ; ++i)
+		{
+			Entry entry;
+			entry.fMatcher = i->fMatcher->Clone();
+			entry.fLiteral = i->fLiteral;
+			if (entry.fMatcher == NULL)
+			{
+				set->Release();
+				return NULL;
+			}
+			set->fEntries.push_back( entry);
+		}
+	}
+	return set;
+}
+
+
+bool VRegexMatcherSet::_Find( const Entry& inEntry, const VString& inText, VError *outError)
+{
+	if (!inEntry.fLiteral.IsEmpty() && (VString::FindRawString( inText.GetCPointer(), inText.GetLength(), inEntry.fLiteral.GetCPointer(), inEntry.fLiteral.GetLength()) <= 0))
+		return false;
+
+	return inEntry.fMatcher->Find( inText, 1, true, outError);
+}
+
+
+bool VRegexMatcherSet::FindAll( const VString& inText, std::vector<VIndex>& outIndexes, VError *outError)
+{
+	outIndexes.clear();
+
+	VError err = VE_OK;
+	for( std::vector<Entry>::const_iterator i = fEntries.begin() ; (i != fEntries.end()) && (err == VE_OK) ; ++i)
+	{
+		if (_Find( *i, inText, &err))
+			outIndexes.push_back( (VIndex) (i - fEntries.begin()));
+	}
+
+	if (outError != NULL)
+		*outError = err;
+
+	return !outIndexes.empty();
+}
+
+
+VIndex VRegexMatcherSet::FindFirst( const VString& inText, VError *outError)
+{
+	VError err = VE_OK;
+	VIndex found = -1;
+	for( std::vector<Entry>::const_iterator i = fEntries.begin() ; (i != fEntries.end()) && (err == VE_OK) ; ++i)
+	{
+		if (_Find( *i, inText, &err))
+		{
+			found = (VIndex) (i - fEntries.begin());
+			break;
+		}
+	}
+
+	if (outError != NULL)
+		*outError = err;
+
+	return found;
+}
+
 END_TOOLBOX_NAMESPACE
 
 #endif
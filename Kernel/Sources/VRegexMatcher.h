@@ -24,10 +24,36 @@ namespace xbox_icu
 
 BEGIN_TOOLBOX_NAMESPACE
 
+class VRegexPattern;
+
+
+/**
+	VRegexMatcher options
+**/
+enum
+{
+	RGX_CaseInsensitive	= 1,	// UREGEX_CASE_INSENSITIVE
+	RGX_MultiLine		= 2,	// ^ and $ also match at line ends (UREGEX_MULTILINE)
+	RGX_DotAll			= 4,	// . matches line ends (UREGEX_DOTALL)
+	RGX_Comments		= 8		// white spaces and #comments are ignored in the pattern (UREGEX_COMMENTS)
+};
+typedef uLONG	RegexOptions;
+
+
+/*
+	Compiled patterns are kept in a process-wide cache (most recently used first, bounded)
+	so that creating a matcher for a pattern already seen doesn't compile it again.
+
+	A VRegexMatcher holds its own match state and must be used by one thread at a time.
+	Use Clone() to get another matcher on the same compiled pattern for another thread.
+*/
 class XTOOLBOX_API VRegexMatcher : public VObject, public IRefCountable
 {
 public:
 	static	VRegexMatcher*			Create( const VString& inPattern, VError *outError);
+	static	VRegexMatcher*			Create( const VString& inPattern, RegexOptions inOptions, VError *outError);
+
+			VRegexMatcher*			Clone() const;
 
 			bool					Find( const VString& inText, VIndex inStart, bool inContinueSearching, VError *outError);
 
@@ -37,13 +63,68 @@ public:
 			VIndex					GetGroupLength( VIndex inGroupIndex) const;
 			
 			bool					IsSamePattern( const VString& inPattern) const;
+			const VString&			GetPattern() const		{ return fPattern;}
+			RegexOptions			GetOptions() const;
+
+			// flush the compiled patterns cache
+	static	void					ClearCache();
+
+			// flush the cache and free it (called by VProcess)
+	static	void					DeInit();
 
 private:
-									VRegexMatcher( const VString& inPattern, xbox_icu::RegexMatcher *inMatcher):fPattern( inPattern), fMatcher( inMatcher) {;}
+									VRegexMatcher( const VString& inPattern, VRegexPattern *inCompiledPattern, xbox_icu::RegexMatcher *inMatcher);
 									~VRegexMatcher();
 
 			xbox_icu::RegexMatcher*		fMatcher;
 			VString					fPattern;
+			VRegexPattern*			fCompiledPattern;	// the icu matcher points to its pattern
+};
+
+
+/*
+	Tests a text against a list of patterns.
+
+	ICU has no multi-pattern engine so each pattern still runs on its own,
+	but patterns starting with a literal (like "/api/users/[0-9]+") are skipped
+	without running the regex engine when the text doesn't contain it.
+	This is the common case for url routes and log filters.
+
+	Like VRegexMatcher, a set must be used by one thread at a time (see Clone).
+*/
+class XTOOLBOX_API VRegexMatcherSet : public VObject, public IRefCountable
+{
+public:
+									VRegexMatcherSet();
+
+			// returns the 0-based index of the pattern or -1
+			VIndex					AddPattern( const VString& inPattern, RegexOptions inOptions, VError *outError);
+			VIndex					GetCount() const		{ return (VIndex) fEntries.size();}
+			VRegexMatcher*			GetMatcher( VIndex inIndex) const	{ return fEntries[inIndex].fMatcher;}
+
+			VRegexMatcherSet*		Clone() const;
+
+			// indexes of all the patterns found in inText, in the order they were added
+			bool					FindAll( const VString& inText, std::vector<VIndex>& outIndexes, VError *outError);
+
+			// index of the first added pattern found in inText or -1.
+			// GetMatcher() of this index gives the groups.
+			VIndex					FindFirst( const VString& inText, VError *outError);
+
+private:
+	struct Entry
+	{
+		VRegexMatcher*	fMatcher;
+		VString			fLiteral;	// a match always contains it
+	};
+
+									VRegexMatcherSet( const VRegexMatcherSet&);
+									~VRegexMatcherSet();
+			VRegexMatcherSet&		operator=( const VRegexMatcherSet&);
+
+			bool					_Find( const Entry& inEntry, const VString& inText, VError *outError);
+
+			std::vector<Entry>		fEntries;
 };
 
 END_TOOLBOX_NAMESPACE
@@ -51,4 +132,3 @@ END_TOOLBOX_NAMESPACE
 #endif	// if icu
 
 #endif
-
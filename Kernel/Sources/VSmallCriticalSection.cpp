@@ -20,6 +20,158 @@
 #include "VSyncObject.h"
 
 
+#if VERSION_LINUX
+
+// On linux, both critical sections are built on a futex word (cf XLinuxFutex) and never allocate a VSyncEvent.
+// Recursive ownership is handled by fOwner/fUseCount which are only written by the owner task.
+
+VNonVirtualCriticalSection::VNonVirtualCriticalSection()
+{
+	fStatistics = NULL;
+	fUseCount = 0;
+	fOwner = NULL_TASK_ID;
+	fFutex = 0;
+}
+
+
+Boolean VNonVirtualCriticalSection::TryToLock()
+{
+	VTaskID	currentTaskID = VTask::GetCurrentID();
+
+	if (fOwner == currentTaskID)
+	{
+		++fUseCount;
+		return true;
+	}
+
+	if (!XLinuxFutex::TryToLock( &fFutex))
+		return false;
+
+	assert(fUseCount == 0);
+	if (fStatistics != NULL)
+		fStatistics->AddAcquisition();
+	fOwner = currentTaskID;
+	fUseCount = 1;
+	return true;
+}
+
+
+Boolean VNonVirtualCriticalSection::Lock()
+{
+	VTaskID currentTaskID = VTask::GetCurrentID();
+
+	if (fOwner == currentTaskID)
+	{
+		++fUseCount;
+	}
+	else
+	{
+		XLinuxFutex::Lock( &fFutex, fStatistics);
+		assert(fUseCount == 0);
+		fOwner = currentTaskID;
+		fUseCount = 1;
+	}
+	return true;
+}
+
+
+Boolean VNonVirtualCriticalSection::Unlock()
+{
+	assert((fOwner == VTask::GetCurrentID()) && (fUseCount > 0) && (fUseCount < 32000L));
+
+	if (--fUseCount == 0)
+	{
+		fOwner = NULL_TASK_ID;
+		XLinuxFutex::Unlock( &fFutex);
+	}
+	return true;
+}
+
+
+VNonVirtualCriticalSection::~VNonVirtualCriticalSection()
+{
+	assert(fUseCount == 0 && fOwner == NULL_TASK_ID && fFutex == 0);
+
+	while (fUseCount > 0)
+		Unlock();
+}
+
+
+#pragma mark-
+
+VSmallCriticalSection::VSmallCriticalSection()
+{
+	fFutex = 0;
+	fOwner = NULL_TASK_ID;
+	fUseCount = 0;
+	fStatistics = NULL;
+}
+
+
+Boolean VSmallCriticalSection::TryToLock()
+{
+	sWORD currentTaskID = (sWORD)VTask::GetCurrentID();
+
+	if (fOwner == currentTaskID)
+	{
+		++fUseCount;
+		return true;
+	}
+
+	if (!XLinuxFutex::TryToLock( &fFutex))
+		return false;
+
+	assert(fUseCount == 0);
+	if (fStatistics != NULL)
+		fStatistics->AddAcquisition();
+	fOwner = currentTaskID;
+	fUseCount = 1;
+	return true;
+}
+
+
+Boolean VSmallCriticalSection::Lock()
+{
+	sWORD currentTaskID = (sWORD)VTask::GetCurrentID();
+
+	if (fOwner == currentTaskID)
+	{
+		++fUseCount;
+	}
+	else
+	{
+		XLinuxFutex::Lock( &fFutex, fStatistics);
+		assert(fUseCount == 0);
+		fOwner = currentTaskID;
+		fUseCount = 1;
+	}
+	return true;
+}
+
+
+Boolean VSmallCriticalSection::Unlock()
+{
+	assert(fUseCount > 0);
+
+	if (--fUseCount == 0)
+	{
+		fOwner = NULL_TASK_ID;
+		XLinuxFutex::Unlock( &fFutex);
+	}
+	return true;
+}
+
+
+VSmallCriticalSection::~VSmallCriticalSection()
+{
+	assert(fUseCount == 0 && fOwner == NULL_TASK_ID && fFutex == 0);
+
+	while (fUseCount > 0)
+		Unlock();
+}
+
+#else
+
 // Class statics
 sLONG	VSmallCriticalSection::sUnlockCount = 0;
 sLONG	VNonVirtualCriticalSection::sUnlockCount = 0;
@@ -283,3 +435,5 @@ VSmallCriticalSection::~VSmallCriticalSection()
 	while (fUseCount > 0)
 		Unlock();
 }
+
+#endif
@@ -22,6 +22,7 @@ BEGIN_TOOLBOX_NAMESPACE
 class VNonVirtualCriticalSection;
 class VSmallCriticalSection;
 class VSyncEvent;
+class VLockStatistics;
 
 class XTOOLBOX_API VNonVirtualCriticalSection  // Similar VCriticalSection but takes only 12 bytes
 {
@@ -35,12 +36,24 @@ public:
 
 	sLONG	GetUseCount() const	{ return fUseCount; };	// No protection - may be called only if Lock() returns true
 
+#if VERSION_LINUX
+	// optional contention counters (NULL by default)
+	void	SetStatistics( VLockStatistics* inStatistics)	{ fStatistics = inStatistics; };
+#endif
+
 private:
+#if VERSION_LINUX
+	VLockStatistics*	fStatistics;
+	VTaskID		fOwner;
+	sLONG		fUseCount;
+	sLONG		fFutex;		// futex word (cf XLinuxFutex)
+#else
 	VSyncEvent*	fEvent;
 	VTaskID		fOwner;
 	sLONG		fUseCount;
 
 	static sLONG	sUnlockCount;
+#endif
 };
 
 
@@ -55,13 +68,25 @@ public:
 	Boolean	Unlock ();
 
 	sLONG	GetUseCount () const { return fUseCount; };	// No protection - may be called only if Lock() returns true
+
+#if VERSION_LINUX
+	// optional contention counters (NULL by default)
+	void	SetStatistics( VLockStatistics* inStatistics)	{ fStatistics = inStatistics; };
+#endif
 	
 protected:
+#if VERSION_LINUX
+	sLONG		fFutex;		// futex word (cf XLinuxFutex)
+	sWORD		fOwner;
+	sWORD		fUseCount;
+	VLockStatistics*	fStatistics;
+#else
 	VSyncEvent*	fEvent;
 	sWORD		fOwner;		// CAUTION: Assumes fOwner and fUseCount are contiguous
 	sWORD		fUseCount;	//	and ordered.
 
 	static sLONG	sUnlockCount;
+#endif
 };
 
 END_TOOLBOX_NAMESPACE
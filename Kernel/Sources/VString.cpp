@@ -29,6 +29,8 @@
 #include "VValueBag.h"
 #include "VJSONValue.h"
 #include "Base64Coder.h"
+#include "MurmurHash.h"
+#include "VSystem.h"
 
 #if VERSIONWIN
 	#include <locale.h>
@@ -36,6 +38,10 @@
 	#include <xlocale.h>
 #endif
 
+#if WITH_SSE2
+#include <emmintrin.h>
+#endif
+
 BEGIN_TOOLBOX_NAMESPACE
 
 
@@ -167,7 +173,7 @@ VSize VString_info::GetAvgSpace() const
 
 VString::VString():VValueSingle( false)
 {
-	fMaxBufferLength = (sizeof(fBuffer) / sizeof(UniChar)) - 1; // zero
+	fMaxBufferLength = (sizeof(fBuffer) / sizeof(UniChar)) - 1;
 	fMaxLength = fMaxBufferLength;
 	fString = fBuffer;
 	fLength = 0;
@@ -177,7 +183,7 @@ VString::VString():VValueSingle( false)
 
 VString::VString( bool inNull):VValueSingle( inNull)
 {
-	fMaxBufferLength = (sizeof(fBuffer) / sizeof(UniChar)) - 1; // zero
+	fMaxBufferLength = (sizeof(fBuffer) / sizeof(UniChar)) - 1;
 	fMaxLength = fMaxBufferLength;
 	fString = fBuffer;
 	fLength = 0;
@@ -238,7 +244,8 @@ VString::VString( const VString& inString):VValueSingle( inString.IsNull())
 {
 	fMaxBufferLength = (sizeof(fBuffer) / sizeof(UniChar)) - 1;
 
-	UniChar *retainedBuffer = inString._RetainBuffer();
+	// short strings are copied in the private buffer, it's cheaper than sharing
+	UniChar *retainedBuffer = (inString.fLength > fMaxBufferLength) ? inString._RetainBuffer() : NULL;
 	if (retainedBuffer != NULL)
 	{
 		fMaxLength = inString.fMaxLength;
@@ -380,7 +387,7 @@ VString::VString( UniChar* inUniCString, VIndex inLength, VSize inMaxBytes):VVal
 
 VString::VString( const VInlineString& inString):VValueSingle( false)
 {
-	fMaxBufferLength = (sizeof(fBuffer) / sizeof(UniChar)) - 1; // zero
+	fMaxBufferLength = (sizeof(fBuffer) / sizeof(UniChar)) - 1;
 	fString = inString.RetainBuffer( &fLength, &fMaxLength);
 	if (fString == NULL)
 	{
@@ -626,67 +633,372 @@ bool VString::EqualToStringRaw( const VString& inString) const
 }
 
 
+// ---------------------------------------------------------------------------
+//  Raw search
+//
+//	Short patterns: candidates are the positions where both the first and the last chars
+//	of the pattern match, 8 positions at a time with SSE2, then the middle chars are verified.
+//	Long patterns: Boyer-Moore-Horspool with a skip table indexed by the low byte of chars,
+//	until shifts get too small compared to the filter.
+//	Verifications have a budget after which Knuth-Morris-Pratt takes over (periodic text)
+//	so that the search stays linear.
+//
+//	The pattern given to the kernels is already case folded if FOLD is true.
+// ---------------------------------------------------------------------------
+
+const sLONG	kLONG_PATTERN_LENGTH	= 32;	// Horspool from this length
+const sLONG	kSEARCH_BUFFER_LENGTH	= 256;	// patterns shorter than this are folded or indexed on the stack
+
+
+static inline UniChar _FoldASCII( UniChar inChar)
+{
+	return ((UniChar) (inChar - CHAR_LATIN_CAPITAL_LETTER_A) < 26) ? (UniChar) (inChar + 0x20) : inChar;
+}
+
+
+template<bool FOLD>
+static inline UniChar _FoldASCII( UniChar inChar)
+{
+	return FOLD ? _FoldASCII( inChar) : inChar;
+}
+
+
+template<bool FOLD>
+static inline bool _EqualRaw( const UniChar *inText, const UniChar *inPattern, sLONG inSize)
+{
+	for( sLONG i = 0 ; i < inSize ; ++i)
+	{
+		if (_FoldASCII<FOLD>( inText[i]) != inPattern[i])
+			return false;
+	}
+	return true;
+}
+
+
+// verifications are allowed to cost this many chars before giving up for KMP
+static inline sLONG _SearchBudget( sLONG inPosition)
+{
+	return 4 * inPosition + 1024;
+}
+
+
+#if WITH_SSE2
+
+static inline __m128i _FoldASCII( __m128i inChars)
+{
+	// 'A'..'Z' become 0x8000..0x8019, the lowest signed values
+	__m128i shifted = _mm_add_epi16( inChars, _mm_set1_epi16( (short) (0x8000 - CHAR_LATIN_CAPITAL_LETTER_A)));
+	__m128i isUpper = _mm_cmplt_epi16( shifted, _mm_set1_epi16( (short) (0x8000 + 26)));
+	return _mm_add_epi16( inChars, _mm_and_si128( isUpper, _mm_set1_epi16( 0x20)));
+}
+
+#endif
+
+
 /*
-	static
+	returns the 1-based position, 0 if not found, or -1 if giving up in which case ioPosition is where to go on.
 */
-sLONG VString::FindRawString( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize)
+template<bool FOLD>
+static sLONG _FindRawFiltered( const UniChar *inText, sLONG inTextSize, const UniChar *inPattern, sLONG inPatternSize, sLONG& ioPosition)
 {
-	// see http://fr.wikipedia.org/wiki/Algorithme_de_Knuth-Morris-Pratt
-	
-	sLONG targetBuffer[256];
-	sLONG *retarget = (inPatternSize < 256) ? targetBuffer : (sLONG*) malloc( sizeof( sLONG) * (inPatternSize + 1));
+	const UniChar firstChar = inPattern[0];
+	const UniChar lastChar = inPattern[inPatternSize - 1];
+	const sLONG lastPosition = inTextSize - inPatternSize;
+	sLONG cost = 0;
+	sLONG i = ioPosition;
 
+#if WITH_SSE2
+	const __m128i firstChars = _mm_set1_epi16( (short) firstChar);
+	const __m128i lastChars = _mm_set1_epi16( (short) lastChar);
+	for( ; i + 7 <= lastPosition ; i += 8)
 	{
-		sLONG i = 0;
-		sLONG j = -1;
-		UniChar c = 0;
-		
-		retarget[0] = j;
-		while( i != inPatternSize)
+		__m128i first = _mm_loadu_si128( (const __m128i*) (inText + i));
+		__m128i last = _mm_loadu_si128( (const __m128i*) (inText + i + inPatternSize - 1));
+		if (FOLD)
+		{
+			first = _FoldASCII( first);
+			last = _FoldASCII( last);
+		}
+		int mask = _mm_movemask_epi8( _mm_and_si128( _mm_cmpeq_epi16( first, firstChars), _mm_cmpeq_epi16( last, lastChars)));
+		if (mask != 0)
 		{
-			if (inPattern[i] == c)
+			for( sLONG j = 0 ; j < 8 ; ++j)
 			{
-				retarget[i + 1] = j + 1;
-				++j;
-				++i;
+				if ( ((mask >> (2 * j)) & 1) && _EqualRaw<FOLD>( inText + i + j + 1, inPattern + 1, inPatternSize - 2) )
+					return i + j + 1;
 			}
-			else if (j > 0)
+			cost += inPatternSize;
+			if (cost > _SearchBudget( i))
 			{
-				j = retarget[j];
+				ioPosition = i + 8;
+				return -1;
 			}
-			else
+		}
+	}
+#endif
+
+	for( ; i <= lastPosition ; ++i)
+	{
+		if ( (_FoldASCII<FOLD>( inText[i]) == firstChar) && (_FoldASCII<FOLD>( inText[i + inPatternSize - 1]) == lastChar) )
+		{
+			if (_EqualRaw<FOLD>( inText + i + 1, inPattern + 1, inPatternSize - 2))
+				return i + 1;
+			cost += inPatternSize;
+			if (cost > _SearchBudget( i))
 			{
-				retarget[i + 1] = 0;
-				++i;
-				j = 0;
+				ioPosition = i + 1;
+				return -1;
 			}
-			c = inPattern[j];
 		}
 	}
 
-	sLONG m = 0;
-	sLONG i = 0;
-	while( (m + i != inTextSize) && (i != inPatternSize))
+	return 0;
+}
+
+
+template<bool FOLD>
+static sLONG _FindRawHorspool( const UniChar *inText, sLONG inTextSize, const UniChar *inPattern, sLONG inPatternSize, sLONG& ioPosition)
+{
+	// chars sharing their low byte share their shift, the smallest one
+	sLONG shift[256];
+	for( sLONG i = 0 ; i < 256 ; ++i)
+		shift[i] = inPatternSize;
+	for( sLONG i = 0 ; i < inPatternSize - 1 ; ++i)
+		shift[inPattern[i] & 0xFF] = inPatternSize - 1 - i;
+
+	const UniChar lastChar = inPattern[inPatternSize - 1];
+	const sLONG lastPosition = inTextSize - inPatternSize;
+	const sLONG start = ioPosition;
+	sLONG cost = 0;
+	sLONG steps = 0;
+	sLONG i = start;
+	while( i <= lastPosition)
 	{
-		if (inText[m + i] == inPattern[i])
+		UniChar c = _FoldASCII<FOLD>( inText[i + inPatternSize - 1]);
+		if (c == lastChar)
 		{
-			++i;
+			if (_EqualRaw<FOLD>( inText + i, inPattern, inPatternSize - 1))
+				return i + 1;
+			cost += inPatternSize;
 		}
-		else
+		i += shift[c & 0xFF];
+
+		// small shifts (repetitive text) are slower than the filter
+		if ( (((++steps % 64) == 0) && (i - start < steps * 8)) || (cost > _SearchBudget( i)) )
 		{
-			m += i - retarget[i];
-			if (i > 0)
-				i = retarget[i];
+			ioPosition = i;
+			return -1;
 		}
 	}
-	
+
+	return 0;
+}
+
+
+// see http://fr.wikipedia.org/wiki/Algorithme_de_Knuth-Morris-Pratt
+template<bool FOLD>
+static sLONG _FindRawKMP( const UniChar *inText, sLONG inTextSize, const UniChar *inPattern, sLONG inPatternSize)
+{
+	sLONG targetBuffer[kSEARCH_BUFFER_LENGTH];
+	sLONG *retarget = (inPatternSize < kSEARCH_BUFFER_LENGTH) ? targetBuffer : (sLONG*) malloc( sizeof( sLONG) * (inPatternSize + 1));
+	if (retarget == NULL)
+		return 0;
+
+	retarget[0] = -1;
+	for( sLONG i = 0, j = -1 ; i < inPatternSize ; )
+	{
+		while( (j >= 0) && (inPattern[i] != inPattern[j]))
+			j = retarget[j];
+		retarget[++i] = ++j;
+	}
+
+	sLONG result = 0;
+	for( sLONG m = 0, i = 0 ; m < inTextSize ; ++m)
+	{
+		UniChar c = _FoldASCII<FOLD>( inText[m]);
+		while( (i >= 0) && (c != inPattern[i]))
+			i = retarget[i];
+		if (++i == inPatternSize)
+		{
+			result = m - inPatternSize + 2;
+			break;
+		}
+	}
+
 	if (retarget != targetBuffer)
 		free( retarget);
 
-	if (i >= inPatternSize)
-		return m + 1;
-	else
+	return result;
+}
+
+
+template<bool FOLD>
+static sLONG _FindRaw( const UniChar *inText, sLONG inTextSize, const UniChar *inPattern, sLONG inPatternSize)
+{
+	if (inPatternSize <= 0)
+		return 1;
+
+	if (inPatternSize > inTextSize)
 		return 0;
+
+	sLONG position = 0;
+	sLONG result = -1;
+	if (inPatternSize >= kLONG_PATTERN_LENGTH)
+		result = _FindRawHorspool<FOLD>( inText, inTextSize, inPattern, inPatternSize, position);
+
+	if (result < 0)
+		result = _FindRawFiltered<FOLD>( inText, inTextSize, inPattern, inPatternSize, position);
+
+	if (result < 0)
+	{
+		result = _FindRawKMP<FOLD>( inText + position, inTextSize - position, inPattern, inPatternSize);
+		if (result > 0)
+			result += position;
+	}
+
+	return result;
+}
+
+
+static inline UniChar _WidenASCII( UniChar inChar)		{ return inChar;}
+static inline UniChar _WidenASCII( char inChar)			{ return (UniChar) (uBYTE) inChar;}
+
+
+// the pattern has to be folded or widened before the search
+template<class T>
+static sLONG _FindASCII( const UniChar *inText, sLONG inTextSize, const T *inPattern, sLONG inPatternSize, bool inCaseSensitive)
+{
+	if (inPatternSize <= 0)
+		return 1;
+
+	if (inPatternSize > inTextSize)
+		return 0;
+
+	UniChar patternBuffer[kSEARCH_BUFFER_LENGTH];
+	UniChar *pattern = (inPatternSize <= kSEARCH_BUFFER_LENGTH) ? patternBuffer : (UniChar*) malloc( sizeof( UniChar) * inPatternSize);
+	if (pattern == NULL)
+		return 0;
+
+	for( sLONG i = 0 ; i < inPatternSize ; ++i)
+	{
+		UniChar c = _WidenASCII( inPattern[i]);
+		pattern[i] = inCaseSensitive ? c : _FoldASCII( c);
+	}
+
+	sLONG result = inCaseSensitive
+				? _FindRaw<false>( inText, inTextSize, pattern, inPatternSize)
+				: _FindRaw<true>( inText, inTextSize, pattern, inPatternSize);
+
+	if (pattern != patternBuffer)
+		free( pattern);
+
+	return result;
+}
+
+
+template<bool FOLD>
+static bool _EqualASCII( const UniChar *inText1, const UniChar *inText2, sLONG inSize)
+{
+	sLONG i = 0;
+#if WITH_SSE2
+	for( ; i + 8 <= inSize ; i += 8)
+	{
+		__m128i chars1 = _mm_loadu_si128( (const __m128i*) (inText1 + i));
+		__m128i chars2 = _mm_loadu_si128( (const __m128i*) (inText2 + i));
+		if (FOLD)
+		{
+			chars1 = _FoldASCII( chars1);
+			chars2 = _FoldASCII( chars2);
+		}
+		if (_mm_movemask_epi8( _mm_cmpeq_epi16( chars1, chars2)) != 0xFFFF)
+			return false;
+	}
+#endif
+	for( ; i < inSize ; ++i)
+	{
+		if (_FoldASCII<FOLD>( inText1[i]) != _FoldASCII<FOLD>( inText2[i]))
+			return false;
+	}
+	return true;
+}
+
+
+template<bool FOLD>
+static bool _EqualASCII( const UniChar *inText1, const char *inText2, sLONG inSize)
+{
+	sLONG i = 0;
+#if WITH_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	for( ; i + 8 <= inSize ; i += 8)
+	{
+		__m128i chars1 = _mm_loadu_si128( (const __m128i*) (inText1 + i));
+		__m128i chars2 = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i*) (inText2 + i)), zero);
+		if (FOLD)
+		{
+			chars1 = _FoldASCII( chars1);
+			chars2 = _FoldASCII( chars2);
+		}
+		if (_mm_movemask_epi8( _mm_cmpeq_epi16( chars1, chars2)) != 0xFFFF)
+			return false;
+	}
+#endif
+	for( ; i < inSize ; ++i)
+	{
+		if (_FoldASCII<FOLD>( inText1[i]) != _FoldASCII<FOLD>( (UniChar) (uBYTE) inText2[i]))
+			return false;
+	}
+	return true;
+}
+
+
+/*
+	static
+*/
+sLONG VString::FindRawString( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize)
+{
+	return _FindRaw<false>( inText, inTextSize, inPattern, inPatternSize);
+}
+
+
+/*
+	static
+*/
+sLONG VString::FindASCIIString( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize, bool inCaseSensitive)
+{
+	if (inCaseSensitive)
+		return _FindRaw<false>( inText, inTextSize, inPattern, inPatternSize);
+
+	return _FindASCII( inText, inTextSize, inPattern, inPatternSize, false);
+}
+
+
+/*
+	static
+*/
+sLONG VString::FindASCIIString( const UniChar* inText, sLONG inTextSize, const char* inPattern, sLONG inPatternSize, bool inCaseSensitive)
+{
+	return _FindASCII( inText, inTextSize, inPattern, inPatternSize, inCaseSensitive);
+}
+
+
+/*
+	static
+*/
+bool VString::EqualASCIIString( const UniChar* inText1, const UniChar* inText2, sLONG inSize, bool inCaseSensitive)
+{
+	if (inCaseSensitive)
+		return ::memcmp( inText1, inText2, inSize * sizeof( UniChar)) == 0;
+
+	return _EqualASCII<true>( inText1, inText2, inSize);
+}
+
+
+/*
+	static
+*/
+bool VString::EqualASCIIString( const UniChar* inText1, const char* inText2, sLONG inSize, bool inCaseSensitive)
+{
+	return inCaseSensitive ? _EqualASCII<false>( inText1, inText2, inSize) : _EqualASCII<true>( inText1, inText2, inSize);
 }
 
 
@@ -1653,25 +1965,31 @@ void VString::GetDuration(VDuration& outDuration) const
 }
 
 
-uLONG VString::GetHashValue() const
+uLONG VString::GetHashSeed()
 {
-    uLONG stringLength = GetLength();
-    uLONG result = stringLength;
-    uLONG characterIndex;
-
-	const UniChar *uContents = GetCPointer();
-	if (stringLength <= 16) {
-		for (characterIndex = 0; characterIndex < stringLength; ++characterIndex) 
-			result = result * 257 + uContents[characterIndex];
-	} else {
-		for (characterIndex = 0; characterIndex < 8; ++characterIndex) 
-			result = result * 257 + uContents[characterIndex];
-		for (characterIndex = stringLength - 8; characterIndex < stringLength; ++characterIndex) 
-			result = result * 257 + uContents[characterIndex];
+	// random per process so that keys colliding on purpose can't be built from outside.
+	// 0 means not yet computed, concurrent callers all end up with the first stored seed.
+	static sLONG sSeed = 0;
+	if (sSeed == 0)
+	{
+		sLONG seed = (sLONG) (((uLONG) VSystem::Random( false) << 16) ^ (uLONG) VSystem::Random( false) ^ (uLONG) VSystem::GetCurrentTime());
+		if (seed == 0)
+			seed = 1;
+		VInterlocked::CompareExchange( &sSeed, 0, seed);
 	}
-	
-    result += (result << (stringLength & 31));
-    return result;
+	return (uLONG) sSeed;
+}
+
+
+uLONG VString::GetHashValue() const
+{
+	// every char counts: urls, paths or json keys often share long prefixes and suffixes.
+#if ARCH_64
+	uLONG8 result = MurmurHash64A( GetCPointer(), GetLength() * (int) sizeof( UniChar), GetHashSeed());
+	return (uLONG) (result ^ (result >> 32));
+#else
+	return MurmurHash2( GetCPointer(), GetLength() * (int) sizeof( UniChar), GetHashSeed());
+#endif
 }
 
 
@@ -2159,7 +2477,8 @@ void VString::FromString( const VString& inString)
 			FromBlock( inString.fString, GetMaxLength() * sizeof(UniChar), VTC_UTF_16);
 		}
 */
-		UniChar *retainedBuffer = inString._RetainBuffer();
+		// short strings are copied in the private buffer, it's cheaper than sharing
+		UniChar *retainedBuffer = (inString.fLength > fMaxBufferLength) ? inString._RetainBuffer() : NULL;
 		if (retainedBuffer != NULL)
 		{
 			_ReleaseBuffer();
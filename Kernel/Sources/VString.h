@@ -87,6 +87,8 @@ public:
 		
 		Whenever you attempt to add some characters, VString may try to allocate a
 		bigger buffer. This is the only occasion where the string buffer may be moved around.
+		Strings up to 13 chars are kept in the private buffer and never allocate
+		(dictionary keys, header names, numbers...).
 		See the VStr<> template definition for specifying a pre-allocated buffer size.
 
 		A VString is a VValue so it supports the IsDirty and the IsNull state flags.
@@ -102,6 +104,7 @@ class XTOOLBOX_API VString : public VValueSingle
 { 
 public:
 	friend struct VInlineString;
+	friend class VStringBuilder;
 	typedef VString_info	InfoType;
 	static const InfoType	sInfo;
 	
@@ -467,6 +470,16 @@ public:
 			bool				EqualToStringRaw( const VString& inString) const;
 			sLONG				FindRawString( const VString& inString) const	{ return FindRawString( GetCPointer(), GetLength(), inString.GetCPointer(), inString.GetLength());}
 	static	sLONG				FindRawString( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize);
+
+			/**
+			* @brief raw search and comparison where only ASCII letters (A-Z) may be case folded (protocol keywords, header names...).
+			* Find functions return the 1-based position of the pattern or 0.
+			*/
+	static	sLONG				FindASCIIString( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize, bool inCaseSensitive);
+	static	sLONG				FindASCIIString( const UniChar* inText, sLONG inTextSize, const char* inPattern, sLONG inPatternSize, bool inCaseSensitive);
+	static	bool				EqualASCIIString( const UniChar* inText1, const UniChar* inText2, sLONG inSize, bool inCaseSensitive);
+	static	bool				EqualASCIIString( const UniChar* inText1, const char* inText2, sLONG inSize, bool inCaseSensitive);
+
 			void				ExchangeRawString( const VString& inStringToFind, const VString& inStringToInsert, VIndex inPlaceToStart = 1, VIndex inCountToReplace = 1);
 
 			/**
@@ -564,7 +577,9 @@ public:
 	virtual	void				GetTime( VTime& outTime) const;	// Assumes format "YYYY-MM-DD HH:MM:SS:MS"
 	virtual	void				GetDuration( VDuration& outDuration) const;	// Assumes 'DDDD:HH:MM:SS:MS'
 	
+	// full length hash seeded per process: don't store hash values, they change from one launch to another.
 	virtual uLONG				GetHashValue() const;
+	static	uLONG				GetHashSeed();
 
 			OsType				GetOsType() const;	// Assumes the string is 4 char long
 
@@ -745,7 +760,7 @@ protected:
 			VIndex				fLength;	// Nb chars
 			VIndex				fMaxLength;	// Max nb of chars fString can handle( not including the null char)
 			VIndex				fMaxBufferLength;	// Max nb of chars fBuffer can handle( not including the null char)
-			UniChar				fBuffer[1];	// Private buffer, may be extended using the VStr template
+			UniChar				fBuffer[14];	// Private buffer for short strings (13 chars), may be extended using the VStr template
 
 			// Inherited from VValue
 	virtual	void				DoNullChanged();
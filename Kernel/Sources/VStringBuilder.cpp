@@ -0,0 +1,147 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "VStringBuilder.h"
+
+
+// Class constants
+const VIndex	kMIN_SHARED_FRAGMENT_LENGTH		= 64;	// shorter fragments are copied
+
+
+VStringBuilder::VStringBuilder( VIndex inReservedChars)
+: fLength( 0)
+{
+	fChars.reserve( inReservedChars);
+}
+
+
+VStringBuilder::~VStringBuilder()
+{
+}
+
+
+VStringBuilder& VStringBuilder::AppendString( const VString& inString)
+{
+	if ( (inString.GetLength() >= kMIN_SHARED_FRAGMENT_LENGTH) && inString._IsBufferRefCounted())
+	{
+		// the copy retains inString buffer
+		fShared.push_back( SharedFragment( (VIndex) fChars.size(), inString));
+		fLength += inString.GetLength();
+	}
+	else
+	{
+		AppendUniChars( inString.GetCPointer(), inString.GetLength());
+	}
+	return *this;
+}
+
+
+VStringBuilder& VStringBuilder::AppendUniChars( const UniChar *inChars, VIndex inLength)
+{
+	if (inLength > 0)
+	{
+		fChars.insert( fChars.end(), inChars, inChars + inLength);
+		fLength += inLength;
+	}
+	return *this;
+}
+
+
+VStringBuilder& VStringBuilder::AppendCString( const char *inCString)
+{
+	// plain ascii is widened in place, other chars go through VString conversion
+	const char *p = inCString;
+	while( (*p != 0) && ((uBYTE) *p < 0x80))
+		++p;
+
+	size_t asciiLength = p - inCString;
+	if (asciiLength > 0)
+	{
+		size_t size = fChars.size();
+		fChars.resize( size + asciiLength);
+		for( const char *q = inCString ; q != p ; ++q)
+			fChars[size++] = (uBYTE) *q;
+		fLength += (VIndex) asciiLength;
+	}
+
+	if (*p != 0)
+		AppendString( VString( p));
+
+	return *this;
+}
+
+
+VStringBuilder& VStringBuilder::AppendLong8( sLONG8 inValue)
+{
+	UniChar	temp[24];
+	UniChar *end = &temp[24];
+	UniChar *current = end;
+
+	// unsigned arithmetic so that the min value has no special case
+	uLONG8 value = (inValue < 0) ? (0 - (uLONG8) inValue) : (uLONG8) inValue;
+	do
+	{
+		*--current = (UniChar) (CHAR_DIGIT_ZERO + (value % 10));
+		value /= 10;
+	} while( value > 0);
+
+	if (inValue < 0)
+		*--current = CHAR_HYPHEN_MINUS;
+
+	return AppendUniChars( current, (VIndex) (end - current));
+}
+
+
+void VStringBuilder::Clear()
+{
+	fChars.clear();
+	fShared.clear();
+	fLength = 0;
+}
+
+
+bool VStringBuilder::GetString( VString& outString) const
+{
+	// a single long fragment is just shared
+	if (fChars.empty() && (fShared.size() == 1))
+	{
+		outString.FromString( fShared.front().second);
+		return true;
+	}
+
+	outString.Clear();
+	UniChar *p = outString.GetCPointerForWrite( fLength);
+	if (p == NULL)
+		return false;
+
+	VIndex position = 0;
+	for( VectorOfSharedFragment::const_iterator i = fShared.begin() ; i != fShared.end() ; ++i)
+	{
+		if (i->first > position)
+		{
+			::memcpy( p, &fChars[position], (i->first - position) * sizeof( UniChar));
+			p += i->first - position;
+			position = i->first;
+		}
+		::memcpy( p, i->second.GetCPointer(), i->second.GetLength() * sizeof( UniChar));
+		p += i->second.GetLength();
+	}
+
+	if ((VIndex) fChars.size() > position)
+		::memcpy( p, &fChars[position], (fChars.size() - position) * sizeof( UniChar));
+
+	return outString.Validate( fLength);
+}
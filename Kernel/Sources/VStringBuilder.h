@@ -0,0 +1,84 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __VStringBuilder__
+#define __VStringBuilder__
+
+#include "Kernel/Sources/VString.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+
+/*!
+	@class	VStringBuilder
+	@abstract	Accumulates string fragments and builds the final VString once.
+	@discussion
+		Appending to a VString reallocates and copies its buffer each time it grows.
+		VStringBuilder copies short fragments in a growing buffer and keeps long VString fragments
+		by sharing their buffer (no copy at all), then GetString() allocates the result once at its exact size.
+
+		A builder may be reused after Clear(): its buffer is kept.
+
+		VStringBuilder builder;
+		builder.AppendString( name).AppendCString( ": ").AppendString( value).AppendCString( "\r\n");
+		builder.GetString( header);
+*/
+class XTOOLBOX_API VStringBuilder : public VObject
+{
+public:
+										VStringBuilder():fLength( 0)							{;}
+	explicit							VStringBuilder( VIndex inReservedChars);
+	virtual								~VStringBuilder();
+
+			VStringBuilder&				AppendString( const VString& inString);
+			VStringBuilder&				AppendUniChars( const UniChar *inChars, VIndex inLength);
+			VStringBuilder&				AppendUniChar( UniChar inChar)							{ fChars.push_back( inChar); ++fLength; return *this;}
+			VStringBuilder&				AppendCString( const char *inCString);	// same charset as VString::AppendCString
+			VStringBuilder&				AppendLong( sLONG inValue)								{ return AppendLong8( inValue);}
+			VStringBuilder&				AppendLong8( sLONG8 inValue);
+
+			VStringBuilder&				operator+=( const VString& inString)					{ return AppendString( inString);}
+			VStringBuilder&				operator+=( const char *inCString)						{ return AppendCString( inCString);}
+			VStringBuilder&				operator+=( UniChar inChar)								{ return AppendUniChar( inChar);}
+
+			VIndex						GetLength() const										{ return fLength;}
+			bool						IsEmpty() const											{ return fLength == 0;}
+
+			// forget appended fragments but keep the buffer
+			void						Clear();
+
+			// ensure the copy buffer doesn't reallocate until inNbChars are appended
+			void						Reserve( VIndex inNbChars)								{ fChars.reserve( inNbChars);}
+
+			// build the string. Returns false on memory failure.
+			bool						GetString( VString& outString) const;
+
+private:
+	// long VString fragments are kept aside and inserted in fChars at fPosition
+	typedef std::pair<VIndex,VString>	SharedFragment;
+	typedef std::vector<SharedFragment>	VectorOfSharedFragment;
+
+										VStringBuilder( const VStringBuilder&);
+			VStringBuilder&				operator=( const VStringBuilder&);
+
+			std::vector<UniChar>		fChars;
+			VectorOfSharedFragment		fShared;
+			VIndex						fLength;
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
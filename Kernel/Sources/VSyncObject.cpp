@@ -17,6 +17,7 @@
 #include "VSyncObject.h"
 #include "VTask.h"
 #include "VInterlocked.h"
+#include "VString.h"
 
 
 // Class macros
@@ -24,16 +25,95 @@
 
 
 // Class statics
-#if !VCriticalSection_USE_SPINLOCK
+#if !VCriticalSection_USE_SPINLOCK && !VCriticalSection_USE_FUTEX
 sLONG	VCriticalSection::sUnlockCount = 0;
 #endif
 
+VLockStatistics*	VLockStatistics::sFirst = NULL;
+SpinLockType		VLockStatistics::sListLock = 0;
+
+//================================================================================================================
+
+
+VLockStatistics::VLockStatistics( const char *inName)
+: fAcquisitions( 0)
+, fContendedAcquisitions( 0)
+, fWaitMicroseconds( 0)
+, fNext( NULL)
+{
+	::strncpy( fName, inName, sizeof( fName) - 1);
+	fName[sizeof( fName) - 1] = 0;
+}
+
+
+VLockStatistics* VLockStatistics::Get( const char *inName)
+{
+	SpinLockThread( sListLock);
+
+	VLockStatistics *stats = sFirst;
+	while( (stats != NULL) && (::strncmp( stats->fName, inName, sizeof( stats->fName) - 1) != 0) )
+		stats = stats->fNext;
+
+	if (stats == NULL)
+	{
+		// can't use VObject allocator here (VCppMem uses a VCriticalSection)
+		stats = ::new VLockStatistics( inName);
+		stats->fNext = sFirst;
+		sFirst = stats;
+	}
+
+	SpinUnlock( sListLock);
+
+	return stats;
+}
+
+
+void VLockStatistics::DumpAll( VString& outDump)
+{
+	// statistics are never deleted so the list can be walked without lock
+	for( VLockStatistics *stats = sFirst ; stats != NULL ; stats = stats->fNext)
+		stats->Dump( outDump);
+}
+
+
+void VLockStatistics::ResetAll()
+{
+	for( VLockStatistics *stats = sFirst ; stats != NULL ; stats = stats->fNext)
+		stats->Reset();
+}
+
+
+void VLockStatistics::Dump( VString& outDump) const
+{
+	outDump.AppendCString( fName);
+	outDump.AppendCString( ": acquisitions=");
+	outDump.AppendLong8( fAcquisitions);
+	outDump.AppendCString( ", contended=");
+	outDump.AppendLong8( fContendedAcquisitions);
+	outDump.AppendCString( ", wait=");
+	outDump.AppendLong8( fWaitMicroseconds);
+	outDump.AppendCString( "us\n");
+}
+
+
+void VLockStatistics::Reset()
+{
+	VInterlocked::Exchange( &fAcquisitions, 0);
+	VInterlocked::Exchange( &fContendedAcquisitions, 0);
+	VInterlocked::Exchange( &fWaitMicroseconds, 0);
+}
+
+
 //================================================================================================================
 
 
 VCriticalSection::VCriticalSection()
 : fOwner( NULL_TASK_ID)
-#if VCriticalSection_USE_SPINLOCK
+#if VCriticalSection_USE_FUTEX
+, fStatistics( NULL)
+, fFutex( 0)
+, fUseCount( 0)
+#elif VCriticalSection_USE_SPINLOCK
 , fSpinLockAndUseCount( 0)
 #else
 , fUseCount( 0)
@@ -41,7 +121,7 @@ VCriticalSection::VCriticalSection()
 {
 #if DEBUG_SEMA
 	fEvent = reinterpret_cast<VSyncEvent*>(new VSystemCriticalSection);
-#else
+#elif !VCriticalSection_USE_FUTEX
 	fEvent = NULL;
 #endif
 }
@@ -51,6 +131,13 @@ VCriticalSection::~VCriticalSection()
 {
 #if DEBUG_SEMA
 	reinterpret_cast<VSystemCriticalSection*>(fEvent)->Release();
+#elif VCriticalSection_USE_FUTEX
+	xbox_assert( GetUseCount() == 0 && fOwner == NULL_TASK_ID && fFutex == 0);
+
+	while (GetUseCount() > 0)
+	{
+		Unlock();
+	}
 #else
 	xbox_assert( GetUseCount() == 0 && fOwner == NULL_TASK_ID && fEvent == NULL);
 	
@@ -69,7 +156,23 @@ bool VCriticalSection::TryToLock()
 #else
 	VTaskID currentTaskID = VTask::GetCurrentID();
 
-#if VCriticalSection_USE_SPINLOCK
+#if VCriticalSection_USE_FUTEX
+	// only the current task may have stored its own id in fOwner
+	if (fOwner == currentTaskID)
+	{
+		++fUseCount;
+		return true;
+	}
+	if (!XLinuxFutex::TryToLock( &fFutex))
+		return false;
+
+	xbox_assert( fUseCount == 0);
+	if (fStatistics != NULL)
+		fStatistics->AddAcquisition();
+	fOwner = currentTaskID;
+	fUseCount = 1;
+	return true;
+#elif VCriticalSection_USE_SPINLOCK
 	bool ok;
 	_Lock();
 	VTaskID owner = fOwner;
@@ -123,7 +226,21 @@ bool VCriticalSection::Lock()
 	
 	
 	VTaskID currentTaskID = VTask::GetCurrentID();
-#if VCriticalSection_USE_SPINLOCK
+#if VCriticalSection_USE_FUTEX
+	if (fOwner == currentTaskID)
+	{
+		// We are already the owner
+		++fUseCount;
+	}
+	else
+	{
+		XLinuxFutex::Lock( &fFutex, fStatistics);
+		// We are the new owner
+		xbox_assert( fUseCount == 0);
+		fOwner = currentTaskID;
+		fUseCount = 1;
+	}
+#elif VCriticalSection_USE_SPINLOCK
 	_Lock();
 	do {
 		VTaskID	owner = fOwner;
@@ -277,7 +394,14 @@ bool VCriticalSection::Unlock()
 #else
 	xbox_assert((fOwner == VTask::GetCurrentID()) && (GetUseCount() > 0) && (GetUseCount() < 32000L));
 
-#if VCriticalSection_USE_SPINLOCK
+#if VCriticalSection_USE_FUTEX
+	// Unlock or another successfull lock can only be called from same thread (so no contention can occur on fUseCount)
+	if (--fUseCount == 0)
+	{
+		fOwner = NULL_TASK_ID;
+		XLinuxFutex::Unlock( &fFutex);
+	}
+#elif VCriticalSection_USE_SPINLOCK
 	_Lock();
 	if (--fSpinLockAndUseCount == 0x80000000)
 	{
@@ -403,3 +527,322 @@ bool VConditionVariable::_Wait( VCriticalSection *inMutex, bool inWithTimeout, s
 	return ok;
 }
 
+
+
+//================================================================================================================
+
+
+VReadWriteLock::VReadWriteLock()
+: fReadersGate( 0, kMAX_sLONG)
+, fWritersGate( 0, kMAX_sLONG)
+, fSpinLock( 0)
+, fReaders( 0)
+, fWaitingReaders( 0)
+, fWaitingWriters( 0)
+, fWriter( false)
+{
+}
+
+
+VReadWriteLock::~VReadWriteLock()
+{
+	xbox_assert( fReaders == 0 && !fWriter && fWaitingReaders == 0 && fWaitingWriters == 0);
+}
+
+
+bool VReadWriteLock::LockRead()
+{
+	_Lock();
+	if (!fWriter && (fWaitingWriters == 0))
+	{
+		++fReaders;
+		_Unlock();
+		return true;
+	}
+
+	// queue behind current or waiting writer.
+	// UnlockWrite() will count us as an active reader before opening the gate.
+	++fWaitingReaders;
+	_Unlock();
+
+	return fReadersGate.Lock();
+}
+
+
+bool VReadWriteLock::TryToLockRead()
+{
+	bool ok;
+	_Lock();
+	if (!fWriter && (fWaitingWriters == 0))
+	{
+		++fReaders;
+		ok = true;
+	}
+	else
+	{
+		ok = false;
+	}
+	_Unlock();
+	return ok;
+}
+
+
+bool VReadWriteLock::UnlockRead()
+{
+	_Lock();
+	xbox_assert( fReaders > 0 && !fWriter);
+	if ( (--fReaders == 0) && (fWaitingWriters > 0) )
+	{
+		// hand the lock over to the first waiting writer
+		--fWaitingWriters;
+		fWriter = true;
+		_Unlock();
+		fWritersGate.Unlock();
+	}
+	else
+	{
+		_Unlock();
+	}
+	return true;
+}
+
+
+bool VReadWriteLock::LockWrite()
+{
+	_Lock();
+	if (!fWriter && (fReaders == 0))
+	{
+		fWriter = true;
+		_Unlock();
+		return true;
+	}
+
+	// the lock will be handed over to us by UnlockRead() or UnlockWrite()
+	++fWaitingWriters;
+	_Unlock();
+
+	return fWritersGate.Lock();
+}
+
+
+bool VReadWriteLock::TryToLockWrite()
+{
+	bool ok;
+	_Lock();
+	if (!fWriter && (fReaders == 0))
+	{
+		fWriter = true;
+		ok = true;
+	}
+	else
+	{
+		ok = false;
+	}
+	_Unlock();
+	return ok;
+}
+
+
+bool VReadWriteLock::UnlockWrite()
+{
+	_Lock();
+	xbox_assert( fWriter && fReaders == 0);
+	if (fWaitingReaders > 0)
+	{
+		// readers that queued during the write phase go first
+		sLONG count = fWaitingReaders;
+		fReaders = count;
+		fWaitingReaders = 0;
+		fWriter = false;
+		_Unlock();
+		while( count-- > 0)
+			fReadersGate.Unlock();
+	}
+	else if (fWaitingWriters > 0)
+	{
+		// hand the lock over to next writer (fWriter remains set)
+		--fWaitingWriters;
+		_Unlock();
+		fWritersGate.Unlock();
+	}
+	else
+	{
+		fWriter = false;
+		_Unlock();
+	}
+	return true;
+}
+
+
+//================================================================================================================
+
+
+BEGIN_TOOLBOX_NAMESPACE
+
+class VEpochRecord
+{
+public:
+	sLONG				fEpoch;		// global epoch when the read section was entered, 0 when quiescent
+	sLONG				fNesting;
+	sLONG				fInUse;
+	bool				fTaskOwned;	// records are attached to their VTask until it dies
+	VEpochRecord*		fNext;
+};
+
+END_TOOLBOX_NAMESPACE
+
+
+typedef struct VRetiredObject
+{
+	void*						fObject;
+	VEpochReclaimer::DeleteProc	fDeleteProc;
+	sLONG						fEpoch;
+} VRetiredObject;
+
+
+// records are never deleted but recycled when their owner task dies
+static	VEpochRecord*				sFirstEpochRecord = NULL;
+static	sLONG						sGlobalEpoch = 1;
+static	VTaskDataKey				sEpochRecordKey = 0;
+static	SpinLockType				sEpochLock = 0;
+static	std::vector<VRetiredObject>	*sRetiredObjects = NULL;
+
+
+static void _DisposeEpochRecord( void *inData)
+{
+	VEpochRecord *record = (VEpochRecord*) inData;
+	xbox_assert( record->fNesting == 0);
+	record->fNesting = 0;
+	VInterlocked::Exchange( &record->fEpoch, 0);
+	VInterlocked::Exchange( &record->fInUse, 0);
+}
+
+
+static VEpochRecord *_AcquireEpochRecord( bool inTaskOwned)
+{
+	VEpochRecord *record;
+	for( record = sFirstEpochRecord ; record != NULL ; record = record->fNext)
+	{
+		if ( (record->fInUse == 0) && (VInterlocked::CompareExchange( &record->fInUse, 0, 1) == 0) )
+			break;
+	}
+
+	if (record == NULL)
+	{
+		// can't use VObject allocator here (VCppMem uses a VCriticalSection)
+		record = ::new VEpochRecord;
+		record->fEpoch = 0;
+		record->fNesting = 0;
+		record->fInUse = 1;
+
+		VEpochRecord *first;
+		do {
+			first = sFirstEpochRecord;
+			record->fNext = first;
+		} while( VInterlocked::CompareExchangePtr( (void**) &sFirstEpochRecord, first, record) != first);
+	}
+	record->fTaskOwned = inTaskOwned;
+
+	return record;
+}
+
+
+VEpochRecord* VEpochReclaimer::EnterReadSection()
+{
+	VEpochRecord *record;
+	if (VTask::GetCurrent() != NULL)
+	{
+		if (sEpochRecordKey == 0)
+		{
+			SpinLockThread( sEpochLock);
+			if (sEpochRecordKey == 0)
+				sEpochRecordKey = VTask::CreateDataKey( _DisposeEpochRecord);
+			SpinUnlock( sEpochLock);
+		}
+
+		record = (VEpochRecord*) VTask::GetCurrentData( sEpochRecordKey);
+		if (record == NULL)
+		{
+			record = _AcquireEpochRecord( true);
+			VTask::SetCurrentData( sEpochRecordKey, record);
+		}
+	}
+	else
+	{
+		// not a VTask: use a record for this read section only
+		record = _AcquireEpochRecord( false);
+	}
+
+	// the epoch must be visible before the caller loads any shared pointer (CompareExchange is a full barrier)
+	if (record->fNesting++ == 0)
+		VInterlocked::CompareExchange( &record->fEpoch, 0, sGlobalEpoch);
+
+	return record;
+}
+
+
+void VEpochReclaimer::LeaveReadSection( VEpochRecord *inRecord)
+{
+	xbox_assert( inRecord->fNesting > 0);
+	if (--inRecord->fNesting == 0)
+	{
+		VInterlocked::Exchange( &inRecord->fEpoch, 0);
+		if (!inRecord->fTaskOwned)
+			VInterlocked::Exchange( &inRecord->fInUse, 0);
+	}
+}
+
+
+void VEpochReclaimer::Retire( void *inObject, DeleteProc inDeleteProc)
+{
+	// the object has already been unpublished: readers entering from now on can't see it.
+	sLONG epoch = VInterlocked::Increment( &sGlobalEpoch);
+	if (epoch == 0)
+		epoch = VInterlocked::Increment( &sGlobalEpoch);	// 0 means quiescent
+
+	VRetiredObject retired = { inObject, inDeleteProc, epoch};
+
+	SpinLockThread( sEpochLock);
+	if (sRetiredObjects == NULL)
+		sRetiredObjects = ::new std::vector<VRetiredObject>;
+	sRetiredObjects->push_back( retired);
+	SpinUnlock( sEpochLock);
+
+	Reclaim();
+}
+
+
+void VEpochReclaimer::Reclaim()
+{
+	std::vector<VRetiredObject> deletables;
+
+	SpinLockThread( sEpochLock);
+	if ( (sRetiredObjects != NULL) && !sRetiredObjects->empty())
+	{
+		std::vector<VRetiredObject>::iterator i = sRetiredObjects->begin();
+		while( i != sRetiredObjects->end())
+		{
+			// an object retired at epoch E may only be seen by read sections entered before E.
+			// (epochs are compared by difference to survive wrapping)
+			bool visible = false;
+			for( VEpochRecord *record = sFirstEpochRecord ; (record != NULL) && !visible ; record = record->fNext)
+			{
+				sLONG recordEpoch = record->fEpoch;
+				visible = (recordEpoch != 0) && ((recordEpoch - i->fEpoch) < 0);
+			}
+			if (visible)
+			{
+				++i;
+			}
+			else
+			{
+				deletables.push_back( *i);
+				i = sRetiredObjects->erase( i);
+			}
+		}
+	}
+	SpinUnlock( sEpochLock);
+
+	for( std::vector<VRetiredObject>::const_iterator i = deletables.begin() ; i != deletables.end() ; ++i)
+		i->fDeleteProc( i->fObject);
+}
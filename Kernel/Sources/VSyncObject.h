@@ -31,6 +31,55 @@ inline	void	SpinLockThread( SpinLockType& ioLock)	{ while( VInterlocked::TestAnd
 inline	void	SpinUnlock( SpinLockType& ioLock)		{ xbox_assert(ioLock & (1 << 31) ); ioLock &= ~(1 << 31); };
 
 
+class VString;
+
+/*
+	Contention counters that can be attached to a critical section (see VCriticalSection_USE_FUTEX).
+	Statistics are registered by name for the whole process life and may be shared by several locks.
+	Counters are updated with interlocked operations so that they can be read at any time.
+*/
+class XTOOLBOX_API VLockStatistics
+{
+public:
+	// returns the statistics registered under inName, creating them if necessary (never deleted).
+	static	VLockStatistics*		Get( const char *inName);
+
+	// appends one line per registered statistics (name, acquisitions, contended acquisitions, wait time in microseconds)
+	static	void					DumpAll( VString& outDump);
+	static	void					ResetAll();
+
+			void					Dump( VString& outDump) const;
+			void					Reset();
+
+			const char*				GetName() const								{ return fName;}
+			sLONG8					GetAcquisitions() const						{ return fAcquisitions;}
+			sLONG8					GetContendedAcquisitions() const			{ return fContendedAcquisitions;}
+			sLONG8					GetWaitMicroseconds() const					{ return fWaitMicroseconds;}
+
+			void					AddAcquisition()							{ VInterlocked::AtomicAdd( &fAcquisitions, 1);}
+			void					AddContendedAcquisition( sLONG8 inWaitMicroseconds)
+									{
+										VInterlocked::AtomicAdd( &fAcquisitions, 1);
+										VInterlocked::AtomicAdd( &fContendedAcquisitions, 1);
+										VInterlocked::AtomicAdd( &fWaitMicroseconds, inWaitMicroseconds);
+									}
+
+private:
+									VLockStatistics( const char *inName);
+									VLockStatistics( const VLockStatistics& );	// no copy
+			VLockStatistics&		operator=( const VLockStatistics& );		// no copy
+
+			char					fName[64];
+			sLONG8					fAcquisitions;
+			sLONG8					fContendedAcquisitions;
+			sLONG8					fWaitMicroseconds;
+			VLockStatistics*		fNext;
+
+	static	VLockStatistics*		sFirst;
+	static	SpinLockType			sListLock;
+};
+
+
 // Root class private to VTaskLock
 // Cant inherit from VObject because it uses VCppMem which uses a VCriticalSection
 
@@ -168,7 +217,9 @@ private:
 			sLONG					fUnlockStamp;	// incremented for each Unlock
 };
 
-#define VCriticalSection_USE_SPINLOCK 1
+// On linux, critical sections are built directly on a futex with adaptive spinning (see XLinuxFutex).
+#define VCriticalSection_USE_FUTEX		VERSION_LINUX
+#define VCriticalSection_USE_SPINLOCK	(!VCriticalSection_USE_FUTEX)
 
 class XTOOLBOX_API VCriticalSection : public VSyncObject
 {
@@ -197,7 +248,19 @@ public:
 
 			VTaskID					GetOwnerTaskID() const						{ return fOwner;}
 
+#if VCriticalSection_USE_FUTEX
+			// optional contention counters (NULL by default)
+			void					SetStatistics( VLockStatistics *inStatistics)	{ fStatistics = inStatistics;}
+			VLockStatistics*		GetStatistics() const						{ return fStatistics;}
+#endif
+
 private:
+#if VCriticalSection_USE_FUTEX
+			VTaskID					fOwner;
+			VLockStatistics*		fStatistics;
+			sLONG					fFutex;						/* 0: unlocked, 1: locked, 2: locked with waiters (cf XLinuxFutex) */
+			sLONG					fUseCount;
+#else
 			VSyncEvent*				fEvent;
 			VTaskID					fOwner;
 #if VCriticalSection_USE_SPINLOCK
@@ -208,6 +271,7 @@ private:
 			sLONG					fUseCount;
 	static	sLONG					sUnlockCount;
 #endif
+#endif
 };
 
 
@@ -291,6 +355,157 @@ private:
 typedef StLocker<VCriticalSection> VTaskLock;
 
 
+class XTOOLBOX_API VReadWriteLock : public VSyncObject
+{
+public:
+	/*
+			Fair reader-writer lock intended to protect read-mostly structures.
+
+			Any number of readers may hold the lock at the same time, writers are exclusive.
+			The lock is phase-fair: once a writer waits, new readers queue behind it,
+			and readers that queued during a write are all admitted before the next writer.
+			So neither readers nor writers can starve.
+
+			NOT recursive: a task holding the lock must not lock it again (in any mode).
+
+			fiber-aware (waiting tasks block on VSemaphore).
+	*/
+									VReadWriteLock();
+									~VReadWriteLock();
+
+			bool					LockRead();
+			bool					TryToLockRead();
+			bool					UnlockRead();
+
+			bool					LockWrite();
+			bool					TryToLockWrite();
+			bool					UnlockWrite();
+
+private:
+			void					_Lock()															{ SpinLockThread( fSpinLock);}
+			void					_Unlock()														{ SpinUnlock( fSpinLock);}
+
+			VSemaphore				fReadersGate;		/* waiting readers block here */
+			VSemaphore				fWritersGate;		/* waiting writers block here */
+			SpinLockType			fSpinLock;			/* Used for internal mutex on structure */
+			sLONG					fReaders;			/* number of active readers */
+			sLONG					fWaitingReaders;
+			sLONG					fWaitingWriters;
+			bool					fWriter;			/* a writer owns the lock */
+};
+
+
+/*
+	Epoch based reclamation of objects that may still be read by lock-free readers (see VSnapshot).
+
+	A reader enters a read section before loading a shared pointer and leaves it when done.
+	Retire() defers the deletion of an object that has been unpublished until every read section
+	that was opened before its retirement has been left.
+
+	Read sections are cheap: they only write in a record private to the calling task.
+	They can be nested but must not be held while waiting for something else.
+*/
+class VEpochRecord;
+
+class XTOOLBOX_API VEpochReclaimer
+{
+public:
+	typedef void (*DeleteProc)( void *inObject);
+
+	static	VEpochRecord*			EnterReadSection();
+	static	void					LeaveReadSection( VEpochRecord *inRecord);
+
+	// inDeleteProc( inObject) will be called once no reader can see inObject any more
+	static	void					Retire( void *inObject, DeleteProc inDeleteProc);
+
+	// deletes retired objects that are not visible any more. Retire() calls it already.
+	static	void					Reclaim();
+
+private:
+									VEpochReclaimer();	// not intended to be instantiated
+};
+
+
+template<class T>
+class VSnapshot : public VSyncObject
+{
+public:
+	/*
+			Holds a T published in copy-on-write mode:
+			readers never lock and never write to shared memory,
+			writers are serialized, copy the current value, modify the copy and publish it.
+			The previous value is deleted through VEpochReclaimer once no reader can see it.
+
+			Readers must use a VSnapshot<T>::Reader which pins the value for its life time.
+	*/
+	class Reader
+	{
+	public:
+									Reader( const VSnapshot<T>& inSnapshot)
+										: fRecord( VEpochReclaimer::EnterReadSection())
+										, fValue( *(T* const volatile*) &inSnapshot.fValue)	{;}
+									~Reader()												{ VEpochReclaimer::LeaveReadSection( fRecord);}
+
+			const T*				Get() const												{ return fValue;}
+			const T*				operator->() const										{ return fValue;}
+			const T&				operator*() const										{ return *fValue;}
+
+	private:
+									Reader( const Reader& );	// no copy
+			Reader&					operator=( const Reader& );	// no copy
+
+			VEpochRecord*			fRecord;
+			const T*				fValue;
+	};
+
+									VSnapshot( T *inInitialValue = NULL):fValue( inInitialValue)	{;}
+									~VSnapshot()											{ delete fValue;}	// no reader may remain
+
+			// copy-on-write update: returns a copy of current value (or a default T) to be passed to EndUpdate or CancelUpdate.
+			// writers are serialized between BeginUpdate and EndUpdate/CancelUpdate.
+			T*						BeginUpdate()											{ fWriterMutex.Lock(); return (fValue != NULL) ? new T( *fValue) : new T;}
+			void					EndUpdate( T *inNewValue)								{ Publish( inNewValue); fWriterMutex.Unlock();}
+			void					CancelUpdate( T *inNewValue)							{ delete inNewValue; fWriterMutex.Unlock();}
+
+			// replaces the published value without copy (takes ownership of inNewValue).
+			void					Publish( T *inNewValue)
+									{
+										StLocker<VCriticalSection> lock( &fWriterMutex);
+										T *previous = VInterlocked::ExchangePtr( &fValue, inNewValue);
+										if (previous != NULL)
+											VEpochReclaimer::Retire( previous, _Delete);
+									}
+
+private:
+	static	void					_Delete( void *inObject)								{ delete (T*) inObject;}
+
+			T*						fValue;
+			VCriticalSection		fWriterMutex;
+};
+
+
+class StReadLocker
+{
+public:
+			StReadLocker( VReadWriteLock* inLock) : fLock( inLock)	{ fLock->LockRead(); }
+			~StReadLocker()											{ fLock->UnlockRead(); }
+
+private:
+	VReadWriteLock*	fLock;
+};
+
+
+class StWriteLocker
+{
+public:
+			StWriteLocker( VReadWriteLock* inLock) : fLock( inLock)	{ fLock->LockWrite(); }
+			~StWriteLocker()										{ fLock->UnlockWrite(); }
+
+private:
+	VReadWriteLock*	fLock;
+};
+
+
 END_TOOLBOX_NAMESPACE
 
 #endif
@@ -23,6 +23,14 @@
 
 #include "VCharSetNames.h"
 
+#if WITH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if VERSIONWIN
+#include <intrin.h>
+#endif
+
 VTextConverters*		VTextConverters::sInstance = NULL;
 
 
@@ -73,6 +81,94 @@ static const uBYTE sFirstByteMark[7] =
 };
 
 
+// ---------------------------------------------------------------------------
+//  ASCII runs
+//
+//	Converts 16 bytes or 8 UniChars at a time as long as they are all ASCII
+//	and advances the pointers. The first block containing a non ASCII char is converted
+//	but the pointers only advance past its leading ASCII chars, and the rest is left to the regular code,
+//	so that results are the same with or without SSE2 (the destination past them may be scribbled).
+//	Mixed text such as latin languages would otherwise pay a failed block test for each ASCII char.
+// ---------------------------------------------------------------------------
+#if WITH_SSE2
+
+static inline uLONG _CountTrailingZeros( uLONG inMask)
+{
+#if VERSIONWIN
+	unsigned long index;
+	_BitScanForward( &index, inMask);
+	return (uLONG) index;
+#else
+	return (uLONG) __builtin_ctz( inMask);
+#endif
+}
+
+
+static void _ConvertASCIIRun( const uBYTE*& ioSource, const uBYTE *inSourceEnd, UniChar*& ioDestination, const UniChar *inDestinationEnd)
+{
+	const __m128i zero = _mm_setzero_si128();
+	while( (inSourceEnd - ioSource >= 16) && (inDestinationEnd - ioDestination >= 16) )
+	{
+		__m128i bytes = _mm_loadu_si128( (const __m128i*) ioSource);
+		_mm_storeu_si128( (__m128i*) ioDestination, _mm_unpacklo_epi8( bytes, zero));
+		_mm_storeu_si128( (__m128i*) (ioDestination + 8), _mm_unpackhi_epi8( bytes, zero));
+		uLONG nonASCII = (uLONG) _mm_movemask_epi8( bytes);
+		if (nonASCII != 0)
+		{
+			uLONG count = _CountTrailingZeros( nonASCII);
+			ioSource += count;
+			ioDestination += count;
+			break;
+		}
+		ioSource += 16;
+		ioDestination += 16;
+	}
+}
+
+
+// inBuffer may be NULL to only compute the size
+static void _ConvertASCIIRun( const UniChar*& ioSource, const UniChar *inSourceEnd, uBYTE*& ioDestination, const uBYTE *inDestinationEnd, bool inWrite)
+{
+	const __m128i nonASCIIMask = _mm_set1_epi16( (short) 0xFF80);
+	const __m128i zero = _mm_setzero_si128();
+	while( (inSourceEnd - ioSource >= 8) && (inDestinationEnd - ioDestination >= 8) )
+	{
+		__m128i chars = _mm_loadu_si128( (const __m128i*) ioSource);
+		if (inWrite)
+			_mm_storel_epi64( (__m128i*) ioDestination, _mm_packus_epi16( chars, chars));
+		uLONG nonASCII = (uLONG) _mm_movemask_epi8( _mm_cmpeq_epi16( _mm_and_si128( chars, nonASCIIMask), zero)) ^ 0xFFFF;
+		if (nonASCII != 0)
+		{
+			uLONG count = _CountTrailingZeros( nonASCII) / 2;
+			ioSource += count;
+			ioDestination += count;
+			break;
+		}
+		ioSource += 8;
+		ioDestination += 8;
+	}
+}
+
+#else
+
+static void _ConvertASCIIRun( const uBYTE*& /*ioSource*/, const uBYTE* /*inSourceEnd*/, UniChar*& /*ioDestination*/, const UniChar* /*inDestinationEnd*/)
+{
+}
+
+
+static void _ConvertASCIIRun( const UniChar*& /*ioSource*/, const UniChar* /*inSourceEnd*/, uBYTE*& /*ioDestination*/, const uBYTE* /*inDestinationEnd*/, bool /*inWrite*/)
+{
+}
+
+#endif
+
+// wchar_t strings take the regular code
+template<class T>
+static void _ConvertASCIIRun( const T*& /*ioSource*/, const T* /*inSourceEnd*/, uBYTE*& /*ioDestination*/, const uBYTE* /*inDestinationEnd*/, bool /*inWrite*/)
+{
+}
+
+
 /*
  * Copyright 2001-2004 Unicode, Inc.
  * 
@@ -693,6 +789,9 @@ bool VToUnicodeConverter_UTF8::Convert(const void* inSource, VSize inSourceBytes
 		{
 			*outPtr++ = UniChar(firstByte);
 			srcPtr++;
+			// a lone ASCII char between multibyte sequences is not worth a block test
+			if ((srcPtr < srcEnd) && (*srcPtr <= 127))
+				_ConvertASCIIRun( srcPtr, srcEnd, outPtr, outEnd);
 			continue;
 		}
 
@@ -802,6 +901,15 @@ static bool _Convert(const T* inSource, VIndex inSourceChars, VIndex *outCharsCo
         //
         uLONG curVal = static_cast<uLONG>( *srcPtr);
 
+        // Special-case ASCII runs (of more than one char)
+        if ((curVal < 0x80) && (srcEnd - srcPtr > 1) && (static_cast<uLONG>( srcPtr[1]) < 0x80))
+        {
+            const T *runStart = srcPtr;
+            _ConvertASCIIRun( srcPtr, srcEnd, outPtr, outEnd, inBuffer != NULL);
+            if (srcPtr != runStart)
+                continue;
+        }
+
         //
         //  If its a leading surrogate, then lets see if we have the trailing
         //  available. If not, then give up now and leave it for next time.
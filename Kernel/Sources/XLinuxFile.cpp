@@ -19,9 +19,91 @@
 #include "VErrorContext.h"
 #include "VTime.h"
 
+#include <sys/uio.h>
+
 
 
 const sLONG	kMAX_PATH_SIZE=PATH_MAX;
+const sLONG	kMAX_STACK_SEGMENTS=16;	//GetDataV & PutDataV don't allocate below this count of segments
+
+
+
+//Positional read or write of consecutive bytes at inOffset, resumed after a short transfer or EINTR.
+//The system pos isn't used nor moved, so that several threads may share the fd.
+static VError _TransferV(int inFd, bool inWrite, const FileDataSegment *inSegments, sLONG inSegmentsCount, sLONG8 inOffset, VSize& outCount)
+{
+	iovec stackVec[kMAX_STACK_SEGMENTS];
+	std::vector<iovec> heapVec;
+	iovec* vec=stackVec;
+
+	if(inSegmentsCount>kMAX_STACK_SEGMENTS)
+	{
+		heapVec.resize(inSegmentsCount);
+		vec=&heapVec[0];
+	}
+
+	for(sLONG i=0 ; i<inSegmentsCount ; i++)
+	{
+		vec[i].iov_base=inSegments[i].fData;
+		vec[i].iov_len=inSegments[i].fSize;
+	}
+
+	VError verr=VE_OK;
+	sLONG first=0;
+
+	outCount=0;
+
+	while(first<inSegmentsCount)
+	{
+		if(vec[first].iov_len==0)
+		{
+			first++;
+			continue;
+		}
+
+		sLONG8 offset=inOffset+outCount;
+
+#if VERSION_LINUX_ON_XCODE
+		//No preadv/pwritev : one segment at a time
+		ssize_t n=inWrite ? pwrite(inFd, vec[first].iov_base, vec[first].iov_len, offset) : pread(inFd, vec[first].iov_base, vec[first].iov_len, offset);
+#else
+		int count=(inSegmentsCount-first<IOV_MAX) ? inSegmentsCount-first : IOV_MAX;
+		ssize_t n=inWrite ? pwritev(inFd, vec+first, count, offset) : preadv(inFd, vec+first, count, offset);
+#endif
+
+		if(n<0)
+		{
+			if(errno==EINTR)
+				continue;
+
+			verr=MAKE_NATIVE_VERROR(errno);
+			break;
+		}
+
+		if(n==0)
+			break;	//EOF (never happens on write with a non empty buffer)
+
+		outCount+=n;
+
+		//Skip what was transfered : whole segments then a part of the next one
+		while(n>0)
+		{
+			if((size_t)n>=vec[first].iov_len)
+			{
+				n-=vec[first].iov_len;
+				first++;
+			}
+			else
+			{
+				vec[first].iov_base=(char*)vec[first].iov_base+n;
+				vec[first].iov_len-=n;
+				n=0;
+			}
+		}
+	}
+
+	return verr;
+}
 
 
 
@@ -31,7 +113,7 @@ const sLONG	kMAX_PATH_SIZE=PATH_MAX;
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-XLinuxFileDesc::XLinuxFileDesc(FileDescSystemRef inRef) : fFd(inRef) { }
+XLinuxFileDesc::XLinuxFileDesc(FileDescSystemRef inRef) : fFd(inRef), fConcurrent(false), fPendingPos(-1) { }
 
 
 //virtual
@@ -85,36 +167,19 @@ VError XLinuxFileDesc::CreateFile(const char* inPath, FileCreateOptions inCreate
 
 VError XLinuxFileDesc::GetSize(sLONG8 *outSize) const
 {
-	//There are two easy ways to implement this function : lseek and fstat.
-	//Both are easy and should work. I choose lseek in an arbitrary way.
-
-	//Utiliser stat helper !
+	//fstat rather than lseek : one syscall and the seek ptr isn't touched (fd may be shared by several threads)
 
 	if(!IsValid())
 		return VE_INVALID_PARAMETER;
 
-	sLONG8 pos=0;
-	sLONG8 end=0;
+	struct stat fileStat;
 
-	VError verr=GetPos(&pos);
-	
-	if(verr==VE_OK)
-		verr=SetPos(0, END);
-	else
+	if(fstat(fFd, &fileStat)<0)
 		return MAKE_NATIVE_VERROR(errno);
 
-	if(verr==VE_OK)
-		verr=GetPos(&end);
-	
-	if(verr==VE_OK)
-	{
-		*outSize=end;
-		verr=SetPos(pos, SET);
-	}
+	*outSize=fileStat.st_size;
 
-	xbox_assert(verr==VE_OK);	//We should always be able to restore seek ptr
-
-    return verr;
+    return VE_OK;
 }
 
 
@@ -135,7 +200,13 @@ VError XLinuxFileDesc::GetData(void *outData, VSize &ioCount, sLONG8 inOffset, b
 	if(!IsValid())
 		return VE_INVALID_PARAMETER;
 
-	VError verr=SetPos(inOffset, inFromStart);
+	if(inFromStart)
+	{
+		FileDataSegment segment={outData, ioCount};
+		return GetDataV(&segment, 1, ioCount, inOffset);
+	}
+
+	VError verr=SetPos(inOffset, CUR);
 
 	if(verr!=VE_OK)
 	{
@@ -180,7 +251,13 @@ VError XLinuxFileDesc::PutData(const void *inData, VSize& ioCount, sLONG8 inOffs
 	if(!IsValid())
 		return VE_INVALID_PARAMETER;
 
-	VError verr=SetPos(inOffset, inFromStart);
+	if(inFromStart)
+	{
+		FileDataSegment segment={const_cast<void*>(inData), ioCount};
+		return PutDataV(&segment, 1, ioCount, inOffset);
+	}
+
+	VError verr=SetPos(inOffset, CUR);
 
 	if(verr!=VE_OK)
 	{
@@ -215,6 +292,53 @@ VError XLinuxFileDesc::PutData(const void *inData, VSize& ioCount, sLONG8 inOffs
 }
 
 
+VError XLinuxFileDesc::GetDataV(const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const
+{
+	if(!IsValid())
+	{
+		ioCount=0;
+		return VE_INVALID_PARAMETER;
+	}
+
+	VSize bytes=ioCount;
+	VSize count=0;
+
+	VError verr=_TransferV(fFd, false /*read*/, inSegments, inSegmentsCount, inOffset, count);
+
+	//Same as GetData : callers expect impl. to fail if it can not fill the buffers
+	if(verr==VE_OK && bytes>count)
+		verr=VE_STREAM_EOF;
+
+	if(!fConcurrent)
+		fPendingPos=inOffset+count;
+
+	ioCount=count;
+
+	return verr;
+}
+
+
+VError XLinuxFileDesc::PutDataV(const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const
+{
+	if(!IsValid())
+	{
+		ioCount=0;
+		return VE_INVALID_PARAMETER;
+	}
+
+	VSize count=0;
+
+	VError verr=_TransferV(fFd, true /*write*/, inSegments, inSegmentsCount, inOffset, count);
+
+	if(!fConcurrent)
+		fPendingPos=inOffset+count;
+
+	ioCount=count;
+
+	return verr;
+}
+
+
 VError XLinuxFileDesc::GetPos(sLONG8* outPos) const
 {
 	if(!IsValid())
@@ -254,11 +378,20 @@ VError XLinuxFileDesc::SetPos(sLONG8 inOffset, Whence inWhence, sLONG8* outLastP
 		return VE_INVALID_PARAMETER;
 	}
 
+	//A relative seek starts from the pos left by the last positional access
+	if(fPendingPos>=0 && whence==SEEK_CUR)
+	{
+		inOffset+=fPendingPos;
+		whence=SEEK_SET;
+	}
+
 	off_t res=lseek(fFd, inOffset, whence);
 
 	if(res<0)
 		return MAKE_NATIVE_VERROR(errno);
 
+	fPendingPos=-1;
+
     if(outLastPos!=NULL)
         *outLastPos=res;
 
@@ -339,11 +472,13 @@ VError XLinuxFile::Open(const FileAccess inFileAccess, FileOpenOptions inOptions
 	if(verr!=VE_OK)
 		return verr;
 
-	*outFileDesc=new VFileDesc(fOwner, fd, inFileAccess);
+	*outFileDesc=new VFileDesc(fOwner, fd, inFileAccess, inOptions);
 
-	if(outFileDesc==NULL)
+	if(*outFileDesc==NULL)
 		return VE_MEMORY_FULL;
 
+	(*outFileDesc)->fImpl.SetConcurrentAccess((inOptions & FO_ConcurrentAccess)!=0);
+
 	return verr;
 }
 
@@ -355,7 +490,7 @@ VError XLinuxFile::Create(FileCreateOptions inOptions) const
 }
 
 
-VError XLinuxFile::Copy(const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions ) const
+VError XLinuxFile::Copy(const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions, VFileCopyProgress* inProgress) const
 {
 	VFilePath tmpPath(inDestination);
 	
@@ -370,7 +505,12 @@ VError XLinuxFile::Copy(const VFilePath& inDestination, VFile** outFile, FileCop
  	dstPath.Init(tmpPath);
 
 	CopyHelper cpHlp;
-	return cpHlp.Copy(fPath, dstPath);
+	VError verr=cpHlp.SetProgress(inProgress).Copy(fPath, dstPath);
+
+	if(outFile!=NULL)
+		*outFile=(verr==VE_OK) ? new VFile(tmpPath) : NULL;
+
+	return verr;
 }
 
 
@@ -390,7 +530,7 @@ VError XLinuxFile::Move(const VFilePath& inDestinationPath, VFile** outFile, Fil
 
 	//If Rename() fails beacause src and dst are not on the same fs, we try a Copy()
 	if(verr!=VE_OK && IS_NATIVE_VERROR(verr) && NATIVE_ERRCODE_FROM_VERROR(verr)==EXDEV)
-		verr=Copy(inDestinationPath, outFile, inOptions);
+		verr=Copy(inDestinationPath, outFile, inOptions, NULL);
 
 	return verr;
 }
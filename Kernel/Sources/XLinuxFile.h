@@ -32,6 +32,7 @@ class VURL;
 // class VString;
 // class VFolder;
 class VFileDesc;
+class VFileCopyProgress;
 // class VFileIterator;
 // class VTime;
 class VFileKind;
@@ -53,6 +54,8 @@ public:
     VError            SetSize(sLONG8 inSize) const;
     VError            GetData(void *outData, VSize &ioCount, sLONG8 inOffset, bool inFromStart) const;
     VError            PutData(const void *inData, VSize& ioCount, sLONG8 inOffset, bool inFromStart) const;
+    VError            GetDataV(const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const;
+    VError            PutDataV(const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const;
     VError            GetPos(sLONG8 *outSize) const;
 	VError            SetPos(sLONG8 inOffset, Whence inWhence, sLONG8* outLastPos=NULL) const;
     VError            SetPos(sLONG8 inOffset, bool inFromStart) const;
@@ -60,8 +63,16 @@ public:
 
     FileDescSystemRef GetSystemRef() const;
 
+	//FO_ConcurrentAccess : positional accesses don't maintain the current pos
+	void              SetConcurrentAccess(bool inConcurrent) { fConcurrent=inConcurrent; }
+
 protected:
     FileDescSystemRef   fFd;
+	bool                fConcurrent;
+
+	//Positional accesses (pread/pwrite) don't move the system pos : the pos they should have
+	//set is kept here and applied before the next access that depends on it (-1 if none).
+	mutable sLONG8      fPendingPos;
 };
 
 
@@ -77,7 +88,7 @@ class XTOOLBOX_API XLinuxFile : public VObject
 
 	VError Open(const FileAccess inFileAccess, FileOpenOptions inOptions, VFileDesc** outFileDesc) const;
 	VError Create(FileCreateOptions inOptions) const;
-    VError Copy(const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions) const;
+    VError Copy(const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions, VFileCopyProgress* inProgress) const;
     VError Move(const VFilePath& inDestinationPath, VFile** outFile, FileCopyOptions iOptions) const;
     VError Rename(const VString& inName, VFile** outFile) const;
 	VError Rename(const VFilePath& inPath, VFile** outFile) const;
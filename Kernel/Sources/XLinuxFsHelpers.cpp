@@ -17,6 +17,7 @@
 #include "VAssert.h"
 // #include "VErrorContext.h"
 #include "VTime.h"
+#include "VFile.h"
 
 #include "XLinuxFsHelpers.h"
 
@@ -28,12 +29,40 @@
 #include <sys/time.h>
 #include <utime.h>
 #include <limits.h>
+#include <sys/ioctl.h>
+
+#if VERSION_LINUX_STRICT
+	#include <sys/syscall.h>
+	#include <sys/sendfile.h>
+#endif
+
+#ifndef FICLONE
+	#define FICLONE _IOW(0x94, 9, int)	//linux/fs.h, since 4.5 (btrfs ioctl before)
+#endif
 
 
 #define PERM_755 S_IRWXU|S_IRGRP|S_IXGRP|S_IROTH|S_IXOTH
 #define PERM_644 S_IRUSR|S_IWUSR|S_IRGRP|S_IROTH
 
 
+const sLONG8 kCOPY_CHUNK_SIZE=8*1024*1024;	//Bytes copied between two progress reports
+const VSize	 kCOPY_BUFFER_SIZE=1024*1024;	//For the pread/pwrite fallback
+const long	 kREADDIR_BUFFER_SIZE=64*1024;	//About 2000 entries per getdents64 call
+
+
+#if VERSION_LINUX_STRICT
+//getdents64 record, not declared by glibc before 2.30
+typedef struct LinuxDirent64
+{
+	uint64_t		d_ino;
+	int64_t			d_off;
+	unsigned short	d_reclen;
+	unsigned char	d_type;
+	char			d_name[1];
+} LinuxDirent64;
+#endif
+
+
 
 //jmo - Ranger ca qq part !
 static VTime UnixToXBoxTime(time_t inTime)
@@ -622,6 +651,60 @@ VError StatHelper::Stat(const PathBuffer& inPath)
 }
 
 
+VError StatHelper::StatAt(FileDescSystemRef inDirFd, const char* inName)
+{
+	int flags=(fFlags&followLinks) ? 0 : AT_SYMLINK_NOFOLLOW;
+	int res=-1;
+	bool done=false;
+
+#if VERSION_LINUX_STRICT && defined(__NR_statx) && defined(STATX_TYPE)
+	static sLONG sNoStatx=0;
+
+	if(sNoStatx==0)
+	{
+		struct statx stx;
+		unsigned int mask=(fFlags&kindOnly) ? STATX_TYPE : STATX_BASIC_STATS;
+		int syncFlags=(fFlags&kindOnly) ? AT_STATX_DONT_SYNC : AT_STATX_SYNC_AS_STAT;	//The type of a file doesn't change
+
+		res=(int)syscall(__NR_statx, inDirFd, inName, flags|syncFlags|AT_NO_AUTOMOUNT, mask, &stx);
+
+		if(res==0)
+		{
+			fStat.st_mode=stx.stx_mode;
+			fStat.st_ino=stx.stx_ino;
+			fStat.st_nlink=stx.stx_nlink;
+			fStat.st_uid=stx.stx_uid;
+			fStat.st_gid=stx.stx_gid;
+			fStat.st_size=stx.stx_size;
+			fStat.st_atime=stx.stx_atime.tv_sec;
+			fStat.st_mtime=stx.stx_mtime.tv_sec;
+			fStat.st_ctime=stx.stx_ctime.tv_sec;
+		}
+
+		if(res==0 || errno!=ENOSYS)
+			done=true;
+		else
+			sNoStatx=1;		//Kernel older than 4.11
+	}
+#endif
+
+	if(!done)
+		res=fstatat(inDirFd, inName, &fStat, flags);
+
+	if(res!=0)
+	{
+		if(errno==ENOENT || errno==ENOTDIR)
+			fDoesNotExist=true;
+
+		return MAKE_NATIVE_VERROR(errno);
+	}
+
+	fDoesExist=true;
+
+	return VE_OK;
+}
+
+
 VError StatHelper::Stat(FileDescSystemRef fd)
 {
 	int res=fstat(fd, &fStat);
@@ -843,7 +926,7 @@ void* MapHelper::GetAddr() { return fAddr; }
 //
 ////////////////////////////////////////////////////////////////////////////////
 
-CopyHelper::CopyHelper() : fSrcSize(0), fSrcFd(-1), fDstFd(-1) {}
+CopyHelper::CopyHelper() : fSrcSize(0), fCopied(0), fSrcFd(-1), fDstFd(-1), fProgress(NULL) {}
 
 
 CopyHelper::~CopyHelper()
@@ -856,6 +939,9 @@ CopyHelper::~CopyHelper()
 }
 
 
+CopyHelper& CopyHelper::SetProgress(VFileCopyProgress* inProgress) { fProgress=inProgress; return *this; }
+
+
 VError CopyHelper::Copy(const PathBuffer& inSrc, const PathBuffer& inDst)
 {
 	VError verr=DoInit(inSrc, inDst);
@@ -864,7 +950,8 @@ VError CopyHelper::Copy(const PathBuffer& inSrc, const PathBuffer& inDst)
 
 		verr=DoCopy();
 
-	if(verr!=VE_OK)
+	//Do not remove the destination if we didn't open it (it may be the source)
+	if(verr!=VE_OK && fDstFd>=0)
 		DoClean(inDst);
 
 	return verr;
@@ -880,59 +967,234 @@ VError CopyHelper::DoInit(const PathBuffer& inSrc, const PathBuffer& inDst)
 	if(verr!=VE_OK)
 		return verr;
 
-	StatHelper srcStats;
+	struct stat srcStats;
+
+	if(fstat(fSrcFd, &srcStats)!=0)
+		return MAKE_NATIVE_VERROR(errno);
+
+	fSrcSize=srcStats.st_size;
+
+	OpenHelper dstOpnHlp;
+
+	FileDescSystemRef dstFd=-1;
 
-	verr=srcStats.Stat(fSrcFd);
+	verr=dstOpnHlp.SetFileAccess(FA_READ_WRITE).SetFileOpenOpts(FO_CreateIfNotFound).Open(inDst, &dstFd);
 
 	if(verr!=VE_OK)
 		return verr;
 
-	fSrcSize=srcStats.GetSize();
+	//Copying a file on itself would truncate it
+	struct stat dstStats;
 
-	OpenHelper dstOpnHlp;
+	int err=(fstat(dstFd, &dstStats)==0) ? 0 : errno;
 
-	verr=dstOpnHlp.SetFileAccess(FA_READ_WRITE).SetFileOpenOpts(FO_CreateIfNotFound).Open(inDst, &fDstFd);
+	if(err==0 && dstStats.st_dev==srcStats.st_dev && dstStats.st_ino==srcStats.st_ino)
+		err=EINVAL;
 
-	return verr;
+	if(err!=0)
+	{
+		close(dstFd);
+		return MAKE_NATIVE_VERROR(err);
+	}
+
+	fDstFd=dstFd;
+
+	if(ftruncate(fDstFd, 0)!=0)
+		return MAKE_NATIVE_VERROR(errno);
+
+	return VE_OK;
 }
 
 
 VError CopyHelper::DoCopy()
 {
-	ResizeHelper dstRszHlp;
+	int res=DoClone();
 
-	VError verr=dstRszHlp.Resize(fDstFd, fSrcSize);
+	if(res==ENOSYS)
+		res=DoCopyFileRange();
 
-	if(verr!=VE_OK)
-		return verr;
+	if(res==ENOSYS)
+		res=DoSendFile();
 
-	MapHelper srcMapHlp;
+	if(res==ENOSYS)
+		res=DoReadWrite();
 
-	verr=srcMapHlp.Map(fSrcFd, fSrcSize);
+	if(res==ECANCELED)
+		return VE_USER_ABORT;
 
-	if(verr!=VE_OK)
-		return verr;
+	return (res==0) ? VE_OK : MAKE_NATIVE_VERROR(res);
+}
+
+
+bool CopyHelper::IsUnsupported(int inErrno) const
+{
+	//Various ways for a file system (or a kernel) to say it can't do it.
+	return inErrno==ENOSYS || inErrno==EXDEV || inErrno==EINVAL || inErrno==EOPNOTSUPP || inErrno==ENOTTY;
+}
 
-	void* srcAddr=srcMapHlp.GetAddr();
 
-	MapHelper dstMapHlp;
+bool CopyHelper::DoProgress(sLONG8 inBytes)
+{
+	return (fProgress==NULL) || fProgress->Add(inBytes);
+}
 
-	verr=dstMapHlp.SetProtection(MapHelper::WRITE).Map(fDstFd, fSrcSize);
 
-	if(verr!=VE_OK)
+int CopyHelper::DoClone()
+{
+#if VERSION_LINUX_STRICT
+	if(fCopied>0)
+		return ENOSYS;
+
+	if(ioctl(fDstFd, FICLONE, fSrcFd)!=0)
+		return IsUnsupported(errno) ? ENOSYS : errno;
+
+	fCopied=fSrcSize;
+
+	//The copy is done, too late to cancel
+	DoProgress(fSrcSize);
+
+	return 0;
+#else
+	return ENOSYS;
+#endif
+}
+
+
+int CopyHelper::DoCopyFileRange()
+{
+#if VERSION_LINUX_STRICT && defined(__NR_copy_file_range)
+	sLONG8 start=fCopied;
+
+	while(fCopied<fSrcSize)
 	{
-		srcMapHlp.UnMap();
-		return verr;
+		loff_t srcOffset=fCopied;
+		loff_t dstOffset=fCopied;
+		size_t count=(size_t)Min(fSrcSize-fCopied, kCOPY_CHUNK_SIZE);
+
+		//Not using the glibc wrapper which appeared with 2.27
+		ssize_t res=syscall(__NR_copy_file_range, fSrcFd, &srcOffset, fDstFd, &dstOffset, count, 0);
+
+		if(res<0)
+		{
+			if(errno==EINTR)
+				continue;
+
+			return (fCopied==start && IsUnsupported(errno)) ? ENOSYS : errno;
+		}
+
+		//Either the file has been truncated meanwhile or the file system says so (procfs, sysfs)
+		if(res==0)
+			return (fCopied==start) ? ENOSYS : 0;
+
+		fCopied+=res;
+
+		if(!DoProgress(res))
+			return ECANCELED;
 	}
 
-	void* dstAddr=dstMapHlp.GetAddr();
+	return 0;
+#else
+	return ENOSYS;
+#endif
+}
 
-	memcpy(dstAddr, srcAddr, fSrcSize);
 
-	srcMapHlp.UnMap();
-	dstMapHlp.UnMap();
+int CopyHelper::DoSendFile()
+{
+#if VERSION_LINUX_STRICT
+	sLONG8 start=fCopied;
 
-	return verr;
+	//sendfile writes at the current position of dst
+	if(lseek(fDstFd, fCopied, SEEK_SET)<0)
+		return errno;
+
+	while(fCopied<fSrcSize)
+	{
+		off_t srcOffset=fCopied;
+		size_t count=(size_t)Min(fSrcSize-fCopied, kCOPY_CHUNK_SIZE);
+
+		ssize_t res=sendfile(fDstFd, fSrcFd, &srcOffset, count);
+
+		if(res<0)
+		{
+			if(errno==EINTR)
+				continue;
+
+			return (fCopied==start && IsUnsupported(errno)) ? ENOSYS : errno;
+		}
+
+		if(res==0)
+			return (fCopied==start) ? ENOSYS : 0;
+
+		fCopied+=res;
+
+		if(!DoProgress(res))
+			return ECANCELED;
+	}
+
+	return 0;
+#else
+	return ENOSYS;
+#endif
+}
+
+
+int CopyHelper::DoReadWrite()
+{
+	char* buffer=(char*)VMemory::NewPtr(kCOPY_BUFFER_SIZE, 'copy');
+
+	if(buffer==NULL)
+		return ENOMEM;
+
+#if VERSION_LINUX_STRICT
+	posix_fadvise(fSrcFd, fCopied, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	int err=0;
+	sLONG8 sinceProgress=0;
+
+	while(err==0 && fCopied<fSrcSize)
+	{
+		ssize_t readCount=pread(fSrcFd, buffer, kCOPY_BUFFER_SIZE, fCopied);
+
+		if(readCount<0)
+		{
+			if(errno!=EINTR)
+				err=errno;
+			continue;
+		}
+
+		//The file has been truncated meanwhile
+		if(readCount==0)
+			break;
+
+		for(ssize_t written=0 ; err==0 && written<readCount ; )
+		{
+			ssize_t res=pwrite(fDstFd, buffer+written, readCount-written, fCopied+written);
+
+			if(res>=0)
+				written+=res;
+			else if(errno!=EINTR)
+				err=errno;
+		}
+
+		if(err==0)
+		{
+			fCopied+=readCount;
+			sinceProgress+=readCount;
+
+			if(sinceProgress>=kCOPY_CHUNK_SIZE || fCopied>=fSrcSize)
+			{
+				if(!DoProgress(sinceProgress))
+					err=ECANCELED;
+				sinceProgress=0;
+			}
+		}
+	}
+
+	VMemory::DisposePtr(buffer);
+
+	return err;
 }
 
 
@@ -986,79 +1248,201 @@ VError RmdirHelper::RemoveDir(const PathBuffer& inPath) const
 ////////////////////////////////////////////////////////////////////////////////
 
 ReaddirHelper::ReaddirHelper(const PathBuffer& inFolderPath, FileIteratorOptions inOptions) :
-	fOpts(inOptions), fDir(NULL), fPath(inFolderPath)
+#if VERSION_LINUX_STRICT
+	fOpts(inOptions), fPath(inFolderPath), fFd(-1), fBuffer(NULL), fBufferSize(0), fBufferPos(0)
+{
+	//If it fails for any reason (inFolderPath is a file for ex.), there's no entry.
+	fFd=open(inFolderPath.GetPath(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+}
+#else
+	fOpts(inOptions), fPath(inFolderPath), fDir(NULL)
 {
-	memset(&fEntry, 0, sizeof(fEntry));
-
 	//If it fails for any reason (inFolderPath is a file for ex.), opendir returns NULL.
 	fDir=opendir(inFolderPath.GetPath());
 }
+#endif
 
 
 ReaddirHelper::~ReaddirHelper()
 {
+#if VERSION_LINUX_STRICT
+	if(fFd>=0)
+		close(fFd);
+
+	delete[] fBuffer;
+#else
 	if(fDir!=NULL)
 		closedir(fDir);
+#endif
 }
 
 
-PathBuffer* ReaddirHelper::Next(PathBuffer* outNextPath)
+FileDescSystemRef ReaddirHelper::GetFd() const
+{
+#if VERSION_LINUX_STRICT
+	return fFd;
+#else
+	return (fDir!=NULL) ? dirfd(fDir) : -1;
+#endif
+}
+
+
+static bool IsDotOrDotDot(const char* inName)
+{
+	return inName[0]=='.' && (inName[1]==0 || (inName[1]=='.' && inName[2]==0));
+}
+
+
+const char* ReaddirHelper::NextEntry(uBYTE* outType)
 {
-	if(fDir==NULL || outNextPath==NULL)
+#if VERSION_LINUX_STRICT
+	if(fFd<0)
+		return NULL;
+
+	for(;;)
+	{
+		if(fBufferPos>=fBufferSize)
+		{
+			if(fBuffer==NULL)
+				fBuffer=new char[kREADDIR_BUFFER_SIZE];
+
+			//0 at the end of the folder
+			long res=syscall(__NR_getdents64, fFd, fBuffer, kREADDIR_BUFFER_SIZE);
+
+			if(res<=0)
+			{
+				fBufferSize=fBufferPos=0;
+				return NULL;
+			}
+
+			fBufferSize=res;
+			fBufferPos=0;
+		}
+
+		LinuxDirent64* entry=reinterpret_cast<LinuxDirent64*>(fBuffer+fBufferPos);
+		fBufferPos+=entry->d_reclen;
+
+		if(!IsDotOrDotDot(entry->d_name))
+		{
+			if(outType!=NULL)
+				*outType=entry->d_type;
+
+			return entry->d_name;
+		}
+	}
+#else
+	if(fDir==NULL)
 		return NULL;
 
-	struct dirent* entryPtr=NULL;
+	for(;;)
+	{
+		struct dirent* entry=readdir(fDir);
+
+		if(entry==NULL)
+			return NULL;
+
+		if(!IsDotOrDotDot(entry->d_name))
+		{
+			if(outType!=NULL)
+				*outType=entry->d_type;
+
+			return entry->d_name;
+		}
+	}
+#endif
+}
 
-	//res replaces errno on failure
-	int res=readdir_r(fDir, &fEntry, &entryPtr);
 
-	if(entryPtr==NULL)
+FileIteratorOptions ReaddirHelper::GetKind(const char* inName, uBYTE inType, bool inResolveLinks, bool* outIsLink)
+{
+	bool isLink=(inType==DT_LNK);
+
+	if(inType==DT_UNKNOWN)
+	{
+		//Some file systems (or old xfs) don't fill d_type
+		StatHelper statHlp;
+		statHlp.SetFlags(StatHelper::kindOnly);
+
+		if(statHlp.StatAt(GetFd(), inName)!=VE_OK)
+			return FI_WANT_NONE;
+
+		isLink=statHlp.IsLink();
+		inType=statHlp.IsDir() ? DT_DIR : (statHlp.IsRegular() ? DT_REG : DT_UNKNOWN);
+	}
+
+	if(outIsLink!=NULL)
+		*outIsLink=isLink;
+
+	if(isLink)
+	{
+		//Unless we prefer to follow them, links are exposed as special files
+		if(!inResolveLinks)
+			return FI_WANT_FILES;
+
+		StatHelper statHlp;
+		statHlp.SetFlags((StatHelper::StatFlags)(StatHelper::followLinks|StatHelper::kindOnly));
+
+		if(statHlp.StatAt(GetFd(), inName)!=VE_OK)
+			return FI_WANT_NONE;
+
+		inType=statHlp.IsDir() ? DT_DIR : (statHlp.IsRegular() ? DT_REG : DT_UNKNOWN);
+	}
+
+	if(inType==DT_REG)
+		return FI_WANT_FILES;
+
+	if(inType==DT_DIR)
+		return FI_WANT_FOLDERS;
+
+	return FI_WANT_NONE;
+}
+
+
+PathBuffer* ReaddirHelper::Next(PathBuffer* outNextPath)
+{
+	if(outNextPath==NULL)
+		return NULL;
+
+	const char* name=NextEntry(NULL);
+
+	if(name==NULL)
 		return NULL;
 
 	//reset path
 	*outNextPath=fPath;
 
-	return (outNextPath->AppendName(entryPtr->d_name)==VE_OK) ? outNextPath : NULL;
+	return (outNextPath->AppendName(name)==VE_OK) ? outNextPath : NULL;
 }
 
 
 PathBuffer* ReaddirHelper::Next(PathBuffer* outNextPath, FileIteratorOptions inWanted, FileIteratorOptions* outFound)
 {
-	outNextPath=Next(outNextPath);
-
 	if(outNextPath==NULL)
 		return NULL;
 
+	uBYTE type=DT_UNKNOWN;
 
-	if(!outNextPath->IsDotOrDotDot())
+	//Loop until we find what we are looking for.
+	for(const char* name=NextEntry(&type) ; name!=NULL ; name=NextEntry(&type))
 	{
-		StatHelper statHlp;
+		FileIteratorOptions kind=GetKind(name, type, (inWanted&FI_RESOLVE_ALIASES)!=0);
 
-		if(inWanted&FI_RESOLVE_ALIASES)
-			statHlp.SetFlags(StatHelper::followLinks);
+		if((kind&inWanted)==0)
+			continue;
 
-		statHlp.Stat(*outNextPath);
+		//reset path
+		*outNextPath=fPath;
 
-		//Unless we prefer to follow them, links are exposed as special files
-		if(inWanted&FI_WANT_FILES && (statHlp.IsRegular() || statHlp.IsLink()))
-		{
-			if(outFound!=NULL)
-				*outFound=FI_WANT_FILES;
-
-			return outNextPath;
-		}
+		if(outNextPath->AppendName(name)!=VE_OK)
+			continue;
 
-		if(inWanted&FI_WANT_FOLDERS && statHlp.IsDir())
-		{
-			if(outFound!=NULL)
-				*outFound=FI_WANT_FOLDERS;
+		if(outFound!=NULL)
+			*outFound=kind;
 
-			return outNextPath;
-		}
+		return outNextPath;
 	}
 
-	//We didn't found what we where looking for. Let's continue.
-	return Next(outNextPath, inWanted, outFound);
+	return NULL;
 }
 
 
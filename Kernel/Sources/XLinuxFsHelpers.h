@@ -43,6 +43,8 @@ BEGIN_TOOLBOX_NAMESPACE
 
 typedef int FileDescSystemRef;
 
+class VFileCopyProgress;
+
 
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -207,10 +209,14 @@ public :
 	VError Stat(const PathBuffer& inPath);
 	VError Stat(FileDescSystemRef fd);
 
+	//Stats inName in the folder inDirFd (statx when available, fstatat otherwise).
+	//With the kindOnly flag, statx only asks for the file type and the file system may answer from its cache.
+	VError StatAt(FileDescSystemRef inDirFd, const char* inName);
+
 	bool	Access();
 	bool	Access(const PathBuffer& inPath);
 
-	typedef enum {vanillaStat=0, followLinks=1, withFileSystemStats=2} StatFlags;
+	typedef enum {vanillaStat=0, followLinks=1, withFileSystemStats=2, kindOnly=4} StatFlags;
 	StatHelper&	SetFlags(StatFlags inFlags);
 
 	VSize	GetSize();
@@ -349,6 +355,14 @@ private :
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+//Streams the data from src to dst, trying in turn (from the cheapest to the most expensive) :
+// - a reflink (FICLONE) : the files share their blocks until one of them is modified (btrfs, xfs)
+// - copy_file_range : in kernel copy, server side on nfs 4.2 and smb
+// - sendfile : in kernel copy
+// - pread/pwrite with a buffer
+//Each method falls back to the next one if the file systems don't support it. The data is copied
+//by chunks so that the progress can be reported and the copy cancelled (VE_USER_ABORT).
+
 class CopyHelper
 {
 public :
@@ -356,6 +370,7 @@ public :
 	CopyHelper();
 	~CopyHelper();
 
+	CopyHelper& SetProgress(VFileCopyProgress* inProgress);
 	VError Copy(const PathBuffer& inSrc, const PathBuffer& inDst);
 
 
@@ -365,9 +380,21 @@ private :
 	VError DoCopy();
 	VError DoClean(const PathBuffer& inDst);
 
-	VSize			  fSrcSize;
+	//Each one returns 0 when the copy is done, ENOSYS if the method can't be used (the next one should be tried),
+	//ECANCELED if the copy has been cancelled or another errno
+	int	   DoClone();
+	int	   DoCopyFileRange();
+	int	   DoSendFile();
+	int	   DoReadWrite();
+
+	bool   DoProgress(sLONG8 inBytes);
+	bool   IsUnsupported(int inErrno) const;
+
+	sLONG8			  fSrcSize;
+	sLONG8			  fCopied;
 	FileDescSystemRef fSrcFd;
 	FileDescSystemRef fDstFd;
+	VFileCopyProgress* fProgress;
 };
 
 
@@ -408,6 +435,9 @@ public :
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+//Reads the folder entries by batches (getdents64 on linux) and takes their kind from d_type, so that
+//an entry is only stat'ed if it's a link to resolve or if the file system doesn't fill d_type.
+
 class ReaddirHelper
 {
 public :
@@ -418,6 +448,17 @@ public :
 	PathBuffer* Next(PathBuffer* outNextPath);
 	PathBuffer* Next(PathBuffer* outNextPath, FileIteratorOptions inWanted, FileIteratorOptions* outFound);
 
+	//Returns the name of the next entry ('.' and '..' are skipped) and its d_type (DT_UNKNOWN if the file
+	//system doesn't tell). The name is valid until the next call.
+	const char* NextEntry(uBYTE* outType);
+
+	//FI_WANT_FILES, FI_WANT_FOLDERS or FI_WANT_NONE (special files, dangling links) for an entry returned by NextEntry.
+	//Unless inResolveLinks, links are exposed as files.
+	FileIteratorOptions GetKind(const char* inName, uBYTE inType, bool inResolveLinks, bool* outIsLink=NULL);
+
+	//Folder fd, for StatHelper::StatAt
+	FileDescSystemRef GetFd() const;
+
 
 private :
 
@@ -426,9 +467,15 @@ private :
 	ReaddirHelper& operator=(const ReaddirHelper& toto);
 
 	FileIteratorOptions	fOpts;
-	DIR*				fDir;
 	PathBuffer			fPath;
-	struct dirent		fEntry;
+#if VERSION_LINUX_STRICT
+	FileDescSystemRef	fFd;
+	char*				fBuffer;		//Last getdents64 batch
+	long				fBufferSize;
+	long				fBufferPos;
+#else
+	DIR*				fDir;
+#endif
 };
 
 
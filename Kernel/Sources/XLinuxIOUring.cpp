@@ -0,0 +1,382 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#include "VKernelPrecompiled.h"
+#include "XLinuxIOUring.h"
+
+#if VERSION_LINUX_STRICT
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#endif
+
+
+// Class constants
+const uLONG	kMAX_OPERATION_SIZE = 0x7ffff000;	// what the kernel transfers at most in one read or write
+
+
+#if VERSION_LINUX_STRICT
+
+// the rings are shared with the kernel: the producer publishes its tail with release semantic,
+// the consumer reads it with acquire semantic.
+static inline uLONG _LoadAcquire( const uLONG *inValue)
+{
+	return __atomic_load_n( inValue, __ATOMIC_ACQUIRE);
+}
+
+
+static inline void _StoreRelease( uLONG *outValue, uLONG inValue)
+{
+	__atomic_store_n( outValue, inValue, __ATOMIC_RELEASE);
+}
+
+
+static inline int _Enter( int inRingFd, uLONG inToSubmit, uLONG inMinComplete, uLONG inFlags)
+{
+	return (int) syscall( __NR_io_uring_enter, inRingFd, inToSubmit, inMinComplete, inFlags, NULL, 0);
+}
+
+#endif
+
+
+XLinuxIOUring::XLinuxIOUring()
+: fRingFd( -1)
+, fFileOperations( false)
+, fSqRing( NULL)
+, fSqRingSize( 0)
+, fSqes( NULL)
+, fSqesSize( 0)
+, fSqHead( NULL)
+, fSqTail( NULL)
+, fSqArray( NULL)
+, fSqMask( 0)
+, fSqEntries( 0)
+, fSqLocalTail( 0)
+, fCqRing( NULL)
+, fCqRingSize( 0)
+, fCqes( NULL)
+, fCqHead( NULL)
+, fCqTail( NULL)
+, fCqMask( 0)
+{
+}
+
+
+XLinuxIOUring::~XLinuxIOUring()
+{
+	_Close();
+}
+
+
+bool XLinuxIOUring::Init( uLONG inEntries)
+{
+	_Close();
+
+#if VERSION_LINUX_STRICT
+	io_uring_params params;
+	memset( &params, 0, sizeof( params));
+
+	int ringFd = (int) syscall( __NR_io_uring_setup, inEntries, &params);
+	if (ringFd < 0)
+		return false;
+
+	fRingFd = ringFd;
+
+	fSqRingSize = params.sq_off.array + params.sq_entries * sizeof( uLONG);
+	fCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe);
+
+	// since 5.4 both rings share one mapping
+	bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMap)
+		fSqRingSize = fCqRingSize = Max( fSqRingSize, fCqRingSize);
+
+	fSqRing = mmap( NULL, fSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+	if (fSqRing == MAP_FAILED)
+	{
+		fSqRing = NULL;
+		_Close();
+		return false;
+	}
+
+	if (singleMap)
+	{
+		fCqRing = fSqRing;
+	}
+	else
+	{
+		fCqRing = mmap( NULL, fCqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+		if (fCqRing == MAP_FAILED)
+		{
+			fCqRing = NULL;
+			_Close();
+			return false;
+		}
+	}
+
+	fSqesSize = params.sq_entries * sizeof( io_uring_sqe);
+	fSqes = mmap( NULL, fSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+	if (fSqes == MAP_FAILED)
+	{
+		fSqes = NULL;
+		_Close();
+		return false;
+	}
+
+	char *sq = (char*) fSqRing;
+	fSqHead = (uLONG*) (sq + params.sq_off.head);
+	fSqTail = (uLONG*) (sq + params.sq_off.tail);
+	fSqArray = (uLONG*) (sq + params.sq_off.array);
+	fSqMask = *(uLONG*) (sq + params.sq_off.ring_mask);
+	fSqEntries = params.sq_entries;
+	fSqLocalTail = *fSqTail;
+
+	char *cq = (char*) fCqRing;
+	fCqHead = (uLONG*) (cq + params.cq_off.head);
+	fCqTail = (uLONG*) (cq + params.cq_off.tail);
+	fCqes = cq + params.cq_off.cqes;
+	fCqMask = *(uLONG*) (cq + params.cq_off.ring_mask);
+
+	// the probe itself appeared with 5.6, like the operations we need
+	const int opsCount = 64;
+	char probeBuffer[sizeof( io_uring_probe) + opsCount * sizeof( io_uring_probe_op)];
+	memset( probeBuffer, 0, sizeof( probeBuffer));
+	io_uring_probe *probe = (io_uring_probe*) probeBuffer;
+	if (syscall( __NR_io_uring_register, ringFd, IORING_REGISTER_PROBE, probe, opsCount) == 0)
+	{
+		const uBYTE ops[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_FSYNC, IORING_OP_FALLOCATE};
+		fFileOperations = true;
+		for( size_t i = 0 ; i < sizeof( ops) / sizeof( ops[0]) ; ++i)
+		{
+			if ( (ops[i] > probe->last_op) || ((probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED) == 0) )
+				fFileOperations = false;
+		}
+	}
+
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+void XLinuxIOUring::_Close()
+{
+#if VERSION_LINUX_STRICT
+	if (fSqes != NULL)
+		munmap( fSqes, fSqesSize);
+	if ( (fCqRing != NULL) && (fCqRing != fSqRing) )
+		munmap( fCqRing, fCqRingSize);
+	if (fSqRing != NULL)
+		munmap( fSqRing, fSqRingSize);
+	if (fRingFd >= 0)
+		close( fRingFd);
+#endif
+
+	fRingFd = -1;
+	fFileOperations = false;
+	fSqRing = fCqRing = fSqes = fCqes = NULL;
+	fSqHead = fSqTail = fSqArray = fCqHead = fCqTail = NULL;
+	fSqEntries = 0;
+}
+
+
+void *XLinuxIOUring::_GetSqe( uLONG8 inUserData)
+{
+#if VERSION_LINUX_STRICT
+	if (!IsValid() || (fSqLocalTail - _LoadAcquire( fSqHead) >= fSqEntries))
+		return NULL;
+
+	uLONG index = fSqLocalTail & fSqMask;
+	io_uring_sqe *sqe = (io_uring_sqe*) fSqes + index;
+	memset( sqe, 0, sizeof( io_uring_sqe));
+	sqe->user_data = inUserData;
+
+	fSqArray[index] = index;
+	++fSqLocalTail;
+
+	return sqe;
+#else
+	return NULL;
+#endif
+}
+
+
+bool XLinuxIOUring::PrepareRead( int inFd, void *outData, VSize inSize, sLONG8 inOffset, uLONG8 inUserData)
+{
+#if VERSION_LINUX_STRICT
+	io_uring_sqe *sqe = (io_uring_sqe*) _GetSqe( inUserData);
+	if (sqe == NULL)
+		return false;
+
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = inFd;
+	sqe->addr = (uLONG8) outData;
+	sqe->len = (uLONG) Min( inSize, (VSize) kMAX_OPERATION_SIZE);
+	sqe->off = inOffset;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+bool XLinuxIOUring::PrepareWrite( int inFd, const void *inData, VSize inSize, sLONG8 inOffset, uLONG8 inUserData)
+{
+#if VERSION_LINUX_STRICT
+	io_uring_sqe *sqe = (io_uring_sqe*) _GetSqe( inUserData);
+	if (sqe == NULL)
+		return false;
+
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = inFd;
+	sqe->addr = (uLONG8) inData;
+	sqe->len = (uLONG) Min( inSize, (VSize) kMAX_OPERATION_SIZE);
+	sqe->off = inOffset;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+bool XLinuxIOUring::PrepareFsync( int inFd, uLONG8 inUserData)
+{
+#if VERSION_LINUX_STRICT
+	io_uring_sqe *sqe = (io_uring_sqe*) _GetSqe( inUserData);
+	if (sqe == NULL)
+		return false;
+
+	sqe->opcode = IORING_OP_FSYNC;
+	sqe->fd = inFd;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+bool XLinuxIOUring::PrepareFallocate( int inFd, sLONG8 inOffset, sLONG8 inSize, uLONG8 inUserData)
+{
+#if VERSION_LINUX_STRICT
+	io_uring_sqe *sqe = (io_uring_sqe*) _GetSqe( inUserData);
+	if (sqe == NULL)
+		return false;
+
+	// yes, the length goes in addr and the mode in len
+	sqe->opcode = IORING_OP_FALLOCATE;
+	sqe->fd = inFd;
+	sqe->off = inOffset;
+	sqe->addr = inSize;
+	sqe->len = 0;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+bool XLinuxIOUring::PrepareNop( uLONG8 inUserData)
+{
+#if VERSION_LINUX_STRICT
+	io_uring_sqe *sqe = (io_uring_sqe*) _GetSqe( inUserData);
+	if (sqe == NULL)
+		return false;
+
+	sqe->opcode = IORING_OP_NOP;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+bool XLinuxIOUring::PrepareCancel( uLONG8 inTargetUserData, uLONG8 inUserData)
+{
+#if VERSION_LINUX_STRICT
+	io_uring_sqe *sqe = (io_uring_sqe*) _GetSqe( inUserData);
+	if (sqe == NULL)
+		return false;
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->fd = -1;
+	sqe->addr = inTargetUserData;
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+sLONG XLinuxIOUring::Submit()
+{
+#if VERSION_LINUX_STRICT
+	if (!IsValid())
+		return -EBADF;
+
+	_StoreRelease( fSqTail, fSqLocalTail);
+
+	// entries refused by a previous call (EAGAIN, EBUSY) are still in the ring
+	uLONG toSubmit = fSqLocalTail - _LoadAcquire( fSqHead);
+	if (toSubmit == 0)
+		return 0;
+
+	int r;
+	do {
+		r = _Enter( fRingFd, toSubmit, 0, 0);
+	} while( (r < 0) && (errno == EINTR));
+
+	return (r < 0) ? -errno : r;
+#else
+	return -ENOSYS;
+#endif
+}
+
+
+sLONG XLinuxIOUring::GetCompletions( Completion *outCompletions, sLONG inMaxCount, bool inWait)
+{
+#if VERSION_LINUX_STRICT
+	if (!IsValid())
+		return -EBADF;
+
+	uLONG head = *fCqHead;
+	uLONG tail = _LoadAcquire( fCqTail);
+
+	if ( (head == tail) && inWait)
+	{
+		int r = _Enter( fRingFd, 0, 1, IORING_ENTER_GETEVENTS);
+		if ( (r < 0) && (errno != EINTR) )
+			return -errno;
+		tail = _LoadAcquire( fCqTail);
+	}
+
+	sLONG count = 0;
+	while( (head != tail) && (count < inMaxCount) )
+	{
+		const io_uring_cqe *cqe = (const io_uring_cqe*) fCqes + (head & fCqMask);
+		outCompletions[count].fUserData = cqe->user_data;
+		outCompletions[count].fResult = cqe->res;
+		++count;
+		++head;
+	}
+
+	// gives the entries back to the kernel
+	_StoreRelease( fCqHead, head);
+
+	return count;
+#else
+	return -ENOSYS;
+#endif
+}
+
@@ -0,0 +1,108 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __XLinuxIOUring__
+#define __XLinuxIOUring__
+
+#include "Kernel/Sources/VObject.h"
+
+BEGIN_TOOLBOX_NAMESPACE
+
+
+/*
+	Thin layer over a linux io_uring instance (raw syscalls, no liburing).
+
+	Prepare*() queue operations in the submission ring, Submit() hands them to the kernel in one syscall.
+	The submission side is not thread-safe: the caller serializes Prepare*() and Submit().
+	The completion side (GetCompletions) is meant to be used by one task only and may run concurrently with submissions.
+
+	Init() returns false if io_uring is not available (kernel older than 5.1, disabled by seccomp or sysctl, XCode build).
+	Operations that the kernel doesn't know complete with -EINVAL: check SupportsFileOperations().
+*/
+class XTOOLBOX_API XLinuxIOUring : public VObject
+{
+public:
+	typedef struct Completion
+	{
+		uLONG8	fUserData;
+		sLONG	fResult;	// bytes transfered or -errno
+	} Completion;
+
+									XLinuxIOUring();
+	virtual							~XLinuxIOUring();
+
+			bool					Init( uLONG inEntries);
+			bool					IsValid() const				{ return fRingFd >= 0;}
+
+			// submission ring size (power of two >= entries asked to Init)
+			uLONG					GetEntries() const			{ return fSqEntries;}
+
+			// tells if the kernel knows READ, WRITE, FSYNC and FALLOCATE (5.6 and later)
+			bool					SupportsFileOperations() const	{ return fFileOperations;}
+
+			// queue one operation. Returns false if the submission ring is full (call Submit).
+			// sizes above 2GB are truncated: expect a short transfer.
+			bool					PrepareRead( int inFd, void *outData, VSize inSize, sLONG8 inOffset, uLONG8 inUserData);
+			bool					PrepareWrite( int inFd, const void *inData, VSize inSize, sLONG8 inOffset, uLONG8 inUserData);
+			bool					PrepareFsync( int inFd, uLONG8 inUserData);
+			bool					PrepareFallocate( int inFd, sLONG8 inOffset, sLONG8 inSize, uLONG8 inUserData);
+			bool					PrepareNop( uLONG8 inUserData);
+
+			// asks the kernel to cancel the operation queued with inTargetUserData.
+			// The operation completes with -ECANCELED if it could be cancelled, else with its own result.
+			bool					PrepareCancel( uLONG8 inTargetUserData, uLONG8 inUserData);
+
+			// submits all queued operations. Returns the count of operations taken by the kernel or -errno.
+			sLONG					Submit();
+
+			// copies up to inMaxCount completions, waiting for at least one if inWait.
+			// Returns the count of completions or -errno.
+			sLONG					GetCompletions( Completion *outCompletions, sLONG inMaxCount, bool inWait);
+
+private:
+									XLinuxIOUring( const XLinuxIOUring&);
+			XLinuxIOUring&			operator=( const XLinuxIOUring&);
+
+			void*					_GetSqe( uLONG8 inUserData);
+			void					_Close();
+
+			int						fRingFd;
+			bool					fFileOperations;
+
+			// submission ring
+			void*					fSqRing;
+			VSize					fSqRingSize;
+			void*					fSqes;
+			VSize					fSqesSize;
+			uLONG*					fSqHead;
+			uLONG*					fSqTail;
+			uLONG*					fSqArray;
+			uLONG					fSqMask;
+			uLONG					fSqEntries;
+			uLONG					fSqLocalTail;	// prepared but not yet published entries end here
+
+			// completion ring
+			void*					fCqRing;
+			VSize					fCqRingSize;
+			void*					fCqes;
+			uLONG*					fCqHead;
+			uLONG*					fCqTail;
+			uLONG					fCqMask;
+};
+
+
+END_TOOLBOX_NAMESPACE
+
+#endif
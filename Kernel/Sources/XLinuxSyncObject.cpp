@@ -14,5 +14,179 @@
 * other than those specified in the applicable license is granted.
 */
 #include "VKernelPrecompiled.h"
-#include "XLinuxSyncObject.h"
+#include "VSyncObject.h"
 
+#if VERSION_LINUX_STRICT
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+// Maximum and initial number of spin iterations before parking a thread on a contended futex lock
+const sLONG	kMAX_FUTEX_SPIN_COUNT = 200;
+
+
+// Class statics
+sLONG XLinuxFutex::sSpinCount = -1;
+
+
+static inline void _CpuRelax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__( "pause" ::: "memory");
+#else
+	__asm__ __volatile__( "" ::: "memory");
+#endif
+}
+
+
+bool XLinuxFutex::Wait( sLONG *inFutex, sLONG inExpectedValue, sLONG inTimeoutMilliseconds)
+{
+#if VERSION_LINUX_STRICT
+	timespec timeout = { inTimeoutMilliseconds / 1000, (inTimeoutMilliseconds % 1000) * 1000000};
+	int r = (int) syscall( SYS_futex, inFutex, FUTEX_WAIT_PRIVATE, inExpectedValue, (inTimeoutMilliseconds >= 0) ? &timeout : NULL, NULL, 0);
+	return (r == 0) || (errno != ETIMEDOUT);
+#else
+	XTaskMgrImpl::YieldNow();
+	return true;
+#endif
+}
+
+
+void XLinuxFutex::Wake( sLONG *inFutex, sLONG inCount)
+{
+#if VERSION_LINUX_STRICT
+	syscall( SYS_futex, inFutex, FUTEX_WAKE_PRIVATE, inCount, NULL, NULL, 0);
+#endif
+}
+
+
+void XLinuxFutex::_LockContended( sLONG *ioFutex, VLockStatistics *inStatistics)
+{
+	sLONG8 startCounter = 0;
+	if (inStatistics != NULL)
+		VSystem::GetProfilingCounter( startCounter);
+
+	if (!VTask::CurrentCanBlockOnSyncObject())
+	{
+		// a fiber must not block its thread
+		while( !TryToLock( ioFutex))
+			VTask::YieldNow();
+	}
+	else
+	{
+		// sSpinCount is a process wide heuristic: races on it are harmless
+		sLONG maxSpin = sSpinCount;
+		if (maxSpin < 0)
+			sSpinCount = maxSpin = (VSystem::GetNumberOfProcessors() > 1) ? kMAX_FUTEX_SPIN_COUNT : 0;
+
+		// spin while the owner is likely to release the lock soon.
+		// Stop as soon as some other thread had to park: the lock is then held for long.
+		bool acquired = false;
+		sLONG spin;
+		for( spin = 0 ; spin < maxSpin ; ++spin)
+		{
+			sLONG state = *(volatile sLONG*) ioFutex;
+			if (state == 0)
+			{
+				if (VInterlocked::CompareExchange( ioFutex, 0, 1) == 0)
+				{
+					acquired = true;
+					break;
+				}
+			}
+			else if (state == 2)
+			{
+				break;
+			}
+			_CpuRelax();
+		}
+
+		if (acquired)
+		{
+			// spinning paid: allow a bit more spinning next time
+			if (maxSpin < kMAX_FUTEX_SPIN_COUNT)
+				sSpinCount = maxSpin + (kMAX_FUTEX_SPIN_COUNT - maxSpin) / 8 + 1;
+		}
+		else
+		{
+			if ( (spin >= maxSpin) && (maxSpin > 16) )
+				sSpinCount = maxSpin - maxSpin / 8;	// spinning was useless: spin less next time
+
+			// mark the lock as contended and park until we get it
+			while( VInterlocked::Exchange( ioFutex, 2) != 0)
+				Wait( ioFutex, 2);
+		}
+	}
+
+	if (inStatistics != NULL)
+	{
+		sLONG8 endCounter;
+		VSystem::GetProfilingCounter( endCounter);
+		inStatistics->AddContendedAcquisition( ((endCounter - startCounter) * 1000000) / VSystem::GetProfilingFrequency());
+	}
+}
+
+
+//================================================================================================================
+
+
+bool XLinuxSemaphore::Lock()
+{
+	// fibers are handled by VSemaphore (see VSyncObject::_FiberLock)
+	while( !TryToLock())
+	{
+		VInterlocked::Increment( &fWaiters);
+		XLinuxFutex::Wait( &fCount, 0);
+		VInterlocked::Decrement( &fWaiters);
+	}
+	return true;
+}
+
+
+bool XLinuxSemaphore::Lock( sLONG inTimeoutMilliseconds)
+{
+	if (TryToLock())
+		return true;
+
+	if (inTimeoutMilliseconds <= 0)
+		return false;
+
+	uLONG t1 = VSystem::GetCurrentTime() + inTimeoutMilliseconds;
+	sLONG delta = inTimeoutMilliseconds;
+	do
+	{
+		VInterlocked::Increment( &fWaiters);
+		XLinuxFutex::Wait( &fCount, 0, delta);
+		VInterlocked::Decrement( &fWaiters);
+
+		if (TryToLock())
+			return true;
+
+		uLONG t0 = VSystem::GetCurrentTime();
+		if (t0 >= t1)
+			break;
+		delta = t1 - t0;
+	} while( true);
+
+	return false;
+}
+
+
+bool XLinuxSemaphore::Unlock()
+{
+	sLONG count = fCount;
+	while( count < fMaxCount)
+	{
+		sLONG previous = VInterlocked::CompareExchange( &fCount, count, count + 1);
+		if (previous == count)
+			break;
+		count = previous;
+	}
+
+	if (VInterlocked::AtomicGet( &fWaiters) > 0)
+		XLinuxFutex::Wake( &fCount, 1);
+
+	return true;
+}
@@ -53,107 +53,99 @@ static int pthread_cond_timedwait_relative_np(pthread_cond_t* cond, pthread_mute
 BEGIN_TOOLBOX_NAMESPACE
 
 
-class XTOOLBOX_API XLinuxSemaphore
+/*
+	Thin layer over the linux futex syscall.
+
+	The lock functions implement a non-recursive lock on a 32 bits word:
+		0: unlocked
+		1: locked, no waiter
+		2: locked, some tasks may be parked in the kernel
+
+	A contended Lock() first spins a bounded number of times (adapted to how often spinning succeeds)
+	before parking the thread with FUTEX_WAIT. Unlock() only enters the kernel if someone may be parked.
+	Cooperative tasks (fibers) never park: they yield until the lock is available.
+*/
+class XTOOLBOX_API XLinuxFutex
 {
 public:
-		XLinuxSemaphore( sLONG inInitialCount, sLONG inMaxCount):fCount( inInitialCount), fMaxCount( inMaxCount)
+	static	bool	TryToLock( sLONG *ioFutex)
+	{
+		return VInterlocked::CompareExchange( ioFutex, 0, 1) == 0;
+	}
+
+	static	void	Lock( sLONG *ioFutex, VLockStatistics *inStatistics)
+	{
+		if (VInterlocked::CompareExchange( ioFutex, 0, 1) == 0)
 		{
-			pthread_mutex_init( &fMutex, NULL);	// no need for a recursive mutex
-			pthread_cond_init( &fCondition, NULL);
+			if (inStatistics != NULL)
+				inStatistics->AddAcquisition();
 		}
-		
-		
-		~XLinuxSemaphore()
+		else
 		{
-			// in case of error, relinquish any pending lock
-			while( pthread_cond_destroy( &fCondition) == EBUSY)
-			{
-				pthread_cond_broadcast( &fCondition);
-				PTHREAD_YIELD();
-			}
-			pthread_mutex_destroy( &fMutex);
+			_LockContended( ioFutex, inStatistics);
 		}
+	}
 
+	static	void	Unlock( sLONG *ioFutex)
+	{
+		if (VInterlocked::Exchange( ioFutex, 0) == 2)
+			Wake( ioFutex, 1);
+	}
 
-		bool	Lock( sLONG inTimeoutMilliseconds)
-		{
-			bool ok;
-			int r = pthread_mutex_lock( &fMutex);
-			if (fCount > 0)
-			{
-				ok = true;
-				--fCount;
-			}
-			else if (inTimeoutMilliseconds > 0)
-			{
-				timespec timeout = { inTimeoutMilliseconds / 1000, (inTimeoutMilliseconds % 1000) * 1000000};
-				r = pthread_cond_timedwait_relative_np( &fCondition, &fMutex, &timeout);
-				if (fCount > 0)
-				{
-					ok = true;
-					--fCount;
-				}
-				else
-				{
-					ok = false;
-				}
-			}
-			else
-			{
-				ok = false;
-			}
-			r = pthread_mutex_unlock( &fMutex);
+	// Parks the calling thread as long as *inFutex equals inExpectedValue.
+	// May return spuriously. Returns false if the timeout expired (negative timeout means infinite).
+	static	bool	Wait( sLONG *inFutex, sLONG inExpectedValue, sLONG inTimeoutMilliseconds = -1);
 
-			return ok;
+	// wakes up to inCount threads parked on inFutex
+	static	void	Wake( sLONG *inFutex, sLONG inCount);
+
+private:
+	static	void	_LockContended( sLONG *ioFutex, VLockStatistics *inStatistics);
+
+	static	sLONG	sSpinCount;
+};
+
+
+class XTOOLBOX_API XLinuxSemaphore
+{
+public:
+		XLinuxSemaphore( sLONG inInitialCount, sLONG inMaxCount):fCount( inInitialCount), fMaxCount( inMaxCount), fWaiters( 0)
+		{
 		}
 		
 		
-		bool	Lock()
+		~XLinuxSemaphore()
 		{
-			int r = pthread_mutex_lock( &fMutex);
-			while( fCount == 0)
-				r = pthread_cond_wait( &fCondition, &fMutex);
-			--fCount;
-			r = pthread_mutex_unlock( &fMutex);
-
-			return true;
+			// in case of error, relinquish any pending lock
+			if (fWaiters > 0)
+				XLinuxFutex::Wake( &fCount, fWaiters);
 		}
 
 
+		bool	Lock( sLONG inTimeoutMilliseconds);
+		bool	Lock();
+
+
 		bool	TryToLock()
 		{
-			bool ok;
-			int r = pthread_mutex_lock( &fMutex);
-			if (fCount > 0)
-			{
-				--fCount;
-				ok = true;
-			}
-			else
+			sLONG count = fCount;
+			while( count > 0)
 			{
-				ok = false;
+				sLONG previous = VInterlocked::CompareExchange( &fCount, count, count - 1);
+				if (previous == count)
+					return true;
+				count = previous;
 			}
-			r = pthread_mutex_unlock( &fMutex);
-
-			return ok;
+			return false;
 		}
 
 		
-		bool	Unlock()
-		{
-			int r = pthread_mutex_lock( &fMutex);
-			if (fCount < fMaxCount)
-				fCount++;
-			pthread_cond_signal( &fCondition);
-			r = pthread_mutex_unlock( &fMutex);
-			return true;
-		}
+		bool	Unlock();
 
 private:
-		pthread_mutex_t		fMutex;
-		pthread_cond_t		fCondition;
-		sLONG				fCount;
+		sLONG				fCount;		// futex word
 		sLONG				fMaxCount;
+		sLONG				fWaiters;
 };
 
 
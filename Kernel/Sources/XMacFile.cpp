@@ -119,6 +119,37 @@ VError XMacFileDesc::PutData( const void *inData, VSize& ioCount, sLONG8 inOffse
 }
 
 
+VError XMacFileDesc::GetDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const
+{
+	// FSReadFork has no vectored form but is positional
+	VError err = VE_OK;
+	VSize count = 0;
+	for( sLONG i = 0 ; (i < inSegmentsCount) && (err == VE_OK) ; ++i)
+	{
+		VSize size = inSegments[i].fSize;
+		err = GetData( inSegments[i].fData, size, inOffset + count, true);
+		count += size;
+	}
+	ioCount = count;
+	return err;
+}
+
+
+VError XMacFileDesc::PutDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const
+{
+	VError err = VE_OK;
+	VSize count = 0;
+	for( sLONG i = 0 ; (i < inSegmentsCount) && (err == VE_OK) ; ++i)
+	{
+		VSize size = inSegments[i].fSize;
+		err = PutData( inSegments[i].fData, size, inOffset + count, true);
+		count += size;
+	}
+	ioCount = count;
+	return err;
+}
+
+
 VError XMacFileDesc::GetPos( sLONG8 *outPos) const
 {
 	sLONG8 filePos;
@@ -587,7 +618,7 @@ VError XMacFile::Open( const FileAccess inFileAccess, FileOpenOptions inOptions,
 
 	if ( macError == noErr )
 	{
-		*outFileDesc = new VFileDesc( fOwner, fileForkRef, inFileAccess );
+		*outFileDesc = new VFileDesc( fOwner, fileForkRef, inFileAccess, inOptions );
 	}
 
 	return MAKE_NATIVE_VERROR( macError);
@@ -599,8 +630,16 @@ void _CallBackProc( FSFileOperationRef fileOp, const FSRef *currentItem, FSFileO
 		((VSyncEvent*)info)->Unlock();
 }
 
-VError XMacFile::Copy( const VFilePath& inDestinationPath, VFile** outFile, FileCopyOptions inOptions ) const
+VError XMacFile::Copy( const VFilePath& inDestinationPath, VFile** outFile, FileCopyOptions inOptions, VFileCopyProgress *inProgress ) const
 {
+	// FSCopyObject can't be interrupted: the progress is reported once the copy is done
+	if ( (inProgress != NULL) && inProgress->IsCancelled() )
+	{
+		if (outFile != NULL)
+			*outFile = NULL;
+		return VE_USER_ABORT;
+	}
+
 	// CFRunLoopGetMain is a 10.5 api that may exist in 10.4.
 	// Let's load it dynamically.
 #if MAC_OS_X_VERSION_MAX_ALLOWED <= MAC_OS_X_VERSION_10_4
@@ -738,6 +777,13 @@ VError XMacFile::Copy( const VFilePath& inDestinationPath, VFile** outFile, File
 		}
 	}
 
+	if ( (macError == noErr) && (inProgress != NULL) )
+	{
+		sLONG8 size;
+		if (GetSize( &size) == VE_OK)
+			inProgress->Add( size);
+	}
+
 	if (outFile != NULL)
 	{
 		if (macError == noErr)
@@ -27,6 +27,7 @@ class VURL;
 class VString;
 class VFolder;
 class VFileDesc;
+class VFileCopyProgress;
 class VFileIterator;
 class VTime;
 class VFileKind;
@@ -51,6 +52,10 @@ public:
 									// write some bytes. PutData (buf, count) writes at current pos
 				VError 				PutData( const void *inData, VSize& ioCount, sLONG8 inOffset, bool inFromStart) const;
 
+									// vectored read & write at inOffset from beginning
+				VError				GetDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const;
+				VError				PutDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const;
+
 				VError 				GetPos( sLONG8 *outSize) const;
 
 									// absolute offset by default
@@ -78,7 +83,7 @@ public:
 			VError 				Open ( const FileAccess inFileAccess, FileOpenOptions inOptions, VFileDesc** outFileDesc) const;
 			VError				Create( FileCreateOptions inOptions) const;
 
-			VError				Copy( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions ) const;
+			VError				Copy( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions, VFileCopyProgress *inProgress ) const;
 			VError 				Move( const VFilePath& inDestinationPath, VFile** outFile, FileCopyOptions inOptions ) const;	
 			VError 				Rename( const VString& inName, VFile** outFile ) const;
 			VError 				Delete() const;
@@ -26,9 +26,24 @@
 
 const LARGE_INTEGER LARGEZERO = { 0, 0 };
 
+typedef struct CopyProgressData
+{
+	VFileCopyProgress*	fProgress;
+	sLONG8				fReported;	// TotalBytesTransferred of the previous call
+} CopyProgressData;
+
 static DWORD CALLBACK CopyProgressRoutine( LARGE_INTEGER TotalFileSize, LARGE_INTEGER TotalBytesTransferred, LARGE_INTEGER StreamSize, LARGE_INTEGER StreamBytesTransferred, DWORD dwStreamNumber, DWORD dwCallbackReason, HANDLE hSourceFile, HANDLE hDestinationFile, LPVOID lpData )
 {
 	VTask::Yield();
+
+	CopyProgressData *data = (CopyProgressData*) lpData;
+	if ( (data != NULL) && (data->fProgress != NULL) )
+	{
+		sLONG8 bytes = TotalBytesTransferred.QuadPart - data->fReported;
+		data->fReported = TotalBytesTransferred.QuadPart;
+		if (!data->fProgress->Add( bytes))
+			return PROGRESS_CANCEL;
+	}
 	return PROGRESS_CONTINUE;
 }
 
@@ -240,6 +255,41 @@ VError XWinFileDesc::PutData(const void *inData, VSize& ioCount, sLONG8 inOffset
 }
 
 
+VError XWinFileDesc::GetDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const
+{
+	// ReadFileScatter needs unbuffered page aligned i/o, so the segments are read one by one under the lock
+	VTaskLock locker(&fMutex);
+
+	VError err = VE_OK;
+	VSize count = 0;
+	for( sLONG i = 0 ; (i < inSegmentsCount) && (err == VE_OK) ; ++i)
+	{
+		VSize size = inSegments[i].fSize;
+		err = GetData( inSegments[i].fData, size, inOffset + count, true);
+		count += size;
+	}
+	ioCount = count;
+	return err;
+}
+
+
+VError XWinFileDesc::PutDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const
+{
+	VTaskLock locker(&fMutex);
+
+	VError err = VE_OK;
+	VSize count = 0;
+	for( sLONG i = 0 ; (i < inSegmentsCount) && (err == VE_OK) ; ++i)
+	{
+		VSize size = inSegments[i].fSize;
+		err = PutData( inSegments[i].fData, size, inOffset + count, true);
+		count += size;
+	}
+	ioCount = count;
+	return err;
+}
+
+
 VError XWinFileDesc::GetPos( sLONG8 *outPos) const
 {
 	LARGE_INTEGER posx;
@@ -379,7 +429,7 @@ VError XWinFile::Open( FileAccess inFileAccess, FileOpenOptions inOptions, VFile
 	{
 		winErr = 0;
 		if ( outFileDesc )
-			*outFileDesc = new VFileDesc( fOwner, fileHandle, inFileAccess );
+			*outFileDesc = new VFileDesc( fOwner, fileHandle, inFileAccess, inOptions );
 		else
 			::CloseHandle(fileHandle);
 	}
@@ -392,7 +442,7 @@ VError XWinFile::Open( FileAccess inFileAccess, FileOpenOptions inOptions, VFile
 }
 
 
-VError XWinFile::Copy( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions ) const
+VError XWinFile::Copy( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions, VFileCopyProgress *inProgress ) const
 {
 	VFilePath newPath( inDestination);
 	
@@ -435,14 +485,21 @@ VError XWinFile::Copy( const VFilePath& inDestination, VFile** outFile, FileCopy
 		}
 	}
 
+	CopyProgressData progressData;
+	progressData.fProgress = inProgress;
+	progressData.fReported = 0;
+
 	BOOL canceled = FALSE;
-	DWORD winErr = ::CopyFileExW( oldWinPath, newWinPath, &CopyProgressRoutine, NULL, &canceled, flags) ? 0 : ::GetLastError();
+	DWORD winErr = ::CopyFileExW( oldWinPath, newWinPath, &CopyProgressRoutine, &progressData, &canceled, flags) ? 0 : ::GetLastError();
 
 	if (outFile)
 	{
 		*outFile = (winErr == 0) ? new VFile( newPath) : NULL;
 	}
 	
+	if (winErr == ERROR_REQUEST_ABORTED)
+		return VE_USER_ABORT;
+
 	return MAKE_NATIVE_VERROR( winErr);
 }
 
@@ -28,6 +28,7 @@ class VURL;
 class VString;
 class VFolder;
 class VFileDesc;
+class VFileCopyProgress;
 class VFileIterator;
 class VTime;
 class VFileKind;
@@ -65,6 +66,10 @@ public:
 			// write some bytes. PutData (buf, count) writes at current pos
 			VError				PutData( const void *inData, VSize& ioCount, sLONG8 inOffset, bool inFromStart) const;
 
+			// vectored read & write at inOffset from beginning
+			VError				GetDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const;
+			VError				PutDataV( const FileDataSegment *inSegments, sLONG inSegmentsCount, VSize &ioCount, sLONG8 inOffset) const;
+
 			VError				GetPos( sLONG8 *outPos) const;
 
 			// absolute offset by default
@@ -94,7 +99,7 @@ public:
 			
 			// Rename the file with the given name ( foofoo.html ).
 			VError				Rename( const VString& inName, VFile** outFile ) const;
-			VError				Copy( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions ) const;
+			VError				Copy( const VFilePath& inDestination, VFile** outFile, FileCopyOptions inOptions, VFileCopyProgress *inProgress ) const;
 			VError				Move( const VFilePath& inName, VFile** outFile, FileCopyOptions inOptions ) const;
 			VError				Delete() const;
 
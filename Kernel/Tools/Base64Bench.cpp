@@ -0,0 +1,153 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+
+/*
+	Base64Bench: throughput of Base64Coder, Base64Encoder/Base64Decoder and HexCoder.
+
+	usage: Base64Bench [size in KB (default 1024)] [rounds (default 64)]
+
+	Prints MB/s of data for each operation. Decoded data is checked against the source.
+*/
+
+#include "Kernel/VKernel.h"
+#include "Kernel/Sources/Base64Coder.h"
+#include "Kernel/Sources/HexCoder.h"
+#include "BenchTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+USING_TOOLBOX_NAMESPACE
+
+
+static bool _Equal( const VMemoryBuffer<>& inBuffer, const std::vector<char>& inData)
+{
+	return (inBuffer.GetDataSize() == inData.size()) && (::memcmp( inBuffer.GetDataPtr(), &inData.front(), inData.size()) == 0);
+}
+
+
+static bool _Bench( const std::vector<char>& inData, sLONG inRounds)
+{
+	bool ok = true;
+	VSize size = inData.size();
+	VSize total = size * inRounds;
+
+	::printf( "%d KB x %d, %s\n", (int) (size / 1024), (int) inRounds, Base64Coder::IsAccelerated() ? "accelerated" : "scalar");
+
+	// one line vs standard mime lines (19 quads per line)
+	const sLONG quadsPerLine[] = { kMAX_sLONG / 4, 19 };
+	for( size_t i = 0 ; i < sizeof( quadsPerLine) / sizeof( quadsPerLine[0]) ; ++i)
+	{
+		char name[64];
+		VMemoryBuffer<> text, data;
+
+		::sprintf( name, "Base64Coder::Encode (%s)", (i == 0) ? "one line" : "mime lines");
+		{
+			StBenchTimer timer( name, total);
+			for( sLONG r = 0 ; r < inRounds ; ++r)
+				ok = Base64Coder::Encode( &inData.front(), size, text, quadsPerLine[i]) && ok;
+		}
+
+		::sprintf( name, "Base64Coder::Decode (%s)", (i == 0) ? "one line" : "mime lines");
+		{
+			StBenchTimer timer( name, total);
+			for( sLONG r = 0 ; r < inRounds ; ++r)
+				ok = Base64Coder::Decode( text.GetDataPtr(), text.GetDataSize(), data) && ok;
+		}
+		ok = _Equal( data, inData) && ok;
+	}
+
+	// streaming, 4 KB chunks like a socket or a file read
+	const VSize chunk = 4096;
+	VMemoryBuffer<> text;
+	Base64Coder::Encode( &inData.front(), size, text);
+	{
+		StBenchTimer timer( "Base64Encoder (4 KB chunks)", total);
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+		{
+			VPtrStream stream;
+			stream.OpenWriting();
+			Base64Encoder encoder( &stream);
+			for( VSize pos = 0 ; pos < size ; pos += chunk)
+				encoder.Put( &inData.front() + pos, Min( chunk, size - pos));
+			ok = (encoder.Close() == VE_OK) && ok;
+			stream.CloseWriting();
+		}
+	}
+	{
+		StBenchTimer timer( "Base64Decoder (4 KB chunks)", total);
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+		{
+			VPtrStream stream;
+			stream.OpenWriting();
+			Base64Decoder decoder( &stream);
+			const char *p = (const char*) text.GetDataPtr();
+			for( VSize pos = 0 ; pos < text.GetDataSize() ; pos += chunk)
+				decoder.Put( p + pos, Min( chunk, text.GetDataSize() - pos));
+			ok = (decoder.Close() == VE_OK) && ok;
+			stream.CloseWriting();
+			ok = (stream.GetDataSize() == size) && (::memcmp( stream.GetDataPtr(), &inData.front(), size) == 0) && ok;
+		}
+	}
+
+	// hex
+	std::vector<char> hex( 2 * size);
+	std::vector<char> decoded( size);
+	{
+		StBenchTimer timer( "HexCoder::Encode", total);
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+			HexCoder::Encode( &inData.front(), size, &hex.front());
+	}
+	{
+		StBenchTimer timer( "HexCoder::Decode", total);
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+			ok = HexCoder::Decode( &hex.front(), hex.size(), &decoded.front()) && ok;
+	}
+	ok = (decoded == inData) && ok;
+
+	return ok;
+}
+
+
+int main( int argc, const char *argv[])
+{
+	sLONG kiloBytes = (argc > 1) ? ::atoi( argv[1]) : 1024;
+	sLONG rounds = (argc > 2) ? ::atoi( argv[2]) : 64;
+	if ( (kiloBytes <= 0) || (rounds <= 0) )
+	{
+		::fprintf( stderr, "usage: Base64Bench [size in KB] [rounds]\n");
+		return 1;
+	}
+
+	VProcess process;
+#if VERSION_LINUX
+	process.LINUX_CommandLineInit( argc, argv);
+#endif
+	if (!process.Init())
+		return 1;
+
+	VSize size = (VSize) kiloBytes * 1024;
+	std::vector<char> data( size);
+	::srand( 1);
+	for( VSize i = 0 ; i < size ; ++i)
+		data[i] = (char) ::rand();
+
+	bool ok = _Bench( data, rounds);
+	if (!ok)
+		::printf( "FAILED: decoded data differs from the source\n");
+
+	return ok ? 0 : 1;
+}
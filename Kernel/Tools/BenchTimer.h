@@ -0,0 +1,54 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+#ifndef __BenchTimer__
+#define __BenchTimer__
+
+#include <cstdio>
+
+BEGIN_TOOLBOX_NAMESPACE
+
+/*
+	Prints the time spent in its scope when destroyed, as MB/s if given a byte count (benchmark tools only).
+
+	{
+		StBenchTimer timer( "encode", size);
+		...
+	}
+*/
+class StBenchTimer
+{
+public:
+	StBenchTimer( const char *inName, VSize inBytes = 0):fName( inName), fBytes( (double) inBytes)	{ VSystem::GetProfilingCounter( fStart);}
+	~StBenchTimer()
+	{
+		sLONG8 stop;
+		VSystem::GetProfilingCounter( stop);
+		double seconds = (double) (stop - fStart) / (double) VSystem::GetProfilingFrequency();
+		if (fBytes > 0)
+			::printf( "%-32s %8.0f MB/s\n", fName, (seconds > 0) ? fBytes / seconds / 1e6 : 0.0);
+		else
+			::printf( "%-32s %8.3f ms\n", fName, seconds * 1e3);
+	}
+
+private:
+	const char*	fName;
+	double		fBytes;
+	sLONG8		fStart;
+};
+
+END_TOOLBOX_NAMESPACE
+
+#endif
@@ -0,0 +1,120 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+
+/*
+	ChecksumBench: throughput of the checksums in VChecksumMD5.h and of VChecksumStream.
+
+	usage: ChecksumBench [size in KB (default 65536)] [rounds (default 4)]
+
+	Prints MB/s for each algorithm over one buffer, then for a stream copy
+	with and without a VChecksumStream (SHA-256) in between.
+*/
+
+#include "Kernel/VKernel.h"
+#include "Kernel/Sources/VChecksumMD5.h"
+#include "BenchTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+USING_TOOLBOX_NAMESPACE
+
+
+static void _BenchChecksum( const char *inName, IChecksum& inChecksum, const std::vector<uBYTE>& inData, sLONG inRounds)
+{
+	uBYTE digest[64];
+	StBenchTimer timer( inName, inData.size() * inRounds);
+	for( sLONG r = 0 ; r < inRounds ; ++r)
+	{
+		inChecksum.Clear();
+		inChecksum.Update( &inData.front(), inData.size());
+		inChecksum.GetChecksumBytes( digest);
+	}
+}
+
+
+static void _Copy( VStream& inStream, const std::vector<uBYTE>& inData)
+{
+	// 64 KB writes like VStream copies of files
+	const VSize chunk = 64 * 1024;
+	inStream.OpenWriting();
+	for( VSize pos = 0 ; pos < inData.size() ; pos += chunk)
+		inStream.PutData( &inData.front() + pos, Min( chunk, inData.size() - pos));
+	inStream.CloseWriting();
+}
+
+
+static void _BenchStreamCopy( const char *inName, IChecksum *inChecksum, const std::vector<uBYTE>& inData, sLONG inRounds)
+{
+	StBenchTimer timer( inName, inData.size() * inRounds);
+	for( sLONG r = 0 ; r < inRounds ; ++r)
+	{
+		VPtrStream destination;
+		if (inChecksum != NULL)
+		{
+			VChecksumStream checksumStream( &destination, inChecksum);
+			_Copy( checksumStream, inData);
+		}
+		else
+		{
+			_Copy( destination, inData);
+		}
+	}
+}
+
+
+int main( int argc, const char *argv[])
+{
+	sLONG kiloBytes = (argc > 1) ? ::atoi( argv[1]) : 64 * 1024;
+	sLONG rounds = (argc > 2) ? ::atoi( argv[2]) : 4;
+	if ( (kiloBytes <= 0) || (rounds <= 0) )
+	{
+		::fprintf( stderr, "usage: ChecksumBench [size in KB] [rounds]\n");
+		return 1;
+	}
+
+	VProcess process;
+#if VERSION_LINUX
+	process.LINUX_CommandLineInit( argc, argv);
+#endif
+	if (!process.Init())
+		return 1;
+
+	std::vector<uBYTE> data( (VSize) kiloBytes * 1024);
+	::srand( 1);
+	for( VSize i = 0 ; i < data.size() ; ++i)
+		data[i] = (uBYTE) ::rand();
+
+	::printf( "%d KB x %d, SHA-256 %s, CRC32C %s\n", (int) kiloBytes, (int) rounds,
+		VChecksumSHA256::IsAccelerated() ? "accelerated" : "scalar", VChecksumCRC32C::IsAccelerated() ? "accelerated" : "scalar");
+
+	VChecksumMD5 md5;
+	VChecksumSHA1 sha1;
+	VChecksumSHA256 sha256;
+	VChecksumCRC32C crc32c;
+	VChecksumXXH64 xxh64;
+
+	_BenchChecksum( "MD5", md5, data, rounds);
+	_BenchChecksum( "SHA-1", sha1, data, rounds);
+	_BenchChecksum( "SHA-256", sha256, data, rounds);
+	_BenchChecksum( "CRC32C", crc32c, data, rounds);
+	_BenchChecksum( "xxHash64", xxh64, data, rounds);
+
+	_BenchStreamCopy( "VPtrStream copy", NULL, data, rounds);
+	_BenchStreamCopy( "VChecksumStream (SHA-256) copy", &sha256, data, rounds);
+
+	return 0;
+}
@@ -0,0 +1,182 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+
+/*
+	HashBench: bucket distribution of VString::GetHashValue vs the hash it replaced.
+
+	usage: HashBench [keys count (default 20000)]
+
+	The previous hash only looked at the first and last 8 chars of strings longer than 16 chars.
+	For each key set (rest urls, file paths, short json property names, uuids) and each hash, prints:
+		- the ratio of used buckets and the longest chain, with as many buckets as keys
+		- the average count of key comparisons for a successful lookup
+		- the time to insert all the keys in an unordered_map_VString and find them back
+*/
+
+#include "Kernel/VKernel.h"
+#include "BenchTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+USING_TOOLBOX_NAMESPACE
+
+
+// VString::GetHashValue before the whole string was hashed
+static uLONG _GetPreviousHashValue( const VString& inString)
+{
+	uLONG stringLength = inString.GetLength();
+	uLONG result = stringLength;
+	uLONG characterIndex;
+
+	const UniChar *uContents = inString.GetCPointer();
+	if (stringLength <= 16) {
+		for (characterIndex = 0; characterIndex < stringLength; ++characterIndex)
+			result = result * 257 + uContents[characterIndex];
+	} else {
+		for (characterIndex = 0; characterIndex < 8; ++characterIndex)
+			result = result * 257 + uContents[characterIndex];
+		for (characterIndex = stringLength - 8; characterIndex < stringLength; ++characterIndex)
+			result = result * 257 + uContents[characterIndex];
+	}
+
+	result += (result << (stringLength & 31));
+	return result;
+}
+
+
+struct PreviousHash
+{
+	size_t operator()( const VString& inString) const		{ return _GetPreviousHashValue( inString);}
+};
+
+struct CurrentHash
+{
+	size_t operator()( const VString& inString) const		{ return inString.GetHashValue();}
+};
+
+
+static size_t _NextPrime( size_t inValue)
+{
+	for( size_t n = (inValue < 2) ? 2 : inValue ; ; ++n)
+	{
+		bool isPrime = true;
+		for( size_t d = 2 ; (d * d <= n) && isPrime ; ++d)
+			isPrime = (n % d) != 0;
+		if (isPrime)
+			return n;
+	}
+}
+
+
+template<class Hash>
+static bool _Bench( const char *inName, const VectorOfVString& inKeys)
+{
+	Hash hash;
+
+	// distribution over a prime count of buckets, as unordered_map does
+	size_t bucketsCount = _NextPrime( inKeys.size());
+	std::vector<sLONG> buckets( bucketsCount, 0);
+	for( VectorOfVString::const_iterator i = inKeys.begin() ; i != inKeys.end() ; ++i)
+		++buckets[hash( *i) % bucketsCount];
+
+	size_t used = 0;
+	sLONG longest = 0;
+	double compares = 0;
+	for( std::vector<sLONG>::const_iterator i = buckets.begin() ; i != buckets.end() ; ++i)
+	{
+		if (*i > 0)
+			++used;
+		longest = Max( longest, *i);
+		compares += (double) *i * (*i + 1) / 2;
+	}
+	::printf( "%-32s %5.1f%% buckets used, longest chain %d, %.2f compares per hit\n", inName, 100.0 * used / bucketsCount, (int) longest, compares / inKeys.size());
+
+	typedef std::tr1::unordered_map<VString,sLONG,Hash,hash_VString::equal_to>	MapType;
+	sLONG found = 0;
+	{
+		StBenchTimer timer( "insert and find");
+		MapType map;
+		for( size_t i = 0 ; i < inKeys.size() ; ++i)
+			map.insert( typename MapType::value_type( inKeys[i], (sLONG) i));
+		for( size_t i = 0 ; i < inKeys.size() ; ++i)
+		{
+			typename MapType::const_iterator j = map.find( inKeys[i]);
+			if ( (j != map.end()) && (j->second == (sLONG) i) )
+				++found;
+		}
+	}
+	return found == (sLONG) inKeys.size();
+}
+
+
+static bool _BenchKeys( const char *inName, const VectorOfVString& inKeys)
+{
+	::printf( "%s: %d keys, \"%s\"\n", inName, (int) inKeys.size(), VStringConvertBuffer( inKeys.back(), VTC_UTF_8).GetCPointer());
+	bool ok = _Bench<PreviousHash>( "previous hash", inKeys);
+	ok = _Bench<CurrentHash>( "GetHashValue", inKeys) && ok;
+	return ok;
+}
+
+
+int main( int argc, const char *argv[])
+{
+	sLONG count = (argc > 1) ? ::atoi( argv[1]) : 20000;
+	if (count <= 0)
+	{
+		::fprintf( stderr, "usage: HashBench [keys count]\n");
+		return 1;
+	}
+
+	VProcess process;
+#if VERSION_LINUX
+	process.LINUX_CommandLineInit( argc, argv);
+#endif
+	if (!process.Init())
+		return 1;
+
+	VectorOfVString urls, paths, properties, uuids;
+	uLONG seed = 12345;
+	for( sLONG i = 0 ; i < count ; ++i)
+	{
+		VString s;
+		s.Printf( "/rest/Employee(%d)/manager?$expand=company", (int) i);
+		urls.push_back( s);
+
+		s.Printf( "/home/wakanda/Contacts/WebFolder/images/photo%d_thumbnail.png", (int) i);
+		paths.push_back( s);
+
+		s.Printf( "prop%d", (int) i);
+		properties.push_back( s);
+
+		s.Clear();
+		for( sLONG j = 0 ; j < 32 ; ++j)
+		{
+			seed = seed * 1103515245 + 12345;
+			s.AppendUniChar( "0123456789ABCDEF"[(seed >> 16) & 15]);
+		}
+		uuids.push_back( s);
+	}
+
+	bool ok = _BenchKeys( "rest urls", urls);
+	ok = _BenchKeys( "file paths", paths) && ok;
+	ok = _BenchKeys( "json properties", properties) && ok;
+	ok = _BenchKeys( "uuids", uuids) && ok;
+	if (!ok)
+		::printf( "FAILED: keys not found back\n");
+
+	return ok ? 0 : 1;
+}
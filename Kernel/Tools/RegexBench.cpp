@@ -0,0 +1,151 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+
+/*
+	RegexBench: VRegexMatcher with its compiled pattern cache vs compiling the pattern for each call.
+
+	usage: RegexBench [rounds (default 2000)]
+
+	A set of url routes is tested against one url:
+		- compiling each pattern with ICU for each test (what VRegexMatcher::Create did before the cache)
+		- VRegexMatcher::Create for each test (the compiled pattern comes from the cache)
+		- the same matchers created once
+		- VRegexMatcherSet::FindAll
+	Prints the total time of each way and checks that they all find the same patterns.
+*/
+
+#include "Kernel/VKernel.h"
+#include "unicode/regex.h"
+#include "BenchTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+USING_TOOLBOX_NAMESPACE
+
+
+static const char *sRoutes[] =
+{
+	"^/api/users/[0-9]+$", "^/api/users/[0-9]+/posts$", "^/api/products/[a-z-]+$", "^/static/.*\\.(js|css)$",
+	"^/api/orders/[0-9]+/items/[0-9]+$", "^/login$", "^/logout$", "^/api/search\\?q=.*", "^/admin/.*", "^/api/v2/.*",
+	"ERROR [0-9]+", "timeout after [0-9]+ms", "^/api/cart/[0-9a-f]{8}$", "^/health$", "^/metrics$",
+	"^/api/users/me$", "^/api/sessions/[0-9]+$", "^/api/files/.+\\.pdf$", "^/docs/[a-z]+$", "^/api/tags/[a-z]+$"
+};
+
+const sLONG kROUTES_COUNT = sizeof( sRoutes) / sizeof( sRoutes[0]);
+
+
+static sLONG _FindWithICU( const VString& inPattern, const VString& inText)
+{
+	UErrorCode status = U_ZERO_ERROR;
+	xbox_icu::UnicodeString pattern( FALSE, inPattern.GetCPointer(), inPattern.GetLength());
+	xbox_icu::RegexMatcher matcher( pattern, 0, status);
+	if (!U_SUCCESS( status))
+		return 0;
+	matcher.reset( xbox_icu::UnicodeString( FALSE, inText.GetCPointer(), inText.GetLength()));
+	return matcher.find() ? 1 : 0;
+}
+
+
+int main( int argc, const char *argv[])
+{
+	sLONG rounds = (argc > 1) ? ::atoi( argv[1]) : 2000;
+	if (rounds <= 0)
+	{
+		::fprintf( stderr, "usage: RegexBench [rounds]\n");
+		return 1;
+	}
+
+	VProcess process;
+#if VERSION_LINUX
+	process.LINUX_CommandLineInit( argc, argv);
+#endif
+	if (!process.Init())
+		return 1;
+
+	std::vector<VString> routes;
+	for( sLONG i = 0 ; i < kROUTES_COUNT ; ++i)
+		routes.push_back( VString( sRoutes[i]));
+
+	VString url( "/api/orders/1234/items/42");
+	VError err = VE_OK;
+	sLONG found[4] = { 0, 0, 0, 0 };
+	char name[128];
+
+	::printf( "%d patterns x %d rounds\n", (int) kROUTES_COUNT, (int) rounds);
+
+	::sprintf( name, "ICU compile per call (%d tests)", (int) (kROUTES_COUNT * rounds));
+	{
+		StBenchTimer timer( name);
+		for( sLONG r = 0 ; r < rounds ; ++r)
+			for( sLONG i = 0 ; i < kROUTES_COUNT ; ++i)
+				found[0] += _FindWithICU( routes[i], url);
+	}
+
+	VRegexMatcher::ClearCache();
+	::sprintf( name, "VRegexMatcher::Create (%d tests)", (int) (kROUTES_COUNT * rounds));
+	{
+		StBenchTimer timer( name);
+		for( sLONG r = 0 ; r < rounds ; ++r)
+		{
+			for( sLONG i = 0 ; i < kROUTES_COUNT ; ++i)
+			{
+				VRegexMatcher *matcher = VRegexMatcher::Create( routes[i], &err);
+				if (matcher != NULL)
+				{
+					found[1] += matcher->Find( url, 1, true, &err) ? 1 : 0;
+					matcher->Release();
+				}
+			}
+		}
+	}
+
+	std::vector<VRegexMatcher*> matchers;
+	for( sLONG i = 0 ; i < kROUTES_COUNT ; ++i)
+		matchers.push_back( VRegexMatcher::Create( routes[i], &err));
+	::sprintf( name, "matchers created once (%d tests)", (int) (kROUTES_COUNT * rounds));
+	{
+		StBenchTimer timer( name);
+		for( sLONG r = 0 ; r < rounds ; ++r)
+			for( sLONG i = 0 ; i < kROUTES_COUNT ; ++i)
+				found[2] += ( (matchers[i] != NULL) && matchers[i]->Find( url, 1, true, &err) ) ? 1 : 0;
+	}
+	for( std::vector<VRegexMatcher*>::iterator i = matchers.begin() ; i != matchers.end() ; ++i)
+		ReleaseRefCountable( &*i);
+
+	VRegexMatcherSet *set = new VRegexMatcherSet;
+	for( sLONG i = 0 ; i < kROUTES_COUNT ; ++i)
+		set->AddPattern( routes[i], 0, &err);
+	std::vector<VIndex> indexes;
+	::sprintf( name, "VRegexMatcherSet::FindAll (%d sets)", (int) rounds);
+	{
+		StBenchTimer timer( name);
+		for( sLONG r = 0 ; r < rounds ; ++r)
+		{
+			set->FindAll( url, indexes, &err);
+			found[3] += (sLONG) indexes.size();
+		}
+	}
+	ReleaseRefCountable( &set);
+
+	VRegexMatcher::ClearCache();
+
+	bool ok = (found[1] == found[0]) && (found[2] == found[0]) && (found[3] == found[0]);
+	if (!ok)
+		::printf( "FAILED: found %d %d %d %d\n", (int) found[0], (int) found[1], (int) found[2], (int) found[3]);
+
+	return ok ? 0 : 1;
+}
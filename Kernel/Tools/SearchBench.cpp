@@ -0,0 +1,307 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+
+/*
+	SearchBench: VString raw and ASCII searches vs the Knuth-Morris-Pratt scans they replaced.
+
+	usage: SearchBench [rounds (default 20000)]
+
+	The workloads are the searches of the HTTPTools helpers (case insensitive by default):
+		- the end of a request head (CRLFCRLF)
+		- a cookie name in a Set-Cookie value
+		- a multipart boundary at the end of a 64K body (case sensitive)
+		- a 64 chars pattern absent from an 8K header block
+	Each one is searched with:
+		- the KMP scan HTTPTools had (a malloc per call, case folded in the inner loop)
+		- the KMP scan VString::FindRawString had (case sensitive workloads only)
+		- VString::FindRawString (first/last char filter, or Horspool from 32 chars) (case sensitive workloads only)
+		- VString::FindASCIIString
+	Prints the total time of each way and checks that they all find the same position.
+*/
+
+#include "Kernel/VKernel.h"
+#include "BenchTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+USING_TOOLBOX_NAMESPACE
+
+
+#define LOWERCASE(c) \
+	if ((c >= CHAR_LATIN_CAPITAL_LETTER_A) && (c <= CHAR_LATIN_CAPITAL_LETTER_Z))\
+	c += 0x0020
+
+
+// the scan of HTTPTools::FindASCIIVString before VString::FindASCIIString
+static sLONG _FindWithHTTPToolsKMP( const UniChar *inText, const sLONG inTextLen, const UniChar *inPattern, const sLONG inPatternLen, bool isCaseSensitive)
+{
+	if (inPatternLen > inTextLen)
+		return 0;
+
+	sLONG	textSize = inTextLen;
+	sLONG	patternSize = inPatternLen;
+	sLONG *	target = (sLONG *)malloc (sizeof(sLONG) * (patternSize + 1));
+
+	if (NULL != target)
+	{
+		sLONG	m = 0;
+		sLONG	i = 0;
+		sLONG	j = -1;
+		UniChar	c = '\0';
+
+		target[0] = j;
+		while (i < patternSize)
+		{
+			UniChar pchar = inPattern[i];
+
+			if (!isCaseSensitive)
+				LOWERCASE (pchar);
+
+			if (pchar == c)
+			{
+				target[i + 1] = j + 1;
+				++j;
+				++i;
+			}
+			else if (j > 0)
+			{
+				j = target[j];
+			}
+			else
+			{
+				target[i + 1] = 0;
+				++i;
+				j = 0;
+			}
+
+			pchar = inPattern[j];
+			if (!isCaseSensitive)
+				LOWERCASE (pchar);
+
+			c = pchar;
+		}
+
+		m = 0;
+		i = 0;
+		while (((m + i) < textSize) && (i < patternSize))
+		{
+			UniChar	tchar = inText[m + i];
+			UniChar	pchar = inPattern[i];
+
+			if (!isCaseSensitive)
+			{
+				LOWERCASE (tchar);
+				LOWERCASE (pchar);
+			}
+
+			if (tchar == pchar)
+			{
+				++i;
+			}
+			else
+			{
+				m += i - target[i];
+				if (i > 0)
+					i = target[i];
+			}
+		}
+
+		free (target);
+
+		if (i >= patternSize)
+			return m + 1;
+	}
+
+	return 0;
+}
+
+
+// the scan of VString::FindRawString before the filter and Horspool kernels
+static sLONG _FindWithRawKMP( const UniChar* inText, sLONG inTextSize, const UniChar* inPattern, sLONG inPatternSize)
+{
+	sLONG targetBuffer[256];
+	sLONG *retarget = (inPatternSize < 256) ? targetBuffer : (sLONG*) malloc( sizeof( sLONG) * (inPatternSize + 1));
+
+	{
+		sLONG i = 0;
+		sLONG j = -1;
+		UniChar c = 0;
+
+		retarget[0] = j;
+		while( i != inPatternSize)
+		{
+			if (inPattern[i] == c)
+			{
+				retarget[i + 1] = j + 1;
+				++j;
+				++i;
+			}
+			else if (j > 0)
+			{
+				j = retarget[j];
+			}
+			else
+			{
+				retarget[i + 1] = 0;
+				++i;
+				j = 0;
+			}
+			c = inPattern[j];
+		}
+	}
+
+	sLONG m = 0;
+	sLONG i = 0;
+	while( (m + i != inTextSize) && (i != inPatternSize))
+	{
+		if (inText[m + i] == inPattern[i])
+		{
+			++i;
+		}
+		else
+		{
+			m += i - retarget[i];
+			if (i > 0)
+				i = retarget[i];
+		}
+	}
+
+	if (retarget != targetBuffer)
+		free( retarget);
+
+	if (i >= inPatternSize)
+		return m + 1;
+	else
+		return 0;
+}
+
+
+typedef enum
+{
+	eWay_HTTPToolsKMP = 0,
+	eWay_RawKMP,
+	eWay_FindRawString,
+	eWay_FindASCIIString
+} EWay;
+
+
+static sLONG _Find( EWay inWay, const VString& inText, const VString& inPattern, bool inCaseSensitive)
+{
+	switch( inWay)
+	{
+		case eWay_HTTPToolsKMP:		return _FindWithHTTPToolsKMP( inText.GetCPointer(), inText.GetLength(), inPattern.GetCPointer(), inPattern.GetLength(), inCaseSensitive);
+		case eWay_RawKMP:			return _FindWithRawKMP( inText.GetCPointer(), inText.GetLength(), inPattern.GetCPointer(), inPattern.GetLength());
+		case eWay_FindRawString:	return VString::FindRawString( inText.GetCPointer(), inText.GetLength(), inPattern.GetCPointer(), inPattern.GetLength());
+		default:					return VString::FindASCIIString( inText.GetCPointer(), inText.GetLength(), inPattern.GetCPointer(), inPattern.GetLength(), inCaseSensitive);
+	}
+}
+
+
+static bool _BenchWorkload( const char *inName, const VString& inText, const VString& inPattern, bool inCaseSensitive, sLONG inRounds)
+{
+	static const char *sWayNames[] = { "HTTPTools KMP (before)", "FindRawString KMP (before)", "FindRawString", "FindASCIIString" };
+
+	sLONG expected = _Find( eWay_HTTPToolsKMP, inText, inPattern, inCaseSensitive);
+	::printf( "%s: %d chars pattern in %d chars, found at %d%s\n", inName, (int) inPattern.GetLength(), (int) inText.GetLength(), (int) expected, inCaseSensitive ? "" : ", case insensitive");
+
+	bool ok = true;
+	for( sLONG way = eWay_HTTPToolsKMP ; way <= eWay_FindASCIIString ; ++way)
+	{
+		// the raw searches can't fold the case
+		if (!inCaseSensitive && ( (way == eWay_RawKMP) || (way == eWay_FindRawString) ))
+			continue;
+
+		sLONG found = 0;
+		{
+			StBenchTimer timer( sWayNames[way]);
+			for( sLONG r = 0 ; r < inRounds ; ++r)
+				found += (_Find( (EWay) way, inText, inPattern, inCaseSensitive) == expected) ? 1 : 0;
+		}
+		if (found != inRounds)
+		{
+			::printf( "FAILED: %s doesn't find the same position\n", sWayNames[way]);
+			ok = false;
+		}
+	}
+	return ok;
+}
+
+
+// reproducible text with the chars of a form body, line breaks and dashes included
+static void _BuildBody( VIndex inLength, VString& outText)
+{
+	static const char sChars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789 -=&%\r\n";
+	uLONG seed = 12345;
+	outText.Clear();
+	outText.EnsureSize( inLength);
+	for( VIndex i = 0 ; i < inLength ; ++i)
+	{
+		seed = seed * 1103515245 + 12345;
+		outText.AppendUniChar( (UniChar) sChars[(seed >> 16) % (sizeof( sChars) - 1)]);
+	}
+}
+
+
+int main( int argc, const char *argv[])
+{
+	sLONG rounds = (argc > 1) ? ::atoi( argv[1]) : 20000;
+	if (rounds <= 0)
+	{
+		::fprintf( stderr, "usage: SearchBench [rounds]\n");
+		return 1;
+	}
+
+	VProcess process;
+#if VERSION_LINUX
+	process.LINUX_CommandLineInit( argc, argv);
+#endif
+	if (!process.Init())
+		return 1;
+
+	VString head(
+		"GET /rest/Employee/?$top=40&$skip=0 HTTP/1.1\r\n"
+		"Host: 192.168.1.10:8080\r\n"
+		"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/118.0 Safari/537.36\r\n"
+		"Accept: application/json, text/javascript, */*; q=0.01\r\n"
+		"Accept-Language: en-US,en;q=0.9,fr;q=0.8\r\n"
+		"Accept-Encoding: gzip, deflate\r\n"
+		"Referer: http://192.168.1.10:8080/index.html\r\n"
+		"X-Requested-With: XMLHttpRequest\r\n"
+		"Cookie: theme=dark; lang=en; WASID=8A1F3C92E07B4D6A9C3B2E1F0D4A7B6C; tracking=off\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n");
+
+	VString cookie( "theme=dark; Path=/; Max-Age=31536000; lang=en; Path=/; WASID=8A1F3C92E07B4D6A9C3B2E1F0D4A7B6C; Path=/; HttpOnly");
+
+	VString boundary( "\r\n------WebKitFormBoundary7MA4YWxkTrZu0gW");
+	VString body;
+	_BuildBody( 64 * 1024, body);
+	body += boundary;
+	body += "--\r\n";
+
+	VString headers;
+	while( headers.GetLength() < 8 * 1024)
+		headers += head;
+	VString absent( "X-Forwarded-For-Original-Client-Address-Through-Several-Proxies:");
+
+	bool ok = _BenchWorkload( "request head end", head, CVSTR( "\r\n\r\n"), false, rounds);
+	ok = _BenchWorkload( "cookie name", cookie, CVSTR( "wasid"), false, rounds) && ok;
+	ok = _BenchWorkload( "multipart boundary", body, boundary, true, rounds / 10) && ok;
+	ok = _BenchWorkload( "absent header", headers, absent, false, rounds / 10) && ok;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,299 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+
+/*
+	StringBench: allocations and time of log line and http header construction.
+
+	usage: StringBench [rounds (default 200000)]
+
+	The log line is built with the fragments of VLog4jMsgFileLogger::LogBag, by appending to a VString
+	(the code LogBag had) and with a VStringBuilder (the code it has now).
+	The header is built like VHTTPHeader::ToString from typical response headers,
+	without and with the final length reserved first.
+	Prints the time and the heap allocations per line (linux only, malloc and realloc are counted).
+*/
+
+#include "Kernel/VKernel.h"
+#include "BenchTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+USING_TOOLBOX_NAMESPACE
+
+
+#if VERSION_LINUX
+// glibc: every heap allocation of the process goes through these
+extern "C" void *__libc_malloc( size_t inSize);
+extern "C" void *__libc_realloc( void *inPtr, size_t inSize);
+
+static sLONG8 sAllocationCount = 0;
+
+extern "C" void *malloc( size_t inSize)
+{
+	__sync_fetch_and_add( &sAllocationCount, 1);
+	return __libc_malloc( inSize);
+}
+
+extern "C" void *realloc( void *inPtr, size_t inSize)
+{
+	__sync_fetch_and_add( &sAllocationCount, 1);
+	return __libc_realloc( inPtr, inSize);
+}
+#endif
+
+
+static sLONG8 _GetAllocationCount()
+{
+#if VERSION_LINUX
+	return __sync_fetch_and_add( &sAllocationCount, 0);
+#else
+	return -1;
+#endif
+}
+
+
+// what a socket log bag usually holds
+typedef struct LogFields
+{
+	VString		fMessage;
+	VError		fError;
+	sLONG		fTaskID;
+	VString		fTaskName;
+	sLONG		fSocket;
+	VString		fLocalAddress;
+	VString		fPeerAddress;
+	sLONG		fTimeout;
+	sLONG		fSent;
+	sLONG		fSpent;
+} LogFields;
+
+
+typedef std::vector<std::pair<VString,VString> >	VectorOfHeader;
+
+
+static void _BuildLogLineWithVString( const LogFields& inFields, VString& outLine)
+{
+	VString message( inFields.fMessage);
+	if (inFields.fError != VE_OK)
+	{
+		VString s;
+		s.Printf( "[%d] ", ERRCODE_FROM_VERROR( inFields.fError));
+		message.Insert( s, 1);
+	}
+	message.AppendString( CVSTR( ", task #"));
+	message.AppendLong( inFields.fTaskID);
+	message += ", ";
+	message += inFields.fTaskName;
+	message.AppendString( CVSTR( ", socket "));
+	message.AppendLong( inFields.fSocket);
+	message.AppendString( CVSTR( ", local addr is "));
+	message.AppendString( inFields.fLocalAddress);
+	message.AppendString( CVSTR( ", peer addr is "));
+	message.AppendString( inFields.fPeerAddress);
+	message.AppendString( CVSTR( ", is not blocking "));
+	message.AppendString( CVSTR( ", with SSL "));
+	message.AppendString( CVSTR( ", with "));
+	message.AppendLong( inFields.fTimeout);
+	message.AppendString( CVSTR( "ms timeout"));
+	message.AppendString( CVSTR( ", sent "));
+	message.AppendLong( inFields.fSent);
+	message.AppendString( CVSTR( " byte(s)"));
+	message.AppendString( CVSTR( ", done in "));
+	message.AppendLong( inFields.fSpent);
+	message.AppendString( CVSTR( "ms"));
+	outLine = message;
+}
+
+
+static void _BuildLogLineWithBuilder( const LogFields& inFields, VString& outLine)
+{
+	VStringBuilder builder( 256);
+	if (inFields.fError != VE_OK)
+		builder.AppendUniChar( '[').AppendLong( ERRCODE_FROM_VERROR( inFields.fError)).AppendCString( "] ");
+	builder.AppendString( inFields.fMessage);
+	builder.AppendString( CVSTR( ", task #"));
+	builder.AppendLong( inFields.fTaskID);
+	builder += ", ";
+	builder += inFields.fTaskName;
+	builder.AppendString( CVSTR( ", socket "));
+	builder.AppendLong( inFields.fSocket);
+	builder.AppendString( CVSTR( ", local addr is "));
+	builder.AppendString( inFields.fLocalAddress);
+	builder.AppendString( CVSTR( ", peer addr is "));
+	builder.AppendString( inFields.fPeerAddress);
+	builder.AppendString( CVSTR( ", is not blocking "));
+	builder.AppendString( CVSTR( ", with SSL "));
+	builder.AppendString( CVSTR( ", with "));
+	builder.AppendLong( inFields.fTimeout);
+	builder.AppendString( CVSTR( "ms timeout"));
+	builder.AppendString( CVSTR( ", sent "));
+	builder.AppendLong( inFields.fSent);
+	builder.AppendString( CVSTR( " byte(s)"));
+	builder.AppendString( CVSTR( ", done in "));
+	builder.AppendLong( inFields.fSpent);
+	builder.AppendString( CVSTR( "ms"));
+	builder.GetString( outLine);
+}
+
+
+static void _BuildHeader( const VectorOfHeader& inHeaders, bool inReserve, VString& outString)
+{
+	if (inReserve)
+	{
+		VIndex length = outString.GetLength();
+		for( VectorOfHeader::const_iterator i = inHeaders.begin() ; i != inHeaders.end() ; ++i)
+			length += i->first.GetLength() + i->second.GetLength() + 4;
+		outString.EnsureSize( length);
+	}
+
+	for( VectorOfHeader::const_iterator i = inHeaders.begin() ; i != inHeaders.end() ; ++i)
+	{
+		outString.AppendString( i->first);
+		outString.AppendUniChar( ':');
+		outString.AppendUniChar( ' ');
+		outString.AppendString( i->second);
+		outString.AppendCString( "\r\n");
+	}
+}
+
+
+static void _PrintAllocations( sLONG8 inBefore, sLONG inRounds)
+{
+	sLONG8 after = _GetAllocationCount();
+	if (inBefore >= 0)
+		::printf( "%-32s %8.2f allocations per line\n", "", (double) (after - inBefore) / inRounds);
+}
+
+
+static bool _BenchLogLine( const LogFields& inFields, sLONG inRounds)
+{
+	VString expected, line;
+	_BuildLogLineWithVString( inFields, expected);
+	::printf( "log line: %d chars\n", (int) expected.GetLength());
+
+	sLONG8 before = _GetAllocationCount();
+	{
+		StBenchTimer timer( "VString appends");
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+		{
+			VString s;
+			_BuildLogLineWithVString( inFields, s);
+		}
+	}
+	_PrintAllocations( before, inRounds);
+
+	before = _GetAllocationCount();
+	{
+		StBenchTimer timer( "VStringBuilder");
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+		{
+			VString s;
+			_BuildLogLineWithBuilder( inFields, s);
+		}
+	}
+	_PrintAllocations( before, inRounds);
+
+	_BuildLogLineWithBuilder( inFields, line);
+	return line.EqualToStringRaw( expected);
+}
+
+
+static bool _BenchHeader( const VectorOfHeader& inHeaders, sLONG inRounds)
+{
+	VString expected, header;
+	_BuildHeader( inHeaders, false, expected);
+	::printf( "header: %d fields, %d chars\n", (int) inHeaders.size(), (int) expected.GetLength());
+
+	sLONG8 before = _GetAllocationCount();
+	{
+		StBenchTimer timer( "appends");
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+		{
+			VString s;
+			_BuildHeader( inHeaders, false, s);
+		}
+	}
+	_PrintAllocations( before, inRounds);
+
+	before = _GetAllocationCount();
+	{
+		StBenchTimer timer( "length reserved first");
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+		{
+			VString s;
+			_BuildHeader( inHeaders, true, s);
+		}
+	}
+	_PrintAllocations( before, inRounds);
+
+	_BuildHeader( inHeaders, true, header);
+	return header.EqualToStringRaw( expected);
+}
+
+
+int main( int argc, const char *argv[])
+{
+	sLONG rounds = (argc > 1) ? ::atoi( argv[1]) : 200000;
+	if (rounds <= 0)
+	{
+		::fprintf( stderr, "usage: StringBench [rounds]\n");
+		return 1;
+	}
+
+	VProcess process;
+#if VERSION_LINUX
+	process.LINUX_CommandLineInit( argc, argv);
+#endif
+	if (!process.Init())
+		return 1;
+
+	LogFields fields;
+	fields.fMessage = "Connection closed by peer";
+	fields.fError = MAKE_VERROR( 'srvn', 1234);
+	fields.fTaskID = 42;
+	fields.fTaskName = "HTTP connection handler #3";
+	fields.fSocket = 17;
+	fields.fLocalAddress = "192.168.1.10:8080";
+	fields.fPeerAddress = "192.168.1.27:53211";
+	fields.fTimeout = 5000;
+	fields.fSent = 15360;
+	fields.fSpent = 12;
+
+	const char *headers[][2] =
+	{
+		{ "Date", "Mon, 19 Oct 2026 08:12:45 GMT" },
+		{ "Server", "Wakanda" },
+		{ "Content-Type", "application/json; charset=utf-8" },
+		{ "Content-Length", "15360" },
+		{ "Cache-Control", "no-cache, no-store, must-revalidate" },
+		{ "Connection", "keep-alive" },
+		{ "Keep-Alive", "timeout=15, max=100" },
+		{ "ETag", "\"5f2b-17a3c9e4d21\"" },
+		{ "Set-Cookie", "WASID=8A1F3C92E07B4D6A9C3B2E1F0D4A7B6C; path=/; HttpOnly" },
+		{ "Vary", "Accept-Encoding" }
+	};
+	VectorOfHeader headerList;
+	for( size_t i = 0 ; i < sizeof( headers) / sizeof( headers[0]) ; ++i)
+		headerList.push_back( std::make_pair( VString( headers[i][0]), VString( headers[i][1])));
+
+	bool ok = _BenchLogLine( fields, rounds);
+	ok = _BenchHeader( headerList, rounds) && ok;
+	if (!ok)
+		::printf( "FAILED: the ways don't build the same string\n");
+
+	return ok ? 0 : 1;
+}
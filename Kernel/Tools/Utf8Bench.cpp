@@ -0,0 +1,121 @@
+/*
+* This file is part of Wakanda software, licensed by 4D under
+*  (i) the GNU General Public License version 3 (GNU GPL v3), or
+*  (ii) the Affero General Public License version 3 (AGPL v3) or
+*  (iii) a commercial license.
+* This file remains the exclusive property of 4D and/or its licensors
+* and is protected by national and international legislations.
+* In any event, Licensee's compliance with the terms and conditions
+* of the applicable license constitutes a prerequisite to any use of this file.
+* Except as otherwise expressly stated in the applicable license,
+* such license does not include any other license or rights on this file,
+* 4D's and/or its licensors' trademarks and/or other proprietary rights.
+* Consequently, no title, copyright or other proprietary rights
+* other than those specified in the applicable license is granted.
+*/
+
+/*
+	Utf8Bench: throughput of VToUnicodeConverter_UTF8 and VFromUnicodeConverter_UTF8.
+
+	usage: Utf8Bench [size in KB (default 1024)] [rounds (default 64)]
+
+	The corpora are ASCII, Latin (accented), CJK and emoji (surrogate pairs) text.
+	Prints MB/s of utf-8 for each way. Decoded text is checked against the source.
+*/
+
+#include "Kernel/VKernel.h"
+#include "BenchTimer.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+USING_TOOLBOX_NAMESPACE
+
+
+static const char *sCorpora[][2] =
+{
+	{ "ASCII",	"The quick brown fox jumps over the lazy dog, then reads its mail. " },
+	{ "Latin",	"Le c\xC5\x93ur d\xC3\xA9\xC3\xA7u mais l'\xC3\xA2me plut\xC3\xB4t na\xC3\xAFve, Lou\xC3\xBFs r\xC3\xAAva de crapa\xC3\xBCter en cano\xC3\xAB. " },
+	{ "CJK",	"\xE6\x97\xA5\xE6\x9C\xAC\xE8\xAA\x9E\xE3\x81\xAE\xE3\x83\x86\xE3\x82\xAD\xE3\x82\xB9\xE3\x83\x88\xE3\x80\x82\xE4\xB8\xAD\xE6\x96\x87" },
+	{ "emoji",	"\xF0\x9F\x98\x80\xF0\x9F\x8E\x89 \xF0\x9F\x91\x8D\xF0\x9F\x98\x80 " }
+};
+
+const sLONG kCORPORA_COUNT = sizeof( sCorpora) / sizeof( sCorpora[0]);
+
+
+static bool _Bench( const char *inName, const std::vector<char>& inText, sLONG inRounds)
+{
+	VToUnicodeConverter_UTF8 *toUnicode = new VToUnicodeConverter_UTF8;
+	VFromUnicodeConverter_UTF8 *fromUnicode = new VFromUnicodeConverter_UTF8;
+
+	VSize size = inText.size();
+	VSize total = size * inRounds;
+	std::vector<UniChar> chars( size);
+	std::vector<char> text( size);
+	VSize consumed = 0;
+	VIndex produced = 0;
+	char name[64];
+
+	bool ok = true;
+	::sprintf( name, "%s to unicode", inName);
+	{
+		StBenchTimer timer( name, total);
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+			ok = toUnicode->Convert( &inText.front(), size, &consumed, &chars.front(), (VIndex) chars.size(), &produced) && ok;
+	}
+	ok = (consumed == size) && ok;
+
+	VIndex charsConsumed = 0;
+	VSize bytesProduced = 0;
+	::sprintf( name, "%s from unicode", inName);
+	{
+		StBenchTimer timer( name, total);
+		for( sLONG r = 0 ; r < inRounds ; ++r)
+			ok = fromUnicode->Convert( &chars.front(), produced, &charsConsumed, &text.front(), text.size(), &bytesProduced) && ok;
+	}
+	ok = (charsConsumed == produced) && (text == inText) && ok;
+
+	fromUnicode->Release();
+	toUnicode->Release();
+
+	return ok;
+}
+
+
+int main( int argc, const char *argv[])
+{
+	sLONG kiloBytes = (argc > 1) ? ::atoi( argv[1]) : 1024;
+	sLONG rounds = (argc > 2) ? ::atoi( argv[2]) : 64;
+	if ( (kiloBytes <= 0) || (rounds <= 0) )
+	{
+		::fprintf( stderr, "usage: Utf8Bench [size in KB] [rounds]\n");
+		return 1;
+	}
+
+	VProcess process;
+#if VERSION_LINUX
+	process.LINUX_CommandLineInit( argc, argv);
+#endif
+	if (!process.Init())
+		return 1;
+
+	::printf( "%d KB x %d\n", (int) kiloBytes, (int) rounds);
+
+	bool ok = true;
+	for( sLONG i = 0 ; i < kCORPORA_COUNT ; ++i)
+	{
+		// whole samples only, so that the text stays valid utf-8
+		const char *sample = sCorpora[i][1];
+		size_t length = ::strlen( sample);
+		std::vector<char> text;
+		while( text.size() + length <= (VSize) kiloBytes * 1024)
+			text.insert( text.end(), sample, sample + length);
+
+		ok = _Bench( sCorpora[i][0], text, rounds) && ok;
+	}
+
+	if (!ok)
+		::printf( "FAILED: decoded text differs from the source\n");
+
+	return ok ? 0 : 1;
+}
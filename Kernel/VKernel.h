@@ -46,16 +46,21 @@
 #include "Kernel/Sources/VSystem.h"
 #include "Kernel/Sources/IWatchable.h"
 #include "Kernel/Sources/Base64Coder.h"
+#include "Kernel/Sources/HexCoder.h"
 #include "Kernel/Sources/VRegexMatcher.h"
 #include "Kernel/Sources/VPictureHelper.h"
 #include "Kernel/Sources/VJSONTools.h"
 #include "Kernel/Sources/VJSONValue.h"
+#include "Kernel/Sources/VJSONParser.h"
+#include "Kernel/Sources/VJSONUTF8Writer.h"
 #include "Kernel/Sources/VLogger.h"
 #include "Kernel/Sources/VTextStyle.h"
 
 // File & Streams Headers
 #include "Kernel/Sources/VURL.h"
 #include "Kernel/Sources/VFile.h"
+#include "Kernel/Sources/VFileMapping.h"
+#include "Kernel/Sources/VBinaryLog.h"
 #include "Kernel/Sources/VFileSystemObject.h"
 #include "Kernel/Sources/VFolder.h"
 #include "Kernel/Sources/VFilePath.h"
@@ -94,6 +99,9 @@
 #include "Kernel/Sources/VSyncObject.h"
 #include "Kernel/Sources/VTask.h"
 #include "Kernel/Sources/VInterlocked.h"
+#include "Kernel/Sources/VExecutor.h"
+#include "Kernel/Sources/VParallel.h"
+#include "Kernel/Sources/VFileIOEngine.h"
 
 // Text Convertion Headers
 #include "Kernel/Sources/VUnicodeTableLow.h"
@@ -115,10 +123,13 @@
 #include "Kernel/Sources/VFloat.h"
 #include "Kernel/Sources/VString.h"
 #include "Kernel/Sources/VString_ExtendedSTL.h"
+#include "Kernel/Sources/VAtom.h"
+#include "Kernel/Sources/VStringBuilder.h"
 #include "Kernel/Sources/VTime.h"
 #include "Kernel/Sources/VUUID.h"
 #include "Kernel/Sources/VArrayValue.h"
 #include "Kernel/Sources/VValueBag.h"
+#include "Kernel/Sources/VCompactBag.h"
 #include "Kernel/Sources/VValueSingle.h"
 #include "Kernel/Sources/VValueMultiple.h"
 #include "Kernel/Sources/VChecksumMD5.h"
@@ -25,139 +25,6 @@ USING_TOOLBOX_NAMESPACE
 //--------------------------------------------------------------------------------------------------
 
 
-#define LOWERCASE(c) \
-	if ((c >= CHAR_LATIN_CAPITAL_LETTER_A) && (c <= CHAR_LATIN_CAPITAL_LETTER_Z))\
-	c += 0x0020
-
-
-template <typename T1, typename T2>
-inline bool _EqualASCIICString (const T1 *const inCString1, const sLONG inString1Len, const T2 *const inCString2, const sLONG inString2Len, bool isCaseSensitive)
-{
-	if (!inCString1 || !inCString2 || (inString1Len != inString2Len))
-		return false;
-	else if (!(*inCString1) && !(*inCString2) && (inString1Len == 0))
-		return true;
-
-	bool result = false;
-	const T1 *p1 = inCString1;
-	const T2 *p2 = inCString2;
-
-	while (*p1)
-	{
-		if ((NULL != p1) && (NULL != p2))
-		{
-			T1 c1 = *p1;
-			T2 c2 = *p2;
-
-			if (!isCaseSensitive)
-			{
-				LOWERCASE (c1);
-				LOWERCASE (c2);
-			}
-
-			if (c1 == c2)
-				result = true;
-			else
-				return false;
-			p1++;
-			p2++;
-		}
-		else
-		{
-			return false;
-		}
-	}
-
-	return result;
-}
-
-
-template <typename T1, typename T2>
-inline sLONG _FindASCIICString (const T1 *inText, const sLONG inTextLen, const T2 *inPattern, const sLONG inPatternLen, bool isCaseSensitive)
-{
-	// see http://fr.wikipedia.org/wiki/Algorithme_de_Knuth-Morris-Pratt
-
-	if (inPatternLen > inTextLen)
-		return 0;
-
-	sLONG	textSize = inTextLen;
-	sLONG	patternSize = inPatternLen;
-	sLONG *	target = (sLONG *)malloc (sizeof(sLONG) * (patternSize + 1));
-
-	if (NULL != target)
-	{
-		sLONG	m = 0;
-		sLONG	i = 0;
-		sLONG	j = -1;
-		T2		c = '\0';
-
-		target[0] = j;
-		while (i < patternSize)
-		{
-			T2 pchar = inPattern[i];
-
-			if (!isCaseSensitive)
-				LOWERCASE (pchar);
-
-			if (pchar == c)
-			{
-				target[i + 1] = j + 1;
-				++j;
-				++i;
-			}
-			else if (j > 0)
-			{
-				j = target[j];
-			}
-			else
-			{
-				target[i + 1] = 0;
-				++i;
-				j = 0;
-			}
-
-			pchar = inPattern[j];
-			if (!isCaseSensitive)
-				LOWERCASE (pchar);
-
-			c = pchar;
-		}
-
-		m = 0;
-		i = 0;
-		while (((m + i) < textSize) && (i < patternSize))
-		{
-			T1		tchar = inText[m + i];
-			T2		pchar = inPattern[i];
-
-			if (!isCaseSensitive)
-			{
-				LOWERCASE (tchar);
-				LOWERCASE (pchar);
-			}
-
-			if (tchar == (T1)pchar)
-			{
-				++i;
-			}
-			else
-			{
-				m += i - target[i];
-				if (i > 0)
-					i = target[i];
-			}
-		}
-
-		free (target);
-
-		if (i >= patternSize)
-			return m + 1; // 1-based position !!! Just to work as VString.Find()
-	}
-
-	return 0;
-}
-
-
 namespace HTTPTools {
 
 	const XBOX::VString STRING_EMPTY						= CVSTR ("");
@@ -240,37 +107,45 @@ namespace HTTPTools {
 
 	bool EqualASCIIVString (const XBOX::VString& inString1, const XBOX::VString& inString2, bool isCaseSensitive)
 	{
-		return _EqualASCIICString (inString1.GetCPointer(), inString1.GetLength(), inString2.GetCPointer(), inString2.GetLength(), isCaseSensitive);
+		return (inString1.GetLength() == inString2.GetLength()) && XBOX::VString::EqualASCIIString (inString1.GetCPointer(), inString2.GetCPointer(), inString1.GetLength(), isCaseSensitive);
 	}
 
 
 	bool EqualASCIICString (const XBOX::VString& inString1, const char *const inCString2, bool isCaseSensitive)
 	{
-		return _EqualASCIICString (inString1.GetCPointer(), inString1.GetLength(), inCString2, (sLONG)strlen (inCString2), isCaseSensitive);
+		if (NULL == inCString2)
+			return false;
+
+		sLONG length = (sLONG)strlen (inCString2);
+		return (inString1.GetLength() == length) && XBOX::VString::EqualASCIIString (inString1.GetCPointer(), inCString2, length, isCaseSensitive);
 	}
 
 
 	sLONG FindASCIIVString (const XBOX::VString& inText, const XBOX::VString& inPattern, bool isCaseSensitive)
 	{
-		return _FindASCIICString (inText.GetCPointer(), inText.GetLength(), inPattern.GetCPointer(), inPattern.GetLength(), isCaseSensitive);
+		return XBOX::VString::FindASCIIString (inText.GetCPointer(), inText.GetLength(), inPattern.GetCPointer(), inPattern.GetLength(), isCaseSensitive);
 	}
 
 
 	sLONG FindASCIICString (const XBOX::VString& inText, const char *inPattern, bool isCaseSensitive)
 	{
-		return _FindASCIICString (inText.GetCPointer(), inText.GetLength(), inPattern, (sLONG)strlen (inPattern), isCaseSensitive);
+		return XBOX::VString::FindASCIIString (inText.GetCPointer(), inText.GetLength(), inPattern, (sLONG)strlen (inPattern), isCaseSensitive);
 	}
 
 
 	bool BeginsWithASCIIVString (const XBOX::VString& inText, const XBOX::VString& inPattern, bool isCaseSensitive)
 	{
-		return (_FindASCIICString (inText.GetCPointer(), inText.GetLength(), inPattern.GetCPointer(), inPattern.GetLength(), isCaseSensitive) == 1);
+		sLONG patternSize = inPattern.GetLength();
+
+		return (inText.GetLength() >= patternSize) && XBOX::VString::EqualASCIIString (inText.GetCPointer(), inPattern.GetCPointer(), patternSize, isCaseSensitive);
 	}
 
 
 	bool BeginsWithASCIICString (const XBOX::VString& inText, const char *inPattern, bool isCaseSensitive)
 	{
-		return (_FindASCIICString (inText.GetCPointer(), inText.GetLength(), inPattern, (sLONG)strlen (inPattern), isCaseSensitive) == 1);
+		sLONG patternSize = (sLONG)strlen (inPattern);
+
+		return (inText.GetLength() >= patternSize) && XBOX::VString::EqualASCIIString (inText.GetCPointer(), inPattern, patternSize, isCaseSensitive);
 	}
 
 
@@ -279,7 +154,7 @@ namespace HTTPTools {
 		sLONG textSize = inText.GetLength();
 		sLONG patternSize = inPattern.GetLength();
 
-		return (_FindASCIICString (inText.GetCPointer() + (textSize - patternSize), patternSize, inPattern.GetCPointer(), patternSize, isCaseSensitive) == 1);
+		return (textSize >= patternSize) && XBOX::VString::EqualASCIIString (inText.GetCPointer() + (textSize - patternSize), inPattern.GetCPointer(), patternSize, isCaseSensitive);
 	}
 
 
@@ -288,7 +163,7 @@ namespace HTTPTools {
 		sLONG textSize = inText.GetLength();
 		sLONG patternSize = (sLONG)strlen (inPattern);
 
-		return (_FindASCIICString (inText.GetCPointer() + (textSize - patternSize), patternSize, inPattern, patternSize, isCaseSensitive) == 1);
+		return (textSize >= patternSize) && XBOX::VString::EqualASCIIString (inText.GetCPointer() + (textSize - patternSize), inPattern, patternSize, isCaseSensitive);
 	}
 
 
@@ -421,6 +421,13 @@ bool VHTTPHeader::GetBoundary (XBOX::VString& outBoundary) const
 
 void VHTTPHeader::ToString (XBOX::VString& outString) const
 {
+	// Compute the final length first so that outString is allocated once
+	XBOX::VIndex length = outString.GetLength();
+	for (XBOX::VNameValueCollection::ConstIterator it = fHeaderList.begin(); it != fHeaderList.end(); ++it)
+		length += it->first.GetLength() + it->second.GetLength() + 4; // ": " and CRLF
+
+	outString.EnsureSize (length);
+
 	for (XBOX::VNameValueCollection::ConstIterator it = fHeaderList.begin(); it != fHeaderList.end(); ++it)
 	{
 		outString.AppendString (it->first);
@@ -461,11 +461,9 @@ XBOX::VError VMIMEMessage::ToStream (XBOX::VStream& outStream, sLONG inEncoding)
 
 				if (bEncodeBody)
 				{
-					XBOX::VMemoryBuffer<> buffer;
-					if (XBOX::Base64Coder::Encode ((*it)->GetData().GetDataPtr(), (*it)->GetData().GetDataSize(), buffer, kBASE64_QUADS_PER_LINE))
-					{
-						outStream.PutData (buffer.GetDataPtr(), buffer.GetDataSize());
-					}
+					XBOX::Base64Encoder encoder (&outStream, kBASE64_QUADS_PER_LINE);
+					encoder.Put ((*it)->GetData().GetDataPtr(), (*it)->GetData().GetDataSize());
+					encoder.Close();
 				}
 				else
 				{
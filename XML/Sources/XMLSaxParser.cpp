@@ -73,6 +73,21 @@ bool VXMLParser::Parse( VFile *inFile, IXMLHandler *inHandler, XMLParsingOptions
 	inFile->GetPath(full_path);
 	#endif
 	
+	// map the file rather than letting xerces read it by small chunks.
+	// the path is given as system id to resolve relative entities like LocalFileInputSource does.
+	VFileMapping mapping;
+	bool mapped;
+	{
+		StErrorContextInstaller errorContext( false, true);	// xerces will report the error if any
+		mapped = (mapping.Map( *inFile) == VE_OK) && mapping.IsMapped();
+	}
+	if (mapped)
+	{
+		mapping.Advise( eFileMappingSequential);
+		xercesc::MemBufInputSource source( (const XMLByte *) mapping.GetDataPtr(), (unsigned int) mapping.GetDataSize(), full_path.GetCPointer());
+		return SAXParse( this, source, inHandler, inOptions) && !mapping.IsDamaged();
+	}
+
 	xercesc::LocalFileInputSource source(full_path.GetCPointer());
 
 	return SAXParse( this, source, inHandler, inOptions);